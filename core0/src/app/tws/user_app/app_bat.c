@@ -26,6 +26,7 @@ Information is free from patent or copyright infringement.
 #include "app_econn.h"
 #include "app_wws.h"
 #include "ntc.h"
+#include "lut.h"
 
 #ifndef CHECK_BATTERY_LEVEL_PERIOD_MS
 #define CHECK_BATTERY_LEVEL_PERIOD_MS (10 * 1000)
@@ -35,6 +36,34 @@ Information is free from patent or copyright infringement.
 #define CHARGING_CHECK_BATTERY_LEVEL_PERIOD_MS (5 * 1000)
 #endif
 
+/* check period is stretched up to this when the soc estimate is confident */
+#ifndef MAX_CHECK_BATTERY_LEVEL_PERIOD_MS
+#define MAX_CHECK_BATTERY_LEVEL_PERIOD_MS (60 * 1000)
+#endif
+
+/* number of points in volt to level table, level 0 point plus 10 config points */
+#define BAT_LEVEL_LUT_NUM 11
+
+/* soc and its variance are kept in 1/256 percent */
+#define BAT_SOC_SHIFT 8
+/* variance of the first estimate, 10% std */
+#define BAT_SOC_VAR_INIT (100 << BAT_SOC_SHIFT)
+/* variance added per CHECK_BATTERY_LEVEL_PERIOD_MS, 0.5% std */
+#define BAT_SOC_VAR_PROCESS ((1 << BAT_SOC_SHIFT) / 4)
+/* variance of the soc from one voltage sample, 4% std */
+#define BAT_SOC_VAR_VOLT (16 << BAT_SOC_SHIFT)
+/* voltage rises with charging current, voltage soc is almost ignored */
+#define BAT_SOC_VAR_VOLT_CHARGING (10000 << BAT_SOC_SHIFT)
+/* sample far away from the estimate is suspicious, weight it down */
+#define BAT_SOC_OUTLIER_DIFF (10 << BAT_SOC_SHIFT)
+#define BAT_SOC_OUTLIER_VAR_SCALE 16
+/* estimate is confident enough to stretch the check period, 2% std */
+#define BAT_SOC_VAR_STABLE (4 << BAT_SOC_SHIFT)
+/* discharge rate per minute is learned from the filtered soc, averaged over 16 minutes */
+#define BAT_SOC_RATE_PERIOD_MS (60 * 1000)
+#define BAT_SOC_RATE_TAU_MS (16 * 60 * 1000)
+#define BAT_SOC_RATE_MAX (10 << BAT_SOC_SHIFT)
+
 typedef enum {
     BAT_MSG_ID_LOW,
     BAT_MSG_ID_FULL,
@@ -52,6 +81,14 @@ typedef struct {
     bool_t en_battery_report;
     bool_t charge_started;
     uint8_t last_charged_capacity;
+    /* filtered soc and its variance, both in 1/256 percent */
+    int32_t soc;
+    int32_t soc_var;
+    /* learned discharge rate, 1/256 percent per minute */
+    int32_t soc_rate;
+    uint32_t check_period_ms;
+    uint32_t sample_count;
+    lut_point_t level_lut[BAT_LEVEL_LUT_NUM];
 } battery_context_t;
 
 static battery_context_t _context;
@@ -88,11 +125,9 @@ static void battery_low_check(uint16_t volt_mv)
     }
 }
 
-static uint8_t volt_2_level(uint16_t volt_mv)
+static void volt_2_level_lut_init(void)
 {
     const ro_cfg_battery_t *bat_cfg = ro_bat_cfg();
-    uint16_t level_volt;
-    uint16_t next_level_volt;
     uint16_t level_0_volt;
 
     level_0_volt = bat_cfg->battery_low_power_off_voltage;
@@ -101,30 +136,100 @@ static uint8_t volt_2_level(uint16_t volt_mv)
         level_0_volt = bat_cfg->battery_level_voltages[0] - 500;
     }
 
-    if (volt_mv >= bat_cfg->battery_level_voltages[9]) {
-        return 100;
-    } else if (volt_mv <= level_0_volt) {
-        return 0;
+    context->level_lut[0].x = level_0_volt;
+    context->level_lut[0].y = 0;
+    for (int i = 0; i < BAT_LEVEL_LUT_NUM - 1; i++) {
+        context->level_lut[i + 1].x = bat_cfg->battery_level_voltages[i];
+        context->level_lut[i + 1].y = i * 10 + 10;
     }
+}
 
-    for (int i = 8; i >= 0; i--) {
-        level_volt = bat_cfg->battery_level_voltages[i];
-        if (volt_mv >= level_volt) {
-            next_level_volt = bat_cfg->battery_level_voltages[i + 1];
-            return i * 10 + 10
-                + ((uint32_t)(volt_mv - level_volt)) * 10 / (next_level_volt - level_volt);
-        }
+static uint8_t volt_2_level(uint16_t volt_mv)
+{
+    return (uint8_t)lut_interp(context->level_lut, BAT_LEVEL_LUT_NUM, volt_mv);
+}
+
+/**
+ * Scalar kalman filter of the state of charge. Charged capacity drives the
+ * predict step when charging and the learned discharge rate when not, the
+ * level from voltage is the measurement.
+ */
+static uint8_t battery_soc_update(uint8_t volt_level, int32_t charged_delta)
+{
+    int32_t meas = (int32_t)volt_level << BAT_SOC_SHIFT;
+    bool_t discharging = !app_charger_is_charging() && !battery_charger_get_flag();
+    int32_t period_ms = (int32_t)context->check_period_ms;
+    int32_t soc_prev;
+    int32_t meas_var;
+    int32_t diff;
+    int32_t gain;
+
+    if (context->level == BAT_LEVEL_INVALID) {
+        context->soc = meas;
+        context->soc_var = BAT_SOC_VAR_INIT;
+        return volt_level;
+    }
+
+    // predict, uncertainty grows with the time since last sample
+    soc_prev = context->soc;
+    if (discharging) {
+        context->soc -= context->soc_rate * period_ms / BAT_SOC_RATE_PERIOD_MS;
+    } else {
+        context->soc += charged_delta << BAT_SOC_SHIFT;
+    }
+    context->soc_var += (int32_t)(BAT_SOC_VAR_PROCESS * context->check_period_ms
+                                  / CHECK_BATTERY_LEVEL_PERIOD_MS);
+    context->soc_var = MIN(context->soc_var, BAT_SOC_VAR_INIT);
+
+    // update
+    meas_var = app_charger_is_charging() ? BAT_SOC_VAR_VOLT_CHARGING : BAT_SOC_VAR_VOLT;
+    diff = meas - context->soc;
+    if ((diff > BAT_SOC_OUTLIER_DIFF) || (diff < -BAT_SOC_OUTLIER_DIFF)) {
+        meas_var *= BAT_SOC_OUTLIER_VAR_SCALE;
+    }
+
+    gain = (context->soc_var << BAT_SOC_SHIFT) / (context->soc_var + meas_var);
+    context->soc += diff * gain >> BAT_SOC_SHIFT;
+    context->soc_var = context->soc_var * ((1 << BAT_SOC_SHIFT) - gain) >> BAT_SOC_SHIFT;
+
+    context->soc = CLAMP(context->soc, 0, 100 << BAT_SOC_SHIFT);
+
+    // learn the discharge rate from the filtered soc drop, weighted by the period
+    if (discharging) {
+        context->soc_rate += ((soc_prev - context->soc) * BAT_SOC_RATE_PERIOD_MS
+                              - context->soc_rate * period_ms) / BAT_SOC_RATE_TAU_MS;
+        context->soc_rate = CLAMP(context->soc_rate, 0, BAT_SOC_RATE_MAX);
+    }
+
+    return (uint8_t)((context->soc + (1 << (BAT_SOC_SHIFT - 1))) >> BAT_SOC_SHIFT);
+}
+
+static uint32_t battery_check_period_get(void)
+{
+    if (context->charge_started) {
+        return CHARGING_CHECK_BATTERY_LEVEL_PERIOD_MS;
+    }
+
+    if ((context->level == BAT_LEVEL_INVALID) || context->is_low
+        || (context->virtual_volt != BAT_VOLT_INVALID)) {
+        return CHECK_BATTERY_LEVEL_PERIOD_MS;
     }
 
-    return ((uint32_t)(volt_mv - level_0_volt)) * 10
-        / (bat_cfg->battery_level_voltages[0] - level_0_volt);
+    // stretch the period when confident, shrink it back when not
+    if (context->soc_var < BAT_SOC_VAR_STABLE) {
+        return MIN(context->check_period_ms * 2, MAX_CHECK_BATTERY_LEVEL_PERIOD_MS);
+    } else {
+        return MAX(context->check_period_ms / 2, CHECK_BATTERY_LEVEL_PERIOD_MS);
+    }
 }
 
 static void battery_check(void)
 {
     uint16_t volt_mv;
     uint8_t level;
+    uint8_t volt_level;
     uint8_t charged_capacity;
+    int32_t charged_delta = 0;
 
     level = app_econn_get_bat_level();
     if (level != BAT_LEVEL_INVALID) {
@@ -133,18 +238,12 @@ static void battery_check(void)
     }
 
     volt_mv = battery_get_voltage_mv();
-
-    if ((!context->charge_started) && (context->volt_mv != 0)) {
-        if ((volt_mv >= context->volt_mv + 50) || (volt_mv <= context->volt_mv - 50)) {
-            DBGLOG_BAT_ERR("invalid volt, charging:%d volt:%d last_volt:%d",
-                           context->charge_started, volt_mv, context->volt_mv);
-            volt_mv = battery_get_voltage_mv();
-        }
-    }
+    context->sample_count++;
 
     if (volt_mv < UVP_VOLT_MV) {
         DBGLOG_BAT_ERR("invalid battery volt %d\n", volt_mv);
         volt_mv = battery_get_voltage_mv();
+        context->sample_count++;
     }
 
     context->volt_mv = volt_mv;
@@ -174,30 +273,28 @@ static void battery_check(void)
 
     charged_capacity = battery_charger_get_charged_capacity(context->base_level);
 
+    if ((app_charger_is_charging() || battery_charger_get_flag())
+        && (charged_capacity >= context->last_charged_capacity)
+        && (battery_charger_get_cur_limit() != 0)) {
+        charged_delta = charged_capacity - context->last_charged_capacity;
+    }
+    context->last_charged_capacity = charged_capacity;
+
+    // a virtual volt always comes with an invalid level, it seeds the soc
+    volt_level = level;
+    level = battery_soc_update(volt_level, charged_delta);
+    DBGLOG_BAT_DBG("soc lvl:%d => %d var:%d rate:%d charged:%d samples:%d\n", volt_level, level,
+                   context->soc_var, context->soc_rate, charged_delta, context->sample_count);
+
     if (context->level == BAT_LEVEL_INVALID) {
         DBGLOG_BAT_DBG("first battery level\n");
     } else if (app_charger_is_charging() && context->is_full) {
         level = 100;
     } else if (app_charger_is_charging() || battery_charger_get_flag()) {
-        uint8_t new_level;
-        if ((charged_capacity >= context->last_charged_capacity)
-            && (battery_charger_get_cur_limit() != 0)) {
-            new_level = context->level + charged_capacity - context->last_charged_capacity;
-            if ((context->level <= 95) && (new_level > 95)) {
-                new_level = 95;
-            }
-            if (new_level > 100) {
-                new_level = 100;
-            }
-            DBGLOG_BAT_DBG("charging lvl:%d => %d\n", level, new_level);
-        } else {
-            new_level = context->level;
-            DBGLOG_BAT_DBG("charging keep lvl:%d => %d\n", level, new_level);
+        if ((context->level <= 95) && (level > 95)) {
+            level = 95;
         }
-
-        level = new_level;
     }
-    context->last_charged_capacity = charged_capacity;
 
     if (context->virtual_volt != BAT_VOLT_INVALID) {
         DBGLOG_BAT_DBG("bat lvl virtual\n");
@@ -245,13 +342,8 @@ static void app_bat_handle_msg(uint16_t msg_id, void *param)
         }
 
         app_cancel_msg(MSG_TYPE_BAT, BAT_MSG_ID_LEVEL);
-        if (context->charge_started) {
-            app_send_msg_delay(MSG_TYPE_BAT, BAT_MSG_ID_LEVEL, NULL, 0,
-                               CHARGING_CHECK_BATTERY_LEVEL_PERIOD_MS);
-        } else {
-            app_send_msg_delay(MSG_TYPE_BAT, BAT_MSG_ID_LEVEL, NULL, 0,
-                               CHECK_BATTERY_LEVEL_PERIOD_MS);
-        }
+        context->check_period_ms = battery_check_period_get();
+        app_send_msg_delay(MSG_TYPE_BAT, BAT_MSG_ID_LEVEL, NULL, 0, context->check_period_ms);
     } else if (msg_id == BAT_MSG_ID_LOW) {
         if (context->is_low) {
             app_cancel_msg(MSG_TYPE_BAT, BAT_MSG_ID_LOW);
@@ -304,6 +396,10 @@ void app_bat_init(void)
     context->critical_low = false;
     context->virtual_volt = BAT_VOLT_INVALID;
     context->en_battery_report = true;
+    context->check_period_ms = CHECK_BATTERY_LEVEL_PERIOD_MS;
+    context->soc_rate = 0;
+    context->sample_count = 0;
+    volt_2_level_lut_init();
 
     app_register_msg_handler(MSG_TYPE_BAT, app_bat_handle_msg);
     battery_state_register_callback(battery_state_callback);
@@ -383,6 +479,7 @@ void app_bat_handle_charge_changed(bool_t charging)
     }
 
     app_cancel_msg(MSG_TYPE_BAT, BAT_MSG_ID_LEVEL);
+    context->check_period_ms = CHECK_BATTERY_LEVEL_PERIOD_MS;
     if (charging) {
         app_send_msg_delay(MSG_TYPE_BAT, BAT_MSG_ID_LEVEL, NULL, 0, 1000);
     } else {
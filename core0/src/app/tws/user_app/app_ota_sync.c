@@ -28,7 +28,8 @@ Information is free from patent or copyright infringement.
 #define DBGLOG_OTASYNC_WRN(fmt, ...) DBGLOG_USER_APP_LOG(DBGLOG_LEVEL_WARNING, fmt, ##__VA_ARGS__)
 #define DBGLOG_OTASYNC_ERR(fmt, ...) DBGLOG_USER_APP_LOG(DBGLOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
 
-#define OTA_SYNC_DATA_LEN 512
+/* a resume offset from the ota progress bitmap is always a sync block boundary */
+static_assert(OTA_SYNC_DATA_LEN % OTA_PROGRESS_BLOCK_LEN == 0, app_ota_sync_c);
 
 #define DATA_POOL_ITEM_SIZE (sizeof(remote_msg_get_data_rsp_t) + 8)
 
@@ -37,11 +38,21 @@ Information is free from patent or copyright infringement.
 #endif
 
 #ifndef OTA_MAX_SYNC_DATA_COUNT
+#if OTA_SYNC_RELAY_ENABLED
+#define OTA_MAX_SYNC_DATA_COUNT 4
+#else
 #define OTA_MAX_SYNC_DATA_COUNT 2
 #endif
+#endif
+
+/** blocks relayed to the peer without ack, must be <= 32 */
+#ifndef OTA_SYNC_RELAY_WINDOW
+#define OTA_SYNC_RELAY_WINDOW 8
+#endif
 
-#ifndef OTA_FLASH_DEFAULT_VALUE
-#define OTA_FLASH_DEFAULT_VALUE 0xFFFFFFFF
+/** go back to the last acked block if the peer acks nothing for this time */
+#ifndef OTA_SYNC_RELAY_TIMEOUT_MS
+#define OTA_SYNC_RELAY_TIMEOUT_MS 1000
 #endif
 
 #define OTA_SYNC_MSG_ID_GET_DATA            0x01
@@ -53,6 +64,9 @@ Information is free from patent or copyright infringement.
 #define OTA_SYNC_REMOTE_MSG_ID_GET_DATA_REQ 0x07
 #define OTA_SYNC_REMOTE_MSG_ID_GET_DATA_RSP 0x08
 #define OTA_SYNC_REMOTE_MSG_ID_DONE_REPORT  0x09
+#define OTA_SYNC_REMOTE_MSG_ID_RELAY_DATA   0x0A
+#define OTA_SYNC_REMOTE_MSG_ID_RELAY_ACK    0x0B
+#define OTA_SYNC_MSG_ID_RELAY_TIMEOUT       0x0C
 
 typedef struct {
     uint32_t size;
@@ -72,11 +86,27 @@ typedef struct {
     uint8_t data[OTA_SYNC_DATA_LEN];
 } remote_msg_get_data_rsp_t;
 
+/** relayed block, same layout as the get data response */
+typedef remote_msg_get_data_rsp_t remote_msg_relay_data_t;
+
+typedef struct {
+    uint32_t base;     /*!< lowest offset the peer is missing */
+    uint32_t bitmap;   /*!< bit i set if block at base + i * OTA_SYNC_DATA_LEN was received */
+} remote_msg_relay_ack_t;
+
 static ota_sync_mode_e sync_mode = OTA_SYNC_MODE_COMPLETE;
 static uint32_t m_file_length = 0;
 static uint32_t m_file_crc = 0;
 static uint32_t m_file_offset = 0;
 static uint8_t m_sync_flag = 0;
+/* relay sender, blocks in [relay_base, relay_next) were sent and not acked yet */
+static bool_t relay_ready = false;
+static uint32_t relay_base = 0;
+static uint32_t relay_next = 0;
+static uint32_t relay_fill_base = 0xFFFFFFFF;
+/* relay receiver, blocks received after m_file_offset */
+static uint32_t relay_rx_bitmap = 0;
+static uint32_t relay_rx_acked = 0;
 static uint32_t data_pool_used_cnt[OTA_MAX_SYNC_DATA_COUNT];
 static uint32_t data_pool_free_cnt[OTA_MAX_SYNC_DATA_COUNT];
 
@@ -166,65 +196,10 @@ static inline void data_pool_free(void *ptr)
 }
 #endif
 
-static bool_t is_flash_written(uint32_t offset, uint32_t len)
-{
-    uint32_t data;
-    uint8_t data8;
-    uint32_t empty_count = 0;
-
-    if (len < 32) {
-        for (uint32_t i = 0; i < len; i++) {
-            ota_read_data(&data8, sizeof(uint8_t), offset + i);
-            if (data8 != (OTA_FLASH_DEFAULT_VALUE & 0xFF)) {
-                return true;
-            }
-        }
-        return false;
-    }
-
-    ota_read_data(&data, sizeof(uint32_t), offset);
-    if (data == OTA_FLASH_DEFAULT_VALUE) {
-        empty_count += 1;
-    }
-
-    ota_read_data(&data, sizeof(uint32_t), offset + len / 2);
-    if (data == OTA_FLASH_DEFAULT_VALUE) {
-        empty_count += 1;
-    }
-
-    ota_read_data(&data, sizeof(uint32_t), offset + len - 4);
-    if (data == OTA_FLASH_DEFAULT_VALUE) {
-        empty_count += 1;
-    }
-
-    if (empty_count == 0) {
-        return true;
-    } else if (empty_count == 3) {
-        return false;
-    } else {
-        DBGLOG_OTASYNC_ERR("is_flash_written error offset:%d empty_count:%d\n", offset,
-                           empty_count);
-        return false;
-    }
-}
-
 static void offset_validate(void)
 {
-    uint32_t len;
-
-    while (m_file_offset < m_file_length) {
-        if (m_file_offset + OTA_SYNC_DATA_LEN > m_file_length) {
-            len = m_file_length - m_file_offset;
-        } else {
-            len = OTA_SYNC_DATA_LEN;
-        }
-
-        if (!is_flash_written(m_file_offset, len)) {
-            break;
-        }
-
-        m_file_offset += len;
-    }
+    /* skip the blocks already written, the progress bitmap of lib ota is exact */
+    m_file_offset = ota_progress_get_resume_offset(m_file_length, m_file_offset);
 }
 
 static inline void send_remote_msg(app_msg_type_t type, uint16_t id, uint16_t param_len,
@@ -300,6 +275,179 @@ static void send_get_data_rsp(uint32_t offset)
     data_pool_free(data);
 }
 
+static void relay_send_block(uint32_t offset, const uint8_t *block, uint16_t len, uint32_t crc)
+{
+    uint8_t *data;
+    remote_msg_relay_data_t *msg;
+
+    data = data_pool_malloc(sizeof(remote_msg_relay_data_t) + 8);
+    if (!data) {
+        DBGLOG_OTASYNC_ERR("relay_send_block malloc failed\n");
+        return;
+    }
+
+    msg = (remote_msg_relay_data_t *)&data[8];
+    msg->offset = offset;
+    msg->len = len;
+    msg->reserved = 0;
+    if (block) {
+        memcpy(msg->data, block, len);
+    } else {
+        /* gap fill, the block is read back from the local ota zone */
+        ota_task_read_ext(msg->data, len, offset);
+        crc = getcrc32(msg->data, len);
+    }
+    msg->crc = crc;
+    DBGLOG_OTASYNC_DBG("[ota_sync] relay offset:%d len:%d base:%d next:%d fill:%d\n", offset, len,
+                       relay_base, relay_next, block == NULL);
+    app_wws_send_remote_msg_ext(MSG_TYPE_SYNC, OTA_SYNC_REMOTE_MSG_ID_RELAY_DATA, data,
+                                sizeof(remote_msg_relay_data_t), 8);
+    data_pool_free(data);
+}
+
+static inline uint16_t relay_block_len(uint32_t offset)
+{
+    return (uint16_t)MIN(m_file_length - offset, (uint32_t)OTA_SYNC_DATA_LEN);
+}
+
+static void relay_pump(void)
+{
+    uint32_t written = ota_task_get_write_offset();
+    uint32_t window_end = relay_base + OTA_SYNC_RELAY_WINDOW * OTA_SYNC_DATA_LEN;
+
+    /* catch up from flash with blocks the fast path could not send */
+    while (relay_next < m_file_length && relay_next < window_end
+           && relay_next + relay_block_len(relay_next) <= written) {
+        relay_send_block(relay_next, NULL, relay_block_len(relay_next), 0);
+        relay_next += OTA_SYNC_DATA_LEN;
+    }
+}
+
+static void relay_arm_timeout(void)
+{
+    app_cancel_msg(MSG_TYPE_SYNC, OTA_SYNC_MSG_ID_RELAY_TIMEOUT);
+    app_send_msg_delay(MSG_TYPE_SYNC, OTA_SYNC_MSG_ID_RELAY_TIMEOUT, NULL, 0,
+                       OTA_SYNC_RELAY_TIMEOUT_MS);
+}
+
+static void relay_handle_ack(const remote_msg_relay_ack_t *ack)
+{
+    uint32_t top;
+
+    DBGLOG_OTASYNC_DBG("[ota_sync] relay ack base:%d map:0x%X next:%d\n", ack->base, ack->bitmap,
+                       relay_next);
+
+    relay_ready = true;
+    relay_base = ack->base;
+    if (relay_next < relay_base
+        || relay_next > relay_base + OTA_SYNC_RELAY_WINDOW * OTA_SYNC_DATA_LEN) {
+        relay_next = relay_base;
+    }
+
+    if (relay_base >= m_file_length) {
+        app_cancel_msg(MSG_TYPE_SYNC, OTA_SYNC_MSG_ID_RELAY_TIMEOUT);
+        return;
+    }
+
+    /* the wws link keeps order, holes below the highest received block were lost, fill them once
+     * per base and leave later losses to the timeout */
+    if (ack->bitmap && relay_fill_base != relay_base) {
+        relay_fill_base = relay_base;
+        top = 31 - __builtin_clz(ack->bitmap);
+        for (uint32_t i = 0; i < top; i++) {
+            uint32_t offset = relay_base + i * OTA_SYNC_DATA_LEN;
+            if (!(ack->bitmap & BIT(i)) && offset < relay_next) {
+                relay_send_block(offset, NULL, relay_block_len(offset), 0);
+            }
+        }
+    }
+
+    relay_pump();
+    relay_arm_timeout();
+}
+
+static void relay_handle_timeout(void)
+{
+    if (!m_sync_flag || !relay_ready || relay_base >= m_file_length) {
+        return;
+    }
+    DBGLOG_OTASYNC_WRN("[ota_sync] relay timeout base:%d next:%d\n", relay_base, relay_next);
+    relay_next = relay_base;
+    relay_fill_base = 0xFFFFFFFF;
+    if (app_wws_is_connected()) {
+        relay_pump();
+    }
+    relay_arm_timeout();
+}
+
+static void relay_send_ack(void)
+{
+    remote_msg_relay_ack_t ack;
+
+    ack.base = m_file_offset;
+    ack.bitmap = relay_rx_bitmap;
+    relay_rx_acked = m_file_offset;
+    send_remote_msg(MSG_TYPE_SYNC, OTA_SYNC_REMOTE_MSG_ID_RELAY_ACK, sizeof(ack), (uint8_t *)&ack);
+}
+
+static void relay_handle_data(const remote_msg_relay_data_t *msg)
+{
+    uint32_t idx;
+    uint32_t crc;
+    uint8_t *buffer;
+    bool_t gap;
+
+    if (msg->offset < m_file_offset) {
+        /* the sender went back, tell it where we are */
+        relay_send_ack();
+        return;
+    }
+
+    idx = (msg->offset - m_file_offset) / OTA_SYNC_DATA_LEN;
+    if (msg->offset >= m_file_length || (msg->offset % OTA_SYNC_DATA_LEN) || idx >= 32 || (relay_rx_bitmap & BIT(idx))
+        || msg->len != relay_block_len(msg->offset)) {
+        DBGLOG_OTASYNC_INF("[ota_sync] relay drop offset:%d len:%d base:%d map:0x%X\n",
+                           msg->offset, msg->len, m_file_offset, relay_rx_bitmap);
+        return;
+    }
+
+    crc = getcrc32(msg->data, msg->len);
+    if (crc != msg->crc) {
+        DBGLOG_OTASYNC_ERR("[ota_sync] relay crc error offset:%d expected:0x%X calc:0x%X\n",
+                           msg->offset, msg->crc, crc);
+        return;
+    }
+
+    /* a dropped block is filled in by the sender after the next ack */
+    buffer = data_pool_malloc(msg->len);
+    if (!buffer) {
+        DBGLOG_OTASYNC_WRN("[ota_sync] relay pool busy offset:%d\n", msg->offset);
+        return;
+    }
+    memcpy(buffer, msg->data, msg->len);
+    if (ota_task_write_ext(buffer, msg->len, msg->offset) != RET_OK) {
+        data_pool_free(buffer);
+        return;
+    }
+
+    gap = idx != 0 && relay_rx_bitmap == 0;
+    relay_rx_bitmap |= BIT(idx);
+    while (relay_rx_bitmap & BIT(0)) {
+        relay_rx_bitmap >>= 1;
+        m_file_offset = MIN(m_file_offset + (uint32_t)OTA_SYNC_DATA_LEN, m_file_length);
+    }
+
+    if (m_file_offset >= m_file_length) {
+        DBGLOG_OTASYNC_INF("[ota_sync] relay done size:%d\n", m_file_length);
+        relay_send_ack();
+        ota_task_finish_without_commit();
+    } else if (gap
+               || m_file_offset - relay_rx_acked
+                   >= OTA_SYNC_RELAY_WINDOW / 2 * OTA_SYNC_DATA_LEN) {
+        relay_send_ack();
+    }
+}
+
 static void ota_task_callback(ota_task_evt_t evt, int result, void *data)
 {
     UNUSED(data);
@@ -333,6 +481,11 @@ static void handle_msg(uint16_t msg_id, void *param)
     switch (msg_id) {
         case OTA_SYNC_MSG_ID_GET_DATA:
             if (m_sync_flag && app_wws_is_connected()) {
+                if (sync_mode == OTA_SYNC_MODE_RELAY) {
+                    /* the first ack tells the sender where to start */
+                    relay_send_ack();
+                    break;
+                }
                 if (sync_mode == OTA_SYNC_MODE_PARTIAL) {
                     offset_validate();
                 }
@@ -363,6 +516,8 @@ static void handle_msg(uint16_t msg_id, void *param)
                     m_file_length = msg->size;
                     m_file_crc = msg->crc;
                 }
+                relay_rx_bitmap = 0;
+                relay_rx_acked = 0;
                 DBGLOG_OTASYNC_INF(
                     "[ota_sync] msg_recv_start size:%d %d crc:0x%08X 0x%08X wws_conn:%d role:%d mode:%d\n",
                     msg->size, m_file_length, msg->crc, m_file_crc, app_wws_is_connected(),
@@ -447,6 +602,19 @@ static void handle_msg(uint16_t msg_id, void *param)
                 }
             }
             break;
+        case OTA_SYNC_REMOTE_MSG_ID_RELAY_DATA:
+            if (param && m_sync_flag) {
+                relay_handle_data((remote_msg_relay_data_t *)param);
+            }
+            break;
+        case OTA_SYNC_REMOTE_MSG_ID_RELAY_ACK:
+            if (param && m_sync_flag && sync_mode == OTA_SYNC_MODE_RELAY) {
+                relay_handle_ack((remote_msg_relay_ack_t *)param);
+            }
+            break;
+        case OTA_SYNC_MSG_ID_RELAY_TIMEOUT:
+            relay_handle_timeout();
+            break;
         case OTA_SYNC_REMOTE_MSG_ID_DONE_REPORT:
             DBGLOG_OTASYNC_INF(
                 "[ota_sync] msg_recv_finish wws_conn:%d role:%d pool used:%d,%d free:%d,%d\n",
@@ -484,6 +652,10 @@ void app_ota_sync_start(uint32_t image_size, uint32_t image_crc, ota_sync_mode_e
     sync_mode = mode;
     m_file_length = image_size;
     m_file_crc = image_crc;
+    relay_ready = false;
+    relay_base = 0;
+    relay_next = 0;
+    relay_fill_base = 0xFFFFFFFF;
     if (app_wws_is_connected()) {
         m_sync_flag = 1;
         msg.size = image_size;
@@ -496,9 +668,29 @@ void app_ota_sync_start(uint32_t image_size, uint32_t image_crc, ota_sync_mode_e
     }
 }
 
+void app_ota_sync_relay_block(const uint8_t *data, uint16_t len, uint32_t offset, uint32_t crc)
+{
+    if (!m_sync_flag || sync_mode != OTA_SYNC_MODE_RELAY || !relay_ready
+        || !app_wws_is_connected()) {
+        return;
+    }
+
+    /* only the next block in order inside the window goes out directly, the rest is pumped from
+     * flash when the peer acks */
+    if (offset != relay_next || len != relay_block_len(offset)
+        || offset >= relay_base + OTA_SYNC_RELAY_WINDOW * OTA_SYNC_DATA_LEN) {
+        return;
+    }
+
+    relay_send_block(offset, data, len, crc);
+    relay_next += OTA_SYNC_DATA_LEN;
+}
+
 void app_ota_sync_stop(void)
 {
     m_sync_flag = 0;
+    relay_ready = false;
+    app_cancel_msg(MSG_TYPE_SYNC, OTA_SYNC_MSG_ID_RELAY_TIMEOUT);
     if (app_wws_is_connected()) {
         send_remote_msg(MSG_TYPE_SYNC, OTA_SYNC_REMOTE_MSG_ID_STOP, 0, NULL);
         DBGLOG_OTASYNC_INF("[ota_sync] msg_send_stop wws_conn:%d role:%d\n", app_wws_is_connected(),
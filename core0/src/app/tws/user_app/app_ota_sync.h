@@ -37,9 +37,19 @@ Information is free from patent or copyright infringement.
 #define OTA_SYNC_ENABLED 1
 #endif
 
+/** forward the ota blocks to the peer while they are received from the phone,
+ *  off by default so the peer keeps the complete image sync after the update */
+#ifndef OTA_SYNC_RELAY_ENABLED
+#define OTA_SYNC_RELAY_ENABLED 0
+#endif
+
+/** largest block sent to the peer in one sync message */
+#define OTA_SYNC_DATA_LEN 512
+
 typedef enum {
     OTA_SYNC_MODE_COMPLETE,
     OTA_SYNC_MODE_PARTIAL,
+    OTA_SYNC_MODE_RELAY,
 } ota_sync_mode_e;
 
 #if OTA_SYNC_ENABLED
@@ -61,6 +71,15 @@ void app_ota_sync_deinit(void);
  */
 void app_ota_sync_start(uint32_t image_size, uint32_t image_crc, ota_sync_mode_e mode);
 
+/**
+ * @brief relay a verified ota block to the peer, only used in OTA_SYNC_MODE_RELAY
+ * @param data data of the block, it is copied before return
+ * @param len length of the block
+ * @param offset offset of the block in the ota data
+ * @param crc crc32 of the block
+ */
+void app_ota_sync_relay_block(const uint8_t *data, uint16_t len, uint32_t offset, uint32_t crc);
+
 /**
  * @brief stop ota sync
  */
@@ -100,6 +119,21 @@ static inline void app_ota_sync_start(uint32_t image_size, uint32_t image_crc, o
     UNUSED(image_crc);
     UNUSED(mode);
 }
+/**
+ * @brief relay a verified ota block to the peer, only used in OTA_SYNC_MODE_RELAY
+ * @param data data of the block, it is copied before return
+ * @param len length of the block
+ * @param offset offset of the block in the ota data
+ * @param crc crc32 of the block
+ */
+static inline void app_ota_sync_relay_block(const uint8_t *data, uint16_t len, uint32_t offset,
+                                            uint32_t crc)
+{
+    UNUSED(data);
+    UNUSED(len);
+    UNUSED(offset);
+    UNUSED(crc);
+}
 /**
  * @brief stop ota sync
  */
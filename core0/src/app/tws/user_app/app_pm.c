@@ -33,6 +33,7 @@ Information is free from patent or copyright infringement.
 #include "app_evt.h"
 #include "app_wws.h"
 #include "dfs.h"
+#include "iot_flash.h"
 
 #define APP_PM_CRASH_RESET_FLAG_POWER_ON  0x70
 #define APP_PM_CRASH_RESET_FLAG_POWER_OFF 0x33
@@ -181,6 +182,8 @@ static void do_shutdown(void)
         }
     }
 
+    iot_flash_flush();
+
     DBGLOG_PM_DBG("[auto]power_mgnt_shut_down\n");
     power_mgnt_shut_down();
 
@@ -58,6 +58,9 @@ Information is free from patent or copyright infringement.
 #define OTA_BLOCK_LEN 512
 #endif
 
+/* a block is relayed to the peer as one ota sync block */
+static_assert(OTA_BLOCK_LEN <= OTA_SYNC_DATA_LEN, app_wqota_c);
+
 #ifndef OTA_STREAMING_DELAY_MS
 #define OTA_STREAMING_DELAY_MS 1000
 #endif
@@ -78,10 +81,27 @@ Information is free from patent or copyright infringement.
 #define OTA_UUID_CHARACTER_TX 0x2002
 #endif
 
+/**
+ * Windowed mode: the phone asks for a window in ENTER_UPDATE_MODE and may then
+ * keep that many blocks outstanding. Every block is answered with the lowest
+ * missing offset, a repeated offset tells the phone to resend that block.
+ * Blocks received ahead of a gap are held and queued to ota task in order.
+ */
+#ifndef OTA_WINDOW_MAX
+#define OTA_WINDOW_MAX 4
+#endif
+
+#if OTA_WINDOW_MAX > 32
+#error "OTA_WINDOW_MAX must fit the window bitmap"
+#endif
+
+/* window, one buffer under reassembly and one being written by ota task */
 #ifndef OTA_MAX_PACKET_COUNT
-#define OTA_MAX_PACKET_COUNT 2
+#define OTA_MAX_PACKET_COUNT (OTA_WINDOW_MAX + 2)
 #endif
 
+#define OTA_PKT_POOL_NUM(window) ((window) > 1 ? (window) + 2 : 2)
+
 #define DEV_INFO_ATTR_TYPE_VERSION          0x00
 #define DEV_INFO_ATTR_TYPE_VID_AND_PID      0x01
 #define DEV_INFO_ATTR_TYPE_BATTERY          0x02
@@ -164,10 +184,13 @@ typedef struct {
     uint16_t pid_be;
     uint16_t version_be;
     uint32_t len_be;
-    uint32_t reserved;
+    uint32_t flags_be;
     uint32_t crc_be;
 } __attribute__((packed)) ota_file_header_t;
 
+/** the file is a delta package, see ota_delta_hdr_t */
+#define OTA_FILE_FLAG_DELTA BIT(0)
+
 typedef struct {
     uint32_t prefix : 24;
     uint8_t source : 3;
@@ -229,6 +252,7 @@ typedef struct {
 
 typedef struct {
     uint8_t sn;
+    uint8_t window;   // optional, blocks the phone wants outstanding
 } __attribute__((packed)) enter_update_mode_cmd_param_t;
 
 typedef struct {
@@ -238,6 +262,7 @@ typedef struct {
     uint32_t offset_be;
     uint16_t len_be;
     uint8_t need_crc;
+    uint8_t window;   // only sent when the phone asked for a window
 } __attribute__((packed)) enter_update_mode_rsp_param_t;
 
 typedef struct {
@@ -314,6 +339,20 @@ typedef enum {
     OTA_CH_BLE,
 } ota_ch_t;
 
+/**
+ * A block in flight. A block that came in one transport packet stays in the transport buffer,
+ * the slot only takes it over. Blocks in fragments are reassembled into the slot's own buffer.
+ * get_cnt is only changed by the app task and put_cnt by whoever drops the block, the slot is
+ * free again when they are equal.
+ */
+typedef struct {
+    uint8_t *buf;       // buffer of the block, own or adopted
+    uint8_t *own;       // reassembly buffer, allocated on first use
+    bool_t adopted;     // buf is the transport buffer, freed with the last put
+    volatile uint32_t get_cnt;
+    volatile uint32_t put_cnt;
+} ota_pkt_t;
+
 static bool_t ota_started = false;
 static bool_t gatts_connected = false;
 static bool_t spps_connected = false;
@@ -330,12 +369,22 @@ static uint32_t ota_file_offset = 0;
 static uint32_t ota_file_len = 0;
 static uint32_t ota_file_crc = 0;
 static uint16_t ota_file_ver = 0;
+static bool_t ota_file_delta = false;
+static uint32_t ota_delta_target_len = 0;
+static uint32_t ota_delta_target_crc = 0;
 static uint8_t *ota_packet_buffer = NULL;
 static uint32_t ota_packet_offset = 0;
 static uint32_t ota_packet_length = 0;
-static void *ota_pkt_pool[OTA_MAX_PACKET_COUNT];
-static uint32_t ota_pkt_used_cnt[OTA_MAX_PACKET_COUNT];
-static uint32_t ota_pkt_free_cnt[OTA_MAX_PACKET_COUNT];
+static ota_pkt_t ota_pkt_pool[OTA_MAX_PACKET_COUNT];
+static uint8_t ota_pkt_pool_num = 0;
+static app_wqota_pool_stats_t ota_pkt_stats;
+
+static bool_t ota_window_requested = false;
+static uint8_t ota_window = 1;
+static uint32_t ota_window_bitmap = 0;   // bit n: block ota_file_offset + n is held
+static uint8_t *ota_window_data[OTA_WINDOW_MAX];
+static uint16_t ota_window_len[OTA_WINDOW_MAX];
+static uint32_t ota_window_crc[OTA_WINDOW_MAX];
 
 static wq_adv_data_t adv_data = {
     .flag_len = 0x02,                        //
@@ -355,70 +404,116 @@ static get_refresh_status_rsp_param_t refresh_status_rsp_param;
 static void send_ota_data(uint8_t *data, uint16_t len);
 static void response_ota_enter_update_mode(uint8_t result);
 static void request_ota_firmware_block_command(uint32_t offset);
+static void ota_window_reset(void);
 
-static bool_t ota_pkt_pool_init(void)
+static void ota_pkt_pool_init(uint8_t num)
 {
-    bool_t succeed = true;
+    assert(num <= OTA_MAX_PACKET_COUNT);
+    if (num < ota_pkt_pool_num) {
+        num = ota_pkt_pool_num;
+    }
+    ota_pkt_pool_num = num;
+    memset(&ota_pkt_stats, 0, sizeof(ota_pkt_stats));
+}
 
+static void ota_pkt_pool_deinit(void)
+{
     for (int i = 0; i < OTA_MAX_PACKET_COUNT; i++) {
-        if (!ota_pkt_pool[i]) {
-            ota_pkt_pool[i] = os_mem_malloc(IOT_APP_MID, OTA_PACKET_LEN);
-            ota_pkt_used_cnt[i] = 0;
-            ota_pkt_free_cnt[i] = 0;
+        ota_pkt_t *slot = &ota_pkt_pool[i];
+
+        // a block still in flight keeps its slot, ota_pkt_pool_free() looks
+        // at every slot and releases it, the own buffer goes on a later deinit
+        if (slot->get_cnt != slot->put_cnt) {
+            DBGLOG_WQOTA_WRN("[wqota] pool deinit, slot %d in flight get %d put %d\n", i,
+                             slot->get_cnt, slot->put_cnt);
+            continue;
         }
-        if (!ota_pkt_pool[i]) {
-            succeed = false;
-            break;
-        }
-    }
-
-    if (!succeed) {
-        for (int i = 0; i < OTA_MAX_PACKET_COUNT; i++) {
-            if (ota_pkt_pool[i]) {
-                os_mem_free(ota_pkt_pool[i]);
-                ota_pkt_pool[i] = NULL;
-            }
+        if (slot->own) {
+            os_mem_free(slot->own);
         }
+        memset(slot, 0, sizeof(ota_pkt_t));
     }
-
-    return succeed;
+    ota_pkt_pool_num = 0;
 }
 
-static void ota_pkt_pool_deinit(void)
+static ota_pkt_t *ota_pkt_pool_get_slot(void)
 {
-    for (int i = 0; i < OTA_MAX_PACKET_COUNT; i++) {
-        if (ota_pkt_pool[i]) {
-            os_mem_free(ota_pkt_pool[i]);
-            ota_pkt_pool[i] = NULL;
-            ota_pkt_used_cnt[i] = 0;
-            ota_pkt_free_cnt[i] = 0;
+    ota_pkt_t *slot = NULL;
+    uint8_t in_use = 1;
+
+    for (int i = 0; i < ota_pkt_pool_num; i++) {
+        assert(ota_pkt_pool[i].put_cnt <= ota_pkt_pool[i].get_cnt);
+        if (ota_pkt_pool[i].put_cnt != ota_pkt_pool[i].get_cnt) {
+            in_use++;
+        } else if (!slot) {
+            slot = &ota_pkt_pool[i];
         }
     }
+
+    if (!slot) {
+        ota_pkt_stats.dropped++;
+    } else if (in_use > ota_pkt_stats.peak) {
+        ota_pkt_stats.peak = in_use;
+    }
+    return slot;
 }
 
 static void *ota_pkt_pool_malloc(uint32_t size)
 {
+    ota_pkt_t *slot;
+
     if (size > OTA_PACKET_LEN) {
         DBGLOG_WQOTA_ERR("ota_pkt_pool_malloc error size=%d\n", size);
         return NULL;
     }
 
-    for (int i = 0; i < OTA_MAX_PACKET_COUNT; i++) {
-        assert(ota_pkt_free_cnt[i] <= ota_pkt_used_cnt[i]);
-        if (ota_pkt_free_cnt[i] == ota_pkt_used_cnt[i]) {
-            ota_pkt_used_cnt[i] += 1;
-            return ota_pkt_pool[i];
+    slot = ota_pkt_pool_get_slot();
+    if (!slot) {
+        return NULL;
+    }
+    if (!slot->own) {
+        slot->own = os_mem_malloc(IOT_APP_MID, OTA_PACKET_LEN);
+        if (!slot->own) {
+            return NULL;
         }
     }
+    slot->buf = slot->own;
+    slot->adopted = false;
+    slot->get_cnt += 1;
+    ota_pkt_stats.copied++;
+
+    return slot->buf;
+}
+
+/* take over a transport buffer holding a whole packet, no copy */
+static void *ota_pkt_pool_adopt(uint8_t *data)
+{
+    ota_pkt_t *slot = ota_pkt_pool_get_slot();
+
+    if (!slot) {
+        return NULL;
+    }
+    slot->buf = data;
+    slot->adopted = true;
+    slot->get_cnt += 1;
+    ota_pkt_stats.adopted++;
 
-    return NULL;
+    return slot->buf;
 }
 
 static void ota_pkt_pool_free(void *ptr)
 {
     for (int i = 0; i < OTA_MAX_PACKET_COUNT; i++) {
-        if (ota_pkt_pool[i] == ptr) {
-            ota_pkt_free_cnt[i] += 1;
+        ota_pkt_t *slot = &ota_pkt_pool[i];
+
+        if (slot->buf == ptr && slot->put_cnt != slot->get_cnt) {
+            bool_t adopted = slot->adopted;
+
+            // the slot may be reused once put_cnt is updated, buf is kept in ptr
+            slot->put_cnt += 1;
+            if (adopted && slot->put_cnt == slot->get_cnt) {
+                os_mem_free(ptr);
+            }
             break;
         }
     }
@@ -639,6 +734,7 @@ static void handle_ota_inquiry_if_can_update_command(uint8_t opcode, bool_t need
     uint32_t len_be;
     uint32_t crc_be;
     uint16_t version_be;
+    bool_t delta;
 
     UNUSED(data_len);
     UNUSED(need_rsp);
@@ -661,14 +757,16 @@ static void handle_ota_inquiry_if_can_update_command(uint8_t opcode, bool_t need
         len_be = EC32(header->len_be);
         crc_be = EC32(header->crc_be);
         version_be = EC16(header->version_be);
-        DBGLOG_WQOTA_INF("[wqota] ver:0x%x size:%d %d crc:0x%08X 0x%08X\n", ota_file_ver, len_be,
-                         ota_file_len, crc_be, ota_file_crc);
-        if (ota_file_len == len_be && ota_file_crc == crc_be) {
+        delta = !!(EC32(header->flags_be) & OTA_FILE_FLAG_DELTA);
+        DBGLOG_WQOTA_INF("[wqota] ver:0x%x size:%d %d crc:0x%08X 0x%08X delta:%d\n", ota_file_ver,
+                         len_be, ota_file_len, crc_be, ota_file_crc, delta);
+        if (ota_file_len == len_be && ota_file_crc == crc_be && ota_file_delta == delta) {
             ota_resume_flag = 1;
         } else {
             ota_resume_flag = 0;
             ota_file_len = len_be;
             ota_file_crc = crc_be;
+            ota_file_delta = delta;
         }
         ota_file_ver = version_be;
     }
@@ -688,9 +786,12 @@ static void response_ota_enter_update_mode(uint8_t result)
     rsp_param.offset_be = EC32(ota_file_offset + sizeof(ota_file_header_t));
     rsp_param.len_be = EC16(OTA_BLOCK_LEN);
     rsp_param.need_crc = OTA_NEED_CRC;
-    DBGLOG_WQOTA_INF("[wqota] request block offset:%d len:%d need_crc:%d\n", ota_file_offset,
-                     OTA_BLOCK_LEN, OTA_NEED_CRC);
-    send_response(OPCODE_OTA_ENTER_UPDATE_MODE, &rsp_param, sizeof(rsp_param));
+    rsp_param.window = ota_window;
+    DBGLOG_WQOTA_INF("[wqota] request block offset:%d len:%d need_crc:%d window:%d\n",
+                     ota_file_offset, OTA_BLOCK_LEN, OTA_NEED_CRC, ota_window);
+    send_response(OPCODE_OTA_ENTER_UPDATE_MODE, &rsp_param,
+                  ota_window_requested ? sizeof(rsp_param)
+                                       : sizeof(rsp_param) - sizeof(rsp_param.window));
 }
 
 static void request_ota_firmware_block_command(uint32_t offset)
@@ -728,12 +829,12 @@ static void request_ota_firmware_block_command(uint32_t offset)
 static void handle_ota_enter_update_mode_command(uint8_t opcode, bool_t need_rsp, uint8_t *data,
                                                  uint16_t data_len)
 {
+    enter_update_mode_cmd_param_t *param = (enter_update_mode_cmd_param_t *)data;
+
     UNUSED(opcode);
-    UNUSED(data_len);
     UNUSED(need_rsp);
-    UNUSED(data);
 
-    ota_sn = data[0];
+    ota_sn = param->sn;
 
     if (enter_update_mode_pending) {
         DBGLOG_WQOTA_ERR("handle_ota_enter_update_mode_command enter_update_mode_pending sn:%d\n",
@@ -742,15 +843,36 @@ static void handle_ota_enter_update_mode_command(uint8_t opcode, bool_t need_rsp
     }
     enter_update_mode_pending = true;
 
-    if (ota_pkt_pool_init() == false) {
-        DBGLOG_WQOTA_ERR("[wqota] ota_pkt_pool_init error\n");
-        response_ota_enter_update_mode(1);
-        return;
+    ota_window_reset();
+    ota_window_requested = data_len >= sizeof(enter_update_mode_cmd_param_t);
+    ota_window = 1;
+    if (ota_window_requested && param->window > 1) {
+        ota_window = param->window > OTA_WINDOW_MAX ? OTA_WINDOW_MAX : param->window;
     }
+
+    ota_pkt_pool_init(OTA_PKT_POOL_NUM(ota_window));
     if (ota_file_len == 0) {
         DBGLOG_WQOTA_ERR("[wqota] ota_file_len:0 error\n");
         response_ota_enter_update_mode(1);
         return;
+    } else if (ota_file_delta && ota_resume_flag && (ota_file_offset != 0)) {
+        /* the base package was partly overwritten, only a full package can follow */
+        DBGLOG_WQOTA_ERR("[wqota] delta can not resume offset:%d\n", ota_file_offset);
+        ota_file_offset = 0;
+        ota_file_len = 0;
+        response_ota_enter_update_mode(1);
+        return;
+    } else if (ota_file_delta) {
+        ota_file_offset = 0;
+        if (ota_task_start_delta(ota_task_callback, ota_file_len) != 0) {
+            DBGLOG_WQOTA_ERR("[wqota] ota_task_start_delta error\n");
+            response_ota_enter_update_mode(1);
+            return;
+        }
+        DBGLOG_WQOTA_INF("[wqota] delta start succeed size:%d crc:0x%08X\n", ota_file_len,
+                         ota_file_crc);
+        /* the peer is synced with the rebuilt package once it is finished */
+        return;
     } else if (ota_resume_flag && (ota_file_offset != 0) && (ota_file_offset < ota_file_len)) {
         if (ota_task_resume(ota_task_callback) != 0) {
             DBGLOG_WQOTA_ERR("[wqota] ota_task_resume error\n");
@@ -774,7 +896,8 @@ static void handle_ota_enter_update_mode_command(uint8_t opcode, bool_t need_rsp
     }
 
     if (ota_file_len != 0 && ota_dual_flag && gatts_connected && ota_ch == OTA_CH_BLE) {
-        app_ota_sync_start(ota_file_len, ota_file_crc, OTA_SYNC_MODE_COMPLETE);
+        app_ota_sync_start(ota_file_len, ota_file_crc,
+                           OTA_SYNC_RELAY_ENABLED ? OTA_SYNC_MODE_RELAY : OTA_SYNC_MODE_COMPLETE);
     }
 }
 
@@ -794,6 +917,7 @@ static void handle_ota_exit_update_mode_command(uint8_t opcode, bool_t need_rsp,
     ota_file_crc = 0;
     ota_file_len = 0;
     ota_file_offset = 0;
+    ota_window_reset();
 
     enter_update_mode_pending = false;
 
@@ -806,6 +930,67 @@ static void handle_ota_exit_update_mode_command(uint8_t opcode, bool_t need_rsp,
     send_response(opcode, &rsp_param, sizeof(rsp_param));
 }
 
+static void ota_window_reset(void)
+{
+    for (uint8_t i = 0; i < OTA_WINDOW_MAX; i++) {
+        if (ota_window_data[i]) {
+            ota_pkt_pool_free(ota_window_data[i] - OTA_DATA_OFFSET);
+            ota_window_data[i] = NULL;
+        }
+    }
+    ota_window_bitmap = 0;
+}
+
+static void ota_window_flush(void)
+{
+    uint8_t slot;
+
+    /* queue the contiguous blocks at the window base to ota task in order */
+    while (ota_window_bitmap & BIT(0)) {
+        slot = (ota_file_offset / OTA_BLOCK_LEN) % OTA_WINDOW_MAX;
+        if (ota_task_write_ext(ota_window_data[slot], ota_window_len[slot], ota_file_offset)) {
+            DBGLOG_WQOTA_WRN("[wqota] ota_task_write offset:%d busy\n", ota_file_offset);
+            break;
+        }
+        /* relay copies the block, the ota task (lowest prio) has not freed it yet */
+        app_ota_sync_relay_block(ota_window_data[slot], ota_window_len[slot], ota_file_offset,
+                                 ota_window_crc[slot]);
+        ota_window_data[slot] = NULL;
+        ota_window_bitmap >>= 1;
+        ota_file_offset += OTA_BLOCK_LEN;
+    }
+}
+
+static void handle_ota_firmware_block_windowed(uint8_t *ota_data, uint16_t ota_data_len,
+                                               uint32_t offset, uint32_t crc)
+{
+    uint32_t idx;
+    uint8_t slot;
+
+    idx = (offset - ota_file_offset) / OTA_BLOCK_LEN;
+    if ((offset < ota_file_offset) || (offset % OTA_BLOCK_LEN) || (idx >= ota_window)
+        || (ota_window_bitmap & BIT(idx))
+        || ((offset + ota_data_len != ota_file_len) && (ota_data_len != OTA_BLOCK_LEN))) {
+        ota_pkt_pool_free(ota_data - OTA_DATA_OFFSET);
+        DBGLOG_WQOTA_INF("[wqota] window drop offset:%d len:%d base:%d map:0x%X\n", offset,
+                         ota_data_len, ota_file_offset, ota_window_bitmap);
+        ota_window_flush();
+        request_ota_firmware_block_command(ota_file_offset);
+        return;
+    }
+
+    slot = (offset / OTA_BLOCK_LEN) % OTA_WINDOW_MAX;
+    ota_window_data[slot] = ota_data;
+    ota_window_len[slot] = ota_data_len;
+    ota_window_crc[slot] = crc;
+    ota_window_bitmap |= BIT(idx);
+    DBGLOG_WQOTA_DBG("[wqota] window offset:%d len:%d base:%d map:0x%X\n", offset, ota_data_len,
+                     ota_file_offset, ota_window_bitmap);
+
+    ota_window_flush();
+    request_ota_firmware_block_command(ota_file_offset);
+}
+
 static void handle_ota_firmware_block_command(uint8_t opcode, bool_t need_rsp, uint8_t *data,
                                               uint16_t len)
 {
@@ -821,14 +1006,18 @@ static void handle_ota_firmware_block_command(uint8_t opcode, bool_t need_rsp, u
     UNUSED(len);
 
     if (ota_file_len == 0) {
+        ota_pkt_pool_free(ota_data - OTA_DATA_OFFSET);
         DBGLOG_WQOTA_ERR("[wqota] ota_file_len:0 error\n");
         return;
     }
 
 #if OTA_NEED_CRC
     ota_data_len -= 4;
-    // check crc
+#endif
+    // computed once, reused by the check, the log and the relay to the peer
     uint32_t cal_crc = getcrc32((const uint8_t *)ota_data, ota_data_len);
+#if OTA_NEED_CRC
+    // check crc
     uint32_t dat_crc = uint32_big_decode(&ota_data[ota_data_len]);
     if (cal_crc != dat_crc) {
         ota_pkt_pool_free(ota_data - OTA_DATA_OFFSET);
@@ -838,6 +1027,13 @@ static void handle_ota_firmware_block_command(uint8_t opcode, bool_t need_rsp, u
     }
 #endif
 
+    if (ota_file_delta && offset == 0 && ota_data_len >= sizeof(ota_delta_hdr_t)) {
+        const ota_delta_hdr_t *hdr = (const ota_delta_hdr_t *)ota_data;
+        ota_delta_target_len = hdr->target_size;
+        ota_delta_target_crc = hdr->target_crc;
+    }
+
+    // both checks hold for the windowed blocks too
     if (ota_sn == param->sn) {
         ota_pkt_pool_free(ota_data - OTA_DATA_OFFSET);
         DBGLOG_WQOTA_INF("[wqota] ignored opcode:0x%02X len:%d sn:%d\n", opcode, len, param->sn);
@@ -847,24 +1043,31 @@ static void handle_ota_firmware_block_command(uint8_t opcode, bool_t need_rsp, u
         ota_sn = param->sn;
     }
 
-    if (offset + ota_data_len > ota_file_len) {
+    if ((offset >= ota_file_len) || (ota_data_len > ota_file_len - offset)) {
+        ota_pkt_pool_free(ota_data - OTA_DATA_OFFSET);
         DBGLOG_WQOTA_ERR("[wqota] invalid offset:%d data_len:%d file_len:%d\n", offset,
                          ota_data_len, ota_file_len);
         request_ota_firmware_block_command(ota_file_offset);
         return;
     }
 
+    if (ota_window > 1) {
+        handle_ota_firmware_block_windowed(ota_data, ota_data_len, offset, cal_crc);
+        return;
+    }
+
     if (offset != ota_file_offset) {
         DBGLOG_WQOTA_WRN("[wqota] miss block,offset %d %d", offset, ota_file_offset);
         ota_file_offset = offset;
     }
     DBGLOG_WQOTA_INF("[wqota] size:%d offset:%d len:%d data:0x%02X crc:0x%08X\n", ota_file_len,
-                     ota_file_offset, ota_data_len, ota_data[0], getcrc32(ota_data, ota_data_len));
+                     ota_file_offset, ota_data_len, ota_data[0], cal_crc);
     ret = ota_task_write_ext(ota_data, ota_data_len, ota_file_offset);
     if (ret) {
         ota_pkt_pool_free(ota_data - OTA_DATA_OFFSET);
         DBGLOG_WQOTA_WRN("[wqota] ota_task_write error %d\n", ret);
     } else {
+        app_ota_sync_relay_block(ota_data, ota_data_len, ota_file_offset, cal_crc);
         ota_file_offset += OTA_BLOCK_LEN;
         request_ota_firmware_block_command(ota_file_offset);
     }
@@ -882,8 +1085,9 @@ static void handle_ota_get_refresh_firmware_status_command(uint8_t opcode, bool_
     refresh_status_rsp_param.status = STATUS_SUCCESS;
     refresh_status_rsp_param.sn = param->sn;
 
-    DBGLOG_WQOTA_INF("ota finish, pool used:%d,%d free:%d,%d\n", ota_pkt_used_cnt[0],
-                     ota_pkt_used_cnt[1], ota_pkt_free_cnt[0], ota_pkt_free_cnt[1]);
+    DBGLOG_WQOTA_INF("ota finish, pool size:%d peak:%d adopted:%d copied:%d dropped:%d\n",
+                     ota_pkt_pool_num, ota_pkt_stats.peak, ota_pkt_stats.adopted,
+                     ota_pkt_stats.copied, ota_pkt_stats.dropped);
 
     if (ota_file_len == 0) {
         DBGLOG_WQOTA_ERR("[wqota] ota_file_len:0 error\n");
@@ -1031,18 +1235,25 @@ static void handle_packet_data(const uint8_t *data, uint16_t len)
     }
 }
 
-static void handle_ota_data(const uint8_t *data, uint16_t len)
+/**
+ * @brief handle a packet from spp or gatt
+ *
+ * @param data the packet, allocated by the transport
+ * @param len length of the packet
+ * @return true if a firmware block took the buffer over, the caller must not free it
+ */
+static bool_t handle_ota_data(uint8_t *data, uint16_t len)
 {
     DBGLOG_WQOTA_DBG("[wqota] handle_ota_data len:%d\n", len);
     packet_t *packet = (packet_t *)data;
     if (PKT_PREFIX(packet) != PACKET_PREFIX_VALUE) {
         handle_packet_data(data, len);
-        return;
+        return false;
     }
 
     if (len < sizeof(packet_t) + sizeof(uint8_t)) {
         DBGLOG_WQOTA_ERR("[wqota] data len:%d error\n", len);
-        return;
+        return false;
     }
 
     if (ota_packet_buffer) {
@@ -1056,12 +1267,12 @@ static void handle_ota_data(const uint8_t *data, uint16_t len)
 
         if ((packet->opcode != OPCODE_OTA_SEND_FIRMWARE_BLOCK) || (!packet->is_cmd)) {
             DBGLOG_WQOTA_ERR("[wqota] unknown opcode:0x%X\n", packet->opcode);
-            return;
+            return false;
         }
 
         if (ota_packet_length > OTA_PACKET_LEN) {
             DBGLOG_WQOTA_ERR("[wqota] invalid packet len:%d\n", ota_packet_length);
-            return;
+            return false;
         }
 
         ota_packet_buffer = ota_pkt_pool_malloc(ota_packet_length);
@@ -1070,23 +1281,24 @@ static void handle_ota_data(const uint8_t *data, uint16_t len)
         } else {
             DBGLOG_WQOTA_ERR("[wqota] packet os_mem_malloc len:%d error\n", ota_packet_length);
         }
-        return;
+        return false;
     }
 
     if (PKT_SUFFIX(packet) != PACKET_SUFFIX_VALUE) {
         DBGLOG_WQOTA_ERR("[wqota] suffix 0x%02X error\n", PKT_SUFFIX(packet));
-        return;
+        return false;
     }
 
     if ((packet->opcode == OPCODE_OTA_SEND_FIRMWARE_BLOCK) && (packet->is_cmd)) {
-        ota_packet_buffer = ota_pkt_pool_malloc(len);
-        if (ota_packet_buffer) {
-            packet = (packet_t *)ota_packet_buffer;
-            memcpy(packet, data, len);
-        } else {
-            DBGLOG_WQOTA_ERR("[wqota] block os_mem_malloc len:%d error\n", len);
-            return;
+        /* the block is parsed, checked and written in the transport buffer */
+        ota_packet_buffer = ota_pkt_pool_adopt(data);
+        if (!ota_packet_buffer) {
+            DBGLOG_WQOTA_ERR("[wqota] block len:%d no free packet\n", len);
+            return false;
         }
+        handle_command(packet);
+        ota_packet_buffer = NULL;
+        return true;
     }
 
     if (packet->is_cmd) {
@@ -1095,7 +1307,7 @@ static void handle_ota_data(const uint8_t *data, uint16_t len)
         hanle_response(packet);
     }
 
-    ota_packet_buffer = NULL;
+    return false;
 }
 
 static void spp_connection_callback(BD_ADDR_T *addr, uint16_t uuid, bool_t connected)
@@ -1122,8 +1334,9 @@ static void spp_data_callback(BD_ADDR_T *addr, uint16_t uuid, uint8_t *data, uin
         ota_file_len = 0;   // reset
         ota_file_crc = 0;   // reset
     }
-    handle_ota_data(data, len);
-    os_mem_free(data);
+    if (!handle_ota_data(data, len)) {
+        os_mem_free(data);
+    }
 }
 
 static void gatts_connection_callback(BD_ADDR_T *addr, bool_t is_ble, bool_t connected)
@@ -1180,8 +1393,9 @@ static void write_callback(BD_ADDR_T *addr, gatts_character_t *character, uint8_
         }
     }
     DBGLOG_WQOTA_DBG("[wqota] gatt write_callback len:%d\n", len);
-    handle_ota_data(data, len);
-    os_mem_free(data);
+    if (!handle_ota_data(data, len)) {
+        os_mem_free(data);
+    }
 }
 
 static void notify_enable_callback(BD_ADDR_T *addr, gatts_character_t *character, bool_t enabled)
@@ -1200,8 +1414,17 @@ static void app_ota_handle_msg(uint16_t msg, void *param)
             response_ota_enter_update_mode(0);
             break;
         case OTA_MSG_ID_TASK_FINISH:
-            if (ota_file_len != 0 && ota_dual_flag && (ota_ch == OTA_CH_SPP) && app_wws_is_master()
-                && (refresh_status_rsp_param.result == 0)) {
+            if (ota_file_delta) {
+                /* the peer gets the rebuilt package, it is pushed from the local ota zone */
+                if (ota_dual_flag && (refresh_status_rsp_param.result == 0)
+                    && ((ota_ch == OTA_CH_SPP && app_wws_is_master())
+                        || (gatts_connected && ota_ch == OTA_CH_BLE))) {
+                    app_ota_sync_start(ota_delta_target_len, ota_delta_target_crc,
+                                       OTA_SYNC_RELAY_ENABLED ? OTA_SYNC_MODE_RELAY
+                                                              : OTA_SYNC_MODE_COMPLETE);
+                }
+            } else if (ota_file_len != 0 && ota_dual_flag && (ota_ch == OTA_CH_SPP)
+                       && app_wws_is_master() && (refresh_status_rsp_param.result == 0)) {
                 app_ota_sync_start(ota_file_len, ota_file_crc, OTA_SYNC_MODE_PARTIAL);
             }
             send_response(OPCODE_OTA_GET_REFRESH_FIRMWARE_STATUS, &refresh_status_rsp_param,
@@ -1210,6 +1433,7 @@ static void app_ota_handle_msg(uint16_t msg, void *param)
             ota_file_offset = 0;
             ota_file_len = 0;
             ota_file_crc = 0;
+            ota_window_reset();
             if (ota_packet_buffer) {
                 ota_pkt_pool_free(ota_packet_buffer);
                 ota_packet_buffer = NULL;
@@ -1303,6 +1527,18 @@ void app_wqota_deinit(void)
     UNUSED(ota_pkt_pool_free);
 }
 
+void app_wqota_get_pool_stats(app_wqota_pool_stats_t *stats)
+{
+    *stats = ota_pkt_stats;
+    stats->size = ota_pkt_pool_num;
+    stats->in_use = 0;
+    for (int i = 0; i < ota_pkt_pool_num; i++) {
+        if (ota_pkt_pool[i].put_cnt != ota_pkt_pool[i].get_cnt) {
+            stats->in_use++;
+        }
+    }
+}
+
 void app_wqota_start_adv(void)
 {
     if (ota_started) {
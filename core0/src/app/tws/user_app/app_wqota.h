@@ -37,6 +37,18 @@ Information is free from patent or copyright infringement.
 #define WQOTA_ENABLED 1
 #endif
 
+/**
+ * @brief packet pool usage of the wq ota receive path
+ */
+typedef struct {
+    uint8_t size;       /**< packet slots, bounds the blocks in flight */
+    uint8_t in_use;     /**< slots in use now */
+    uint8_t peak;       /**< high watermark of the slots in use */
+    uint32_t adopted;   /**< blocks kept in the transport buffer without a copy */
+    uint32_t copied;    /**< blocks reassembled from fragments into a pool buffer */
+    uint32_t dropped;   /**< blocks dropped without a free slot */
+} app_wqota_pool_stats_t;
+
 #if WQOTA_ENABLED
 /**
  * @brief init the wq ota module
@@ -59,6 +71,13 @@ void app_wqota_start_adv(void);
  * @param connected true if connected, false if not
  */
 void app_wqota_handle_tws_state_changed(bool_t connected);
+
+/**
+ * @brief get the packet pool usage of the ota receive path
+ *
+ * @param stats the usage copied out
+ */
+void app_wqota_get_pool_stats(app_wqota_pool_stats_t *stats);
 #else
 static inline void app_wqota_init(void)
 {
@@ -74,6 +93,11 @@ static inline void app_wqota_handle_tws_state_changed(bool_t connected)
 {
     UNUSED(connected);
 }
+
+static inline void app_wqota_get_pool_stats(app_wqota_pool_stats_t *stats)
+{
+    *stats = (app_wqota_pool_stats_t){0};
+}
 #endif
 
 /**
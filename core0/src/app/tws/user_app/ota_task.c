@@ -19,7 +19,6 @@ Information is free from patent or copyright infringement.
 #include "string.h"
 #include "assert.h"
 #include "ota.h"
-#include "crc.h"
 #include "iot_rtc.h"
 #include "rpc_caller.h"
 #include "power_mgnt.h"
@@ -39,6 +38,7 @@ Information is free from patent or copyright infringement.
 #define OTA_TASK_MSG_TYPE_WRITE      1
 #define OTA_TASK_MSG_TYPE_WRITE_DATA 2
 #define OTA_TASK_MSG_TYPE_FINISH     3
+#define OTA_TASK_MSG_TYPE_START_DELTA 4
 
 #define INVALID_OTA_HANDLE 0
 
@@ -57,6 +57,7 @@ static ota_task_callback_t callback = NULL;
 static ota_handle_t ota_handle = INVALID_OTA_HANDLE;
 static uint32_t write_size = 0;
 static uint32_t write_offset = 0;
+static bool_t delta_mode = false;
 uint32_t deep_sleep_thr = 60;
 uint32_t light_sleep_thr = 0xFFFFFFFF;
 
@@ -70,6 +71,7 @@ static void handle_start(uint32_t image_size)
     }
     write_size = image_size;
     write_offset = 0;
+    delta_mode = false;
     DBGLOG_OTAT_INF("[auto][ota_task] ota_begin size:%d", image_size);
     ret = ota_begin(image_size, &ota_handle);
     if (ret) {
@@ -80,6 +82,46 @@ static void handle_start(uint32_t image_size)
     callback(OTA_TASK_EVT_STARTED, ret, &image_size);
 }
 
+static void handle_start_delta(uint32_t delta_size)
+{
+    RET_TYPE ret;
+
+    if (ota_handle != INVALID_OTA_HANDLE) {
+        ota_end(ota_handle);
+        ota_handle = INVALID_OTA_HANDLE;
+    }
+    write_size = delta_size;
+    write_offset = 0;
+    delta_mode = true;
+    DBGLOG_OTAT_INF("[auto][ota_task] ota_delta_begin size:%d", delta_size);
+    ret = ota_delta_begin(&ota_handle);
+    if (ret) {
+        DBGLOG_OTAT_ERR("[auto][ota_task] ota_delta_begin error ret:%d\n", ret);
+    } else {
+        DBGLOG_OTAT_INF("[auto][ota_task] ota_delta_begin succeed handle:%d\n", ota_handle);
+    }
+    callback(OTA_TASK_EVT_STARTED, ret, &delta_size);
+}
+
+static void hanle_write_delta(uint8_t *data, uint16_t len, uint32_t offset)
+{
+    RET_TYPE ret;
+    ota_verify_state_t verify_state;
+
+    ret = ota_delta_write(ota_handle, data, len, offset);
+    if (ret) {
+        DBGLOG_OTAT_ERR("[ota_task] ota_delta_write error ret:%d offset:%d len:%d\n", ret, offset,
+                        len);
+    } else {
+        // write_offset is the rebuilt part of the ota zone, which the peer sync reads from
+        ota_get_verify_state(ota_handle, &verify_state);
+        write_offset = verify_state.offset;
+        DBGLOG_OTAT_INF("[ota_task] ota_delta_write size:%d offset:%d len:%d out:%d\n",
+                        write_size, offset, len, write_offset);
+    }
+    callback(OTA_TASK_EVT_DATA_HANDLED, ret, data);
+}
+
 static void hanle_write(uint8_t *data, uint16_t len)
 {
     RET_TYPE ret;
@@ -93,8 +135,8 @@ static void hanle_write(uint8_t *data, uint16_t len)
         DBGLOG_OTAT_ERR("[ota_task] ota_write error ret:%d hdl:%d len:%d\n", ret, ota_handle, len);
     } else {
         write_offset += len;
-        DBGLOG_OTAT_INF("[ota_task] ota_write succeed.handle:0x%X len:%d data:0x%02X crc:0x%08X\n",
-                        ota_handle, len, data[0], getcrc32(data, len));
+        DBGLOG_OTAT_INF("[ota_task] ota_write succeed.handle:0x%X len:%d data:0x%02X\n",
+                        ota_handle, len, data[0]);
     }
     callback(OTA_TASK_EVT_DATA_HANDLED, ret, data);
 }
@@ -107,6 +149,10 @@ static void hanle_write_ext(uint8_t *data, uint16_t len, uint32_t offset)
         callback(OTA_TASK_EVT_DATA_HANDLED, RET_FAIL, data);
         return;
     }
+    if (delta_mode) {
+        hanle_write_delta(data, len, offset);
+        return;
+    }
     uint32_t rtc_start = iot_rtc_get_global_time_ms();
     ret = ota_write_data(ota_handle, data, len, offset);
     uint32_t rtc_end = iot_rtc_get_global_time_ms();
@@ -114,9 +160,8 @@ static void hanle_write_ext(uint8_t *data, uint16_t len, uint32_t offset)
         DBGLOG_OTAT_ERR("[ota_task] ota_write error ret:%d hdl:%d len:%d\n", ret, ota_handle, len);
     } else {
         DBGLOG_OTAT_INF(
-            "[ota_task] ota_write_data size:%d offset:%d len:%d data:0x%02X crc:0x%08X run_time_ms:%d %d\n",
-            write_size, offset, len, data[0], getcrc32(data, len), rtc_end - rtc_start,
-            rtc_start - rtc_last);
+            "[ota_task] ota_write_data size:%d offset:%d len:%d data:0x%02X run_time_ms:%d %d\n",
+            write_size, offset, len, data[0], rtc_end - rtc_start, rtc_start - rtc_last);
         if (write_offset != offset) {
             DBGLOG_OTAT_ERR("[ota_task]  write_offset:%d != offset:%d\n", write_offset, offset);
             write_offset = offset + len;
@@ -180,6 +225,9 @@ static void ota_task_handler(void *arg)
             case OTA_TASK_MSG_TYPE_FINISH:
                 handle_finish((uint32_t)msg.data);
                 break;
+            case OTA_TASK_MSG_TYPE_START_DELTA:
+                handle_start_delta((uint32_t)msg.data);
+                break;
             default:
                 break;
         }
@@ -254,6 +302,16 @@ int ota_task_start(ota_task_callback_t _callback, uint32_t image_size)
     }
 }
 
+int ota_task_start_delta(ota_task_callback_t _callback, uint32_t delta_size)
+{
+    int ret = ota_task_resume(_callback);
+    if (ret != RET_OK) {
+        return ret;
+    } else {
+        return ota_task_send_msg(OTA_TASK_MSG_TYPE_START_DELTA, (void *)delta_size, 0, 0);
+    }
+}
+
 int ota_task_write(uint8_t *data, uint16_t len)
 {
     if (!started) {
@@ -29,6 +29,7 @@ Information is free from patent or copyright infringement.
 #include "types.h"
 #include "errno.h"
 #include "userapp_dbglog.h"
+#include "ota.h"
 
 /** @defgroup ota_task_enum Enum
  * @{
@@ -71,6 +72,19 @@ int ota_task_resume(ota_task_callback_t callback);
  */
 int ota_task_start(ota_task_callback_t callback, uint32_t image_size);
 
+/**
+ * @brief start the ota task with a delta package, see ota_delta_hdr_t
+ *
+ * @param callback the callback to handle ota_task_evt_t
+ * @param delta_size size of the delta package
+ *
+ * @note the delta is written with ota_task_write_ext in order, the write offset
+ *       is the size of the rebuilt package written to the ota zone
+ *
+ * @return 0 for success, else for fail.
+ */
+int ota_task_start_delta(ota_task_callback_t callback, uint32_t delta_size);
+
 /**
  * @brief write ota data
  *
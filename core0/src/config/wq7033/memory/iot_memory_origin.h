@@ -62,6 +62,9 @@
  *                 |   DCP     | --> 384K (96 sectors)
  *                 +-----------+
  *                 |   FOTA    | --> 644K (161 sectors)
+ *                 | ota, log  | --> 580K (145 sectors)
+ *                 | - - - - - |
+ *                 | COREDUMP  | --> 64K (16 sectors), with CONFIG_COREDUMP_FLASH
  *                 +-----------+
  *                 |   TONE    | --> 100K (25 sectors)
  *                 +-----------+
@@ -109,6 +112,23 @@
 #define FLASH_DCP_LENGTH (FLASH_SECTOR_SIZE * FLASH_DCP_SECTORS)
 #define FLASH_FOTA_OFFSET (FLASH_DCP_OFFSET + FLASH_DCP_LENGTH)
 #define FLASH_FOTA_LENGTH (FLASH_SECTOR_SIZE * FLASH_FOTA_SECTORS)
+/* the last sectors of FOTA keep the crash dumps of iot_coredump.c,
+ * ota and the flash log use the sectors before them. The dumps go out as
+ * generic transmission binary, so the carve-out only exists with it. */
+#ifndef CONFIG_COREDUMP_FLASH
+#if defined(LIB_GENERIC_TRANSMISSION_ENABLE) && defined(BUILD_CORE_CORE0)
+#define CONFIG_COREDUMP_FLASH 1
+#else
+#define CONFIG_COREDUMP_FLASH 0
+#endif
+#endif
+#if CONFIG_COREDUMP_FLASH
+#define FLASH_COREDUMP_SECTORS  16
+#else
+#define FLASH_COREDUMP_SECTORS  0
+#endif
+#define FLASH_COREDUMP_LENGTH   (FLASH_SECTOR_SIZE * FLASH_COREDUMP_SECTORS)
+#define FLASH_COREDUMP_OFFSET   (FLASH_FOTA_OFFSET + FLASH_FOTA_LENGTH - FLASH_COREDUMP_LENGTH)
 #define FLASH_TONE_OFFSET (FLASH_FOTA_OFFSET + FLASH_FOTA_LENGTH)
 #define FLASH_TONE_LENGTH (FLASH_SECTOR_SIZE * FLASH_TONE_SECTORS)
 
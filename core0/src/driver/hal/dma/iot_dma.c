@@ -936,6 +936,57 @@ uint8_t iot_dma_chs_flush(uint32_t ch_bmp)
     return RET_OK;
 }
 
+uint8_t iot_dma_ch_abort(IOT_DMA_CHANNEL_ID ch)
+{
+    assert(ch < IOT_DMA_CHANNEL_MAX);
+
+    iot_dma_trans_info_t *trans;
+    iot_dma_trans_info_t *next;
+    IOT_DMA_CONTROLLER controller = iot_dma_get_controller();
+
+    /*
+     * unlike flush, nothing waits for the peripheral to feed the pending
+     * descriptors, e.g. an idle uart rx line would never fill them
+     */
+    dma_channel_suspend((DMA_CONTROLLER)controller, (DMA_CHANNEL_ID)ch);
+    for (uint32_t i = 0; !dma_is_channel_idle((DMA_CONTROLLER)controller, (DMA_CHANNEL_ID)ch);
+            i++) {
+        if (i > 100) {
+            assert(0);
+            break;  //lint !e527 assert might be ignored
+        }
+        iot_timer_delay_us(10);
+    }
+
+    cpu_critical_enter();
+    dma_channel_reset((DMA_CONTROLLER)controller, (DMA_CHANNEL_ID)ch);
+    dma_channel_int_clear_all((DMA_CONTROLLER)controller, (DMA_CHANNEL_ID)ch);
+
+    // Drop the pending trans without calling back, the owner takes the buffers back
+    for (trans = iot_dma_ch_info[ch].trans_head; trans != NULL; trans = next) {
+        next = trans->next;
+#if defined(LOW_POWER_ENABLE)
+        if (trans->cb != NULL) {
+            power_mgnt_dec_module_refcnt(POWER_SLEEP_DMA);
+            iot_dma_ch_active_count[ch]--;
+        }
+#endif
+        iot_dma_free_trans(trans);
+    }
+    iot_dma_ch_info[ch].trans_head = NULL;
+    iot_dma_ch_info[ch].trans_tail = NULL;
+
+    iot_dma_ch_active_vect &= ~BIT(ch);
+#if defined(LOW_POWER_ENABLE)
+    if (!iot_dma_ch_active_vect) {
+        power_mgnt_clr_module_refcnt(POWER_SLEEP_DMA);
+    }
+#endif
+    cpu_critical_exit();
+
+    return RET_OK;
+}
+
 uint8_t iot_dma_peri_to_mem(IOT_DMA_CHANNEL_ID ch, void *dst, void *src,
                             uint32_t length, dma_peri_mem_done_callback cb)
 {
@@ -182,6 +182,16 @@ uint8_t iot_dma_ch_flush(IOT_DMA_CHANNEL_ID ch);
 
 uint8_t iot_dma_chs_flush(uint32_t ch_bmp);
 
+/**
+ * @brief Stop a dma channel and drop its pending descriptors without waiting
+ *        for the peripheral, no done callback is called for the dropped ones
+ *
+ * @param[in] ch The dma channel
+ *
+ * @return 0 - OK
+ */
+uint8_t iot_dma_ch_abort(IOT_DMA_CHANNEL_ID ch);
+
 #ifdef __cplusplus
 }
 #endif
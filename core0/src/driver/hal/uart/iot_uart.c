@@ -13,6 +13,7 @@ Information is free from patent or copyright infringement.
 
 ****************************************************************************/
 #include "types.h"
+#include "string.h"
 #include "modules.h"
 #include "riscv_cpu.h"
 #include "chip_irq_vector.h"
@@ -48,6 +49,9 @@ typedef struct iot_uart_rx_state {
     uint8_t *buffer;
     uint32_t length;
     uint32_t receive_length;
+    bool_t dma_mode;
+    dma_peri_mem_done_callback dma_done_cb;
+    iot_uart_rx_stats_t stats;
 } iot_uart_rx_state_t;
 
 typedef struct iot_uart_tx_block {
@@ -92,6 +96,7 @@ static struct pm_operation uart_pm;
 #endif
 
 static uint32_t iot_uart_isr_handler(uint32_t vector, uint32_t data);
+static void iot_uart_rx_dma_start(IOT_UART_PORT port);
 static iot_uart_port_state_t iot_uart_stats[IOT_UART_PORT_MAX];
 static iot_uart_port_restore_state_t iot_uart_restore_stats[IOT_UART_PORT_MAX];
 static iot_uart_uniq_line_state_t iot_uart_uniq_line_stats[IOT_UART_PORT_MAX];
@@ -390,7 +395,9 @@ uint32_t iot_uart_restore(uint32_t data)
             uart_set_threshold(port, UART_THR_RXTIMEOUT, UART_TOUT_THRESH);
             uart_set_threshold(port, UART_THR_RXFULL, UART_FULL_THRESH);
 
-            uart_interrupt_enable(port, UART_INT_RXFIFO_FULL);
+            if (!iot_uart_stats[port].rx.dma_mode) {
+                uart_interrupt_enable(port, UART_INT_RXFIFO_FULL);
+            }
             uart_interrupt_enable(port, UART_INT_RXFIFO_TOUT);
             uart_interrupt_enable(port, UART_INT_RXFIFO_OVF);
             uart_interrupt_enable(port, UART_INT_BRK_DET);
@@ -405,6 +412,9 @@ uint32_t iot_uart_restore(uint32_t data)
         }
         if (iot_uart_stats[(IOT_UART_PORT)port].dma.rx_enable) {
             iot_uart_rx_dma_config((IOT_UART_PORT)port);
+            if (iot_uart_stats[port].rx.dma_mode) {
+                iot_uart_rx_dma_start((IOT_UART_PORT)port);
+            }
         }
         if (uniq_line_cfg->enable) {
             iot_uart_uniq_line_config((IOT_UART_PORT)port, (iot_uart_uniq_line_configuration_t *)uniq_line_cfg);
@@ -643,6 +653,8 @@ int8_t iot_uart_register_rx_callback(IOT_UART_PORT port, uint8_t *buffer,
     iot_uart_stats[port].rx.buffer = buffer;
     iot_uart_stats[port].rx.length = length;
     iot_uart_stats[port].rx.receive_length = 0;
+    iot_uart_stats[port].rx.dma_mode = false;
+    memset(&iot_uart_stats[port].rx.stats, 0, sizeof(iot_uart_rx_stats_t));
 
     // Config rx threshold
     uart_set_threshold(p, UART_THR_RXTIMEOUT, UART_TOUT_THRESH);
@@ -660,6 +672,114 @@ int8_t iot_uart_register_rx_callback(IOT_UART_PORT port, uint8_t *buffer,
     return RET_OK;
 }
 
+static void iot_uart_rx_dma_done_handler(IOT_UART_PORT port, void *buf, uint32_t length)
+                                                IRAM_TEXT(iot_uart_rx_dma_done_handler);
+static void iot_uart_rx_dma_done_handler(IOT_UART_PORT port, void *buf, uint32_t length)
+{
+    iot_uart_rx_state_t *rx = &iot_uart_stats[port].rx;
+
+    if (!rx->dma_mode) {
+        // Rx callback unregistered, leave the span idle
+        return;
+    }
+
+    rx->stats.dma_span_cnt++;
+    rx->stats.rx_bytes += length;
+
+    if (rx->callback != NULL) {
+        rx->callback(buf, length);
+    }
+
+    // Re-arm the span behind the other one which is receiving now
+    if (iot_dma_peri_to_mem(iot_uart_stats[port].dma.rx_ch, buf,
+                            uart_get_fifo_addr((UART_PORT)port), length,
+                            rx->dma_done_cb) != RET_OK) {
+        rx->stats.dma_lost_cnt++;
+    }
+}
+
+static void iot_uart_rx_dma_done_callback0(void *buf, uint32_t length) IRAM_TEXT(iot_uart_rx_dma_done_callback0);
+static void iot_uart_rx_dma_done_callback0(void *buf, uint32_t length)
+{
+    iot_uart_rx_dma_done_handler(IOT_UART_PORT_0, buf, length);
+}
+
+static void iot_uart_rx_dma_done_callback1(void *buf, uint32_t length) IRAM_TEXT(iot_uart_rx_dma_done_callback1);
+static void iot_uart_rx_dma_done_callback1(void *buf, uint32_t length)
+{
+    iot_uart_rx_dma_done_handler(IOT_UART_PORT_1, buf, length);
+}
+
+static void iot_uart_rx_dma_start(IOT_UART_PORT port)
+{
+    iot_uart_rx_state_t *rx = &iot_uart_stats[port].rx;
+
+    // Both spans are queued, dma fills them in turn
+    for (uint32_t i = 0; i < 2; i++) {
+        if (iot_dma_peri_to_mem(iot_uart_stats[port].dma.rx_ch,
+                                rx->buffer + i * IOT_UART_RX_DMA_SPAN_LEN,
+                                uart_get_fifo_addr((UART_PORT)port),
+                                IOT_UART_RX_DMA_SPAN_LEN, rx->dma_done_cb) != RET_OK) {
+            rx->stats.dma_lost_cnt++;
+        }
+    }
+}
+
+int8_t iot_uart_register_rx_dma_callback(IOT_UART_PORT port, uint8_t *buffer,
+                                         uint32_t length,
+                                         iot_uart_rx_callback callback)
+{
+    UART_PORT p = (UART_PORT)port;
+    if (callback == NULL || buffer == NULL || length < IOT_UART_RX_DMA_BUF_LEN) {
+        return RET_INVAL;
+    }
+
+    if (!iot_uart_stats[port].dma.rx_enable) {
+        return RET_NOT_READY;
+    }
+
+    if (iot_uart_stats[port].rx.callback || iot_uart_stats[port].rx.buffer
+            || iot_uart_stats[port].rx.length) {
+        return RET_AGAIN;
+    }
+
+    iot_uart_stats[port].rx.callback = callback;
+    iot_uart_stats[port].rx.buffer = buffer;
+    iot_uart_stats[port].rx.length = length;
+    iot_uart_stats[port].rx.receive_length = 0;
+    iot_uart_stats[port].rx.dma_done_cb = port == IOT_UART_PORT_0
+                                              ? iot_uart_rx_dma_done_callback0
+                                              : iot_uart_rx_dma_done_callback1;
+    iot_uart_stats[port].rx.dma_mode = true;
+    memset(&iot_uart_stats[port].rx.stats, 0, sizeof(iot_uart_rx_stats_t));
+
+    /**
+     * One dma request moves a whole full-threshold block out of rx fifo, so
+     * the span length equals the threshold and a span is never left half
+     * filled. Bytes below the threshold stay in rx fifo until the timeout.
+     */
+    uart_set_threshold(p, UART_THR_RXTIMEOUT, UART_TOUT_THRESH);
+    uart_set_threshold(p, UART_THR_RXFULL, IOT_UART_RX_DMA_SPAN_LEN);
+
+    uint32_t mask = cpu_disable_irq();
+    iot_uart_rx_dma_start(port);
+    uart_interrupt_enable(p, UART_INT_RXFIFO_TOUT);
+    uart_interrupt_enable(p, UART_INT_RXFIFO_OVF);
+    uart_interrupt_enable(p, UART_INT_BRK_DET);
+    uart_interrupt_enable(p, UART_INT_GLITCH_DET);
+    uart_interrupt_enable(p, UART_INT_FRM_ERR);
+    cpu_restore_irq(mask);
+
+    return RET_OK;
+}
+
+void iot_uart_get_rx_stats(IOT_UART_PORT port, iot_uart_rx_stats_t *stats)
+{
+    uint32_t mask = cpu_disable_irq();
+    *stats = iot_uart_stats[port].rx.stats;
+    cpu_restore_irq(mask);
+}
+
 int8_t iot_uart_set_rx_buffer(IOT_UART_PORT port, uint8_t *buffer,
                 uint32_t length) IRAM_TEXT(iot_uart_set_rx_buffer);
 int8_t iot_uart_set_rx_buffer(IOT_UART_PORT port, uint8_t *buffer,
@@ -669,6 +789,11 @@ int8_t iot_uart_set_rx_buffer(IOT_UART_PORT port, uint8_t *buffer,
         return RET_INVAL;
     }
 
+    if (iot_uart_stats[port].rx.dma_mode) {
+        // Spans are owned by dma in ping-pong mode
+        return RET_BUSY;
+    }
+
     uint32_t mask = cpu_disable_irq();
     iot_uart_stats[port].rx.buffer = buffer;
     iot_uart_stats[port].rx.length = length;
@@ -686,8 +811,15 @@ void iot_uart_unregister_rx_callback(IOT_UART_PORT port)
     uart_interrupt_disable((UART_PORT)port, UART_INT_GLITCH_DET);
     uart_interrupt_disable((UART_PORT)port, UART_INT_FRM_ERR);
     uart_interrupt_clear_all((UART_PORT)port);
+    iot_uart_stats[port].rx.dma_mode = false;
     cpu_restore_irq(mask);
 
+    if (iot_uart_stats[port].rx.dma_done_cb != NULL) {
+        // Both spans are still armed, stop dma before the buffer is released
+        iot_dma_ch_abort(iot_uart_stats[port].dma.rx_ch);
+        iot_uart_stats[port].rx.dma_done_cb = NULL;
+    }
+
     iot_uart_stats[port].rx.callback = NULL;
     iot_uart_stats[port].rx.buffer = NULL;
     iot_uart_stats[port].rx.length = 0;
@@ -734,8 +866,26 @@ void iot_uart_write_buffer(IOT_UART_PORT port, const uint8_t *buffer, uint32_t l
 static void iot_uart_rx_int_handler(IOT_UART_PORT port)
 {
     uint32_t read_size = iot_uart_stats[port].rx.length;
+    uint8_t *read_buffer = iot_uart_stats[port].rx.buffer;
+
+    if (iot_uart_stats[port].rx.dma_mode) {
+        // Line idle, flush the bytes below dma threshold through the tail span
+        read_buffer += IOT_UART_RX_DMA_SPAN_LEN * 2;
+        read_size = uart_read((UART_PORT)port, read_buffer, IOT_UART_RX_DMA_SPAN_LEN);
+        if (read_size == 0) {
+            return;
+        }
+        iot_uart_stats[port].rx.stats.idle_flush_cnt++;
+        iot_uart_stats[port].rx.stats.rx_bytes += read_size;
+
+        if (iot_uart_stats[port].rx.callback != NULL) {
+            iot_uart_stats[port].rx.callback(read_buffer, read_size);
+        }
+        return;
+    }
 
-    read_size = uart_read((UART_PORT)port, iot_uart_stats[port].rx.buffer, read_size);
+    read_size = uart_read((UART_PORT)port, read_buffer, read_size);
+    iot_uart_stats[port].rx.stats.rx_bytes += read_size;
 
     if (iot_uart_stats[port].rx.callback != NULL) {
         iot_uart_stats[port].rx.callback(iot_uart_stats[port].rx.buffer,
@@ -756,6 +906,7 @@ static void iot_uart_tx_done_handler(IOT_UART_PORT port)
 
 static void iot_uart_rx_fifo_overflow_handler(IOT_UART_PORT port)
 {
+    iot_uart_stats[port].rx.stats.overflow_cnt++;
     uart_reset_rx_fifo((UART_PORT)port);
 }
 
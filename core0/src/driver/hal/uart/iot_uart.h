@@ -116,6 +116,22 @@ typedef struct iot_uart_dma_config {
 typedef void (*iot_uart_write_done_callback)(const void *buffer, uint32_t length);
 typedef void (*iot_uart_rx_callback)(const void *buffer, uint32_t length);
 
+/** Length of one rx dma span, equal to the rx fifo full threshold */
+#define IOT_UART_RX_DMA_SPAN_LEN    128U
+/** Rx dma buffer length, two ping-pong spans plus one idle-line tail span */
+#define IOT_UART_RX_DMA_BUF_LEN     (IOT_UART_RX_DMA_SPAN_LEN * 3U)
+
+/**
+ * UART rx statistics, cleared when a rx callback is registered
+ */
+typedef struct iot_uart_rx_stats {
+    uint32_t rx_bytes;          /*!< Bytes handed to the rx callback */
+    uint32_t overflow_cnt;      /*!< Rx fifo overflow count */
+    uint32_t dma_lost_cnt;      /*!< Spans lost because the dma could not be re-armed */
+    uint32_t dma_span_cnt;      /*!< Full spans received through dma */
+    uint32_t idle_flush_cnt;    /*!< Idle-line tail flush count */
+} iot_uart_rx_stats_t;
+
 void iot_uart_write_fifo_from_critical(IOT_UART_PORT port);
 
 /**
@@ -212,6 +228,33 @@ uint8_t iot_uart_write(IOT_UART_PORT port, const char *string, uint32_t length,
 int8_t iot_uart_register_rx_callback(IOT_UART_PORT port, uint8_t *buffer, uint32_t length,
                                      iot_uart_rx_callback callback);
 
+/**
+ * @brief This function is to register the rx callback of the uart in dma ping-pong mode.
+ *
+ * The buffer is split into two spans filled by dma in turn and one tail span.
+ * Every full span is handed to the callback in place, without copying. When the
+ * rx line goes idle the bytes left in the rx fifo are read into the tail span
+ * and handed to the callback too. The callback is invoked in isr and must be
+ * done with the span before it returns, the span is re-armed right after.
+ * Rx dma must be enabled by iot_uart_dma_config() first.
+ *
+ * @param port is uart port.
+ * @param buffer is the rx buffer, at least IOT_UART_RX_DMA_BUF_LEN bytes.
+ * @param length is the length of the rx buffer.
+ * @param callback is the uart rx callback variable quantity.
+ * @return int8_t RET_INVAL or RET_AGAIN or RET_NOT_READY or RET_OK.
+ */
+int8_t iot_uart_register_rx_dma_callback(IOT_UART_PORT port, uint8_t *buffer, uint32_t length,
+                                         iot_uart_rx_callback callback);
+
+/**
+ * @brief This function is to get the rx statistics of the current rx session.
+ *
+ * @param port is uart port.
+ * @param stats is the statistics output.
+ */
+void iot_uart_get_rx_stats(IOT_UART_PORT port, iot_uart_rx_stats_t *stats);
+
 /**
  * @brief This function is to set the uart rx buffer.
  *
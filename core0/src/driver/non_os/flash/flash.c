@@ -49,6 +49,15 @@ static bool_t flash_special_qpi_mode = false;
 static uint32_t flash_special_erase_wip_wait_time = 0;
 static uint32_t flash_special_program_wip_wait_time = 0;
 
+/* flash needs some time after resume before it can be suspended again */
+#define FLASH_PE_SLICE_TIME_MIN     100
+/* max ms a sw mode program/erase slice is held back for latency critical users */
+#define FLASH_PE_HOLD_MAX_MS        20
+
+static uint32_t flash_special_pe_slice_time = 0;
+static volatile uint8_t flash_special_pe_hold_cnt = 0;
+static flash_pe_stats_t flash_special_pe_stats;
+
 const struct flash_ctrl *flash_special_func = {NULL};
 
 FLASH_PE_MODE flash_special_pe_mode = FLASH_PE_HW_MODE;
@@ -105,6 +114,57 @@ uint32_t flash_special_get_erase_wip_wait_time(void)
     return flash_special_erase_wip_wait_time;
 }
 
+void flash_special_set_pe_slice_time(uint32_t time)
+{
+    if (time != 0 && time < FLASH_PE_SLICE_TIME_MIN) {
+        time = FLASH_PE_SLICE_TIME_MIN;
+    }
+    flash_special_pe_slice_time = time;
+}
+
+bool_t flash_special_wait_pe_slice(uint32_t def_time) IRAM_TEXT(flash_special_wait_pe_slice);
+bool_t flash_special_wait_pe_slice(uint32_t def_time)
+{
+    uint32_t time = flash_special_pe_slice_time ? flash_special_pe_slice_time : def_time;
+    uint32_t start = iot_timer_get_time();
+
+    /* return as soon as it's done instead of waiting the whole slice */
+    while (flash_special_check_wip_status()) {
+        if (iot_timer_get_time() - start >= time) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void flash_special_pe_hold(void) IRAM_TEXT(flash_special_pe_hold);
+void flash_special_pe_hold(void)
+{
+    uint32_t mask = cpu_disable_irq();
+
+    flash_special_pe_hold_cnt++;
+
+    cpu_restore_irq(mask);
+}
+
+void flash_special_pe_release(void) IRAM_TEXT(flash_special_pe_release);
+void flash_special_pe_release(void)
+{
+    uint32_t mask = cpu_disable_irq();
+
+    if (flash_special_pe_hold_cnt) {
+        flash_special_pe_hold_cnt--;
+    }
+
+    cpu_restore_irq(mask);
+}
+
+void flash_special_get_pe_stats(flash_pe_stats_t *stats)
+{
+    *stats = flash_special_pe_stats;
+}
+
 void flash_special_disable_quad_mode(void)
 {
     flash_special_qpi_mode = false;
@@ -457,6 +517,33 @@ bool_t flash_special_is_pe_in_progress(void)
     return sfc_is_pe_in_progress();
 }
 
+#if !defined(BUILD_OS_NON_OS)
+static void flash_special_pe_wait_hold(void)
+{
+    uint32_t i;
+
+    /* start the next slice when the latency critical users are done */
+    for (i = 0; flash_special_pe_hold_cnt && i < FLASH_PE_HOLD_MAX_MS; i++) {
+        os_delay(1);
+    }
+
+    if (i) {
+        flash_special_pe_stats.defer_cnt++;
+    }
+}
+#endif
+
+static void flash_special_pe_slice_done(uint32_t start) IRAM_TEXT(flash_special_pe_slice_done);
+static void flash_special_pe_slice_done(uint32_t start)
+{
+    uint32_t block = iot_timer_get_time() - start;
+
+    flash_special_pe_stats.slice_cnt++;
+    if (block > flash_special_pe_stats.max_block_time) {
+        flash_special_pe_stats.max_block_time = block;
+    }
+}
+
 static uint8_t flash_special_sw_page_program(uint32_t addr, const void *buf, size_t count) IRAM_TEXT(flash_special_sw_page_program);
 static uint8_t flash_special_sw_page_program(uint32_t addr, const void *buf, size_t count)
 {
@@ -465,6 +552,8 @@ static uint8_t flash_special_sw_page_program(uint32_t addr, const void *buf, siz
 
     for (;;) {
 #if !defined(BUILD_OS_NON_OS)
+        flash_special_pe_wait_hold();
+
         os_task_suspend_all();
 
         uint32_t mask = cpu_disable_irq();
@@ -472,6 +561,7 @@ static uint8_t flash_special_sw_page_program(uint32_t addr, const void *buf, siz
         /* suspend bt core's task*/
         iot_suspend_sched_wait_core_suspend(BT_CORE);
 #endif
+        uint32_t start = iot_timer_get_time();
 
 #ifdef CHECK_ISR_FLASH
         iot_soc_cpu_access_enable(IOT_SOC_CPU_ACCESS_DTOP_FLASH, false);
@@ -487,6 +577,8 @@ static uint8_t flash_special_sw_page_program(uint32_t addr, const void *buf, siz
         }
         apb_btb_enable((uint8_t)cpu_get_mhartid(), true);
 
+        flash_special_pe_slice_done(start);
+
 #ifdef CHECK_ISR_FLASH
         iot_soc_cpu_access_enable(IOT_SOC_CPU_ACCESS_DTOP_FLASH, true);
 #endif
@@ -522,6 +614,8 @@ static uint8_t flash_special_sw_erase(uint32_t addr)
 
     for (;;) {
 #if !defined(BUILD_OS_NON_OS)
+        flash_special_pe_wait_hold();
+
         os_task_suspend_all();
 
         uint32_t mask = cpu_disable_irq();
@@ -529,6 +623,7 @@ static uint8_t flash_special_sw_erase(uint32_t addr)
         /* suspend bt core's task*/
         iot_suspend_sched_wait_core_suspend(BT_CORE);
 #endif
+        uint32_t start = iot_timer_get_time();
 
 #ifdef CHECK_ISR_FLASH
         iot_soc_cpu_access_enable(IOT_SOC_CPU_ACCESS_DTOP_FLASH, false);
@@ -544,6 +639,8 @@ static uint8_t flash_special_sw_erase(uint32_t addr)
         }
         apb_btb_enable((uint8_t)cpu_get_mhartid(), true);
 
+        flash_special_pe_slice_done(start);
+
 #ifdef CHECK_ISR_FLASH
         iot_soc_cpu_access_enable(IOT_SOC_CPU_ACCESS_DTOP_FLASH, true);
 #endif
@@ -667,6 +764,27 @@ uint8_t flash_special_write(uint32_t addr, const void *buf, size_t count)
     return ret;
 }
 
+uint8_t flash_special_block_erase(uint32_t addr, uint32_t size)
+{
+    if ((size != FLASH_BLOCK_32K_SIZE && size != FLASH_BLOCK_64K_SIZE)
+        || (addr & (size - 1))) {
+        return RET_INVAL;
+    }
+
+    /* sw mode suspends sector by sector, block erase runs in hw mode only */
+    if (flash_special_get_pe_mode() == FLASH_PE_SW_MODE
+        || flash_special_func->block_erase == NULL) {
+        uint8_t ret = RET_OK;
+
+        for (uint32_t off = 0; off < size; off += FLASH_SECTOR_SIZE) {
+            ret |= flash_special_erase(addr + off);
+        }
+        return ret;
+    }
+
+    return flash_special_func->block_erase(addr, size);
+}
+
 uint8_t flash_special_erase_sector(uint16_t sector_id)
 {
     return flash_special_erase(sector_id * FLASH_SECTOR_SIZE);
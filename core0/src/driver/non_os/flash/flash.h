@@ -23,6 +23,8 @@ extern "C" {
 
 #define FLASH_PAGE_SIZE  0x100U
 #define FLASH_QPAGE_SIZE 0x400U
+#define FLASH_BLOCK_32K_SIZE 0x8000U
+#define FLASH_BLOCK_64K_SIZE 0x10000U
 
 #define param_a(a, b, c, d, e) a
 #define param_b(a, b, c, d, e) b
@@ -112,6 +114,13 @@ typedef enum{
     FLASH_PE_SW_MODE,
 }FLASH_PE_MODE;
 
+/** @brief sw mode program/erase slice statistics. */
+typedef struct {
+    uint32_t slice_cnt;         /* slices run with irq disabled */
+    uint32_t defer_cnt;         /* slices held back by flash_special_pe_hold() */
+    uint32_t max_block_time;    /* longest slice, unit is us */
+} flash_pe_stats_t;
+
 /**
  * @brief This function is to check WIP status.
  *
@@ -193,6 +202,15 @@ uint8_t flash_special_erase_sector(uint16_t sector_id);
  */
 uint8_t flash_special_erase(uint32_t addr);
 
+/**
+ * @brief This function is to erase a 32KB or 64KB flash block.
+ *
+ * @param addr is flash addr, aligned to size
+ * @param size is FLASH_BLOCK_32K_SIZE or FLASH_BLOCK_64K_SIZE
+ * @return uint8_t RET_INVAL or RET_OK,RET_OK for success else error..
+ */
+uint8_t flash_special_block_erase(uint32_t addr, uint32_t size);
+
 /**
  * @brief This function is to write data into flash.
  *
@@ -378,6 +396,42 @@ FLASH_PE_MODE flash_special_get_pe_mode(void);
 
 uint8_t flash_special_get_uid(void *data);
 
+/**
+ * @brief This function is to set the max time a sw mode program/erase slice
+ *        runs before the flash is suspended.
+ *
+ * @param time is the slice time, unit is us, 0 for the flash default.
+ */
+void flash_special_set_pe_slice_time(uint32_t time);
+
+/**
+ * @brief This function is to wait a sw mode program/erase slice.
+ *
+ * @param def_time is the slice time used if none is set, unit is us.
+ * @return bool_t is true if program/erase is still in progress.
+ */
+bool_t flash_special_wait_pe_slice(uint32_t def_time);
+
+/**
+ * @brief This function is to hold back sw mode program/erase slices for a
+ *        latency critical user, it can be called in isr.
+ *
+ */
+void flash_special_pe_hold(void);
+
+/**
+ * @brief This function is to release flash_special_pe_hold().
+ *
+ */
+void flash_special_pe_release(void);
+
+/**
+ * @brief This function is to get sw mode program/erase slice statistics.
+ *
+ * @param stats is the statistics copied out.
+ */
+void flash_special_get_pe_stats(flash_pe_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -40,6 +40,7 @@ struct flash_ctrl {
     void (*otp_lock)(uint8_t id);
     uint8_t (*page_program)(uint32_t addr, const void *buf, size_t count);
     uint8_t (*sector_erase)(uint32_t addr);
+    uint8_t (*block_erase)(uint32_t addr, uint32_t size);
     uint8_t (*otp_write)(uint32_t addr, const void *buf, size_t count);
     uint8_t (*otp_erase)(uint32_t addr);
     uint8_t (*chip_erase)(void);
@@ -24,6 +24,8 @@ Information is free from patent or copyright infringement.
 #define GD_PAGE_PROGRAM   0x02, SFC_OP_PRM, 0x200, 0x08180000, 0x960      //PE=2.4ms
 #define GD_QUAD_PAGE_PROGRAM 0x32, SFC_OP_PRM, 0x201, 0x08180000, 0x960      //PE=2.4ms
 #define GD_SECTOR_ERASE      0x20, SFC_OP_ERASE, 0x200, 0x08180000, 0x493E0  //sector erase time=300ms
+#define GD_BLOCK_ERASE_32K   0x52, SFC_OP_ERASE, 0x200, 0x08180000, 0x186A00 //32KB block erase time=1.6s
+#define GD_BLOCK_ERASE_64K   0xD8, SFC_OP_ERASE, 0x200, 0x08180000, 0x1E8480 //64KB block erase time=2s
 #define GD_OTP_ERASE         0x44, SFC_OP_ERASE, 0x200, 0x08180000, 0x2000
 #define GD_OTP_PAGE_PROGRAM  0x42, SFC_OP_PRM, 0x200, 0x08180000, 0x2000
 #define GD_CHIP_ERASE        0x60, SFC_OP_ERASE, 0x200, 0x08000000, 0x44AA20   //chip erase time=4.5s
@@ -184,6 +186,28 @@ static uint8_t flash_gd_erase(uint32_t addr)
     return ret;
 }
 
+static uint8_t flash_gd_block_erase(uint32_t addr, uint32_t size)
+{
+    sfc_cmd_t cmd_32k = FLASH_CMD(GD_BLOCK_ERASE_32K);
+    sfc_cmd_t cmd_64k = FLASH_CMD(GD_BLOCK_ERASE_64K);
+    sfc_cmd_t *cmd = (size == FLASH_BLOCK_64K_SIZE) ? &cmd_64k : &cmd_32k;
+    uint8_t ret;
+
+    cmd->addr = addr;
+
+    /* check WIP status */
+    flash_special_wait_wip();
+
+    uint8_t offset = flash_gd_info.param_offset;
+
+    flash_special_write_enable();
+
+    sfc_set_dynamic_suspend_resume_param(&gd_pe_param[offset], cmd->wtime);
+    ret = sfc_send_cmd(cmd);
+
+    return ret;
+}
+
 static uint8_t flash_gd_otp_page_program(uint32_t addr, const void *buf, size_t count)
 {
     sfc_cmd_t cmd = FLASH_CMD(GD_OTP_PAGE_PROGRAM);
@@ -243,9 +267,7 @@ static uint8_t flash_gd_sw_erase(uint32_t addr)
 
     ret = sfc_send_cmd(&cmd);
 
-    iot_timer_delay_us(ERAS_TIME_SLICE);
-
-    if(flash_special_check_wip_status()){
+    if(flash_special_wait_pe_slice(ERAS_TIME_SLICE)){
         /*send suspend command*/
         flash_special_pe_suspend();
         ret = 1;
@@ -267,9 +289,7 @@ static uint8_t flash_gd_page_program_sw(uint32_t addr, const void *buf, size_t c
 
     sfc_send_write_cmd(&cmd, buf, count);
 
-    iot_timer_delay_us(PROG_TIME_SLICE);
-
-    if(flash_special_check_wip_status()){
+    if(flash_special_wait_pe_slice(PROG_TIME_SLICE)){
         /*send suspend command*/
         flash_special_pe_suspend();
         ret = 1;
@@ -288,9 +308,7 @@ static uint8_t flash_gd_sw_pe_alg(void)
     /* send resume command */
     flash_special_pe_resume();
 
-    iot_timer_delay_us(ERAS_TIME_SLICE);
-
-    if(flash_special_check_wip_status()){
+    if(flash_special_wait_pe_slice(ERAS_TIME_SLICE)){
         /*send suspend command*/
         flash_special_pe_suspend();
         ret = 1;
@@ -329,6 +347,7 @@ struct flash_ctrl flash_gd_set = {
     .disable_qpp_mode = flash_gd_disable_qpp_mode,
     .page_program = flash_gd_page_program,
     .sector_erase = flash_gd_erase,
+    .block_erase = flash_gd_block_erase,
     .otp_write = flash_gd_otp_page_program,
     .otp_erase = flash_gd_otp_erase,
     .chip_erase = flash_gd_chip_erase,
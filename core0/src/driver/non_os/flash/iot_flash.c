@@ -30,6 +30,19 @@ Information is free from patent or copyright infringement.
 
 #define IOT_FLASH_OTP_SOC_ID_OFFSET 0x8
 
+/* bytes read back at a time to check if a write needs the sector erased */
+#define IOT_FLASH_CHECK_CHUNK       64
+
+/* keep one partially written sector of iot_flash_write_cached() in ram and
+ * erase/program it once, the data only reaches flash on iot_flash_flush() or
+ * when another cached write needs an erase. boot_reason_system_reset() and the
+ * app shutdown flush it, a crash, watchdog reset or power loss before that
+ * loses it. iot_flash_write() never leaves data in ram, so the regions read
+ * through the flash memory map must only use it */
+#ifndef IOT_FLASH_WB_CACHE_ENABLE
+#define IOT_FLASH_WB_CACHE_ENABLE   0
+#endif
+
 #if !defined(BUILD_OS_NON_OS)
 #else
 static uint8_t iot_flash_tmp_buf[FLASH_SECTOR_SIZE];
@@ -40,28 +53,162 @@ static os_mutex_h flash_op_mutex = NULL;
 #endif
 
 static iot_flash_pe_cb flash_pe_cb = NULL;
+static iot_flash_stats_t iot_flash_stats;
+
+#if IOT_FLASH_WB_CACHE_ENABLE
+typedef struct {
+    uint32_t sector_start;
+    bool_t dirty;
+    uint8_t buf[FLASH_SECTOR_SIZE];
+} iot_flash_wb_cache_t;
+
+static iot_flash_wb_cache_t iot_flash_wb;
+#endif
 
 static uint32_t iot_flash_get_sector_id(uint32_t addr)
 {
     return addr / FLASH_SECTOR_SIZE;
 }
 
-static uint8_t iot_flash_sector_write(uint32_t addr, const void *buf, uint32_t length)
+/**
+ * @brief Check if the data can be written by programming only, NOR program
+ *        can only clear bits, so every old byte must have the new 0 bits.
+ *
+ * @param addr is flash addr
+ * @param buf is the new data
+ * @param length is the new data length
+ * @param first is the first byte differs from flash, length if none
+ * @param last is the end of the last byte differs from flash
+ * @return bool_t true if no erase is needed.
+ */
+static bool_t iot_flash_is_programmable(uint32_t addr, const uint8_t *buf,
+                                        uint32_t length, uint32_t *first,
+                                        uint32_t *last)
+{
+    uint8_t old[IOT_FLASH_CHECK_CHUNK];
+    uint32_t n;
+
+    *first = length;
+    *last = 0;
+    for (uint32_t off = 0; off < length; off += n) {
+        n = MIN(length - off, (uint32_t)IOT_FLASH_CHECK_CHUNK);
+        flash_special_read(addr + off, old, n);
+        for (uint32_t i = 0; i < n; i++) {
+            uint8_t data = buf[off + i];
+
+            if (old[i] == data) {
+                continue;
+            }
+            if ((old[i] & data) != data) {
+                return false;
+            }
+            if (*first == length) {
+                *first = off + i;
+            }
+            *last = off + i + 1;
+        }
+    }
+
+    return true;
+}
+
+#if IOT_FLASH_WB_CACHE_ENABLE
+static uint8_t iot_flash_wb_flush(void)
 {
+    uint8_t ret;
+
+    if (!iot_flash_wb.dirty) {
+        return RET_OK;
+    }
+
+    iot_flash_wb.dirty = false;
+    flash_special_erase(iot_flash_wb.sector_start);
+    ret = flash_special_write(iot_flash_wb.sector_start, iot_flash_wb.buf,
+                              FLASH_SECTOR_SIZE);
+    iot_flash_stats.erase_cnt++;
+    iot_flash_stats.program_bytes += FLASH_SECTOR_SIZE;
+
+    if (flash_pe_cb) {
+        flash_pe_cb();
+    }
+    iot_cache_invalidate(IOT_CACHE_SFC_ID, iot_flash_wb.sector_start + FLASH_START,
+                         FLASH_SECTOR_SIZE);
+    return ret;
+}
+
+static bool_t iot_flash_wb_hit(uint32_t addr, uint32_t count)
+{
+    return iot_flash_wb.dirty && addr < iot_flash_wb.sector_start + FLASH_SECTOR_SIZE
+           && addr + count > iot_flash_wb.sector_start;
+}
+
+static void iot_flash_wb_drop(uint32_t sector_start)
+{
+    if (iot_flash_wb.sector_start == sector_start) {
+        iot_flash_wb.dirty = false;
+    }
+}
+#endif
+
+static uint8_t iot_flash_sector_write(uint32_t addr, const void *buf, uint32_t length,
+                                      bool_t cached)
+{
+    uint32_t first, last;
+    uint8_t ret;
+
     // Only write the data in same sector
     if (iot_flash_get_sector_id(addr)
         != iot_flash_get_sector_id(addr + length - 1)) {
         return RET_INVAL;
     }
 
+    uint32_t sector_start = addr & ~(FLASH_SECTOR_SIZE - 1);
+    uint32_t sector_offset = addr % FLASH_SECTOR_SIZE;
+
+#if IOT_FLASH_WB_CACHE_ENABLE
+    // Merge into the sector waiting in ram, an uncached write takes it out
+    if (iot_flash_wb.dirty && iot_flash_wb.sector_start == sector_start) {
+        memcpy(iot_flash_wb.buf + sector_offset, buf, length);
+        if (!cached) {
+            return iot_flash_wb_flush();
+        }
+        iot_flash_stats.erase_avoided++;
+        return RET_OK;
+    }
+#else
+    UNUSED(cached);
+#endif
+
+    // Only 1->0 bits or erased space, program the changed bytes
+    if (iot_flash_is_programmable(addr, buf, length, &first, &last)) {
+        iot_flash_stats.erase_avoided++;
+        if (first == length) {
+            return RET_OK;
+        }
+        iot_flash_stats.program_bytes += last - first;
+        return flash_special_write(addr + first, (const uint8_t *)buf + first,
+                                   last - first);
+    }
+
     // Write a whole sector, just write it
     if (length == FLASH_SECTOR_SIZE) {
         flash_special_erase(addr);
+        iot_flash_stats.erase_cnt++;
+        iot_flash_stats.program_bytes += length;
         return flash_special_write(addr, buf, length);
     }
 
-    uint32_t sector_start = addr & ~(FLASH_SECTOR_SIZE - 1);
-    uint32_t sector_offset = addr % FLASH_SECTOR_SIZE;
+#if IOT_FLASH_WB_CACHE_ENABLE
+    // Keep the sector in ram, it's erased and programmed once on flush
+    if (cached) {
+        ret = iot_flash_wb_flush();
+        flash_special_read(sector_start, iot_flash_wb.buf, FLASH_SECTOR_SIZE);
+        memcpy(iot_flash_wb.buf + sector_offset, buf, length);
+        iot_flash_wb.sector_start = sector_start;
+        iot_flash_wb.dirty = true;
+        return ret;
+    }
+#endif
 
     // read this sector's data */
 #if !defined(BUILD_OS_NON_OS)
@@ -74,8 +221,10 @@ static uint8_t iot_flash_sector_write(uint32_t addr, const void *buf, uint32_t l
 
     flash_special_erase(sector_start);
 
-    uint8_t ret = flash_special_write(sector_start, iot_flash_tmp_buf,
+    ret = flash_special_write(sector_start, iot_flash_tmp_buf,
                                FLASH_SECTOR_SIZE);
+    iot_flash_stats.erase_cnt++;
+    iot_flash_stats.program_bytes += FLASH_SECTOR_SIZE;
 #if !defined(BUILD_OS_NON_OS)
     os_mem_free(iot_flash_tmp_buf);
 #endif
@@ -87,6 +236,10 @@ uint8_t iot_flash_erase_sector(uint16_t sector_id)
     uint8_t ret;
 
     ret = flash_special_erase_sector(sector_id);
+    iot_flash_stats.erase_cnt++;
+#if IOT_FLASH_WB_CACHE_ENABLE
+    iot_flash_wb_drop(sector_id * FLASH_SECTOR_SIZE);
+#endif
 
     if(flash_pe_cb){
         flash_pe_cb();
@@ -102,6 +255,10 @@ uint8_t iot_flash_erase(uint32_t addr)
     uint8_t ret;
 
     ret = flash_special_erase(addr);
+    iot_flash_stats.erase_cnt++;
+#if IOT_FLASH_WB_CACHE_ENABLE
+    iot_flash_wb_drop(addr & ~(FLASH_SECTOR_SIZE - 1));
+#endif
 
     if(flash_pe_cb){
         flash_pe_cb();
@@ -110,11 +267,36 @@ uint8_t iot_flash_erase(uint32_t addr)
     return ret;
 }
 
+uint8_t iot_flash_erase_block(uint32_t addr, uint32_t size)
+{
+    uint8_t ret;
+
+    ret = flash_special_block_erase(addr, size);
+    if (ret != RET_OK) {
+        return ret;
+    }
+    iot_flash_stats.erase_cnt++;
+#if IOT_FLASH_WB_CACHE_ENABLE
+    if (iot_flash_wb_hit(addr, size)) {
+        iot_flash_wb.dirty = false;
+    }
+#endif
+
+    if(flash_pe_cb){
+        flash_pe_cb();
+    }
+    iot_cache_invalidate(IOT_CACHE_SFC_ID, addr + FLASH_START, size);
+    return ret;
+}
+
 uint8_t iot_flash_chip_erase(void)
 {
     uint8_t ret;
 
     ret = flash_special_chip_erase();
+#if IOT_FLASH_WB_CACHE_ENABLE
+    iot_flash_wb.dirty = false;
+#endif
 
     if(flash_pe_cb){
         flash_pe_cb();
@@ -131,6 +313,17 @@ uint8_t iot_flash_read(uint32_t addr, void *buf, size_t count)
 
     uint8_t ret = flash_special_read(addr, buf, count);
 
+#if IOT_FLASH_WB_CACHE_ENABLE
+    // The sector in ram is newer than flash
+    if (iot_flash_wb_hit(addr, count)) {
+        uint32_t start = MAX(addr, iot_flash_wb.sector_start);
+        uint32_t end = MIN(addr + count, iot_flash_wb.sector_start + FLASH_SECTOR_SIZE);
+
+        memcpy((uint8_t *)buf + start - addr,
+               iot_flash_wb.buf + start - iot_flash_wb.sector_start, end - start);
+    }
+#endif
+
 #if !defined(BUILD_OS_NON_OS)
     os_release_mutex(flash_op_mutex);
 #endif
@@ -146,7 +339,14 @@ uint8_t iot_flash_write_without_erase(uint32_t addr, const void *buf, size_t cou
     os_acquire_mutex(flash_op_mutex);
 #endif
 
+#if IOT_FLASH_WB_CACHE_ENABLE
+    if (iot_flash_wb_hit(addr, count)) {
+        iot_flash_wb_flush();
+    }
+#endif
+
     ret = flash_special_write(addr, buf, count);
+    iot_flash_stats.program_bytes += count;
 
     if(flash_pe_cb){
         flash_pe_cb();
@@ -159,7 +359,7 @@ uint8_t iot_flash_write_without_erase(uint32_t addr, const void *buf, size_t cou
     return ret;
 }
 
-uint8_t iot_flash_write(uint32_t addr, void *buf, size_t count)
+static uint8_t iot_flash_write_internal(uint32_t addr, void *buf, size_t count, bool_t cached)
 {
     uint32_t left = count;
     uint32_t waddr = addr;
@@ -174,7 +374,7 @@ uint8_t iot_flash_write(uint32_t addr, void *buf, size_t count)
         uint32_t sector_left =
             ((waddr + FLASH_SECTOR_SIZE) & ~(FLASH_SECTOR_SIZE - 1)) - waddr;
         uint32_t wlen = MIN(sector_left, left);
-        ret = iot_flash_sector_write(waddr, p, wlen);
+        ret = iot_flash_sector_write(waddr, p, wlen, cached);
 
         left -= wlen;
         waddr += wlen;
@@ -192,6 +392,47 @@ uint8_t iot_flash_write(uint32_t addr, void *buf, size_t count)
     return ret;
 }
 
+uint8_t iot_flash_write(uint32_t addr, void *buf, size_t count)
+{
+    return iot_flash_write_internal(addr, buf, count, false);
+}
+
+uint8_t iot_flash_write_cached(uint32_t addr, void *buf, size_t count)
+{
+    return iot_flash_write_internal(addr, buf, count, true);
+}
+
+uint8_t iot_flash_flush(void)
+{
+    uint8_t ret = RET_OK;
+
+#if IOT_FLASH_WB_CACHE_ENABLE
+#if !defined(BUILD_OS_NON_OS)
+    os_acquire_mutex(flash_op_mutex);
+#endif
+
+    ret = iot_flash_wb_flush();
+
+#if !defined(BUILD_OS_NON_OS)
+    os_release_mutex(flash_op_mutex);
+#endif
+#endif
+
+    return ret;
+}
+
+void iot_flash_get_stats(iot_flash_stats_t *stats)
+{
+    flash_pe_stats_t pe_stats;
+
+    flash_special_get_pe_stats(&pe_stats);
+
+    *stats = iot_flash_stats;
+    stats->pe_slice_cnt = pe_stats.slice_cnt;
+    stats->pe_defer_cnt = pe_stats.defer_cnt;
+    stats->pe_max_block = pe_stats.max_block_time;
+}
+
 uint16_t iot_flash_get_id(void)
 {
     return flash_special_get_id();
@@ -353,6 +594,23 @@ void iot_flash_set_pe_mode(IOT_FLASH_PE_MODE mode)
     flash_special_set_pe_mode((FLASH_PE_MODE)mode);
 }
 
+void iot_flash_set_pe_slice_time(uint32_t time)
+{
+    flash_special_set_pe_slice_time(time);
+}
+
+void iot_flash_pe_hold(void) IRAM_TEXT(iot_flash_pe_hold);
+void iot_flash_pe_hold(void)
+{
+    flash_special_pe_hold();
+}
+
+void iot_flash_pe_release(void) IRAM_TEXT(iot_flash_pe_release);
+void iot_flash_pe_release(void)
+{
+    flash_special_pe_release();
+}
+
 IOT_FLASH_PE_MODE iot_flash_get_pe_mode(void)
 {
     return (IOT_FLASH_PE_MODE)flash_special_get_pe_mode();
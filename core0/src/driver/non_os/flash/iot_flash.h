@@ -74,6 +74,19 @@ typedef enum{
  * @}
  */
 
+/**
+ * @brief flash program/erase statistics.
+ *
+ */
+typedef struct {
+    uint32_t erase_cnt;       /* sector erases done */
+    uint32_t erase_avoided;   /* writes done without a sector erase */
+    uint32_t program_bytes;   /* bytes programmed */
+    uint32_t pe_slice_cnt;    /* sw mode program/erase slices */
+    uint32_t pe_defer_cnt;    /* sw mode slices held back by iot_flash_pe_hold() */
+    uint32_t pe_max_block;    /* longest sw mode slice with irq disabled, unit is us */
+} iot_flash_stats_t;
+
 /**
  * @brief This function is to erase flash sector according to the sector id.
  *
@@ -90,6 +103,15 @@ uint8_t iot_flash_erase_sector(uint16_t sector_id);
  */
 uint8_t iot_flash_erase(uint32_t addr);
 
+/**
+ * @brief This function is to erase a 32KB or 64KB flash block with one command.
+ *
+ * @param addr is erase flash addr, aligned to size
+ * @param size is BLOCK_ERASE_32K_SIZE or BLOCK_ERASE_64K_SIZE
+ * @return uint8_t RET_INVAL or RET_OK,RET_OK for success else error..
+ */
+uint8_t iot_flash_erase_block(uint32_t addr, uint32_t size);
+
 /**
  * @brief This function is to chip erase flash.
  *
@@ -117,6 +139,21 @@ uint8_t iot_flash_read(uint32_t addr, void *buf, size_t count);
  */
 uint8_t iot_flash_write(uint32_t addr, void *buf, size_t count);
 
+/**
+ * @brief This function is to write data into flash addr through the write-back
+ *        cache, a sector needing an erase is kept in ram until iot_flash_flush()
+ *        or a cached write to another sector. Only for regions read back by
+ *        iot_flash_read() and not through the flash memory map, whose data may
+ *        be lost on a crash. Same as iot_flash_write() if
+ *        IOT_FLASH_WB_CACHE_ENABLE is 0.
+ *
+ * @param addr is flash addr
+ * @param buf is buffer ready write to flash
+ * @param count is buffer len
+ * @return uint8_t RET_OK or RET_INVAL,RET_OK for success else error..
+ */
+uint8_t iot_flash_write_cached(uint32_t addr, void *buf, size_t count);
+
 /**
  * @brief This function is to wtite data into flash addr without erase.
  *
@@ -127,6 +164,23 @@ uint8_t iot_flash_write(uint32_t addr, void *buf, size_t count);
  */
 uint8_t iot_flash_write_without_erase(uint32_t addr, const void *buf, size_t count);
 
+/**
+ * @brief This function is to write the sector kept in ram by the write-back
+ *        cache into flash, nothing to do if IOT_FLASH_WB_CACHE_ENABLE is 0.
+ *        Called before a soft reset and power off, call it before any other
+ *        path that drops the power.
+ *
+ * @return uint8_t RET_OK for success else error.
+ */
+uint8_t iot_flash_flush(void);
+
+/**
+ * @brief This function is to get flash program/erase statistics.
+ *
+ * @param stats is the statistics copied out.
+ */
+void iot_flash_get_stats(iot_flash_stats_t *stats);
+
 /**
  * @brief This function is to get flash id.
  *
@@ -287,6 +341,34 @@ bool_t iot_flash_is_pe_in_progress(void);
  */
 void iot_flash_set_pe_mode(IOT_FLASH_PE_MODE mode);
 
+/**
+ * @brief This function is to set the max time a sw mode program/erase runs
+ *        with irq disabled before it's suspended to let other code run.
+ *        Only GD flash has sw mode slices, PUYA sw mode functions are empty
+ *        and its program/erase is left to the sfc suspend/resume, so this
+ *        and iot_flash_pe_hold() have no effect there.
+ *
+ * @param time is the slice time, unit is us, 0 for the flash default.
+ */
+void iot_flash_set_pe_slice_time(uint32_t time);
+
+/**
+ * @brief This function is to hold back sw mode program/erase slices while a
+ *        latency critical job runs, it can be called in isr. A program/erase
+ *        is held back for 20ms at most.
+ *
+ * @note It's only the hook for such users, nothing in the sdk holds it yet.
+ *       Keep the hold short, e.g. around one audio frame deadline, a hold
+ *       kept for a whole call or playback delays every slice by 20ms.
+ */
+void iot_flash_pe_hold(void);
+
+/**
+ * @brief This function is to release iot_flash_pe_hold().
+ *
+ */
+void iot_flash_pe_release(void);
+
 /**
  * @brief This function is to get program/erase mode.
  *
@@ -26,6 +26,8 @@ Information is free from patent or copyright infringement.
 #define PUYA_PAGE_PROGRAM      0x02, SFC_OP_PRM,   0x200, 0x08180000, 3000     //page program=3ms
 #define PUYA_QUAD_PAGE_PROGRAM 0x32, SFC_OP_PRM,   0x201, 0x08180000, 3000   //quad page program=3ms
 #define PUYA_SECTOR_ERASE      0x20, SFC_OP_ERASE, 0x200, 0x08180000, 30000  //sector erase time=30ms
+#define PUYA_BLOCK_ERASE_32K   0x52, SFC_OP_ERASE, 0x200, 0x08180000, 30000  //32KB block erase time=30ms
+#define PUYA_BLOCK_ERASE_64K   0xD8, SFC_OP_ERASE, 0x200, 0x08180000, 30000  //64KB block erase time=30ms
 #define PUYA_OTP_ERASE         0x44, SFC_OP_ERASE, 0x200, 0x08180000, 8000   //otp erase time=8ms
 #define PUYA_OTP_PAGE_PROGRAM  0x42, SFC_OP_PRM,   0x200, 0x08180000, 8000   //otp program time=8ms
 #define PUYA_CHIP_ERASE        0x60, SFC_OP_ERASE, 0x200, 0x08000000, 180000 //chip erase time=180ms
@@ -288,6 +290,30 @@ static uint8_t flash_puya_erase(uint32_t addr)
     return ret;
 }
 
+static uint8_t flash_puya_block_erase(uint32_t addr, uint32_t size)
+{
+    sfc_cmd_t cmd_32k = FLASH_CMD(PUYA_BLOCK_ERASE_32K);
+    sfc_cmd_t cmd_64k = FLASH_CMD(PUYA_BLOCK_ERASE_64K);
+    sfc_cmd_t *cmd = (size == FLASH_BLOCK_64K_SIZE) ? &cmd_64k : &cmd_32k;
+    uint8_t ret;
+
+    cmd->addr = addr;
+
+    /* check WIP status */
+    flash_special_wait_wip();
+
+    uint8_t offset = flash_puya_info.param_offset;
+
+    flash_special_write_enable();
+
+    sfc_set_dynamic_suspend_resume_param(&puya_pe_param[offset], cmd->wtime);
+    ret = sfc_send_cmd(cmd);
+
+    flash_puya_pe_war();
+
+    return ret;
+}
+
 static uint8_t flash_puya_otp_page_program(uint32_t addr, const void *buf, size_t count)
 {
     sfc_cmd_t cmd = FLASH_CMD(PUYA_OTP_PAGE_PROGRAM);
@@ -390,6 +416,7 @@ struct flash_ctrl flash_puya_set = {
     .disable_qpp_mode = flash_puya_disable_qpp_mode,
     .page_program = flash_puya_page_program,
     .sector_erase = flash_puya_erase,
+    .block_erase = flash_puya_block_erase,
     .otp_write = flash_puya_otp_page_program,
     .otp_erase = flash_puya_otp_erase,
     .chip_erase = flash_puya_chip_erase,
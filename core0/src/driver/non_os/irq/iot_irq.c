@@ -33,6 +33,9 @@ Information is free from patent or copyright infringement.
 #ifdef CHECK_ISR_FLASH
 #include "iot_soc.h"
 #endif
+#ifdef CPU_USAGE_TRACE_ENABLE
+#include "encoding.h"
+#endif
 
 //storm interrupt debug, uncomment it to disable it.
 #define DEBUG_CHECK_INTERRUPT_STORM
@@ -47,6 +50,10 @@ uint32_t irq_nest = 0;
 iot_isr_usage_t iot_isr_usage;
 #endif
 
+#ifdef CPU_USAGE_TRACE_ENABLE
+iot_irq_trace_t iot_irq_trace;
+#endif
+
 #ifdef LOW_POWER_ENABLE
 struct pm_operation tick_pm;
 #endif
@@ -137,10 +144,35 @@ static void iot_irq_deliver_isr(uint32_t vector)
 #ifdef CHECK_ISR_USAGE
     uint64_t start = iot_timer_get_time();
 #endif
+#ifdef CPU_USAGE_TRACE_ENABLE
+    uint32_t cycle_start = read_csr(mcycle);
+
+    if (++iot_irq_trace.depth > iot_irq_trace.max_depth) {
+        iot_irq_trace.max_depth = iot_irq_trace.depth;
+    }
+    if (iot_irq_trace.depth == 1) {
+        iot_irq_trace.enter_cycles = cycle_start;
+    }
+#endif
 
     // Call the ISR
     isr(vector, param);
 
+#ifdef CPU_USAGE_TRACE_ENABLE
+    uint32_t cycles = (uint32_t)read_csr(mcycle) - cycle_start;
+    isr_trace_param_t *trace = &iot_irq_trace.vector[vector];
+
+    trace->cycles += cycles;
+    trace->cnt++;
+    if (cycles > trace->max_cycles) {
+        trace->max_cycles = cycles;
+    }
+    //only the outermost ISR counts, nested ones are already inside it
+    if (--iot_irq_trace.depth == 0) {
+        iot_irq_trace.total_cycles += cycles;
+    }
+#endif
+
 #ifdef CHECK_ISR_USAGE
     uint64_t stop = iot_timer_get_time();
     uint32_t duration_us = (stop - start);
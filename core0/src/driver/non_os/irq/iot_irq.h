@@ -82,6 +82,27 @@ typedef struct
 //data of iot_isr_usage
 extern iot_isr_usage_t iot_isr_usage;
 
+/** @brief Per vector ISR cycle accounting, nested ISR time is inclusive. */
+typedef struct
+{
+    uint32_t  cycles;
+    uint32_t  max_cycles;
+    uint32_t  cnt;
+}isr_trace_param_t;
+
+/** @brief ISR cycle trace data struct. */
+typedef struct
+{
+    isr_trace_param_t vector[CHIP_IRQ_VECTOR_MAX];
+    uint32_t  total_cycles;     /* outermost ISR cycles, free running */
+    uint32_t  enter_cycles;     /* mcycle when the outermost ISR started */
+    uint8_t   depth;
+    uint8_t   max_depth;
+}iot_irq_trace_t;
+
+//data of iot_irq_trace, only updated with CPU_USAGE_TRACE_ENABLE
+extern iot_irq_trace_t iot_irq_trace;
+
 /**
  * @brief This function is to check os timer handler duration and insert to queue.
  *
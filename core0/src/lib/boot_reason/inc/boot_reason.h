@@ -128,7 +128,8 @@ BOOT_REASON_TYPE boot_reason_get_reason(void);
 BOOT_REASON_WAKEUP_SOURCE boot_reason_get_wakeup_source(void);
 
 /**
- * @brief This function is to do soft reset when system idle.
+ * @brief This function is to do soft reset when system idle. The flash
+ *        write-back cache is flushed first, so call it from a task.
  *
  * @return BOOT_REASON_WAKEUP_SOURCE is wakeup source.
  */
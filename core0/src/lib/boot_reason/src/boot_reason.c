@@ -19,6 +19,7 @@ Information is free from patent or copyright infringement.
 #include "iot_wdt.h"
 #include "iot_debounce.h"
 #include "iot_charger.h"
+#include "iot_flash.h"
 #include "boot_reason.h"
 
 #if !defined(BUILD_OS_NON_OS)
@@ -298,6 +299,8 @@ void boot_reason_system_reset(BOOT_REASON_SOFT_REASON reason, uint8_t flag)
 {
     boot_reason_reset_reason = reason;
     boot_reason_reset_flag = flag;
+    /* the idle hook must not block, write back the flash cache here */
+    iot_flash_flush();
     os_hook_idle_register_callback(boot_reason_chip_reset);
 }
 #endif
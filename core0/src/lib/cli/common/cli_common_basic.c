@@ -18,6 +18,7 @@ Information is free from patent or copyright infringement.
 #include "iot_flash.h"
 #include "iot_rom_patch.h"
 #include "os_utils.h"
+#include "os_mem.h"
 #include "boot_reason.h"
 #include "iot_clock.h"
 #include "caldata.h"
@@ -35,6 +36,12 @@ Information is free from patent or copyright infringement.
 #include "cli_common_basic.h"
 #include "iot_memory_origin.h"
 #include "dfs.h"
+#include "iot_share_task.h"
+#include "iot_coredump.h"
+
+#define CLI_DFS_TRACE_MAX_SIZE          (DEFAULT_CLI_MAX_BUFFER_LEN - 32)
+#define CLI_SHARE_TASK_STATS_MAX_SIZE   (DEFAULT_CLI_MAX_BUFFER_LEN - 32)
+#define CLI_CMD_STATS_MAX_NUM           ((DEFAULT_CLI_MAX_BUFFER_LEN - 32) / sizeof(cli_command_stats_t))
 
 #pragma pack(push) /* save the pack status */
 #pragma pack(1)    /* 1 byte align */
@@ -50,6 +57,16 @@ typedef struct cli_log_level {
     uint8_t reserved[2];
 } cli_log_level_t;
 
+#define CLI_COREDUMP_OP_LIST    0   /* response: iot_core_dump_flash_info_t array */
+#define CLI_COREDUMP_OP_UPLOAD  1   /* seq, io: generic transmission io, uart0 if omitted */
+#define CLI_COREDUMP_OP_ACK     2   /* seq */
+
+typedef struct cli_coredump_cmd {
+    uint8_t op;
+    uint32_t seq;
+    uint8_t io;
+} cli_coredump_cmd_t;
+
 typedef struct {
     uint16_t ate_ver_major;
     uint16_t ate_ver_minor;
@@ -232,6 +249,107 @@ void cli_common_basic_set_clock_mode(uint8_t *buffer, uint32_t bufferlen)
     cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_SET_CLOCK_MODE, NULL, 0, 0, ret);
 }
 
+void cli_common_basic_get_dfs_trace(uint8_t *buffer, uint32_t bufferlen)
+{
+    uint8_t *trace = os_mem_malloc(IOT_CLI_MID, CLI_DFS_TRACE_MAX_SIZE);
+    uint32_t len;
+    uint8_t ret = RET_OK;
+
+    if (trace == NULL) {
+        cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_GET_DFS_TRACE,
+                                   NULL, 0, 0, RET_NOMEM);
+        return;
+    }
+
+    if (bufferlen >= 1 && buffer[0] == 1) {
+        ret = dfs_trace_export();
+    }
+
+    len = dfs_trace_get(trace, CLI_DFS_TRACE_MAX_SIZE);
+    if (len == 0) {
+        ret = RET_NOT_READY;
+    }
+
+    /* the trace comes back even if the export failed, result tells the export */
+    cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_GET_DFS_TRACE,
+                               trace, len, 0, ret);
+    os_mem_free(trace);
+}
+
+void cli_common_basic_get_share_task_stats(uint8_t *buffer, uint32_t bufferlen)
+{
+    uint8_t *stats = os_mem_malloc(IOT_CLI_MID, CLI_SHARE_TASK_STATS_MAX_SIZE);
+    uint32_t len;
+
+    if (stats == NULL) {
+        cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_GET_SHARE_TASK_STATS,
+                                   NULL, 0, 0, RET_NOMEM);
+        return;
+    }
+
+    len = iot_share_task_get_stats(stats, CLI_SHARE_TASK_STATS_MAX_SIZE,
+                                   bufferlen >= 1 && buffer[0] == 1);
+
+    cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_GET_SHARE_TASK_STATS,
+                               stats, len, 0, RET_OK);
+    os_mem_free(stats);
+}
+
+void cli_common_basic_get_cli_stats(uint8_t *buffer, uint32_t bufferlen)
+{
+    cli_command_stats_t *stats = os_mem_malloc(IOT_CLI_MID,
+                                               CLI_CMD_STATS_MAX_NUM * sizeof(cli_command_stats_t));
+    uint32_t num;
+
+    if (stats == NULL) {
+        cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_GET_CLI_STATS,
+                                   NULL, 0, 0, RET_NOMEM);
+        return;
+    }
+
+    num = cli_command_get_stats(stats, CLI_CMD_STATS_MAX_NUM, bufferlen >= 1 && buffer[0] == 1);
+
+    cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_GET_CLI_STATS, (uint8_t *)stats,
+                               num * sizeof(cli_command_stats_t), 0, RET_OK);
+    os_mem_free(stats);
+}
+
+#if CONFIG_COREDUMP_FLASH
+void cli_common_basic_get_coredump(uint8_t *buffer, uint32_t bufferlen)
+{
+    cli_coredump_cmd_t *cmd = (cli_coredump_cmd_t *)buffer;
+    iot_core_dump_flash_info_t info[FLASH_COREDUMP_SECTORS];
+    uint32_t num;
+    uint8_t ret;
+
+    if (bufferlen < 1 || (cmd->op != CLI_COREDUMP_OP_LIST && bufferlen < 5)) {
+        cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_GET_COREDUMP, NULL, 0, 0,
+                                   RET_INVAL);
+        return;
+    }
+
+    switch (cmd->op) {
+        case CLI_COREDUMP_OP_LIST:
+            num = iot_core_dump_flash_get_info(info, FLASH_COREDUMP_SECTORS);
+            cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_GET_COREDUMP, (uint8_t *)info,
+                                       num * sizeof(info[0]), 0, RET_OK);
+            return;
+        case CLI_COREDUMP_OP_UPLOAD:
+            ret = iot_core_dump_flash_upload(cmd->seq, bufferlen >= 6 ? cmd->io : 0);
+            break;
+        case CLI_COREDUMP_OP_ACK:
+            ret = iot_core_dump_flash_ack(cmd->seq);
+            break;
+        default:
+            ret = RET_INVAL;
+            break;
+    }
+
+    DBGLOG_LIB_CLI_INFO("cli coredump op %d seq %d, ret %d\n", cmd->op, cmd->seq, ret);
+    cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_GET_COREDUMP, NULL, 0, 0, ret);
+}
+#endif
+
 void cli_common_basic_set_log_level(uint8_t *buffer, uint32_t bufferlen)
 {
     UNUSED(bufferlen);
@@ -397,6 +515,12 @@ CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_GET_ANC_DATA, cli_common_basic_ge
 CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_GET_CHIP_INFO, cli_common_basic_get_chip_info);
 CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_SOFT_RST, cli_common_basic_reset);
 CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_SET_CLOCK_MODE, cli_common_basic_set_clock_mode);
+CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_GET_DFS_TRACE, cli_common_basic_get_dfs_trace);
+CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_GET_SHARE_TASK_STATS, cli_common_basic_get_share_task_stats);
+CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_GET_CLI_STATS, cli_common_basic_get_cli_stats);
+#if CONFIG_COREDUMP_FLASH
+CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_GET_COREDUMP, cli_common_basic_get_coredump);
+#endif
 CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_SET_LOG_LEVEL, cli_common_basic_set_log_level);
 CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_GET_ROM_VER, cli_common_basic_get_romlib_ver);
 CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_ROM_CRC_CHECK, cli_common_basic_rom_crc_check);
@@ -84,6 +84,44 @@ void cli_common_basic_reset(uint8_t *buffer, uint32_t bufferlen);
  */
 void cli_common_basic_set_clock_mode(uint8_t *buffer, uint32_t bufferlen);
 
+/**
+ * @brief This function is used to response the dfs transition trace, the
+ *        newest records that fit. A first payload byte of 1 also exports the
+ *        whole trace through generic transmission.
+ *
+ * @param buffer is cli command payload.
+ * @param bufferlen is cli command payload length.
+ */
+void cli_common_basic_get_dfs_trace(uint8_t *buffer, uint32_t bufferlen);
+
+/**
+ * @brief This function is used to response the share task statistics. A
+ *        first payload byte of 1 clears them after they are read.
+ *
+ * @param buffer is cli command payload.
+ * @param bufferlen is cli command payload length.
+ */
+void cli_common_basic_get_share_task_stats(uint8_t *buffer, uint32_t bufferlen);
+
+/**
+ * @brief This function is used to response the cli command statistics,
+ *        cli_command_stats_t of the commands invoked. A first payload byte
+ *        of 1 clears them after they are read.
+ *
+ * @param buffer is cli command payload.
+ * @param bufferlen is cli command payload length.
+ */
+void cli_common_basic_get_cli_stats(uint8_t *buffer, uint32_t bufferlen);
+
+/**
+ * @brief This function is used to handle the core dumps kept in flash, list
+ *        them, upload one through generic transmission or ack one received.
+ *
+ * @param buffer is cli command payload.
+ * @param bufferlen is cli command payload length.
+ */
+void cli_common_basic_get_coredump(uint8_t *buffer, uint32_t bufferlen);
+
 /**
  * @brief Set output log level
  *
@@ -67,6 +67,13 @@ typedef enum {
 
     CLI_MSGID_COREDUMP_MODE_SET,
     CLI_MSGID_ROM_CRC_CHECK,
+    CLI_MSGID_GET_HEAP_MAP,
+    CLI_MSGID_GET_DFS_TRACE,
+    CLI_MSGID_GET_SHARE_TASK_STATS,
+    CLI_MSGID_GET_COREDUMP,
+    CLI_MSGID_GET_CLI_STATS,
+    CLI_MSGID_READ_STREAM,
+    CLI_MSGID_READ_STREAM_DATA,
     CLI_MSGID_COMMON_MAX_NUM,
 } CLI_COMMON_MSGID;
 
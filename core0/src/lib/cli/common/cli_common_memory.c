@@ -21,8 +21,19 @@ Information is free from patent or copyright infringement.
 #include "cli_common_definition.h"
 #include "cli_common_memory.h"
 #include "iot_soc.h"
+#include "iot_flash.h"
+#include "iot_share_task.h"
 #include "crc.h"
+#include "iot_memory_origin.h"
 #define CLI_DATA_OPERATION_MAX_SIZE 256
+#define CLI_HEAP_MAP_MAX_SIZE       (DEFAULT_CLI_MAX_BUFFER_LEN - 32)
+
+/* read stream chunk, the ind frame fits one generic transmission packet */
+#define CLI_STREAM_CHUNK_MAX        (DEFAULT_CLI_MAX_BUFFER_LEN - 64)
+/* chunks sent per share task run, the other works run in between */
+#define CLI_STREAM_BATCH            8
+/* generic transmission fifo full, wait for the transport to drain it */
+#define CLI_STREAM_RETRY_MS         2
 
 typedef struct cli_cmd_read_data {
     uint32_t addr;
@@ -65,6 +76,41 @@ typedef struct _cli_clac_crc_ack {
     uint8_t crc_type;
 } __attribute__((packed)) cli_clac_crc_ack;
 
+typedef struct cli_cmd_read_stream {
+    uint32_t addr;              /* ram address, or flash offset for CLI_DATA_OPERATION_TYPE_FLASH */
+    uint32_t length;            /* 0 stops the stream running */
+    uint32_t offset;            /* resume from it, the chunks before are not sent */
+    uint16_t chunk;             /* 0 for CLI_STREAM_CHUNK_MAX */
+    uint8_t operation_type;
+    uint8_t flags;              /* CLI_STREAM_FLAG_CRC */
+    uint8_t io;                 /* GENERIC_TRANSMISSION_IO_UART0 or _SPP, the chunks go there only */
+} __attribute__((packed)) cli_cmd_read_stream_t;
+
+/* CLI_MSGID_READ_STREAM_DATA ind */
+typedef struct _cli_stream_data {
+    uint32_t addr;
+    uint32_t offset;            /* of the chunk in the stream */
+    uint16_t len;
+    uint8_t flags;              /* CLI_STREAM_FLAG_xx */
+    uint8_t data[];             /* len bytes, then their crc32 with CLI_STREAM_FLAG_CRC */
+} __attribute__((packed)) cli_stream_data_t;
+
+typedef struct _cli_stream {
+    iot_share_work_t work;
+    uint8_t *frame;             /* ind frame, the chunks are read into it in place */
+    uint32_t addr;
+    uint32_t length;
+    uint32_t offset;
+    uint16_t chunk;
+    uint8_t operation_type;
+    uint8_t flags;
+    generic_transmission_io_t io;
+    volatile bool_t running;
+    volatile bool_t stop;
+} cli_stream_t;
+
+static cli_stream_t cli_stream;
+
 void cli_common_memory_read_data(uint8_t *buffer, uint32_t length)
 {
     cli_cmd_read_data_t *cmd = (cli_cmd_read_data_t *)buffer;
@@ -279,6 +325,143 @@ void cli_common_memory_set_cap_code(uint8_t *buffer, uint32_t bufferlen)
                                NULL, 0, 0, RET_OK);
 }
 
+void cli_common_memory_get_heap_map(uint8_t *buffer, uint32_t bufferlen)
+{
+    UNUSED(buffer);
+    UNUSED(bufferlen);
+
+    /* the map buffer itself is taken from heap, it shows up as allocated */
+    uint8_t *map = os_mem_malloc(IOT_CLI_MID, CLI_HEAP_MAP_MAX_SIZE);
+
+    if (map == NULL) {
+        cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_GET_HEAP_MAP,
+                                   NULL, 0, 0, RET_NOMEM);
+        return;
+    }
+
+    uint32_t len = os_mem_get_heap_map(map, CLI_HEAP_MAP_MAX_SIZE);
+
+    cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_GET_HEAP_MAP,
+                               map, len, 0, RET_OK);
+    os_mem_free(map);
+}
+
+static void cli_common_memory_stream_work(iot_share_work_t *work)
+{
+    cli_stream_t *st = list_entry(work, cli_stream_t, work);
+    cli_stream_data_t *ind = (cli_stream_data_t *)(st->frame + CLI_FRAME_HEAD_LEN);
+    uint32_t len, payload_len, crc;
+    uint8_t ret = RET_OK;
+
+    for (uint8_t i = 0; i < CLI_STREAM_BATCH && !st->stop; i++) {
+        len = MIN(st->chunk, st->length - st->offset);
+        ind->addr = st->addr;
+        ind->offset = st->offset;
+        ind->len = (uint16_t)len;
+        ind->flags = st->flags;
+        if (st->offset + len == st->length) {
+            ind->flags |= CLI_STREAM_FLAG_LAST;
+        }
+
+        if (st->operation_type == CLI_DATA_OPERATION_TYPE_FLASH) {
+            ret = iot_flash_read(st->addr + st->offset, ind->data, len);
+        } else {
+            memcpy(ind->data, (const void *)(st->addr + st->offset), len);
+        }
+        payload_len = sizeof(cli_stream_data_t) + len;
+        if (st->flags & CLI_STREAM_FLAG_CRC) {
+            crc = getcrc32(ind->data, len);
+            memcpy(ind->data + len, &crc, sizeof(crc));
+            payload_len += sizeof(crc);
+        }
+
+        if (ret == RET_OK) {
+            ret = cli_interface_msg_ind_frame(CLI_MODULEID_COMMON, CLI_MSGID_READ_STREAM_DATA,
+                                              st->frame, payload_len, RET_OK, st->io);
+        }
+        if (ret == RET_BUSY) {
+            iot_share_task_queue_delayed_work(IOT_SHARE_TASK_QUEUE_LP, work, CLI_STREAM_RETRY_MS);
+            return;
+        } else if (ret != RET_OK) {
+            /* the host resumes from the offset of the last chunk it got */
+            DBGLOG_LIB_CLI_INFO("cli read stream 0x%08x failed at %d, ret %d\n", st->addr,
+                                st->offset, ret);
+            break;
+        }
+
+        st->offset += len;
+        if (st->offset == st->length) {
+            break;
+        }
+    }
+
+    if (ret == RET_OK && st->offset < st->length && !st->stop) {
+        iot_share_task_queue_work(IOT_SHARE_TASK_QUEUE_LP, work);
+        return;
+    }
+
+    os_mem_free(st->frame);
+    st->frame = NULL;
+    st->running = false;
+}
+
+void cli_common_memory_read_stream(uint8_t *buffer, uint32_t bufferlen)
+{
+    cli_cmd_read_stream_t *cmd = (cli_cmd_read_stream_t *)buffer;
+    cli_stream_t *st = &cli_stream;
+    uint8_t ret = RET_OK;
+    uint16_t chunk;
+
+    if (bufferlen < sizeof(cli_cmd_read_stream_t)) {
+        cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_READ_STREAM, NULL, 0, 0,
+                                   RET_INVAL);
+        return;
+    }
+
+    DBGLOG_LIB_CLI_INFO("cli read stream 0x%08x len %d from %d, chunk %d type %d\n", cmd->addr,
+                        cmd->length, cmd->offset, cmd->chunk, cmd->operation_type);
+
+    chunk = cmd->chunk ? cmd->chunk : CLI_STREAM_CHUNK_MAX;
+    if (cmd->length == 0) {
+        st->stop = true;
+    } else if (st->running) {
+        ret = RET_BUSY;
+    } else if (cmd->offset >= cmd->length || chunk > CLI_STREAM_CHUNK_MAX ||
+               (cmd->io != GENERIC_TRANSMISSION_IO_UART0 && cmd->io != GENERIC_TRANSMISSION_IO_SPP) ||
+               /* wrapped */
+               cmd->addr + cmd->length < cmd->addr ||
+               (cmd->operation_type == CLI_DATA_OPERATION_TYPE_FLASH &&
+                cmd->addr + cmd->length > FLASH_LENGTH) ||
+               (cmd->operation_type != CLI_DATA_OPERATION_TYPE_RAM &&
+                cmd->operation_type != CLI_DATA_OPERATION_TYPE_FLASH)) {
+        ret = RET_INVAL;
+    } else {
+        st->frame = os_mem_malloc(IOT_CLI_MID, CLI_FRAME_HEAD_LEN + sizeof(cli_stream_data_t) +
+                                  chunk + sizeof(uint32_t) + CLI_FRAME_TAIL_LEN);
+        if (st->frame == NULL) {
+            ret = RET_NOMEM;
+        }
+    }
+
+    /* the response goes before the first chunk */
+    cli_interface_msg_response(CLI_MODULEID_COMMON, CLI_MSGID_READ_STREAM, NULL, 0, 0, ret);
+    if (cmd->length == 0 || ret != RET_OK) {
+        return;
+    }
+
+    st->addr = cmd->addr;
+    st->length = cmd->length;
+    st->offset = cmd->offset;
+    st->chunk = chunk;
+    st->operation_type = cmd->operation_type;
+    st->flags = cmd->flags & CLI_STREAM_FLAG_CRC;
+    st->io = (generic_transmission_io_t)cmd->io;
+    st->stop = false;
+    st->running = true;
+    iot_share_task_init_work(&st->work, cli_common_memory_stream_work);
+    iot_share_task_queue_work(IOT_SHARE_TASK_QUEUE_LP, &st->work);
+}
+
 CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_READ_DATA, cli_common_memory_read_data);
 
 CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_SET_DATA, cli_common_memory_write_data);
@@ -286,3 +469,7 @@ CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_SET_DATA, cli_common_memory_write
 CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_CALC_CRC, cli_common_memory_calculate_crc);
 
 CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_CAP_CODE_SET, cli_common_memory_set_cap_code);
+
+CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_GET_HEAP_MAP, cli_common_memory_get_heap_map);
+
+CLI_ADD_COMMAND(CLI_MODULEID_COMMON, CLI_MSGID_READ_STREAM, cli_common_memory_read_stream);
@@ -27,6 +27,10 @@ enum CLI_DATA_OPERATION_TYPE {
     CLI_DATA_OPERATION_TYPE_REG_GROUP,
 };
 
+/* read stream flags */
+#define CLI_STREAM_FLAG_CRC     (1 << 0)    /* crc32 of the data follows each chunk */
+#define CLI_STREAM_FLAG_LAST    (1 << 1)    /* ind only, the last chunk of the stream */
+
 enum CLI_CRC_CALCULATION_TYPE {
     CLI_CRC_CALC_8BIT,
     CLI_CRC_CALC_16BIT,
@@ -66,6 +70,26 @@ void cli_common_memory_calculate_crc(uint8_t *buffer, uint32_t length);
  */
 void cli_common_memory_set_cap_code(uint8_t *buffer, uint32_t bufferlen);
 
+/**
+ * @brief This function is used to response the heap fragmentation map.
+ *
+ * @param buffer is cli command payload.
+ * @param bufferlen is cli command payload length.
+ */
+void cli_common_memory_get_heap_map(uint8_t *buffer, uint32_t bufferlen);
+
+/**
+ * @brief This function is used to stream a ram or flash region back as
+ *        CLI_MSGID_READ_STREAM_DATA inds, sent back to back in the share task
+ *        on the io given in the command, as fast as that io takes them. A
+ *        length of 0 stops the stream running; a stream cut off resumes from
+ *        the offset given.
+ *
+ * @param buffer is cli command payload.
+ * @param bufferlen is cli command payload length.
+ */
+void cli_common_memory_read_stream(uint8_t *buffer, uint32_t bufferlen);
+
 #ifdef __cplusplus
 }
 #endif
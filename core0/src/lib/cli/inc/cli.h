@@ -27,6 +27,13 @@ extern "C" {
 #define DEFAULT_CLI_TASK_SIZE   256
 #define DEFAULT_CLI_TASK_PRIO 8
 #define DEFAULT_CLI_MAX_BUFFER_LEN 512
+/* bytes around the payload in a frame of cli_interface_msg_ind_frame() */
+#ifdef CLI_LEGACY_MODE
+#define CLI_FRAME_HEAD_LEN  26
+#else
+#define CLI_FRAME_HEAD_LEN  14
+#endif
+#define CLI_FRAME_TAIL_LEN  2
 #define DBGLOG_LIB_CLI_RAW(fmt, arg...)      DBGLOG_LOG(IOT_CLI_MID, DBGLOG_LEVEL_VERBOSE, fmt, ##arg)
 #define DBGLOG_LIB_CLI_INFO(fmt, arg...)     DBGLOG_STREAM_INFO(IOT_CLI_MID, fmt, ##arg)
 
@@ -90,6 +97,24 @@ uint8_t cli_interface_msg_ind(uint32_t module_id, uint32_t msg_id,
                                    uint8_t *buffer, uint32_t buffer_len,
                                    uint16_t sn, uint8_t result);
 
+/**
+ * @brief This function is used to send an ind message built in place, without
+ *        the malloc and copy of cli_interface_msg_ind(). For streams of them,
+ *        so it goes out on one io only and busy follows that io.
+ *
+ * @param module_id is the module id of function.
+ * @param msg_id is the message id of function.
+ * @param frame CLI_FRAME_HEAD_LEN bytes, the payload, CLI_FRAME_TAIL_LEN bytes.
+ *              The head and tail are filled here.
+ * @param buffer_len is the payload length.
+ * @param result is message result.
+ * @param io is GENERIC_TRANSMISSION_IO_UART0 or GENERIC_TRANSMISSION_IO_SPP.
+ * @return uint8_t RET_OK, RET_BUSY if the generic transmission fifo of io is full.
+ */
+uint8_t cli_interface_msg_ind_frame(uint32_t module_id, uint32_t msg_id,
+                                    uint8_t *frame, uint32_t buffer_len, uint8_t result,
+                                    generic_transmission_io_t io);
+
 /**
  * @brief This function is used to get current cmd sn.
  *
@@ -61,6 +61,27 @@ typedef struct cli_command {
     cli_command command_func;
 } cli_command_t;
 
+/**
+ * @brief cli command statistics, only the commands invoked are reported
+ * invoke_cnt: times invoked
+ * max_run: longest us in the command function
+ */
+typedef struct cli_command_stats {
+    uint16_t module_id;
+    uint16_t msg_id;
+    uint32_t invoke_cnt;
+    uint32_t max_run;
+} __attribute__((packed)) cli_command_stats_t;
+
+/**
+ * @brief This function is used to build the command index. The commands of
+ *        the .cli_cmd section are sorted by module id and msg id once, so
+ *        cli_command_invoke() finds them by binary search instead of a scan.
+ *
+ * @return RET_OK, or RET_NOMEM and the commands are still found by the scan.
+ */
+uint8_t cli_command_init(void);
+
 /**
  * @brief This function is used to register cli command.
  *
@@ -72,6 +93,16 @@ typedef struct cli_command {
 void cli_command_invoke(uint16_t module_id, uint16_t msg_id, uint8_t *msg,
                         uint32_t msg_len);
 
+/**
+ * @brief This function is used to get the cli command statistics.
+ *
+ * @param stats output array.
+ * @param num entries of stats.
+ * @param clear clear the statistics after they are read.
+ * @return entries filled.
+ */
+uint32_t cli_command_get_stats(cli_command_stats_t *stats, uint32_t num, bool_t clear);
+
 #ifdef __cplusplus
 }
 #endif
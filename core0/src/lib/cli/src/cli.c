@@ -191,8 +191,15 @@ uint8_t cli_init(cli_config_t *cli_config)
     cli_receive_msg_event = os_create_semaphore(IOT_CLI_MID, MAX_TIME, false);
     assert(cli_receive_msg_event);
 
+#ifdef CLI_LEGACY_MODE
+    assert(CLI_FRAME_HEAD_LEN == CLI_MSG_START_LEN + sizeof(cli_msg_legacy_header_t));
+#else
+    assert(CLI_FRAME_HEAD_LEN == CLI_MSG_START_LEN + sizeof(cli_msg_header_t));
+#endif
+
     // init cli command list
     list_init(&cli_cmd_list_info.cli_cmd_list);
+    cli_command_init();
 
     // use default cli config here
     if(cli_config->cli_task_size == 0) {
@@ -255,30 +262,26 @@ uint8_t cli_interface_msg_receive(generic_transmission_tid_t tid,generic_transmi
     return RET_OK;
 }
 
-static uint8_t cli_interface_msg_send(uint32_t module_id, uint32_t msg_id,
-                                   uint8_t *buffer, uint32_t buffer_len,
-                                   uint8_t result, CLI_TYPE type)
+/*
+ * put the cli header and guards around the payload at frame + CLI_FRAME_HEAD_LEN and send it
+ * on io, GENERIC_TRANSMISSION_IO_NUM for both uart0 and spp
+ */
+static uint8_t cli_interface_frame_send(uint32_t module_id, uint32_t msg_id, uint8_t *frame,
+                                        uint32_t buffer_len, uint8_t result, CLI_TYPE type,
+                                        generic_transmission_io_t io)
 {
-    uint8_t *response;
 #ifdef CLI_LEGACY_MODE
     cli_msg_legacy_header_t cli_header;
-    uint32_t response_len = sizeof(cli_msg_legacy_header_t) + buffer_len
-        + CLI_MSG_START_LEN + CLI_MSG_END_LEN;
 #else
     cli_msg_header_t cli_header;
-    uint32_t response_len = sizeof(cli_msg_header_t) + buffer_len
-        + CLI_MSG_START_LEN + CLI_MSG_END_LEN;
 #endif
-    response = os_mem_malloc(IOT_CLI_MID, response_len);
+    uint32_t frame_len = CLI_FRAME_HEAD_LEN + buffer_len + CLI_FRAME_TAIL_LEN;
+    uint8_t *buffer = frame + CLI_FRAME_HEAD_LEN;
+    int32_t ret;
 
-    if (response == NULL) {
-        return RET_NOMEM;
-    }
-
-    memset(response, 0, response_len);
     memset(&cli_header, 0, sizeof(cli_header));
-    response[0] = CLI_MSG_START & 0xFF;
-    response[1] = (CLI_MSG_START >> 8) & 0xFF;
+    frame[0] = CLI_MSG_START & 0xFF;
+    frame[1] = (CLI_MSG_START >> 8) & 0xFF;
     cli_header.module_id = module_id;
     cli_header.msg_id = msg_id;
     cli_header.msg_length = buffer_len;
@@ -292,24 +295,50 @@ static uint8_t cli_interface_msg_send(uint32_t module_id, uint32_t msg_id,
 
     cli_header.result = result;
     cli_header.type = type;
-    memcpy(response + 2, &cli_header, sizeof(cli_header));
-    memcpy(response + 2 + sizeof(cli_header), buffer, buffer_len);
-    response[2 + sizeof(cli_header) + buffer_len] = CLI_MSG_END & 0xFF;
-    response[2 + sizeof(cli_header) + buffer_len + 1] = (CLI_MSG_END >> 8) & 0xFF;
-
-    int ret = generic_transmission_data_tx(GENERIC_TRANSMISSION_TX_MODE_LAZY, GENERIC_TRANSMISSION_DATA_TYPE_CLI, CLI_TID,\
-                                       GENERIC_TRANSMISSION_IO_UART0, (const uint8_t *)response,  \
-                                       response_len, 0);
-    generic_transmission_data_tx(GENERIC_TRANSMISSION_TX_MODE_LAZY, GENERIC_TRANSMISSION_DATA_TYPE_CLI, CLI_TID,\
-                                GENERIC_TRANSMISSION_IO_SPP, (const uint8_t *)response,  \
-                                response_len, 0);
-    os_mem_free(response);
-    if(ret < 0){
+    memcpy(frame + 2, &cli_header, sizeof(cli_header));
+    frame[CLI_FRAME_HEAD_LEN + buffer_len] = CLI_MSG_END & 0xFF;
+    frame[CLI_FRAME_HEAD_LEN + buffer_len + 1] = (CLI_MSG_END >> 8) & 0xFF;
+
+    if (io != GENERIC_TRANSMISSION_IO_NUM) {
+        ret = generic_transmission_data_tx(GENERIC_TRANSMISSION_TX_MODE_LAZY, GENERIC_TRANSMISSION_DATA_TYPE_CLI, CLI_TID,\
+                                           io, (const uint8_t *)frame, frame_len, 0);
+    } else {
+        ret = generic_transmission_data_tx(GENERIC_TRANSMISSION_TX_MODE_LAZY, GENERIC_TRANSMISSION_DATA_TYPE_CLI, CLI_TID,\
+                                           GENERIC_TRANSMISSION_IO_UART0, (const uint8_t *)frame,  \
+                                           frame_len, 0);
+        generic_transmission_data_tx(GENERIC_TRANSMISSION_TX_MODE_LAZY, GENERIC_TRANSMISSION_DATA_TYPE_CLI, CLI_TID,\
+                                    GENERIC_TRANSMISSION_IO_SPP, (const uint8_t *)frame,  \
+                                    frame_len, 0);
+    }
+    if (ret == -RET_NOMEM) {
+        return RET_BUSY;
+    } else if (ret < 0) {
         return RET_FAIL;
     }
     return RET_OK;
 }
 
+static uint8_t cli_interface_msg_send(uint32_t module_id, uint32_t msg_id,
+                                   uint8_t *buffer, uint32_t buffer_len,
+                                   uint8_t result, CLI_TYPE type)
+{
+    uint8_t *response;
+    uint8_t ret;
+
+    response = os_mem_malloc(IOT_CLI_MID, CLI_FRAME_HEAD_LEN + buffer_len + CLI_FRAME_TAIL_LEN);
+
+    if (response == NULL) {
+        return RET_NOMEM;
+    }
+
+    memcpy(response + CLI_FRAME_HEAD_LEN, buffer, buffer_len);
+    ret = cli_interface_frame_send(module_id, msg_id, response, buffer_len, result, type,
+                                   GENERIC_TRANSMISSION_IO_NUM);
+    os_mem_free(response);
+
+    return ret == RET_OK ? RET_OK : RET_FAIL;
+}
+
 uint8_t cli_interface_msg_response(uint32_t module_id, uint32_t msg_id,
                                    uint8_t *buffer, uint32_t buffer_len,
                                    uint16_t sn, uint8_t result)
@@ -326,6 +355,13 @@ uint8_t cli_interface_msg_ind(uint32_t module_id, uint32_t msg_id,
     return cli_interface_msg_send(module_id, msg_id, buffer, buffer_len, result, CLI_TYPE_IND);
 }
 
+uint8_t cli_interface_msg_ind_frame(uint32_t module_id, uint32_t msg_id,
+                                    uint8_t *frame, uint32_t buffer_len, uint8_t result,
+                                    generic_transmission_io_t io)
+{
+    return cli_interface_frame_send(module_id, msg_id, frame, buffer_len, result, CLI_TYPE_IND, io);
+}
+
 uint16_t cli_interface_get_current_cmd_sn(void)
 {
     return g_msg_cmd_sn;
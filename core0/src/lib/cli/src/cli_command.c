@@ -17,6 +17,7 @@ Information is free from patent or copyright infringement.
 #include "os_mem.h"
 #include "riscv_cpu.h"
 #include "crc.h"
+#include "iot_timer.h"
 
 #include "dbglog.h"
 #include "lib_dbglog.h"
@@ -26,21 +27,143 @@ Information is free from patent or copyright infringement.
 extern uint32_t _cli_cmd_start;
 extern uint32_t _cli_cmd_end;
 
+/* module id in the high half, sorts the index */
+#define CLI_COMMAND_KEY(module_id, msg_id) (((uint32_t)(module_id) << 16) | (msg_id))
+
+typedef struct cli_command_index {
+    uint32_t key;
+    const cli_command_t *cmd;
+    uint32_t invoke_cnt;
+    uint32_t max_run;       /* longest us in the command function */
+} cli_command_index_t;
+
+/* sorted by key, built from the .cli_cmd section once at init */
+static cli_command_index_t *cli_cmd_index = NULL;
+static uint16_t cli_cmd_index_num = 0;
+
+uint8_t cli_command_init(void)
+{
+    const cli_command_t *cmd;
+    cli_command_index_t item;
+    uint16_t num = 0;
+    uint16_t i;
+
+    if (cli_cmd_index) {
+        return RET_OK;
+    }
+
+    for (cmd = (const cli_command_t *)(&_cli_cmd_start);
+         (uint32_t)cmd < (uint32_t)(&_cli_cmd_end); cmd++) {
+        if (cmd->magic == CLI_COMMAND_MAGIC && cmd->command_func) {
+            num++;
+        }
+    }
+
+    cli_cmd_index = os_mem_malloc(IOT_CLI_MID, num * sizeof(cli_command_index_t));
+    if (cli_cmd_index == NULL) {
+        /* cli_command_invoke() falls back to the section scan */
+        return RET_NOMEM;
+    }
+
+    /* insertion sort, stable so the first of a duplicated key wins as in the section */
+    for (cmd = (const cli_command_t *)(&_cli_cmd_start);
+         (uint32_t)cmd < (uint32_t)(&_cli_cmd_end); cmd++) {
+        if (cmd->magic != CLI_COMMAND_MAGIC || cmd->command_func == NULL) {
+            continue;
+        }
+        memset(&item, 0, sizeof(item));
+        item.key = CLI_COMMAND_KEY(cmd->module_id_num, cmd->msg_id_num);
+        item.cmd = cmd;
+        for (i = cli_cmd_index_num; i > 0 && cli_cmd_index[i - 1].key > item.key; i--) {
+            cli_cmd_index[i] = cli_cmd_index[i - 1];
+        }
+        if (i > 0 && cli_cmd_index[i - 1].key == item.key) {
+            DBGLOG_LIB_CLI_INFO("duplicated command, module id:%d, msg id:%d\n",
+                                cmd->module_id_num, cmd->msg_id_num);
+        }
+        cli_cmd_index[i] = item;
+        cli_cmd_index_num++;
+    }
+
+    return RET_OK;
+}
+
+static cli_command_index_t *cli_command_find(uint16_t module_id, uint16_t msg_id)
+{
+    uint32_t key = CLI_COMMAND_KEY(module_id, msg_id);
+    uint16_t lo = 0;
+    uint16_t hi = cli_cmd_index_num;
+    uint16_t mid;
+
+    /* lower bound, the first one of a duplicated key */
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (cli_cmd_index[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo < cli_cmd_index_num && cli_cmd_index[lo].key == key) {
+        return &cli_cmd_index[lo];
+    }
+    return NULL;
+}
+
 void cli_command_invoke(uint16_t module_id, uint16_t msg_id, uint8_t *msg,
                         uint32_t msg_len)
 {
     cli_command_t *cmd = NULL;
+    cli_command_index_t *item;
+    uint32_t start, run;
 
-    for (cmd = (cli_command_t *)(&_cli_cmd_start);
-         (uint32_t)cmd < (uint32_t)(&_cli_cmd_end); cmd++) {
-        if (cmd->magic == CLI_COMMAND_MAGIC && cmd->module_id_num == module_id
-            && cmd->msg_id_num == msg_id) {
-            if (cmd->command_func) {
-                cmd->command_func(msg, msg_len);
-                return;
+    if (cli_cmd_index) {
+        item = cli_command_find(module_id, msg_id);
+        if (item) {
+            start = iot_timer_get_time();
+            item->cmd->command_func(msg, msg_len);
+            run = iot_timer_get_time() - start;
+            item->invoke_cnt++;
+            item->max_run = MAX(item->max_run, run);
+            return;
+        }
+    } else {
+        for (cmd = (cli_command_t *)(&_cli_cmd_start);
+             (uint32_t)cmd < (uint32_t)(&_cli_cmd_end); cmd++) {
+            if (cmd->magic == CLI_COMMAND_MAGIC && cmd->module_id_num == module_id
+                && cmd->msg_id_num == msg_id) {
+                if (cmd->command_func) {
+                    cmd->command_func(msg, msg_len);
+                    return;
+                }
             }
         }
     }
 
     DBGLOG_LIB_CLI_INFO("invalid command, module id:%d, msg id:%d\n", module_id, msg_id);
 }
+
+uint32_t cli_command_get_stats(cli_command_stats_t *stats, uint32_t num, bool_t clear)
+{
+    uint32_t cnt = 0;
+
+    for (uint16_t i = 0; i < cli_cmd_index_num; i++) {
+        if (cli_cmd_index[i].invoke_cnt == 0) {
+            continue;
+        }
+        if (cnt < num) {
+            stats[cnt].module_id = cli_cmd_index[i].cmd->module_id_num;
+            stats[cnt].msg_id = cli_cmd_index[i].cmd->msg_id_num;
+            stats[cnt].invoke_cnt = cli_cmd_index[i].invoke_cnt;
+            stats[cnt].max_run = cli_cmd_index[i].max_run;
+            cnt++;
+        }
+        if (clear) {
+            cli_cmd_index[i].invoke_cnt = 0;
+            cli_cmd_index[i].max_run = 0;
+        }
+    }
+
+    return cnt;
+}
@@ -44,6 +44,79 @@ extern "C" {
 #define DBGLOG_LIB_CPU_USAGE_ERROR(fmt, arg...)    printf(fmt, ##arg)
 #endif
 
+/** @brief Task slots of the cycle trace table, must be power of 2. */
+#define CPU_USAGE_TRACE_TASK_NUM    32
+/** @brief Slice histogram buckets, bucket n holds slices below 4^(n+5) cycles,
+ *         the last bucket takes the rest. */
+#define CPU_USAGE_TRACE_HIST_NUM    8
+#define CPU_USAGE_TRACE_MAGIC       0x5543  /* "CU" */
+#define CPU_USAGE_TRACE_VERSION     2
+
+/**
+ * @brief Binary trace record, exported through generic transmission as
+ *        GENERIC_TRANSMISSION_DATA_TYPE_TRACE after each cpu usage interval.
+ *        The header is followed by task_num task records and then isr_num
+ *        isr records, all little endian.
+ */
+typedef struct _cpu_usage_trace_hdr_t {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t task_num;
+    uint32_t interval_cycles;   /* cycles since the previous record */
+    uint32_t isr_cycles;        /* cycles spent in outermost ISRs */
+    uint8_t isr_num;
+    uint8_t isr_max_depth;      /* deepest ISR nesting seen */
+    uint16_t dropped;           /* switches lost for a full task table */
+} __attribute__((packed)) cpu_usage_trace_hdr_t;
+
+typedef struct _cpu_usage_trace_task_t {
+    char name[4];
+    uint32_t run_cycles;        /* task cycles, ISR time excluded */
+    uint32_t slices;
+    uint32_t max_slice;
+    uint32_t max_latency;       /* worst cycles from ready to switched in */
+    uint16_t hist[CPU_USAGE_TRACE_HIST_NUM];
+} __attribute__((packed)) cpu_usage_trace_task_t;
+
+typedef struct _cpu_usage_trace_isr_t {
+    uint8_t vector;
+    uint8_t reserved[3];
+    uint32_t cnt;
+    uint32_t cycles;
+    uint32_t max_cycles;
+} __attribute__((packed)) cpu_usage_trace_isr_t;
+
+/**
+ * @brief This function is called by the kernel when a task moves to ready list.
+ *
+ * @param task is the task control block.
+ * @param name is the task name.
+ */
+void cpu_usage_trace_task_ready(const void *task, const char *name);
+
+/**
+ * @brief This function is called by the kernel when a task is switched in.
+ *
+ * @param task is the task control block.
+ * @param name is the task name.
+ */
+void cpu_usage_trace_task_switched_in(const void *task, const char *name);
+
+/**
+ * @brief This function is called by the kernel when a task is switched out.
+ *
+ * @param task is the task control block.
+ */
+void cpu_usage_trace_task_switched_out(const void *task);
+
+/**
+ * @brief This function is called by the kernel when a task is deleted, its
+ *        slot is released after the next record.
+ *
+ * @param task is the task control block.
+ */
+void cpu_usage_trace_task_deleted(const void *task);
+
 /**
  * @brief This function is used to display isr for cpu usage.
  *
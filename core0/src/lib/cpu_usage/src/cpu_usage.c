@@ -31,6 +31,12 @@ Information is free from patent or copyright infringement.
 #include "iot_irq.h"
 #include "iot_rtc.h"
 #endif
+#ifdef CPU_USAGE_TRACE_ENABLE
+#include "iot_irq.h"
+#include "encoding.h"
+#include "generic_transmission_api.h"
+#include "generic_transmission_config.h"
+#endif
 #include "iot_lpm.h"
 
 #include "power_mgnt.h"
@@ -66,6 +72,31 @@ typedef struct cpu_usage_cxt_t {
 } cpu_usage_ctxt;
 
 static cpu_usage_ctxt g_cpu_usage_ctxt = {0};
+
+#ifdef CPU_USAGE_TRACE_ENABLE
+/* a released slot, lookups probe past it and inserts reuse it */
+#define CPU_USAGE_TRACE_SLOT_FREE   ((const void *)1)
+
+typedef struct cpu_usage_trace_slot_t {
+    const void *task;
+    uint32_t ready_ts;      /* 0 means not waiting for cpu */
+    uint8_t deleted;        /* task gone, released after the next record */
+    cpu_usage_trace_task_t stat;
+} cpu_usage_trace_slot_t;
+
+typedef struct cpu_usage_trace_ctxt_t {
+    cpu_usage_trace_slot_t slot[CPU_USAGE_TRACE_TASK_NUM];
+    cpu_usage_trace_slot_t *cur;
+    uint32_t cur_in_ts;
+    uint32_t cur_isr_cycles;
+    uint32_t last_record_ts;
+    uint32_t last_isr_cycles;
+    uint16_t dropped;
+    uint8_t *buf;           /* record buffer, allocated at init */
+} cpu_usage_trace_ctxt_t;
+
+static cpu_usage_trace_ctxt_t g_cpu_usage_trace;
+#endif
 #ifdef BUILD_CORE_CORE1
 uint32_t g_phy_save[16] = {0};
 uint32_t g_phy_save_cnt = 0;
@@ -102,13 +133,14 @@ static void os_cpu_usage_display_handler(const cpu_usage_ctxt *ctxt)
     total_time = ctxt->end.ts - ctxt->start.ts;
 
 #ifdef BUILD_CORE_CORE0
-    DBGLOG_LIB_CPU_USAGE_DEBUG("[auto]Core%d: Mem usage total:%dB free:%dB lowest:%dB cache missed:%d\n",
+    DBGLOG_LIB_CPU_USAGE_DEBUG("[auto]Core%d: Mem usage total:%dB free:%dB lowest:%dB largest:>=%dB cache missed:%d\n",
                     cpu, os_get_heap_size(), os_mem_get_heap_free(),
-                    os_mem_get_heap_lowest_free(), iot_cache_get_miss_cnt(IOT_CACHE_SFC_ID));
+                    os_mem_get_heap_lowest_free(), os_mem_get_heap_largest_free_class(),
+                    iot_cache_get_miss_cnt(IOT_CACHE_SFC_ID));
 #else
-    DBGLOG_LIB_CPU_USAGE_DEBUG("[auto]Core%d: Mem usage total:%dB free:%dB lowest:%dB\n",
+    DBGLOG_LIB_CPU_USAGE_DEBUG("[auto]Core%d: Mem usage total:%dB free:%dB lowest:%dB largest:>=%dB\n",
                     cpu, os_get_heap_size(), os_mem_get_heap_free(),
-                    os_mem_get_heap_lowest_free());
+                    os_mem_get_heap_lowest_free(), os_mem_get_heap_largest_free_class());
     DBGLOG_LIB_CPU_USAGE_DEBUG("%d phy[0-7] %x %x %x %x %x %x %x %x\r\n",
                     g_phy_save_cnt,
                     g_phy_save[0], g_phy_save[1], g_phy_save[2], g_phy_save[3],
@@ -185,6 +217,232 @@ void os_cpu_usage_display_isr(void)
 #endif
 }
 
+#ifdef CPU_USAGE_TRACE_ENABLE
+static cpu_usage_trace_slot_t *cpu_usage_trace_slot_get(const void *task, const char *name)
+    IRAM_TEXT(cpu_usage_trace_slot_get);
+static cpu_usage_trace_slot_t *cpu_usage_trace_slot_get(const void *task, const char *name)
+{
+    cpu_usage_trace_slot_t *slot;
+    cpu_usage_trace_slot_t *free_slot = NULL;
+    uint32_t idx = ((uint32_t)task >> 3) & (CPU_USAGE_TRACE_TASK_NUM - 1);
+
+    //open addressing on the TCB address, a deleted task's slot never matches
+    //so a new task reusing its TCB gets a slot of its own
+    for (uint32_t i = 0; i < CPU_USAGE_TRACE_TASK_NUM; i++) {
+        slot = &g_cpu_usage_trace.slot[idx];
+        if (slot->task == task && !slot->deleted) {
+            return slot;
+        }
+        if (slot->task == NULL || slot->task == CPU_USAGE_TRACE_SLOT_FREE) {
+            if (!free_slot) {
+                free_slot = slot;
+            }
+            if (slot->task == NULL) {
+                break;
+            }
+        }
+        idx = (idx + 1) & (CPU_USAGE_TRACE_TASK_NUM - 1);
+    }
+
+    if (!free_slot || !name) {
+        g_cpu_usage_trace.dropped += (name != NULL);
+        return NULL;
+    }
+
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->task = task;
+    for (uint32_t j = 0; j < sizeof(free_slot->stat.name) && name[j]; j++) {
+        free_slot->stat.name[j] = name[j];
+    }
+    return free_slot;
+}
+
+static uint32_t cpu_usage_trace_isr_cycles(uint32_t now) IRAM_TEXT(cpu_usage_trace_isr_cycles);
+static uint32_t cpu_usage_trace_isr_cycles(uint32_t now)
+{
+    uint32_t cycles = iot_irq_trace.total_cycles;
+
+    //the outermost ISR adds to total_cycles when it ends, a switch from
+    //inside it charges the part so far
+    if (iot_irq_trace.depth) {
+        cycles += now - iot_irq_trace.enter_cycles;
+    }
+    return cycles;
+}
+
+void cpu_usage_trace_task_ready(const void *task, const char *name)
+    IRAM_TEXT(cpu_usage_trace_task_ready);
+void cpu_usage_trace_task_ready(const void *task, const char *name)
+{
+    cpu_usage_trace_slot_t *slot = cpu_usage_trace_slot_get(task, name);
+
+    if (slot && !slot->ready_ts) {
+        //keep the earliest ready time, 0 marks the task not waiting
+        slot->ready_ts = (uint32_t)read_csr(mcycle) | 1U;
+    }
+}
+
+void cpu_usage_trace_task_switched_in(const void *task, const char *name)
+    IRAM_TEXT(cpu_usage_trace_task_switched_in);
+void cpu_usage_trace_task_switched_in(const void *task, const char *name)
+{
+    cpu_usage_trace_ctxt_t *trace = &g_cpu_usage_trace;
+    cpu_usage_trace_slot_t *slot = cpu_usage_trace_slot_get(task, name);
+    uint32_t now = (uint32_t)read_csr(mcycle);
+
+    trace->cur = slot;
+    trace->cur_in_ts = now;
+    trace->cur_isr_cycles = cpu_usage_trace_isr_cycles(now);
+
+    if (slot && slot->ready_ts) {
+        uint32_t latency = now - slot->ready_ts;
+
+        if (latency > slot->stat.max_latency) {
+            slot->stat.max_latency = latency;
+        }
+        slot->ready_ts = 0;
+    }
+}
+
+void cpu_usage_trace_task_switched_out(const void *task)
+    IRAM_TEXT(cpu_usage_trace_task_switched_out);
+void cpu_usage_trace_task_switched_out(const void *task)
+{
+    cpu_usage_trace_ctxt_t *trace = &g_cpu_usage_trace;
+    cpu_usage_trace_slot_t *slot = trace->cur;
+    uint32_t now = (uint32_t)read_csr(mcycle);
+    uint32_t slice;
+    uint32_t isr;
+    int32_t bucket;
+
+    if (!slot || slot->task != task) {
+        return;
+    }
+    //a running task re-added to ready list is not waiting for cpu
+    slot->ready_ts = 0;
+
+    slice = now - trace->cur_in_ts;
+    isr = cpu_usage_trace_isr_cycles(now) - trace->cur_isr_cycles;
+    slice = slice > isr ? slice - isr : 0;
+
+    slot->stat.run_cycles += slice;
+    slot->stat.slices++;
+    if (slice > slot->stat.max_slice) {
+        slot->stat.max_slice = slice;
+    }
+
+    //bucket n: slice < 4^(n + 5) cycles
+    bucket = slice ? (int32_t)(32 - __builtin_clz(slice)) - 9 : 0;
+    bucket = bucket > 0 ? bucket >> 1 : 0;
+    if (bucket >= CPU_USAGE_TRACE_HIST_NUM) {
+        bucket = CPU_USAGE_TRACE_HIST_NUM - 1;
+    }
+    if (slot->stat.hist[bucket] != 0xFFFF) {
+        slot->stat.hist[bucket]++;
+    }
+    trace->cur = NULL;
+}
+
+void cpu_usage_trace_task_deleted(const void *task)
+    IRAM_TEXT(cpu_usage_trace_task_deleted);
+void cpu_usage_trace_task_deleted(const void *task)
+{
+    cpu_usage_trace_slot_t *slot = cpu_usage_trace_slot_get(task, NULL);
+
+    if (!slot) {
+        return;
+    }
+    if (!g_cpu_usage_ctxt.interval) {
+        //no record to come, a task deleting itself just loses its last slice
+        memset(slot, 0, sizeof(*slot));
+        slot->task = CPU_USAGE_TRACE_SLOT_FREE;
+        return;
+    }
+    //keep the stats for the next record, a task deleting itself still
+    //has its last slice to come
+    slot->deleted = 1;
+    slot->ready_ts = 0;
+}
+
+#define CPU_USAGE_TRACE_BUF_LEN                                      \
+    (sizeof(cpu_usage_trace_hdr_t) +                                 \
+     sizeof(cpu_usage_trace_task_t) * CPU_USAGE_TRACE_TASK_NUM +     \
+     sizeof(cpu_usage_trace_isr_t) * CHIP_IRQ_VECTOR_MAX)
+
+static void os_cpu_usage_trace_export(void)
+{
+    cpu_usage_trace_ctxt_t *trace = &g_cpu_usage_trace;
+    cpu_usage_trace_hdr_t *hdr;
+    cpu_usage_trace_task_t *task_rec;
+    cpu_usage_trace_isr_t *isr_rec;
+    uint8_t *buf = trace->buf;
+    uint32_t len;
+
+    if (!buf) {
+        return;
+    }
+
+    hdr = (cpu_usage_trace_hdr_t *)buf;
+    task_rec = (cpu_usage_trace_task_t *)(hdr + 1);
+    hdr->magic = CPU_USAGE_TRACE_MAGIC;
+    hdr->version = CPU_USAGE_TRACE_VERSION;
+    hdr->task_num = 0;
+    hdr->isr_num = 0;
+
+    /* snapshot and clear in one go, the kernel hooks run with irq disabled */
+    uint32_t mask = cpu_disable_irq();
+    uint32_t now = (uint32_t)read_csr(mcycle);
+
+    hdr->interval_cycles = now - trace->last_record_ts;
+    hdr->isr_cycles = iot_irq_trace.total_cycles - trace->last_isr_cycles;
+    hdr->isr_max_depth = iot_irq_trace.max_depth;
+    hdr->dropped = trace->dropped;
+    trace->last_record_ts = now;
+    trace->last_isr_cycles = iot_irq_trace.total_cycles;
+    trace->dropped = 0;
+    iot_irq_trace.max_depth = 0;
+
+    for (uint32_t i = 0; i < CPU_USAGE_TRACE_TASK_NUM; i++) {
+        cpu_usage_trace_slot_t *slot = &trace->slot[i];
+
+        if (slot->task == NULL || slot->task == CPU_USAGE_TRACE_SLOT_FREE) {
+            continue;
+        }
+        task_rec[hdr->task_num++] = slot->stat;
+        if (slot->deleted && slot != trace->cur) {
+            memset(slot, 0, sizeof(*slot));
+            slot->task = CPU_USAGE_TRACE_SLOT_FREE;
+        } else {
+            memset((uint8_t *)&slot->stat + sizeof(slot->stat.name), 0,
+                   sizeof(slot->stat) - sizeof(slot->stat.name));
+        }
+    }
+
+    isr_rec = (cpu_usage_trace_isr_t *)(task_rec + hdr->task_num);
+    for (uint32_t i = 0; i < CHIP_IRQ_VECTOR_MAX; i++) {
+        isr_trace_param_t *param = &iot_irq_trace.vector[i];
+
+        if (!param->cnt) {
+            continue;
+        }
+        memset(isr_rec, 0, sizeof(*isr_rec));
+        isr_rec->vector = (uint8_t)i;
+        isr_rec->cnt = param->cnt;
+        isr_rec->cycles = param->cycles;
+        isr_rec->max_cycles = param->max_cycles;
+        isr_rec++;
+        hdr->isr_num++;
+        memset(param, 0, sizeof(*param));
+    }
+    cpu_restore_irq(mask);
+
+    len = (uint32_t)((uint8_t *)isr_rec - buf);
+    generic_transmission_data_tx(GENERIC_TRANSMISSION_TX_MODE_LAZY,
+                                 GENERIC_TRANSMISSION_DATA_TYPE_TRACE, TRACE_TID,
+                                 GENERIC_TRANSMISSION_IO_UART0, buf, len, 0);
+}
+#endif
+
 static void lpm_info_display(void)
 {
     uint8_t dtop_ps, bt_ps, dsp_ps, audif_ps;
@@ -221,6 +479,10 @@ static void os_status_display_handler(void *arg)
     os_cpu_usage_get_task_list(&ctxt->end);
     os_cpu_usage_display_handler(ctxt);
 
+#ifdef CPU_USAGE_TRACE_ENABLE
+    os_cpu_usage_trace_export();
+#endif
+
 #ifdef THREAD_STACK_DISPLAY
     os_thread_stack_status(ctxt->end.p_tasks, ctxt->end.num);
 #endif
@@ -302,6 +564,13 @@ void os_cpu_usage_util_init(void)
     iot_isr_usage.last_display_time = iot_rtc_get_global_time_ms();
 #endif
 
+#ifdef CPU_USAGE_TRACE_ENABLE
+    g_cpu_usage_trace.buf = os_mem_malloc(OS_UTILS_MID, CPU_USAGE_TRACE_BUF_LEN);
+    if (!g_cpu_usage_trace.buf) {
+        DBGLOG_LIB_CPU_USAGE_ERROR("cpu usage trace malloc failed.\n");
+    }
+#endif
+
     iot_share_task_event_register(IOT_SHARE_TASK_QUEUE_LP,
                                   IOT_SHARE_EVENT_CPU_USAGE_EVENT,
                                   os_status_display_handler, ctxt);
@@ -232,6 +232,13 @@ uint8_t dbglog_set_log_level(uint8_t module, uint8_t level);
  */
 uint8_t dbglog_get_dump_mode(void);
 
+/**
+ * @brief Get dbglog coredump io
+ *
+ * @return uint8_t coredump io in dbglog, DBGLOG_DUMP_UART or DBGLOG_DUMP_FLASH
+ */
+uint8_t dbglog_get_dump_io(void);
+
 /********** NOTE: these API in deprecated , add them only for core1 patch compile***************/
 uint8_t dbglog_wrap(const char *file_name, uint32_t line, DBGLOG_LEVEL level, const char *format,
                     ...);
@@ -148,6 +148,11 @@ uint8_t dbglog_get_dump_mode(void)
     return (dbglog_coredump_mode == 0)?DBGLOG_DUMP_FULL:DBGLOG_DUMP_MINI;
 }
 
+uint8_t dbglog_get_dump_io(void)
+{
+    return dbglog_coredump_io;
+}
+
 static int dbglog_gtp_write_buffer(bool_t irq_context, int log_type, const uint8_t *buffer, uint32_t length) IRAM_TEXT (dbglog_gtp_write_buffer);
 static int dbglog_gtp_write_buffer(bool_t irq_context, int log_type, const uint8_t *buffer, uint32_t length)
 {
@@ -16,8 +16,10 @@ Information is free from patent or copyright infringement.
 #ifndef DBGLOG_CACHE_H_
 #define DBGLOG_CACHE_H_
 
-#define LOG_BUFFER_SIZE 32
+#define LOG_BUFFER_SIZE 32    // must be power of 2
 #define DBGLOG_CACHE_INTERVAL_US 100000 // 100ms
+#define DBGLOG_CACHE_FLUSH_WATERMARK (LOG_BUFFER_SIZE >> 1)
+#define DBGLOG_CACHE_BANK_NUM 64
 #define DBGLOG_LIB_LOGGER_RAW(fmt, arg...)      DBGLOG_LOG(IOT_LOGGER_MID, DBGLOG_LEVEL_VERBOSE, fmt, ##arg)
 #define DBGLOG_LIB_LOGGER_INFO(fmt, arg...)     DBGLOG_STREAM_INFO(IOT_LOGGER_MID, fmt, ##arg)
 
@@ -57,8 +59,9 @@ typedef struct _log_buf_t
 
 /**
  * @brief This function is used to init dbglog cache.
+ *        The cache is a static ring of LOG_BUFFER_SIZE entries.
  *
- * @param num_malloc is malloc size.
+ * @param num_malloc is kept for compatibility, should be LOG_BUFFER_SIZE.
  */
 void dbglog_cache_init(uint8_t num_malloc);
 
@@ -71,6 +74,10 @@ void dbglog_cache_set_band_bitmap(uint64_t bitmap);
 
 /**
  * @brief This function is used to save dbglog cache.
+ *        Safe to call from isr, the slot is claimed without lock. When the
+ *        cache is full the oldest entry is overwritten and counted as missed
+ *        in the bank it belongs to. Print is posted to share task when the
+ *        used entries reach DBGLOG_CACHE_FLUSH_WATERMARK.
  *
  * @param bank is log buffer's bank.
  * @param offset is struct log buffer's offset.
@@ -84,7 +91,8 @@ void dbglog_cache_save(uint16_t bank, uint16_t offset, const char* fmt,
 
 /**
  * @brief This function is used to trigger print dbglog cache.
- *        only called from task.
+ *        only called from task, prints the entries left below the watermark
+ *        for longer than DBGLOG_CACHE_INTERVAL_US.
  */
 void dbglog_cache_print_trigger(void);
 
@@ -92,11 +100,19 @@ void dbglog_cache_print_trigger(void);
  * @brief This function is used to read info from dbglog cache.
  *
  * @param log_bank is the pointer of log.
- * @param log_miss_cnt is miss count of log.
- * @return uint8_t
+ * @param log_miss_cnt is miss count of the log's bank since last read, cleared after read.
+ * @return uint8_t 1 if one log is read, 0 if cache is empty.
  */
 uint8_t dbglog_cache_read(log_buf_t *log_bank, uint16_t *log_miss_cnt);
 
+/**
+ * @brief This function is used to get and clear the miss count of a bank.
+ *
+ * @param bank is log buffer's bank.
+ * @return uint16_t miss count of the bank.
+ */
+uint16_t dbglog_cache_get_miss_cnt(uint16_t bank);
+
 /**
  * @brief This function is used to get the number of used buffer for dbglog.
  *
@@ -19,28 +19,71 @@ Information is free from patent or copyright infringement.
  */
 #include <stdint.h>   // standard integer definitions
 #include "string.h"
-#include "os_mem.h"
+#include "modules.h"
+#include "riscv_cpu.h"
+#include "critical_sec.h"
 #include "lib_dbglog.h"
 #include "iot_share_task.h"
 #include "iot_timer.h"
 #include "dbglog_cache.h"   // SW profiling definition
 
+/*
+ * TYPES DEFINITIONS
+ ****************************************************************************************
+ */
+typedef struct _log_slot_t
+{
+    log_buf_t log;
+    /* LOG_SLOT_BUSY while written, LOG_SLOT_COMMIT(seq of the entry) after */
+    volatile uint32_t seq;
+} log_slot_t;
+
 /*
  * ENVIRONMENT VARIABLE DEFINITIONS
  ****************************************************************************************
  */
-log_buf_t *log_buffer = NULL;
-uint8_t log_read_idx = 0;
-uint8_t log_write_idx = 0;
-uint16_t log_miss_count = 0;
+static log_slot_t log_buffer[LOG_BUFFER_SIZE];
+/* free running sequences, slot index is seq & (LOG_BUFFER_SIZE - 1) */
+static volatile uint32_t log_write_seq = 0;
+static volatile uint32_t log_read_seq = 0;
+static volatile bool_t log_flush_pending = false;
+static uint32_t log_bank_miss_count[DBGLOG_CACHE_BANK_NUM];
+static bool_t dbglog_cache_inited = false;
 uint32_t dbglog_cache_enable_bitmap_low = 0;
 uint32_t dbglog_cache_enable_bitmap_high = 0;
-uint8_t g_num_malloc = 0;
 uint32_t dbglog_cache_clk_us_prev = 0;
 
 #define IOT_CLK_DIFF(clock_a, clock_b) \
     (((clock_b) > (clock_a)) ? ((clock_b) - (clock_a)) : ((0xFFFFFFFF - (clock_a)) + (clock_b) + 1))
 
+#define LOG_SLOT_IDX(seq) ((seq) & (LOG_BUFFER_SIZE - 1))
+/* committed marks are odd, so never equal to the busy mark */
+#define LOG_SLOT_BUSY           0
+#define LOG_SLOT_COMMIT(seq)    (((seq) << 1) | 1)
+
+/*
+ * LOCAL FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+static void dbglog_cache_flush_post(void) IRAM_TEXT(dbglog_cache_flush_post);
+static void dbglog_cache_flush_post(void)
+{
+    if (log_flush_pending) {
+        return;
+    }
+
+    if (in_irq()) {
+        log_flush_pending = true;
+        iot_share_task_post_event_from_isr(IOT_SHARE_TASK_QUEUE_LP,
+                                           IOT_SHARE_EVENT_DBGLOG_CACHE_EVENT);
+    } else if (cpu_get_int_enable()) {
+        log_flush_pending = true;
+        iot_share_task_post_event(IOT_SHARE_TASK_QUEUE_LP, IOT_SHARE_EVENT_DBGLOG_CACHE_EVENT);
+    } else {
+        // in critical section, the next save or dbglog_cache_print_trigger posts it
+    }
+}
+
 /*
  * EXPORTED FUNCTION DEFINITIONS
  ****************************************************************************************
@@ -50,20 +93,21 @@ void dbglog_cache_init(uint8_t num_malloc)
     uint64_t trace_bitmap = 0;
     uint32_t ret;
 
-    g_num_malloc = num_malloc;
-
-    if (log_buffer != NULL) {
-        DBGLOG_LIB_LOGGER_INFO("dbglog_cache_init:log_buffer isn't NULL error\n");
-        return;
+    if (num_malloc != LOG_BUFFER_SIZE) {
+        DBGLOG_LIB_LOGGER_INFO("dbglog_cache_init:size %d is fixed to %d\n", num_malloc,
+                               LOG_BUFFER_SIZE);
     }
 
-    log_buffer = (log_buf_t *)os_mem_malloc(IOT_LOGGER_MID, ((sizeof(log_buf_t)) * g_num_malloc));
-
-    if (log_buffer == NULL) {
-        DBGLOG_LIB_LOGGER_INFO("dbglog_cache_init malloc fail error ...\n");
+    if (dbglog_cache_inited) {
+        DBGLOG_LIB_LOGGER_INFO("dbglog_cache_init:already inited error\n");
         return;
     }
-    memset((log_buf_t *)log_buffer, 0, ((sizeof(log_buf_t)) * g_num_malloc));
+
+    memset(log_buffer, 0, sizeof(log_buffer));
+    memset(log_bank_miss_count, 0, sizeof(log_bank_miss_count));
+    log_write_seq = 0;
+    log_read_seq = 0;
+    log_flush_pending = false;
 
     //save log print in share task event
     ret = iot_share_task_event_register(IOT_SHARE_TASK_QUEUE_LP, IOT_SHARE_EVENT_DBGLOG_CACHE_EVENT,
@@ -71,6 +115,7 @@ void dbglog_cache_init(uint8_t num_malloc)
     if (ret != RET_OK) {
         return;
     }
+    dbglog_cache_inited = true;
 
     trace_bitmap |= (uint64_t)1 << DBG_SWDIAG_WQ_PHY;
     trace_bitmap |= (uint64_t)1 << DBG_SWDIAG_WQ_P3;
@@ -91,30 +136,41 @@ void dbglog_cache_save(uint16_t bank, uint16_t offset, const char *fmt, uint32_t
 void dbglog_cache_save(uint16_t bank, uint16_t offset, const char *fmt, uint32_t value0,
                        uint32_t value1, uint32_t value2)
 {
-    if (log_buffer == NULL) {
-        DBGLOG_LIB_LOGGER_INFO("dbglog_cache_save malloc fail...\n");
+    uint32_t seq;
+    log_slot_t *slot;
+
+    if (!dbglog_cache_inited || bank >= DBGLOG_CACHE_BANK_NUM) {
         return;
     }
-
     if (bank < 32 && ((dbglog_cache_enable_bitmap_low & (1U << bank)) == 0))
         return;
     if (bank >= 32 && ((dbglog_cache_enable_bitmap_high & (1U << (bank - 32))) == 0))
         return;
-    if (((log_write_idx + 1) & (g_num_malloc - 1)) == log_read_idx) {
-        log_miss_count++;
-        log_read_idx =
-            (log_read_idx + 1) & (g_num_malloc - 1);   //write idx catch the read idx, buffer full
-    }
 
-    log_buffer[log_write_idx].bank = bank;
-    log_buffer[log_write_idx].offset = offset;
-    log_buffer[log_write_idx].clock = iot_timer_get_time();
-    log_buffer[log_write_idx].fmt = fmt;
-    log_buffer[log_write_idx].value0 = value0;
-    log_buffer[log_write_idx].value1 = value1;
-    log_buffer[log_write_idx].value2 = value2;
+    // wait-free slot claim, isr nested in another writer simply gets the next slot
+    seq = __atomic_fetch_add(&log_write_seq, 1, __ATOMIC_RELAXED);
+    slot = &log_buffer[LOG_SLOT_IDX(seq)];
+
+    if (seq - log_read_seq >= LOG_BUFFER_SIZE) {
+        //write seq catch the read seq, buffer full, the oldest entry is lost
+        __atomic_fetch_add(&log_bank_miss_count[slot->log.bank], 1, __ATOMIC_RELAXED);
+    }
 
-    log_write_idx = (log_write_idx + 1) & (g_num_malloc - 1);
+    // mark the slot busy before any field, a reader copying it meanwhile drops the copy
+    __atomic_store_n(&slot->seq, LOG_SLOT_BUSY, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->log.bank = bank;
+    slot->log.offset = offset;
+    slot->log.clock = iot_timer_get_time();
+    slot->log.fmt = fmt;
+    slot->log.value0 = value0;
+    slot->log.value1 = value1;
+    slot->log.value2 = value2;
+    __atomic_store_n(&slot->seq, LOG_SLOT_COMMIT(seq), __ATOMIC_RELEASE);
+
+    if (seq - log_read_seq + 1 >= DBGLOG_CACHE_FLUSH_WATERMARK) {
+        dbglog_cache_flush_post();
+    }
 }
 
 /**
@@ -128,12 +184,9 @@ void dbglog_cache_print_trigger(void)
 
     clk_diff = IOT_CLK_DIFF(dbglog_cache_clk_us_prev, clk_us_curr);
 
-    if (((dbglog_cache_get_used_buf_num() > (LOG_BUFFER_SIZE >> 1))
-         && (clk_diff > (DBGLOG_CACHE_INTERVAL_US >> 1)))
-        || (clk_diff > DBGLOG_CACHE_INTERVAL_US)) {
-        /* post event to share task to print dbglog cache */
-        iot_share_task_post_event(IOT_SHARE_TASK_QUEUE_LP,
-            IOT_SHARE_EVENT_DBGLOG_CACHE_EVENT);
+    // flush is posted by watermark, here only flush the entries left below it
+    if ((dbglog_cache_get_used_buf_num() > 0) && (clk_diff > DBGLOG_CACHE_INTERVAL_US)) {
+        dbglog_cache_flush_post();
         dbglog_cache_clk_us_prev = clk_us_curr;
     }
 
@@ -142,43 +195,64 @@ void dbglog_cache_print_trigger(void)
 
 uint8_t dbglog_cache_read(log_buf_t *log_bank, uint16_t *log_miss_cnt)
 {
-    if (log_buffer == NULL) {
-        DBGLOG_LIB_LOGGER_INFO("dbglog_cache_read malloc fail...\n");
+    uint32_t seq, slot_seq;
+    log_slot_t *slot;
+
+    if (!dbglog_cache_inited) {
         return 0;
     }
 
-    if (log_read_idx == log_write_idx) {
-        return 0;   //buffer empty
+    while (log_read_seq != log_write_seq) {
+        seq = log_read_seq;
+        slot = &log_buffer[LOG_SLOT_IDX(seq)];
+
+        slot_seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (slot_seq == LOG_SLOT_BUSY || (int32_t)(slot_seq - LOG_SLOT_COMMIT(seq)) < 0) {
+            return 0;   //slot claimed but not committed yet
+        }
+
+        *log_bank = slot->log;
+
+        // entry overwritten before or during the copy, it is counted as missed
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != LOG_SLOT_COMMIT(seq)) {
+            log_read_seq = seq + 1;
+            continue;
+        }
+
+        log_read_seq = seq + 1;
+
+        cpu_critical_enter();
+        *log_miss_cnt = (uint16_t)MIN(log_bank_miss_count[log_bank->bank], 0xFFFF);
+        log_bank_miss_count[log_bank->bank] = 0;
+        cpu_critical_exit();
+        return 1;
     }
 
-    log_bank->bank = log_buffer[log_read_idx].bank;
-    log_bank->offset = log_buffer[log_read_idx].offset;
-    log_bank->clock = log_buffer[log_read_idx].clock;
-    log_bank->fmt = log_buffer[log_read_idx].fmt;
-    log_bank->value0 = log_buffer[log_read_idx].value0;
-    log_bank->value1 = log_buffer[log_read_idx].value1;
-    log_bank->value2 = log_buffer[log_read_idx].value2;
-
-    log_read_idx = (log_read_idx + 1) & (g_num_malloc - 1);
-    *log_miss_cnt = log_miss_count;
-    log_miss_count = 0;
-    return 1;
+    return 0;   //buffer empty
 }
 
-
-uint8_t dbglog_cache_get_used_buf_num(void)
+uint16_t dbglog_cache_get_miss_cnt(uint16_t bank)
 {
-    uint8_t num;
+    uint16_t cnt;
 
-    if (log_write_idx > log_read_idx) {
-        num = log_write_idx - log_read_idx;
-    } else if (log_write_idx < log_read_idx) {
-        num = (LOG_BUFFER_SIZE - log_read_idx) + log_write_idx;
-    } else {
-        num = 0;
+    if (bank >= DBGLOG_CACHE_BANK_NUM) {
+        return 0;
     }
 
-    return num;
+    cpu_critical_enter();
+    cnt = (uint16_t)MIN(log_bank_miss_count[bank], 0xFFFF);
+    log_bank_miss_count[bank] = 0;
+    cpu_critical_exit();
+
+    return cnt;
+}
+
+uint8_t dbglog_cache_get_used_buf_num(void)
+{
+    uint32_t num = log_write_seq - log_read_seq;
+
+    return (uint8_t)MIN(num, LOG_BUFFER_SIZE);
 }
 
 void dbglog_cache_print(void *arg)
@@ -189,6 +263,8 @@ void dbglog_cache_print(void *arg)
     UNUSED(arg);
     //DBGLOG_LIB_LOGGER_INFO("%d:used num: %d\n", iot_timer_get_time(), dbglog_cache_get_used_buf_num());
 
+    log_flush_pending = false;
+
     while (dbglog_cache_read(&log_bank, &log_miss_cnt)) {
         if (log_bank.bank == DBG_SWDIAG_WQ_COMMON_LOG) {
             DBGLOG_LIB_LOGGER_RAW(log_bank.fmt, log_bank.value0, log_bank.value1, log_bank.value2);
@@ -198,7 +274,16 @@ void dbglog_cache_print(void *arg)
         }
 
         if (log_miss_cnt != 0) {
-            DBGLOG_LIB_LOGGER_INFO("%d FW logs are overflowed\n", log_miss_cnt);
+            DBGLOG_LIB_LOGGER_INFO("bank %d: %d FW logs are overflowed\n", log_bank.bank,
+                                   log_miss_cnt);
+        }
+    }
+
+    // banks whose every cached entry was overwritten
+    for (uint16_t bank = 0; bank < DBGLOG_CACHE_BANK_NUM; bank++) {
+        log_miss_cnt = dbglog_cache_get_miss_cnt(bank);
+        if (log_miss_cnt != 0) {
+            DBGLOG_LIB_LOGGER_INFO("bank %d: %d FW logs are overflowed\n", bank, log_miss_cnt);
         }
     }
 }
@@ -210,7 +295,7 @@ void dbglog_cache_assert_dump(void (*func)(char *fmt, ...))
     func("----- dbglog_cache_assert_dump -----\n");
     //Dump all log in cache.Because logs may send to share memory , but not output from serial port.
     for (uint32_t i = 0; i < LOG_BUFFER_SIZE; i++) {
-        log_bank = log_buffer[(log_write_idx + i) & (g_num_malloc - 1)];
+        log_bank = log_buffer[LOG_SLOT_IDX(log_write_seq + i)].log;
         func("[%2d]:", i);
         if (log_bank.bank == DBG_SWDIAG_WQ_COMMON_LOG) {
             func((char *)log_bank.fmt, log_bank.value0, log_bank.value1, log_bank.value2);
@@ -23,6 +23,11 @@ extern "C" {
 
 #include "iot_clock.h"
 
+/* start the load governor with the default configuration at boot */
+#ifndef CONFIG_DFS_GOV_ENABLE
+#define CONFIG_DFS_GOV_ENABLE       0
+#endif
+
 typedef enum {
     DFS_HOOK_TYPE_PRE = 0,
     DFS_HOOK_TYPE_POST,
@@ -43,6 +48,93 @@ typedef struct {
     uint32_t init_timeout_ms;
 } dfs_init_cfg_t;
 
+/**
+ * @brief dfs statistics, times in us
+ * req_cnt: start/stop requests processed
+ * switch_cnt: clock mode switches
+ * pending_cnt: switches deferred until the flash program/erase is done
+ * last_latency: request post to clock mode switched, of the last switch
+ * max_latency: max request post to clock mode switched
+ * max_resolve: max time to resolve the clock mode of a request
+ * timeout_rearm_cnt: times the timeout timer was re-armed
+ * gov_level: IOT_CLOCK_CORE the governor asks for dtop/bt, 0 when it's off
+ * gov_load: busy percent of the last governor window
+ */
+typedef struct {
+    uint32_t req_cnt;
+    uint32_t switch_cnt;
+    uint32_t pending_cnt;
+    uint32_t last_latency;
+    uint32_t max_latency;
+    uint32_t max_resolve;
+    uint32_t timeout_rearm_cnt;
+    uint8_t gov_level;
+    uint8_t gov_load;
+} dfs_stats_t;
+
+/**
+ * @brief dfs load governor configuration
+ * window_ms: busy time sampling window
+ * target_load: busy percent to run at, the governor picks the lowest dtop/bt
+ *              clock that keeps the predicted load under it
+ * down_windows: windows in a row asking for less before the clock goes down
+ * burst_load: busy percent of a window taken as saturated, the real demand is
+ *             unknown then, so the clock steps up to twice the measured one at
+ *             once; 0 turns it off
+ * floor_mhz: lowest dtop/bt clock the governor asks for, short bursts of an
+ *            otherwise idle core run at it without waiting for a window
+ */
+typedef struct {
+    uint16_t window_ms;
+    uint8_t target_load;
+    uint8_t down_windows;
+    uint8_t burst_load;
+    uint8_t floor_mhz;
+} dfs_gov_cfg_t;
+
+/** @brief switch time histogram buckets, bucket n holds switches below
+ *         2^(n+5) us, the last bucket takes the rest. */
+#define DFS_TRACE_HIST_NUM          10
+#define DFS_TRACE_MAGIC             0x5444  /* "DT" */
+#define DFS_TRACE_VERSION           1
+
+/* dfs_trace_rec_t.obj of the switches not asked by a dfs object */
+#define DFS_TRACE_OBJ_GOV           0xFFFE
+#define DFS_TRACE_OBJ_PM            0xFFFF
+
+/* dfs_trace_rec_t.flags */
+#define DFS_TRACE_FLAG_STOP         (1 << 0)    /* obj was stopped, else started */
+#define DFS_TRACE_FLAG_PENDING      (1 << 1)    /* deferred until the flash program/erase done */
+
+/**
+ * @brief dfs transition trace, the header is followed by rec_num records,
+ *        oldest first, all little endian. Times in us, saturated to 0xFFFF.
+ */
+typedef struct {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t rec_num;
+    uint32_t seq;               /* transitions so far, the last record is seq - 1 */
+    uint8_t curr_mode;
+    uint8_t hist_num;
+    uint16_t sfc_busy;          /* switches deferred for the flash program/erase */
+    uint16_t mode_miss;         /* deferred switches overwritten by a newer mode */
+    uint16_t reserved;
+    uint16_t hist[DFS_TRACE_HIST_NUM];
+} __attribute__((packed)) dfs_trace_hdr_t;
+
+typedef struct {
+    uint32_t ts;                /* iot_timer_get_time() at the switch start */
+    uint16_t obj;               /* DFS_OBJ of the last request, or DFS_TRACE_OBJ_xx */
+    uint8_t src_mode;
+    uint8_t dst_mode;
+    uint16_t bt_wait;           /* waiting for bt core suspended */
+    uint16_t ack_wait;          /* waiting for the dsp pm lock ipc ack */
+    uint16_t switch_time;       /* whole switch, the other cores are stalled */
+    uint8_t flags;
+    uint8_t pending;            /* requests folded into a deferred switch */
+} __attribute__((packed)) dfs_trace_rec_t;
+
 /**
  * @brief dfs hook function type
  * @param src_mode source clock core mode
@@ -67,6 +159,43 @@ uint8_t dfs_init(dfs_init_cfg_t *cfg);
  */
 void dfs_deinit(void);
 
+/**
+ * @brief start the load governor. The dtop/bt clock follows the busy time of
+ * this core, the started dfs objects are the floor and shared fixed objects
+ * still pin the clock.
+ * @param cfg governor configuration, NULL for the default
+ * @return RET_OK or other failure return value
+ */
+uint8_t dfs_governor_start(const dfs_gov_cfg_t *cfg);
+
+/**
+ * @brief stop the load governor, the clock goes back to the dfs objects
+ */
+void dfs_governor_stop(void);
+
+/**
+ * @brief get dfs statistics
+ * @param stats statistics output
+ */
+void dfs_get_stats(dfs_stats_t *stats);
+
+/**
+ * @brief get the transition trace, a dfs_trace_hdr_t and the newest records
+ * that fit in the buffer
+ * @param buf output buffer
+ * @param len buffer length, at least sizeof(dfs_trace_hdr_t)
+ * @return bytes filled, 0 if the buffer is too short
+ */
+uint32_t dfs_trace_get(uint8_t *buf, uint32_t len);
+
+/**
+ * @brief export the whole transition trace through generic transmission as
+ * GENERIC_TRANSMISSION_DATA_TYPE_TRACE, in the dfs_trace_get() format. It
+ * waits for the fifo up to 200ms, so call it in task context.
+ * @return RET_OK, RET_BUSY if the fifo stayed full, or other failure value
+ */
+uint8_t dfs_trace_export(void);
+
 /**
  * @brief for rpc implement
  * @param src_core source cpu core id
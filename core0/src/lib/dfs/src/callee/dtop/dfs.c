@@ -13,6 +13,7 @@ Information is free from patent or copyright infringement.
 
 ****************************************************************************/
 #include "types.h"
+#include "string.h"
 #include "lib_dbglog.h"
 #include "generic_list.h"
 #include "modules.h"
@@ -23,8 +24,11 @@ Information is free from patent or copyright infringement.
 #include "os_lock.h"
 #include "os_mem.h"
 #include "os_timer.h"
+#include "os_task.h"
+#include "os_utils.h"
 
 #include "iot_rtc.h"
+#include "iot_timer.h"
 #include "iot_clock.h"
 #include "iot_flash.h"
 #include "iot_ipc.h"
@@ -35,6 +39,9 @@ Information is free from patent or copyright infringement.
 
 #include "dfs.h"
 
+#include "generic_transmission_api.h"
+#include "generic_transmission_config.h"
+
 #include "storage_controller.h"
 
 #ifdef LOW_POWER_ENABLE
@@ -50,6 +57,36 @@ Information is free from patent or copyright infringement.
 #define CONFIG_DFS_DEBUG_SFC_BUSY   1
 #endif
 
+/* transition trace records, must be power of 2 */
+#ifndef CONFIG_DFS_TRACE_NUM
+#define CONFIG_DFS_TRACE_NUM        32
+#endif
+
+/* trace export waits this long for the generic transmission fifo to drain */
+#define DFS_TRACE_EXPORT_RETRY_MS   10
+#define DFS_TRACE_EXPORT_RETRY_MAX  20
+
+/* governor defaults, see dfs_gov_cfg_t */
+#ifndef CONFIG_DFS_GOV_WINDOW_MS
+#define CONFIG_DFS_GOV_WINDOW_MS    50
+#endif
+
+#ifndef CONFIG_DFS_GOV_TARGET_LOAD
+#define CONFIG_DFS_GOV_TARGET_LOAD  90
+#endif
+
+#ifndef CONFIG_DFS_GOV_DOWN_WINDOWS
+#define CONFIG_DFS_GOV_DOWN_WINDOWS 4
+#endif
+
+#ifndef CONFIG_DFS_GOV_BURST_LOAD
+#define CONFIG_DFS_GOV_BURST_LOAD   95
+#endif
+
+#ifndef CONFIG_DFS_GOV_FLOOR_MHZ
+#define CONFIG_DFS_GOV_FLOOR_MHZ    32
+#endif
+
 #define DFS_OBJ_SHARED_FIXED_MASK   ((1<<(DFS_OBJ_SHARED_FIXED_END - DFS_OBJ_SHARED_FIXED_START)) - 1)
 
 
@@ -59,6 +96,9 @@ Information is free from patent or copyright infringement.
 #define DFS_OBJ_BT_NUM              (DFS_OBJ_BT_END - DFS_OBJ_BT_START)
 #define DFS_OBJ_DTOP_NUM            (DFS_OBJ_DTOP_END - DFS_OBJ_DTOP_START)
 
+#define DFS_OBJ_TAB_NUM             (DFS_OBJ_SHARED_FIXED_NUM + DFS_OBJ_SHARED_ATLEAST_NUM + \
+                                     DFS_OBJ_DSP_NUM + DFS_OBJ_BT_NUM + DFS_OBJ_DTOP_NUM)
+
 #define DFS_OBJ_GRP_SHARED_FIXED_OFFSET(obj)    ((obj) - DFS_OBJ_SHARED_FIXED_START)
 #define DFS_OBJ_GRP_SHARED_ATLEAST_OFFSET(obj)  ((obj) - DFS_OBJ_SHARED_ATLEAST_START)
 #define DFS_OBJ_GRP_DSP_OFFSET(obj)             ((obj) - DFS_OBJ_DSP_START)
@@ -67,9 +107,31 @@ Information is free from patent or copyright infringement.
 
 #define DFS_TIMEOUT_MS_MIN          5UL
 #define DFS_TIMEOUT_MS_MARGIN       30UL
+/* due timeouts taken per timer expiry */
+#define DFS_TIMEOUT_BATCH           8
+#define DFS_TIMEOUT_POS_NONE        0xFF
 
 #define DFS_PMM_PD_ST_ON            0x4
 
+/* clock domains, same as the core_id of iot_clock_get_core_clock_by_mode() */
+#define DFS_DOMAIN_DTOP             0
+#define DFS_DOMAIN_BT               1
+#define DFS_DOMAIN_DSP              2
+#define DFS_DOMAIN_NUM              3
+
+/* fixed objects are resolved alone, all the others together */
+#define DFS_DEMAND_FIXED            0
+#define DFS_DEMAND_SHARED           1
+#define DFS_DEMAND_NUM              2
+
+#ifdef static_assert
+static_assert(IOT_CLOCK_CORE_MAX <= 16, dfs_c);
+static_assert(IOT_CLOCK_MODE_MAX <= 0xFF, dfs_c);
+static_assert(DFS_OBJ_TAB_NUM < DFS_TIMEOUT_POS_NONE, dfs_c);
+static_assert(CONFIG_DFS_TRACE_NUM && (CONFIG_DFS_TRACE_NUM & (CONFIG_DFS_TRACE_NUM - 1)) == 0, dfs_c);
+static_assert(CONFIG_DFS_TRACE_NUM <= 0xFF, dfs_c);
+#endif
+
 typedef enum {
     DFS_KV_ID_CFG = LIB_DFS_BASE_ID,
 } DFS_KV_ID;
@@ -93,6 +155,7 @@ typedef struct {
             uint8_t src_core;
             uint16_t obj;
             uint8_t act;
+            uint32_t req_ts;
             union {
                 struct {
                     uint32_t timeout_ms;
@@ -100,7 +163,9 @@ typedef struct {
                 uint32_t val;
             } op_param_u;
         } dfs_req;
-        /* DFS_SHARE_TASK_MSG_CMD_PM_RESTORE has no parameters, no param definition here */
+        /* DFS_SHARE_TASK_MSG_CMD_PM_RESTORE has no parameters,
+         * no param definition here
+         */
     } param_u;
 } dfs_share_task_msg_t;
 
@@ -117,14 +182,43 @@ typedef struct {
     uint32_t obj_mask;
     const IOT_CLOCK_MODE *tab_p;
     uint32_t tab_len;
+    /* first entry of this group in dfs_env_t.obj_clk */
+    uint8_t clk_base;
 } dfs_obj_env_t;
 
+/* clock demand of the active objects, kept up to date on every start/stop */
+typedef struct {
+    /* active objects at each clock level of each domain */
+    uint8_t cnt[DFS_DOMAIN_NUM][IOT_CLOCK_CORE_MAX];
+    /* bit n is set when cnt[domain][n] is not 0 */
+    uint16_t level_mask[DFS_DOMAIN_NUM];
+} dfs_demand_t;
+
 typedef struct {
-    struct list_head node;
-    uint8_t obj;
     uint32_t end_ts;
+    uint8_t obj;
+    /* position in dfs_env_t.timeout_heap, DFS_TIMEOUT_POS_NONE if not pending */
+    uint8_t heap_pos;
 } dfs_timeout_item_t;
 
+/* load governor, dtop and bt share the clock so one level covers both */
+typedef struct {
+    dfs_gov_cfg_t cfg;
+    timer_id_t timer;
+    uint32_t last_idle;
+    uint32_t last_total;
+    /* smoothed demand, MHz x percent */
+    uint32_t avg_demand;
+    uint32_t req_ts;
+    /* dtop clock level asked for, 0 when the governor is off */
+    uint8_t level;
+    uint8_t down_cnt;
+    uint8_t down_level;
+    uint8_t load;
+    /* level update, queued once however many windows ask for it */
+    iot_share_work_t work;
+} dfs_gov_t;
+
 typedef struct {
     os_mutex_h mutex;
     os_sem_h ipc_ack_sem_dsp;
@@ -143,6 +237,18 @@ typedef struct {
     uint8_t curr_mode;
     uint8_t pending_mode;
     dfs_obj_env_t obj_env[DFS_OBJ_GRP_NUM];
+    /* clock level of each object per domain, built from tab_p in dfs_init */
+    uint8_t obj_clk[DFS_OBJ_TAB_NUM][DFS_DOMAIN_NUM];
+    dfs_demand_t demand[DFS_DEMAND_NUM];
+    /* clock mode by dtop(=bt) and dsp clock level */
+    uint8_t mode_tab[IOT_CLOCK_CORE_MAX][IOT_CLOCK_CORE_MAX];
+    uint32_t pending_ts;
+    /* requester of the pending mode and the requests folded into it */
+    uint16_t pending_obj;
+    uint8_t pending_flags;
+    uint8_t pending_num;
+    dfs_stats_t stats;
+    dfs_gov_t gov;
 #if CONFIG_DFS_DEBUG_SFC_BUSY
     uint32_t sfc_busy_count;
     uint32_t mode_miss_count;
@@ -152,9 +258,18 @@ typedef struct {
     struct pm_operation dfs_pm;
     dfs_share_task_msg_t pm_restore_msg;
 #endif
-    struct list_head timeout_list;
+    /* timeout of each object by dense table index, and a min-heap of them */
+    dfs_timeout_item_t timeout_item[DFS_OBJ_TAB_NUM];
+    uint8_t timeout_heap[DFS_OBJ_TAB_NUM];
+    uint8_t timeout_num;
+    bool timeout_armed;
+    uint32_t timeout_armed_ts;
+    uint32_t timeout_rearm_cnt;
     timer_id_t timeout_timer;
-    uint8_t timeout_obj;
+    /* transition ring, trace_seq & (CONFIG_DFS_TRACE_NUM - 1) is the next one */
+    dfs_trace_rec_t trace[CONFIG_DFS_TRACE_NUM];
+    uint32_t trace_seq;
+    uint16_t trace_hist[DFS_TRACE_HIST_NUM];
 } dfs_env_t;
 
 static const IOT_CLOCK_MODE s_dfs_shared_fixed_table[DFS_OBJ_SHARED_FIXED_NUM] = {
@@ -299,6 +414,17 @@ static const IOT_CLOCK_MODE s_dfs_dtop_table_music_32m_disable[DFS_OBJ_DTOP_NUM]
 };
 /* =======================  DFS table for disable 32M music end =========================== */
 
+static const uint8_t s_dfs_clk_mhz[IOT_CLOCK_CORE_MAX] = {
+    [IOT_CLOCK_CORE_16M]    = 16,
+    [IOT_CLOCK_CORE_32M]    = 32,
+    [IOT_CLOCK_CORE_48M]    = 48,
+    [IOT_CLOCK_CORE_64M]    = 64,
+    [IOT_CLOCK_CORE_80M]    = 80,
+    [IOT_CLOCK_CORE_96M]    = 96,
+    [IOT_CLOCK_CORE_128M]   = 128,
+    [IOT_CLOCK_CORE_160M]   = 160,
+};
+
 static dfs_persistent_env_t s_dfs_persist_env = {
     .mutex = NULL,
     .ipc_ack_sem_dsp = NULL,
@@ -341,7 +467,6 @@ static dfs_env_t s_dfs_env = {
     .mode_miss_count = 0,
 #endif
     .hooks = {NULL},
-    .timeout_obj = DFS_OBJ_MAX,
 };
 
 static inline bool dfs_is_shared_fixed_obj(DFS_OBJ obj)
@@ -378,6 +503,116 @@ static bool dfs_obj_grp_info_get(DFS_OBJ obj,
     return true;
 }
 
+static void dfs_demand_update(uint8_t obj_grp_idx, uint8_t idx, bool add)
+{
+    dfs_demand_t *demand = &s_dfs_env.demand[obj_grp_idx == DFS_OBJ_GRP_SHARED_FIXED_IDX ?
+                                             DFS_DEMAND_FIXED : DFS_DEMAND_SHARED];
+    const uint8_t *clk = s_dfs_env.obj_clk[s_dfs_env.obj_env[obj_grp_idx].clk_base + idx];
+
+    for (uint8_t domain = 0; domain < DFS_DOMAIN_NUM; domain++) {
+        uint8_t level = clk[domain];
+
+        if (add) {
+            if (demand->cnt[domain][level]++ == 0) {
+                demand->level_mask[domain] |= (uint16_t)(1 << level);
+            }
+        } else {
+            assert(demand->cnt[domain][level] != 0);
+            if (--demand->cnt[domain][level] == 0) {
+                demand->level_mask[domain] &= (uint16_t)~(1 << level);
+            }
+        }
+    }
+}
+
+static inline uint8_t dfs_demand_top(const dfs_demand_t *demand, uint8_t domain)
+{
+    /* 16M is the floor even if no object asks for this domain */
+    return (uint8_t)(31 - __builtin_clz(demand->level_mask[domain] | (1 << IOT_CLOCK_CORE_16M)));
+}
+
+/* the objects are floors, gov_level raises dtop(=bt) to the lowest level at or
+ * above it that has a mode with the dsp clock.
+ */
+static IOT_CLOCK_MODE dfs_demand_resolve(const dfs_demand_t *demand, uint8_t gov_level)
+{
+    uint8_t dtop_clk = dfs_demand_top(demand, DFS_DOMAIN_DTOP);
+    uint8_t dsp_clk = dfs_demand_top(demand, DFS_DOMAIN_DSP);
+
+    assert(dtop_clk == dfs_demand_top(demand, DFS_DOMAIN_BT));
+
+    for (uint8_t clk = gov_level; clk > dtop_clk && clk < IOT_CLOCK_CORE_MAX; clk++) {
+        if (s_dfs_env.mode_tab[clk][dsp_clk] != IOT_CLOCK_MODE_MAX) {
+            return (IOT_CLOCK_MODE)s_dfs_env.mode_tab[clk][dsp_clk];
+        }
+    }
+
+    return (IOT_CLOCK_MODE)s_dfs_env.mode_tab[dtop_clk][dsp_clk];
+}
+
+/* build the per object clock levels and the mode table from the dfs tables,
+ * then the demand of the objects already started before deinit.
+ */
+static void dfs_resolver_init(void)
+{
+    uint8_t clk_base = 0;
+    uint16_t level_mask[DFS_DOMAIN_NUM];
+
+    for (uint8_t domain = 0; domain < DFS_DOMAIN_NUM; domain++) {
+        level_mask[domain] = (uint16_t)(1 << IOT_CLOCK_CORE_16M);
+    }
+
+    for (uint8_t obj_grp_idx = 0; obj_grp_idx < DFS_OBJ_GRP_NUM; obj_grp_idx++) {
+        dfs_obj_env_t *obj_env = &s_dfs_env.obj_env[obj_grp_idx];
+
+        obj_env->clk_base = clk_base;
+        for (uint8_t idx = 0; idx < obj_env->tab_len; idx++) {
+            uint8_t *clk = s_dfs_env.obj_clk[clk_base + idx];
+
+            for (uint8_t domain = 0; domain < DFS_DOMAIN_NUM; domain++) {
+                clk[domain] = (uint8_t)iot_clock_get_core_clock_by_mode(obj_env->tab_p[idx],
+                                                                        domain);
+                assert(clk[domain] < IOT_CLOCK_CORE_MAX);
+                level_mask[domain] |= (uint16_t)(1 << clk[domain]);
+            }
+        }
+        clk_base += obj_env->tab_len;
+    }
+    assert(clk_base == DFS_OBJ_TAB_NUM);
+
+    /* only the levels some object asks for can be resolved */
+    level_mask[DFS_DOMAIN_DTOP] |= level_mask[DFS_DOMAIN_BT];
+    for (uint8_t dtop_clk = 0; dtop_clk < IOT_CLOCK_CORE_MAX; dtop_clk++) {
+        for (uint8_t dsp_clk = 0; dsp_clk < IOT_CLOCK_CORE_MAX; dsp_clk++) {
+            if ((level_mask[DFS_DOMAIN_DTOP] & (1 << dtop_clk)) &&
+                    (level_mask[DFS_DOMAIN_DSP] & (1 << dsp_clk))) {
+                s_dfs_env.mode_tab[dtop_clk][dsp_clk] = (uint8_t)iot_clock_get_mode_by_core_clock(
+                    (IOT_CLOCK_CORE)dtop_clk, (IOT_CLOCK_CORE)dtop_clk, (IOT_CLOCK_CORE)dsp_clk);
+            } else {
+                s_dfs_env.mode_tab[dtop_clk][dsp_clk] = IOT_CLOCK_MODE_MAX;
+            }
+        }
+    }
+
+    memset(s_dfs_env.demand, 0, sizeof(s_dfs_env.demand));
+    for (uint8_t obj_grp_idx = 0; obj_grp_idx < DFS_OBJ_GRP_NUM; obj_grp_idx++) {
+        for (uint8_t idx = 0; idx < s_dfs_env.obj_env[obj_grp_idx].tab_len; idx++) {
+            if (s_dfs_env.obj_env[obj_grp_idx].obj_mask & (1<<idx)) {
+                dfs_demand_update(obj_grp_idx, idx, true);
+            }
+        }
+    }
+}
+
+static void dfs_stats_switch_done(uint32_t req_ts)
+{
+    uint32_t latency = iot_timer_get_time() - req_ts;
+
+    s_dfs_env.stats.switch_cnt++;
+    s_dfs_env.stats.last_latency = latency;
+    s_dfs_env.stats.max_latency = MAX(s_dfs_env.stats.max_latency, latency);
+}
+
 static bool dfs_obj_mask_check_and_set(DFS_OBJ obj)
 {
     uint8_t obj_grp_idx = 0;
@@ -392,6 +627,7 @@ static bool dfs_obj_mask_check_and_set(DFS_OBJ obj)
     }
 
     s_dfs_env.obj_env[obj_grp_idx].obj_mask |= (1<<(obj - obj_grp_start));
+    dfs_demand_update(obj_grp_idx, obj - obj_grp_start, true);
 
     return true;
 }
@@ -410,6 +646,7 @@ static bool dfs_obj_mask_check_and_clear(DFS_OBJ obj)
     }
 
     s_dfs_env.obj_env[obj_grp_idx].obj_mask &= ~(1<<(obj - obj_grp_start));
+    dfs_demand_update(obj_grp_idx, obj - obj_grp_start, false);
 
     return true;
 }
@@ -424,22 +661,58 @@ static void dfs_pm_lock_ipc_ack_cb(IPC_CORES src_cpu)
     }
 }
 
-static void dfs_set_clock_mode(IOT_CLOCK_MODE src_mode, IOT_CLOCK_MODE dst_mode, uint32_t wakeup_core_mask)
+/* with the dfs mutex held, rec->ts is the switch start and the waits are
+ * durations so far
+ */
+static void dfs_trace_add(dfs_trace_rec_t *rec, uint32_t end_ts)
+{
+    uint32_t switch_time = end_ts - rec->ts;
+    int32_t bucket;
+
+    //bucket n: switch_time < 2^(n + 5) us
+    bucket = switch_time ? (int32_t)(32 - __builtin_clz(switch_time)) - 5 : 0;
+    bucket = MIN(MAX(bucket, 0), DFS_TRACE_HIST_NUM - 1);
+    if (s_dfs_env.trace_hist[bucket] != 0xFFFF) {
+        s_dfs_env.trace_hist[bucket]++;
+    }
+
+    rec->switch_time = (uint16_t)MIN(switch_time, 0xFFFF);
+    s_dfs_env.trace[s_dfs_env.trace_seq & (CONFIG_DFS_TRACE_NUM - 1)] = *rec;
+    s_dfs_env.trace_seq++;
+}
+
+static void dfs_set_clock_mode(IOT_CLOCK_MODE src_mode, IOT_CLOCK_MODE dst_mode,
+                               uint32_t wakeup_core_mask, uint16_t obj, uint8_t flags,
+                               uint8_t pending)
 {
     uint8_t dummy_data;
+    uint32_t ts;
+    dfs_trace_rec_t rec;
     dfs_hook_t pre_hook = s_dfs_env.hooks[DFS_HOOK_TYPE_PRE];
     dfs_hook_t post_hook = s_dfs_env.hooks[DFS_HOOK_TYPE_POST];
 
+    rec.ts = iot_timer_get_time();
+    rec.obj = obj;
+    rec.src_mode = (uint8_t)src_mode;
+    rec.dst_mode = (uint8_t)dst_mode;
+    rec.bt_wait = 0;
+    rec.ack_wait = 0;
+    rec.flags = flags;
+    rec.pending = pending;
+
     if (wakeup_core_mask & (1<<BT_CORE)) {
         iot_suspend_sched_wait_core_suspend(BT_CORE);
+        rec.bt_wait = (uint16_t)MIN(iot_timer_get_time() - rec.ts, 0xFFFF);
     }
 
     if (wakeup_core_mask & (1<<AUD_CORE)) {
+        ts = iot_timer_get_time();
         while (iot_ipc_send_message(AUD_CORE, IPC_TYPE_PM_LOCK,
                                     &dummy_data, sizeof(dummy_data), true) != RET_OK) {
             /* nothing, just try until ipc send ok */
         }
         os_pend_semaphore(s_dfs_persist_env.ipc_ack_sem_dsp, 0xFFFFFFFF);
+        rec.ack_wait = (uint16_t)MIN(iot_timer_get_time() - ts, 0xFFFF);
     }
 
     if (pre_hook != NULL) {
@@ -459,6 +732,8 @@ static void dfs_set_clock_mode(IOT_CLOCK_MODE src_mode, IOT_CLOCK_MODE dst_mode,
     if (wakeup_core_mask & (1<<AUD_CORE)) {
         iot_ipc_finsh_keep_wakeup(AUD_CORE);
     }
+
+    dfs_trace_add(&rec, iot_timer_get_time());
 }
 
 static void dfs_pending_list_handler(void)
@@ -478,10 +753,14 @@ static void dfs_pending_list_handler(void)
 
     if (s_dfs_env.pending_mode != IOT_CLOCK_MODE_MAX) {
         dfs_set_clock_mode(s_dfs_env.curr_mode, s_dfs_env.pending_mode,
-                           ((1<<BT_CORE)|(1<<AUD_CORE)));
+                           ((1<<BT_CORE)|(1<<AUD_CORE)), s_dfs_env.pending_obj,
+                           s_dfs_env.pending_flags | DFS_TRACE_FLAG_PENDING,
+                           s_dfs_env.pending_num);
 
         s_dfs_env.curr_mode = s_dfs_env.pending_mode;
         s_dfs_env.pending_mode = IOT_CLOCK_MODE_MAX;
+        s_dfs_env.stats.pending_cnt++;
+        dfs_stats_switch_done(s_dfs_env.pending_ts);
     }
 
     os_release_mutex(s_dfs_persist_env.mutex);
@@ -489,66 +768,136 @@ static void dfs_pending_list_handler(void)
     DBGLOG_LIB_INFO("[DFS] pending update clock to mode %d!!\n", mode);
 }
 
-static inline dfs_timeout_item_t *dfs_timeout_first_item(void)
+static inline bool dfs_timeout_before(uint32_t ts, uint32_t ref)
 {
-    if (list_empty(&s_dfs_env.timeout_list)) {
-        return NULL;
+    return (int32_t)(ts - ref) < 0;
+}
+
+/* dense index of obj in the dfs tables, also the index of its timeout item */
+static uint8_t dfs_obj_tab_idx(DFS_OBJ obj)
+{
+    uint8_t obj_grp_idx = 0;
+    uint8_t obj_grp_start = 0;
+
+    if (dfs_obj_grp_info_get(obj, &obj_grp_idx, &obj_grp_start) == false) {
+        return DFS_TIMEOUT_POS_NONE;
     }
 
-    return list_entry(s_dfs_env.timeout_list.next, dfs_timeout_item_t, node);
+    return s_dfs_env.obj_env[obj_grp_idx].clk_base + (obj - obj_grp_start);
 }
 
-static void dfs_timeout_restart_timer(bool force)
+/* min-heap on end_ts, the callers hold the critical section */
+static void dfs_timeout_heap_set(uint8_t pos, uint8_t idx)
 {
-    uint32_t period;
+    s_dfs_env.timeout_heap[pos] = idx;
+    s_dfs_env.timeout_item[idx].heap_pos = pos;
+}
 
-    cpu_critical_enter();
+static void dfs_timeout_heap_up(uint8_t pos)
+{
+    uint8_t idx = s_dfs_env.timeout_heap[pos];
+    uint32_t end_ts = s_dfs_env.timeout_item[idx].end_ts;
 
-    if (list_empty(&s_dfs_env.timeout_list)) {
-        s_dfs_env.timeout_obj = DFS_OBJ_MAX;
-        goto _stop_timer;
-    } else {
-        dfs_timeout_item_t *first_item = dfs_timeout_first_item();
+    while (pos > 0) {
+        uint8_t parent = (uint8_t)((pos - 1) / 2);
+
+        if (!dfs_timeout_before(end_ts,
+                                s_dfs_env.timeout_item[s_dfs_env.timeout_heap[parent]].end_ts)) {
+            break;
+        }
+        dfs_timeout_heap_set(pos, s_dfs_env.timeout_heap[parent]);
+        pos = parent;
+    }
+    dfs_timeout_heap_set(pos, idx);
+}
 
-        if (force || s_dfs_env.timeout_obj != first_item->obj) {
-            s_dfs_env.timeout_obj = first_item->obj;
+static void dfs_timeout_heap_down(uint8_t pos)
+{
+    uint8_t idx = s_dfs_env.timeout_heap[pos];
+    uint32_t end_ts = s_dfs_env.timeout_item[idx].end_ts;
 
-            /* always make timer trigger to let it process in timer handler */
-            period = first_item->end_ts - iot_rtc_get_global_time_ms();
-            if (period < DFS_TIMEOUT_MS_MIN || period > DFS_TIMEOUT_MS_MAX) {
-                period = DFS_TIMEOUT_MS_MIN;
-            }
+    for (;;) {
+        uint8_t child = (uint8_t)(pos * 2 + 1);
 
-            goto _restart_timer;
-        } else {
-            //do nothing
+        if (child >= s_dfs_env.timeout_num) {
+            break;
+        }
+        if (child + 1 < s_dfs_env.timeout_num &&
+                dfs_timeout_before(s_dfs_env.timeout_item[s_dfs_env.timeout_heap[child + 1]].end_ts,
+                                   s_dfs_env.timeout_item[s_dfs_env.timeout_heap[child]].end_ts)) {
+            child++;
         }
+        if (!dfs_timeout_before(s_dfs_env.timeout_item[s_dfs_env.timeout_heap[child]].end_ts,
+                                end_ts)) {
+            break;
+        }
+        dfs_timeout_heap_set(pos, s_dfs_env.timeout_heap[child]);
+        pos = child;
     }
+    dfs_timeout_heap_set(pos, idx);
+}
 
-    cpu_critical_exit();
+static void dfs_timeout_heap_remove(uint8_t idx)
+{
+    uint8_t pos = s_dfs_env.timeout_item[idx].heap_pos;
+    uint8_t last;
 
-    return;
+    s_dfs_env.timeout_item[idx].heap_pos = DFS_TIMEOUT_POS_NONE;
+    last = s_dfs_env.timeout_heap[--s_dfs_env.timeout_num];
+    if (last == idx) {
+        return;
+    }
 
-_stop_timer:
-    cpu_critical_exit();
+    dfs_timeout_heap_set(pos, last);
+    dfs_timeout_heap_up(pos);
+    dfs_timeout_heap_down(s_dfs_env.timeout_item[last].heap_pos);
+}
 
-    os_stop_timer(s_dfs_env.timeout_timer);
+/* The timer is only re-armed when the head gets earlier than the armed time.
+ * A head removed or pushed later leaves the timer as it is, the handler finds
+ * nothing due then and re-arms for the new head.
+ */
+static void dfs_timeout_restart_timer(void)
+{
+    uint32_t period = 0;
+    bool stop = false;
 
-    return;
+    cpu_critical_enter();
 
-_restart_timer:
-    cpu_critical_exit();
+    if (s_dfs_env.timeout_num == 0) {
+        stop = s_dfs_env.timeout_armed;
+        s_dfs_env.timeout_armed = false;
+    } else {
+        uint32_t end_ts = s_dfs_env.timeout_item[s_dfs_env.timeout_heap[0]].end_ts;
 
-    os_stop_timer(s_dfs_env.timeout_timer);
-    os_start_timer(s_dfs_env.timeout_timer, period);
+        if (!s_dfs_env.timeout_armed || dfs_timeout_before(end_ts, s_dfs_env.timeout_armed_ts)) {
+            s_dfs_env.timeout_armed = true;
+            s_dfs_env.timeout_armed_ts = end_ts;
+
+            /* always make timer trigger to let it process in timer handler */
+            period = end_ts - iot_rtc_get_global_time_ms();
+            if (period < DFS_TIMEOUT_MS_MIN || period > DFS_TIMEOUT_MS_MAX) {
+                period = DFS_TIMEOUT_MS_MIN;
+            }
+        }
+    }
 
-    return;
+    cpu_critical_exit();
+
+    if (stop) {
+        os_stop_timer(s_dfs_env.timeout_timer);
+    } else if (period != 0) {
+        s_dfs_env.timeout_rearm_cnt++;
+        os_stop_timer(s_dfs_env.timeout_timer);
+        os_start_timer(s_dfs_env.timeout_timer, period);
+    }
 }
 
 static void dfs_timeout_handler(timer_id_t timer_id, void * arg)
 {
-    dfs_timeout_item_t *first_item;
-    uint8_t obj = DFS_OBJ_MAX;
+    uint8_t expired[DFS_TIMEOUT_BATCH];
+    uint8_t num = 0;
+    uint32_t now;
 
     UNUSED(timer_id);
     UNUSED(arg);
@@ -559,115 +908,85 @@ static void dfs_timeout_handler(timer_id_t timer_id, void * arg)
 
     cpu_critical_enter();
 
-    first_item = dfs_timeout_first_item();
+    s_dfs_env.timeout_armed = false;
+    now = iot_rtc_get_global_time_ms();
 
-    /* current node is valid and the end ts is past, then remove it */
-    if (s_dfs_env.timeout_obj < DFS_OBJ_MAX && first_item != NULL) {
+    /* take the items due or due within the margin, the rest re-arm the timer */
+    while (num < DFS_TIMEOUT_BATCH && s_dfs_env.timeout_num != 0) {
+        uint8_t idx = s_dfs_env.timeout_heap[0];
 
-        /* do not remove the check, because if the dfs_timeout_handler is already happen, and
-         * preempt current task when it do dfs_timeout_add/modifiy.
-         */
-        if (s_dfs_env.timeout_obj == first_item->obj &&
-                (first_item->end_ts - iot_rtc_get_global_time_ms() <= DFS_TIMEOUT_MS_MARGIN ||
-                 iot_rtc_get_global_time_ms() - first_item->end_ts <= DFS_TIMEOUT_MS_MAX)) {
-            obj = s_dfs_env.timeout_obj;
-            s_dfs_env.timeout_obj = DFS_OBJ_MAX;
+        if ((int32_t)(s_dfs_env.timeout_item[idx].end_ts - now) > (int32_t)DFS_TIMEOUT_MS_MARGIN) {
+            break;
         }
+        expired[num++] = s_dfs_env.timeout_item[idx].obj;
+        dfs_timeout_heap_remove(idx);
     }
 
     cpu_critical_exit();
 
-    if (obj < DFS_OBJ_MAX) {
-        DBGLOG_LIB_INFO("[DFS] TO stop obj %d !!\n", obj);
+    dfs_timeout_restart_timer();
 
-        while (dfs_request_impl(cpu_get_mhartid(), obj, DFS_ACT_STOP, 0) != RET_OK);
-    } else {
-        /* Do nothing. As desgin, do not restart timer in dfs_timeout_handler.
-         * Enter here means the timeout handler is suddenly preempt before restart timer
-         * in dfs_timeout_add, then dfs_timeout_add will restart timer.
-         */
-        DBGLOG_LIB_INFO("[DFS] TO ignore obj %d/%d ts %d/%d !!\n",
-                        s_dfs_env.timeout_obj, (first_item ? first_item->obj : DFS_OBJ_MAX),
-                        iot_rtc_get_global_time_ms(), (first_item ? first_item->end_ts : 0));
+    for (uint8_t i = 0; i < num; i++) {
+        DBGLOG_LIB_INFO("[DFS] TO stop obj %d !!\n", expired[i]);
+
+        while (dfs_request_impl(cpu_get_mhartid(), expired[i], DFS_ACT_STOP, 0) != RET_OK);
     }
 }
 
 static void dfs_timeout_add(uint32_t obj, uint32_t timeout)
 {
-    struct list_head *saved;
-    dfs_timeout_item_t *new_item;
-    dfs_timeout_item_t *item;
-    bool found = false;
+    uint8_t idx;
 
     if (timeout == 0) {
         return;
     }
 
-    new_item = (dfs_timeout_item_t *)os_mem_malloc(UNKNOWN_MID, sizeof(dfs_timeout_item_t));
-    assert(new_item != NULL);
-
-    new_item->obj = obj;
-    new_item->end_ts = (uint32_t)(iot_rtc_get_global_time_ms() + timeout);
+    idx = dfs_obj_tab_idx((DFS_OBJ)obj);
+    assert(idx < DFS_OBJ_TAB_NUM);
 
     cpu_critical_enter();
 
-    list_for_each_entry_safe(item, &s_dfs_env.timeout_list, node, saved) {
-        //look for the item which end ts is just after new item end ts
-        if (item->end_ts - new_item->end_ts <= DFS_TIMEOUT_MS_MAX) {
-            found = true;
-            //insert before current head
-            list_add_tail(&new_item->node, &item->node);
-            break;
-        }
-    }
+    s_dfs_env.timeout_item[idx].obj = (uint8_t)obj;
+    s_dfs_env.timeout_item[idx].end_ts = (uint32_t)(iot_rtc_get_global_time_ms() + timeout);
 
-    if (!found) {
-        //append to list tail
-        list_add_tail(&new_item->node, &s_dfs_env.timeout_list);
+    if (s_dfs_env.timeout_item[idx].heap_pos == DFS_TIMEOUT_POS_NONE) {
+        dfs_timeout_heap_set(s_dfs_env.timeout_num++, idx);
+        dfs_timeout_heap_up(s_dfs_env.timeout_item[idx].heap_pos);
+    } else {
+        /* stale item, a stop always deletes it, re-sort with the new end_ts */
+        dfs_timeout_heap_up(s_dfs_env.timeout_item[idx].heap_pos);
+        dfs_timeout_heap_down(s_dfs_env.timeout_item[idx].heap_pos);
     }
 
     cpu_critical_exit();
 
-    dfs_timeout_restart_timer(false);
+    dfs_timeout_restart_timer();
 }
 
 static void dfs_timeout_del(uint32_t obj)
 {
-    struct list_head *saved;
-    dfs_timeout_item_t *item;
-    dfs_timeout_item_t *free_item = NULL;
-
-    cpu_critical_enter();
+    uint8_t idx = dfs_obj_tab_idx((DFS_OBJ)obj);
 
-    list_for_each_entry_safe(item, &s_dfs_env.timeout_list, node, saved) {
-        if (item->obj == obj) {
-            list_del(&item->node);
-            free_item = item;
+    assert(idx < DFS_OBJ_TAB_NUM);
 
-            if (s_dfs_env.timeout_obj == obj) {
-                s_dfs_env.timeout_obj = DFS_OBJ_MAX;
-            }
+    cpu_critical_enter();
 
-            break;
-        }
+    if (s_dfs_env.timeout_item[idx].heap_pos != DFS_TIMEOUT_POS_NONE) {
+        dfs_timeout_heap_remove(idx);
     }
 
     cpu_critical_exit();
 
-    if (free_item != NULL) {
-        os_mem_free(free_item);
-    }
-
-    dfs_timeout_restart_timer(false);
+    dfs_timeout_restart_timer();
 }
 
 static void dfs_timeout_modify(uint32_t obj, uint32_t timeout)
 {
-    struct list_head *saved;
-    dfs_timeout_item_t *item;
-    dfs_timeout_item_t *free_item = NULL;
+    uint8_t idx = dfs_obj_tab_idx((DFS_OBJ)obj);
     uint32_t new_ts;
 
+    assert(idx < DFS_OBJ_TAB_NUM);
+
     /* always use the longest ts end, timeout 0 is treat forever as large enough.
      * 1. previous end_ts is before new ts ---> new
      * 2. previous end_ts is after new ts --->  previous
@@ -677,64 +996,100 @@ static void dfs_timeout_modify(uint32_t obj, uint32_t timeout)
 
     cpu_critical_enter();
 
-    list_for_each_entry_safe(item, &s_dfs_env.timeout_list, node, saved) {
-        if (item->obj == obj) {
-            if (timeout == 0) {
-                list_del(&item->node);
-                free_item = item;
-            } else if (new_ts - item->end_ts <= DFS_TIMEOUT_MS_MAX) {
-                item->end_ts = new_ts;
-            } else {
-                //do nothing
-            }
-            break;
+    if (s_dfs_env.timeout_item[idx].heap_pos != DFS_TIMEOUT_POS_NONE) {
+        if (timeout == 0) {
+            dfs_timeout_heap_remove(idx);
+        } else if (dfs_timeout_before(s_dfs_env.timeout_item[idx].end_ts, new_ts)) {
+            s_dfs_env.timeout_item[idx].end_ts = new_ts;
+            dfs_timeout_heap_down(s_dfs_env.timeout_item[idx].heap_pos);
+        } else {
+            //do nothing
         }
     }
 
     cpu_critical_exit();
 
-    if (free_item) {
-        os_mem_free(item);
-    }
-
-    dfs_timeout_restart_timer(true);
+    dfs_timeout_restart_timer();
 }
 
 static void dfs_timeout_clear_all(void)
 {
-    struct list_head tmp_list;
-    struct list_head *saved;
-    dfs_timeout_item_t *item;
-
     os_stop_timer(s_dfs_env.timeout_timer);
 
-    list_init(&tmp_list);
-
-    /* critical protect for list walk, then mem free from tmp list */
     cpu_critical_enter();
-    list_for_each_entry_safe(item, &s_dfs_env.timeout_list, node, saved) {
-        list_del(&item->node);
-        list_add_tail(&item->node, &tmp_list);
+
+    for (uint8_t idx = 0; idx < DFS_OBJ_TAB_NUM; idx++) {
+        s_dfs_env.timeout_item[idx].heap_pos = DFS_TIMEOUT_POS_NONE;
     }
+    s_dfs_env.timeout_num = 0;
+    s_dfs_env.timeout_armed = false;
+
     cpu_critical_exit();
+}
+
+/* switch to new_mode with the dfs mutex held.
+ * return RET_OK switched, RET_EXIST already in new_mode, RET_BUSY deferred until
+ * the flash program/erase is done.
+ */
+static uint32_t dfs_switch_mode(IOT_CLOCK_MODE new_mode, uint32_t wakeup_core_mask,
+                                uint32_t req_ts, uint16_t obj, uint8_t flags)
+{
+    if (new_mode == s_dfs_env.curr_mode) {
+        return RET_EXIST;
+    }
 
-    list_for_each_entry_safe(item, &tmp_list, node, saved) {
-        list_del(&item->node);
-        os_mem_free(item);
+#if CONFIG_DFS_DEBUG_SFC_BUSY
+    if (s_dfs_env.pending_mode != IOT_CLOCK_MODE_MAX) {
+        s_dfs_env.mode_miss_count++;
+    }
+#endif
+    /* 1. whatever the pending_mode is, always use the new mode overwrite it.
+     *    This is dut to that the middle value is no meaningful when pe callback
+     *    is calling.
+     * 2. It's more safe that set pending mode before pe check and clear it if pe check fail.
+     * 3. The latency counts from the oldest request still waiting for a switch.
+     */
+    if (s_dfs_env.pending_mode == IOT_CLOCK_MODE_MAX) {
+        s_dfs_env.pending_ts = req_ts;
+        s_dfs_env.pending_num = 0;
+    }
+    s_dfs_env.pending_mode = new_mode;
+    s_dfs_env.pending_obj = obj;
+    s_dfs_env.pending_flags = flags;
+    if (s_dfs_env.pending_num != 0xFF) {
+        s_dfs_env.pending_num++;
     }
+    iot_flash_register_pe_callback(dfs_pending_list_handler);
+
+    if (iot_flash_is_pe_in_progress()) {
+#if CONFIG_DFS_DEBUG_SFC_BUSY
+        s_dfs_env.sfc_busy_count++;
+#endif
+        return RET_BUSY;
+    }
+
+    iot_flash_unregister_pe_callback();
+    s_dfs_env.pending_mode = IOT_CLOCK_MODE_MAX;
+
+    dfs_set_clock_mode(s_dfs_env.curr_mode, new_mode, wakeup_core_mask, obj, flags, 0);
+
+    s_dfs_env.curr_mode = new_mode;
+    dfs_stats_switch_done(req_ts);
+
+    return RET_OK;
 }
 
 static uint32_t dfs_request_process(uint32_t obj,
                                     uint32_t act,
                                     uint32_t param,
-                                    uint32_t wakeup_core_mask)
+                                    uint32_t wakeup_core_mask,
+                                    uint32_t req_ts)
 {
     IOT_CLOCK_MODE new_mode;
-    IOT_CLOCK_CORE new_dtop_clk = IOT_CLOCK_CORE_16M;
-    IOT_CLOCK_CORE new_bt_clk = IOT_CLOCK_CORE_16M;
-    IOT_CLOCK_CORE new_dsp_clk = IOT_CLOCK_CORE_16M;
-    uint8_t obj_grp_idx_start;
-    uint8_t obj_grp_idx_num;
+    const dfs_demand_t *demand;
+    uint8_t gov_level;
+    uint32_t resolve_ts;
+    uint32_t ret;
 
     if (obj >= DFS_OBJ_MAX) {
         return RET_INVAL;
@@ -751,6 +1106,9 @@ static uint32_t dfs_request_process(uint32_t obj,
         return RET_NOT_READY;
     }
 
+    s_dfs_env.stats.req_cnt++;
+    resolve_ts = iot_timer_get_time();
+
     if (act == DFS_ACT_START) {
         if (dfs_obj_mask_check_and_set(obj) == false) {
             dfs_timeout_modify(obj, param);
@@ -771,45 +1129,23 @@ static uint32_t dfs_request_process(uint32_t obj,
     if (dfs_is_shared_fixed_obj(obj) &&
             (s_dfs_env.obj_env[DFS_OBJ_GRP_SHARED_FIXED_IDX].obj_mask &
                 DFS_OBJ_SHARED_FIXED_MASK) != 0) {
-        obj_grp_idx_start = DFS_OBJ_GRP_SHARED_FIXED_IDX;
-        obj_grp_idx_num = 1;
+        demand = &s_dfs_env.demand[DFS_DEMAND_FIXED];
+        gov_level = 0;
     } else {
         if ((s_dfs_env.obj_env[DFS_OBJ_GRP_SHARED_FIXED_IDX].obj_mask &
                 DFS_OBJ_SHARED_FIXED_MASK) != 0) {
             os_release_mutex(s_dfs_persist_env.mutex);
             return RET_PENDING;
         } else {
-            obj_grp_idx_start = DFS_OBJ_GRP_SHARED_ATLEAST_IDX;
-            obj_grp_idx_num = DFS_OBJ_GRP_NUM;
+            demand = &s_dfs_env.demand[DFS_DEMAND_SHARED];
+            gov_level = s_dfs_env.gov.level;
         }
     }
 
-    for (uint8_t obj_grp_idx = obj_grp_idx_start; obj_grp_idx < obj_grp_idx_num; obj_grp_idx++) {
+    new_mode = dfs_demand_resolve(demand, gov_level);
 
-        if (s_dfs_env.obj_env[obj_grp_idx].obj_mask == 0) {
-            continue;
-        }
-
-        for (uint8_t idx = 0; idx < s_dfs_env.obj_env[obj_grp_idx].tab_len; idx++) {
-            if (s_dfs_env.obj_env[obj_grp_idx].obj_mask & (1<<idx)) {
-                const IOT_CLOCK_MODE *dfs_tab_p = s_dfs_env.obj_env[obj_grp_idx].tab_p;
-
-                IOT_CLOCK_CORE dtop_clk = iot_clock_get_core_clock_by_mode(dfs_tab_p[idx], 0);
-                IOT_CLOCK_CORE bt_clk = iot_clock_get_core_clock_by_mode(dfs_tab_p[idx], 1);
-                IOT_CLOCK_CORE dsp_clk = iot_clock_get_core_clock_by_mode(dfs_tab_p[idx], 2);
-
-                new_dtop_clk = (new_dtop_clk > dtop_clk ? new_dtop_clk : dtop_clk);
-                new_bt_clk = (new_bt_clk > bt_clk ? new_bt_clk : bt_clk);
-                new_dsp_clk = (new_dsp_clk > dsp_clk ? new_dsp_clk : dsp_clk);
-            }
-        }
-    }
-
-    assert(new_dtop_clk == new_bt_clk);
-
-    new_mode = iot_clock_get_mode_by_core_clock(new_dtop_clk,
-                                            new_bt_clk,
-                                            new_dsp_clk);
+    resolve_ts = iot_timer_get_time() - resolve_ts;
+    s_dfs_env.stats.max_resolve = MAX(s_dfs_env.stats.max_resolve, resolve_ts);
 
     if (new_mode >= IOT_CLOCK_MODE_MAX) {
         os_release_mutex(s_dfs_persist_env.mutex);
@@ -824,43 +1160,26 @@ static uint32_t dfs_request_process(uint32_t obj,
         return RET_FAIL;
     }
 
-    if (new_mode != s_dfs_env.curr_mode) {
-#if CONFIG_DFS_DEBUG_SFC_BUSY
-        if (s_dfs_env.pending_mode != IOT_CLOCK_MODE_MAX) {
-            s_dfs_env.mode_miss_count++;
-        }
-#endif
-        /* 1. whatever the pending_mode is, always use the new mode overwrite it.
-         *    This is dut to that the middle value is no meaningful when pe callback
-         *    is calling.
-         * 2. It's more safe that set pending mode before pe check and clear it if pe check fail.
-         */
-        s_dfs_env.pending_mode = new_mode;
-        iot_flash_register_pe_callback(dfs_pending_list_handler);
+    ret = dfs_switch_mode(new_mode, wakeup_core_mask, req_ts, (uint16_t)obj,
+                          (act == DFS_ACT_STOP ? DFS_TRACE_FLAG_STOP : 0));
 
-        if (iot_flash_is_pe_in_progress()) {
-            os_release_mutex(s_dfs_persist_env.mutex);
+    os_release_mutex(s_dfs_persist_env.mutex);
+
+    if (ret == RET_BUSY) {
 #if CONFIG_DFS_DEBUG_SFC_BUSY
-            s_dfs_env.sfc_busy_count++;
-            DBGLOG_LIB_INFO("[DFS] update clock in flash busy c %d/%d, obj %u, act %u, mask %x %x %x %x %x!!\n",
-                            s_dfs_env.sfc_busy_count, s_dfs_env.mode_miss_count,
-                            obj, act,
-                            s_dfs_env.obj_env[DFS_OBJ_GRP_SHARED_FIXED_IDX].obj_mask,
-                            s_dfs_env.obj_env[DFS_OBJ_GRP_SHARED_ATLEAST_IDX].obj_mask,
-                            s_dfs_env.obj_env[DFS_OBJ_GRP_DSP_IDX].obj_mask,
-                            s_dfs_env.obj_env[DFS_OBJ_GRP_BT_IDX].obj_mask,
-                            s_dfs_env.obj_env[DFS_OBJ_GRP_DTOP_IDX].obj_mask);
+        DBGLOG_LIB_INFO("[DFS] update clock in flash busy c %d/%d, obj %u, act %u, mask %x %x %x %x %x!!\n",
+                        s_dfs_env.sfc_busy_count, s_dfs_env.mode_miss_count,
+                        obj, act,
+                        s_dfs_env.obj_env[DFS_OBJ_GRP_SHARED_FIXED_IDX].obj_mask,
+                        s_dfs_env.obj_env[DFS_OBJ_GRP_SHARED_ATLEAST_IDX].obj_mask,
+                        s_dfs_env.obj_env[DFS_OBJ_GRP_DSP_IDX].obj_mask,
+                        s_dfs_env.obj_env[DFS_OBJ_GRP_BT_IDX].obj_mask,
+                        s_dfs_env.obj_env[DFS_OBJ_GRP_DTOP_IDX].obj_mask);
 #endif
-            return RET_BUSY;
-        }
-
-        iot_flash_unregister_pe_callback();
-        s_dfs_env.pending_mode = IOT_CLOCK_MODE_MAX;
-
-        dfs_set_clock_mode(s_dfs_env.curr_mode, new_mode, wakeup_core_mask);
-
-        s_dfs_env.curr_mode = new_mode;
+        return RET_BUSY;
+    }
 
+    if (ret == RET_OK) {
         DBGLOG_LIB_INFO("[auto][DFS] update clock to mode %d, obj %u, act %u, mask %x %x %x %x %x!!\n",
                         new_mode, obj, act,
                         s_dfs_env.obj_env[DFS_OBJ_GRP_SHARED_FIXED_IDX].obj_mask,
@@ -878,12 +1197,154 @@ static uint32_t dfs_request_process(uint32_t obj,
                         s_dfs_env.obj_env[DFS_OBJ_GRP_DTOP_IDX].obj_mask);
     }
 
+    return RET_OK;
+}
+
+/* lowest dtop clock level at or above the floor that runs the predicted demand
+ * at the target load
+ */
+static uint8_t dfs_gov_level_get(uint32_t demand)
+{
+    for (uint8_t clk = IOT_CLOCK_CORE_16M; clk < IOT_CLOCK_CORE_MAX; clk++) {
+        if (s_dfs_clk_mhz[clk] != 0 && s_dfs_clk_mhz[clk] >= s_dfs_env.gov.cfg.floor_mhz &&
+                (uint32_t)s_dfs_clk_mhz[clk] * s_dfs_env.gov.cfg.target_load >= demand) {
+            return clk;
+        }
+    }
+
+    return IOT_CLOCK_CORE_160M;
+}
+
+static void dfs_gov_timer_handler(timer_id_t timer_id, void *arg)
+{
+    dfs_gov_t *gov = &s_dfs_env.gov;
+    uint32_t total;
+    uint32_t idle;
+    uint32_t span;
+    uint32_t busy;
+    uint32_t demand;
+    uint8_t level;
+
+    UNUSED(timer_id);
+    UNUSED(arg);
+
+    if (s_dfs_env.status != DFS_ST_READY || gov->level == 0) {
+        return;
+    }
+
+    /* called in timer task, the idle run time is up to date */
+    idle = os_get_idle_run_time(&total);
+    span = total - gov->last_total;
+    busy = span - MIN(idle - gov->last_idle, span);
+    gov->last_total = total;
+    gov->last_idle = idle;
+
+    if (span == 0) {
+        return;
+    }
+
+    /* the busy time was spent at the current dtop clock, scale it to MHz */
+    gov->load = (uint8_t)(busy * 100 / span);
+    demand = (uint32_t)gov->load *
+             s_dfs_clk_mhz[iot_clock_get_core_clock_by_mode(s_dfs_env.curr_mode, DFS_DOMAIN_DTOP)];
+
+    if (gov->cfg.burst_load != 0 && gov->load >= gov->cfg.burst_load) {
+        /* saturated, the work left over is not in the busy time. Step up at
+         * once to twice the clock it ran at, don't wait for the average.
+         */
+        gov->avg_demand = MAX(gov->avg_demand, demand);
+        gov->down_cnt = 0;
+        level = dfs_gov_level_get(demand * 2);
+        if (level <= gov->level) {
+            return;
+        }
+        gov->level = level;
+        gov->req_ts = iot_timer_get_time();
+        iot_share_task_queue_work(IOT_SHARE_TASK_QUEUE_HP, &gov->work);
+        return;
+    }
+
+    /* go up on the higher of this window and the average, go down only after
+     * down_windows windows asked for less, to the highest of them.
+     */
+    gov->avg_demand = (gov->avg_demand + demand) / 2;
+    level = dfs_gov_level_get(MAX(demand, gov->avg_demand));
+
+    if (level >= gov->level) {
+        gov->down_cnt = 0;
+        if (level == gov->level) {
+            return;
+        }
+    } else {
+        gov->down_level = (gov->down_cnt == 0 ? level : MAX(gov->down_level, level));
+        if (++gov->down_cnt < gov->cfg.down_windows) {
+            return;
+        }
+        gov->down_cnt = 0;
+        level = gov->down_level;
+    }
+
+    gov->level = level;
+    gov->req_ts = iot_timer_get_time();
+
+    iot_share_task_queue_work(IOT_SHARE_TASK_QUEUE_HP, &gov->work);
+}
+
+static void dfs_gov_process(void)
+{
+    IOT_CLOCK_MODE new_mode;
+    uint32_t ret = RET_EXIST;
+    uint8_t level;
+
+    os_acquire_mutex(s_dfs_persist_env.mutex);
+
+    if (s_dfs_env.status != DFS_ST_READY) {
+        os_release_mutex(s_dfs_persist_env.mutex);
+        return;
+    }
+
+    level = s_dfs_env.gov.level;
+
+    /* fixed objects pin the clock, the next start/stop picks the level up */
+    if ((s_dfs_env.obj_env[DFS_OBJ_GRP_SHARED_FIXED_IDX].obj_mask & DFS_OBJ_SHARED_FIXED_MASK) == 0) {
+        new_mode = dfs_demand_resolve(&s_dfs_env.demand[DFS_DEMAND_SHARED], level);
+        if (new_mode < IOT_CLOCK_MODE_MAX) {
+            ret = dfs_switch_mode(new_mode, ((1<<BT_CORE) | (1<<AUD_CORE)), s_dfs_env.gov.req_ts,
+                                  DFS_TRACE_OBJ_GOV, 0);
+        }
+    }
+
     os_release_mutex(s_dfs_persist_env.mutex);
 
-    return RET_OK;
+    if (ret != RET_EXIST) {
+        DBGLOG_LIB_INFO("[DFS] gov load %d%% level %d, mode %d ret %d\n",
+                        s_dfs_env.gov.load, level, s_dfs_env.curr_mode, ret);
+    }
 }
 
-static uint32_t dfs_request_in_share_task(uint32_t src_core, uint32_t obj, uint32_t act, uint32_t param)
+static void dfs_gov_work_func(iot_share_work_t *work)
+{
+    UNUSED(work);
+
+    dfs_gov_process();
+}
+
+/* with the dfs mutex held */
+static void dfs_gov_stop_locked(void)
+{
+    if (s_dfs_env.gov.timer == (timer_id_t)NULL) {
+        return;
+    }
+
+    os_stop_timer(s_dfs_env.gov.timer);
+    os_delete_timer(s_dfs_env.gov.timer);
+    s_dfs_env.gov.timer = (timer_id_t)NULL;
+    iot_share_task_cancel_work(&s_dfs_env.gov.work);
+    s_dfs_env.gov.level = 0;
+}
+
+static uint32_t dfs_request_in_share_task(uint32_t src_core, uint32_t obj, uint32_t act,
+                                          uint32_t param, uint32_t req_ts)
 {
     uint32_t wakeup_core_mask;
 #if CONFIG_DFS_WAKEUP_ALL
@@ -893,7 +1354,7 @@ static uint32_t dfs_request_in_share_task(uint32_t src_core, uint32_t obj, uint3
     wakeup_core_mask = (src_core == DTOP_CORE ? ((1<<BT_CORE) | (1<<AUD_CORE)) :
             (src_core == BT_CORE ? (1<<AUD_CORE) : (1<<BT_CORE)));
 #endif
-    return dfs_request_process(obj, act, param, wakeup_core_mask);
+    return dfs_request_process(obj, act, param, wakeup_core_mask, req_ts);
 }
 
 static void dfs_share_task_handler(void *arg)
@@ -905,7 +1366,8 @@ static void dfs_share_task_handler(void *arg)
         dfs_request_in_share_task(msg->param_u.dfs_req.src_core,
                                     msg->param_u.dfs_req.obj,
                                     msg->param_u.dfs_req.act,
-                                    msg->param_u.dfs_req.op_param_u.val);
+                                    msg->param_u.dfs_req.op_param_u.val,
+                                    msg->param_u.dfs_req.req_ts);
         os_mem_free(msg);
         break;
 #ifdef LOW_POWER_ENABLE
@@ -920,7 +1382,8 @@ static void dfs_share_task_handler(void *arg)
                 return;
             }
 
-            dfs_set_clock_mode(IOT_CLOCK_MODE_0, s_dfs_env.curr_mode, wakeup_core_mask);
+            dfs_set_clock_mode(IOT_CLOCK_MODE_0, s_dfs_env.curr_mode, wakeup_core_mask,
+                               DFS_TRACE_OBJ_PM, 0, 0);
             os_release_mutex(s_dfs_persist_env.mutex);
         }
 
@@ -950,6 +1413,7 @@ uint32_t dfs_request_impl(uint32_t src_core, uint32_t obj, uint32_t act, uint32_
     msg->param_u.dfs_req.src_core = (uint8_t)src_core;
     msg->param_u.dfs_req.obj = (uint16_t)obj;
     msg->param_u.dfs_req.act = (uint8_t)act;
+    msg->param_u.dfs_req.req_ts = iot_timer_get_time();
     msg->param_u.dfs_req.op_param_u.val = param;
 
     ret = iot_share_task_post_msg(IOT_SHARE_TASK_QUEUE_HP, s_dfs_persist_env.share_task_msg_id, msg);
@@ -961,6 +1425,182 @@ uint32_t dfs_request_impl(uint32_t src_core, uint32_t obj, uint32_t act, uint32_
     return (ret ? RET_OK : RET_FAIL);
 }
 
+uint8_t dfs_governor_start(const dfs_gov_cfg_t *cfg)
+{
+    dfs_gov_t *gov = &s_dfs_env.gov;
+
+    if (cfg != NULL && (cfg->window_ms == 0 || cfg->target_load == 0 ||
+                        cfg->target_load > 100 || cfg->down_windows == 0 ||
+                        cfg->burst_load > 100 || cfg->floor_mhz > 160)) {
+        return RET_INVAL;
+    }
+
+    assert(s_dfs_persist_env.mutex != NULL);
+
+    os_acquire_mutex(s_dfs_persist_env.mutex);
+
+    if (s_dfs_env.status != DFS_ST_READY) {
+        os_release_mutex(s_dfs_persist_env.mutex);
+        return RET_NOT_READY;
+    }
+
+    if (gov->timer != (timer_id_t)NULL) {
+        os_release_mutex(s_dfs_persist_env.mutex);
+        return RET_EXIST;
+    }
+
+    if (cfg != NULL) {
+        gov->cfg = *cfg;
+    } else {
+        gov->cfg.window_ms = CONFIG_DFS_GOV_WINDOW_MS;
+        gov->cfg.target_load = CONFIG_DFS_GOV_TARGET_LOAD;
+        gov->cfg.down_windows = CONFIG_DFS_GOV_DOWN_WINDOWS;
+        gov->cfg.burst_load = CONFIG_DFS_GOV_BURST_LOAD;
+        gov->cfg.floor_mhz = CONFIG_DFS_GOV_FLOOR_MHZ;
+    }
+
+    gov->timer = os_create_timer(UNKNOWN_MID, true, dfs_gov_timer_handler, NULL);
+    if (gov->timer == (timer_id_t)NULL) {
+        os_release_mutex(s_dfs_persist_env.mutex);
+        return RET_NOMEM;
+    }
+
+    gov->last_idle = os_get_idle_run_time(&gov->last_total);
+    gov->avg_demand = 0;
+    gov->down_cnt = 0;
+    gov->load = 0;
+    gov->level = dfs_gov_level_get(0);
+    iot_share_task_init_work(&gov->work, dfs_gov_work_func);
+
+    os_start_timer(gov->timer, gov->cfg.window_ms);
+
+    os_release_mutex(s_dfs_persist_env.mutex);
+
+    DBGLOG_LIB_INFO("[DFS] gov start, window %dms target %d%% down %d burst %d%% floor %dM\n",
+                    gov->cfg.window_ms, gov->cfg.target_load, gov->cfg.down_windows,
+                    gov->cfg.burst_load, gov->cfg.floor_mhz);
+
+    return RET_OK;
+}
+
+void dfs_governor_stop(void)
+{
+    assert(s_dfs_persist_env.mutex != NULL);
+
+    os_acquire_mutex(s_dfs_persist_env.mutex);
+
+    if (s_dfs_env.gov.timer == (timer_id_t)NULL) {
+        os_release_mutex(s_dfs_persist_env.mutex);
+        return;
+    }
+
+    dfs_gov_stop_locked();
+
+    os_release_mutex(s_dfs_persist_env.mutex);
+
+    /* back to the floor of the objects */
+    dfs_gov_process();
+
+    DBGLOG_LIB_INFO("[DFS] gov stop\n");
+}
+
+void dfs_get_stats(dfs_stats_t *stats)
+{
+    assert(stats);
+
+    cpu_critical_enter();
+    *stats = s_dfs_env.stats;
+    stats->gov_level = s_dfs_env.gov.level;
+    stats->gov_load = s_dfs_env.gov.load;
+    stats->timeout_rearm_cnt = s_dfs_env.timeout_rearm_cnt;
+    cpu_critical_exit();
+}
+
+/* header and the newest rec_max records to buf, return the length */
+static uint32_t dfs_trace_fill(uint8_t *buf, uint32_t rec_max)
+{
+    dfs_trace_hdr_t *hdr = (dfs_trace_hdr_t *)buf;
+    dfs_trace_rec_t *rec = (dfs_trace_rec_t *)(hdr + 1);
+    uint32_t seq;
+    uint32_t num;
+
+    os_acquire_mutex(s_dfs_persist_env.mutex);
+
+    seq = s_dfs_env.trace_seq;
+    num = MIN(MIN(seq, CONFIG_DFS_TRACE_NUM), rec_max);
+
+    hdr->magic = DFS_TRACE_MAGIC;
+    hdr->version = DFS_TRACE_VERSION;
+    hdr->rec_num = (uint8_t)num;
+    hdr->seq = seq;
+    hdr->curr_mode = s_dfs_env.curr_mode;
+    hdr->hist_num = DFS_TRACE_HIST_NUM;
+#if CONFIG_DFS_DEBUG_SFC_BUSY
+    hdr->sfc_busy = (uint16_t)MIN(s_dfs_env.sfc_busy_count, 0xFFFF);
+    hdr->mode_miss = (uint16_t)MIN(s_dfs_env.mode_miss_count, 0xFFFF);
+#else
+    hdr->sfc_busy = 0;
+    hdr->mode_miss = 0;
+#endif
+    hdr->reserved = 0;
+    memcpy(hdr->hist, s_dfs_env.trace_hist, sizeof(hdr->hist));
+
+    for (uint32_t i = seq - num; i != seq; i++) {
+        *rec++ = s_dfs_env.trace[i & (CONFIG_DFS_TRACE_NUM - 1)];
+    }
+
+    os_release_mutex(s_dfs_persist_env.mutex);
+
+    return sizeof(dfs_trace_hdr_t) + num * sizeof(dfs_trace_rec_t);
+}
+
+uint32_t dfs_trace_get(uint8_t *buf, uint32_t len)
+{
+    assert(buf);
+
+    if (len < sizeof(dfs_trace_hdr_t) || s_dfs_persist_env.mutex == NULL) {
+        return 0;
+    }
+
+    return dfs_trace_fill(buf, (len - sizeof(dfs_trace_hdr_t)) / sizeof(dfs_trace_rec_t));
+}
+
+uint8_t dfs_trace_export(void)
+{
+    uint32_t len = sizeof(dfs_trace_hdr_t) + sizeof(dfs_trace_rec_t) * CONFIG_DFS_TRACE_NUM;
+    uint8_t *buf;
+    int32_t ret;
+
+    if (s_dfs_persist_env.mutex == NULL) {
+        return RET_NOT_READY;
+    }
+
+    buf = os_mem_malloc(UNKNOWN_MID, len);
+    if (buf == NULL) {
+        return RET_NOMEM;
+    }
+
+    len = dfs_trace_fill(buf, CONFIG_DFS_TRACE_NUM);
+    /* lazy tx takes the whole trace or nothing, wait for room when the fifo is full */
+    for (uint32_t i = 0;; i++) {
+        ret = generic_transmission_data_tx(GENERIC_TRANSMISSION_TX_MODE_LAZY,
+                                           GENERIC_TRANSMISSION_DATA_TYPE_TRACE, TRACE_TID,
+                                           GENERIC_TRANSMISSION_IO_UART0, buf, len, 0);
+        if (ret != -RET_NOMEM || i >= DFS_TRACE_EXPORT_RETRY_MAX) {
+            break;
+        }
+        os_delay(DFS_TRACE_EXPORT_RETRY_MS);
+    }
+    os_mem_free(buf);
+
+    if (ret == -RET_NOMEM) {
+        return RET_BUSY;
+    } else if (ret < 0) {
+        return RET_FAIL;
+    }
+    return RET_OK;
+}
+
 uint8_t dfs_hook_register(DFS_HOOK_TYPE type, dfs_hook_t hook)
 {
     if (type >= DFS_HOOK_TYPE_NUM) {
@@ -1044,13 +1684,14 @@ uint8_t dfs_init(dfs_init_cfg_t *cfg)
     }
 
     dfs_load_config();
+    dfs_resolver_init();
 
     iot_ipc_register_ack_cb(IPC_TYPE_PM_LOCK, dfs_pm_lock_ipc_ack_cb);
 
     s_dfs_env.timeout_timer = os_create_timer(UNKNOWN_MID, false, dfs_timeout_handler, NULL);
     assert(s_dfs_env.timeout_timer != (timer_id_t)NULL);
 
-    list_init(&s_dfs_env.timeout_list);
+    dfs_timeout_clear_all();
 
 #ifdef LOW_POWER_ENABLE
     list_init(&s_dfs_env.dfs_pm.node);
@@ -1065,7 +1706,8 @@ uint8_t dfs_init(dfs_init_cfg_t *cfg)
     if (cfg != NULL && cfg->init_timeout_ms <= DFS_TIMEOUT_MS_MAX) {
         iot_soc_bt_power_up();
         iot_dsp_power_on();
-        dfs_request_process(cfg->init_obj, DFS_ACT_START, cfg->init_timeout_ms, 0x0);
+        dfs_request_process(cfg->init_obj, DFS_ACT_START, cfg->init_timeout_ms, 0x0,
+                            iot_timer_get_time());
     }
 
     DBGLOG_LIB_INFO("[DFS] init!\n");
@@ -1091,6 +1733,7 @@ void dfs_deinit(void)
 #endif
     iot_ipc_unregister_ack_cb(IPC_TYPE_PM_LOCK);
 
+    dfs_gov_stop_locked();
     dfs_timeout_clear_all();
     os_delete_timer(s_dfs_env.timeout_timer);
     s_dfs_env.timeout_timer = (timer_id_t)NULL;
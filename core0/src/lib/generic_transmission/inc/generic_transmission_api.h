@@ -215,6 +215,7 @@ typedef enum {
     GENERIC_TRANSMISSION_DATA_TYPE_AUDIO_DUMP,
     GENERIC_TRANSMISSION_DATA_TYPE_PANIC_LOG,
     GENERIC_TRANSMISSION_DATA_TYPE_HCI_LOG,
+    GENERIC_TRANSMISSION_DATA_TYPE_TRACE,
     GENERIC_TRANSMISSION_DATA_TYPE_NUM,
 } generic_transmission_data_type_t;
 
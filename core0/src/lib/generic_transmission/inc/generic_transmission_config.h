@@ -22,5 +22,6 @@ Information is free from patent or copyright infringement.
 #define HCI_LOG_TID     GENERIC_TRANSMISSION_TID2
 #define DUMP_TID        GENERIC_TRANSMISSION_TID3
 #define CLI_TID         GENERIC_TRANSMISSION_TID4
+#define TRACE_TID       GENERIC_TRANSMISSION_TID5
 
 #endif /* _LIB_GENERIC_TRANSMISSION_CONFIG_H__ */
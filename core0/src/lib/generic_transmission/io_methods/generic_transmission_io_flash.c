@@ -29,8 +29,8 @@ Information is free from patent or copyright infringement.
 #include "generic_transmission_api.h"
 #include "generic_transmission_io_flash.h"
 
-/* flash log and ota use the same partition */
-#define FLASH_LOG_LIMIT_SIZE (FLASH_FOTA_SECTORS*0x1000UL)
+/* flash log and ota use the same partition, the core dump sectors at its end excluded */
+#define FLASH_LOG_LIMIT_SIZE ((FLASH_FOTA_SECTORS - FLASH_COREDUMP_SECTORS)*0x1000UL)
 #define FLASH_LOG_OFFSET (uint32_t)(FLASH_FOTA_OFFSET - FLASH_START)
 
 /* Log & Print configuration */
@@ -58,7 +58,12 @@ Information is free from patent or copyright infringement.
 
 /* Uart configuration */
 #define GENERIC_TRANSMISSION_DMA_TX_SIZE_ONCE_THRESHOLD 640
+#if CONFIG_GENERIC_TRANSMISSION_IO_UART_USE_DMA
+/* Rx dma ping-pong spans plus idle-line tail span */
+#define GENERIC_TRANSMISSION_UART_RX_BUF_SIZE           IOT_UART_RX_DMA_BUF_LEN
+#else
 #define GENERIC_TRANSMISSION_UART_RX_BUF_SIZE           256
+#endif
 
 /*lint -esym(754, generic_transmission_io_uart_cfg::*_pin) not referenced */
 struct generic_transmission_io_uart_cfg {
@@ -177,9 +182,10 @@ static void generic_transmission_io_uart_cfg_init(void)
     if (s_generic_transmission_io_uart_env.uart_cfg.use_dma) {
         iot_uart_dma_config_t dma_cfg;
 
-        dma_cfg.rx_use_dma = false;
+        dma_cfg.rx_use_dma = true;
         dma_cfg.tx_use_dma = true;
         dma_cfg.tx_priority = IOT_DMA_CH_PRIORITY_HIGH;
+        dma_cfg.rx_priority = IOT_DMA_CH_PRIORITY_HIGH;
         iot_uart_dma_config(CONFIG_GENERIC_TRANSMISSION_IO_UART_PORT, &dma_cfg);
 
         GENERIC_TRANSMISSION_IO_UART_LOGI("[GTP] Uart use dma\n");
@@ -209,9 +215,16 @@ static void generic_transmission_io_uart_cfg_init(void)
     }
     iot_uart_open(CONFIG_GENERIC_TRANSMISSION_IO_UART_PORT, &uart_cfg, &pin_cfg);
 
-    ret = iot_uart_register_rx_callback(
-        CONFIG_GENERIC_TRANSMISSION_IO_UART_PORT, s_generic_transmission_io_uart_env.rx_buf,
-        GENERIC_TRANSMISSION_UART_RX_BUF_SIZE, generic_transmission_io_uart_rx_handler);
+    if (s_generic_transmission_io_uart_env.uart_cfg.use_dma) {
+        // Spans are handed to generic_transmission_io_recv in place
+        ret = iot_uart_register_rx_dma_callback(
+            CONFIG_GENERIC_TRANSMISSION_IO_UART_PORT, s_generic_transmission_io_uart_env.rx_buf,
+            GENERIC_TRANSMISSION_UART_RX_BUF_SIZE, generic_transmission_io_uart_rx_handler);
+    } else {
+        ret = iot_uart_register_rx_callback(
+            CONFIG_GENERIC_TRANSMISSION_IO_UART_PORT, s_generic_transmission_io_uart_env.rx_buf,
+            GENERIC_TRANSMISSION_UART_RX_BUF_SIZE, generic_transmission_io_uart_rx_handler);
+    }
 
     if (ret != RET_OK) {
         GENERIC_TRANSMISSION_IO_UART_LOGI("[GTP] Register rx call back fail %d\n", ret);
@@ -228,6 +241,15 @@ static void generic_transmission_io_uart_cfg_init(void)
 
 static void generic_transmission_io_uart_cfg_deinit(void)
 {
+#if CONFIG_GENERIC_TRANSMISSION_IO_DEBUG
+    iot_uart_rx_stats_t stats;
+
+    iot_uart_get_rx_stats(CONFIG_GENERIC_TRANSMISSION_IO_UART_PORT, &stats);
+    GENERIC_TRANSMISSION_IO_UART_LOGI("[GTP] Uart rx %d bytes, spans %d, idle %d, ovf %d, lost %d\n",
+                                      stats.rx_bytes, stats.dma_span_cnt, stats.idle_flush_cnt,
+                                      stats.overflow_cnt, stats.dma_lost_cnt);
+#endif
+
     iot_uart_close(CONFIG_GENERIC_TRANSMISSION_IO_UART_PORT);
     iot_uart_deinit(CONFIG_GENERIC_TRANSMISSION_IO_UART_PORT);
 }
@@ -19,10 +19,26 @@ Information is free from patent or copyright infringement.
 #include "types.h"
 #include "stdio.h"
 #include "riscv_cpu.h"
+#include "iot_memory_config.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* binary core dump over generic transmission instead of base64 text lines */
+#ifndef CONFIG_COREDUMP_BIN
+#ifdef LIB_GENERIC_TRANSMISSION_ENABLE
+#define CONFIG_COREDUMP_BIN 1
+#else
+#define CONFIG_COREDUMP_BIN 0
+#endif
+#endif
+
+/* binary core dump kept in the FLASH_COREDUMP_SECTORS, uploaded after reboot.
+ * CONFIG_COREDUMP_FLASH is set with the flash layout in iot_memory_origin.h */
+#if CONFIG_COREDUMP_FLASH && !CONFIG_COREDUMP_BIN
+#error "CONFIG_COREDUMP_FLASH needs CONFIG_COREDUMP_BIN"
+#endif
+
 /**
  * @brief This function is call back function type define
  *
@@ -37,6 +53,77 @@ typedef int32_t (*iot_core_dump_callback)(const exception_info_t *info);
  */
 int32_t iot_task_dump_to_uart(const exception_info_t *info);
 
+/**
+ * @brief This function is used to write core dump information as binary frames
+ * through generic transmission. Zero/fill runs are elided, blocks are LZ coded
+ * and only the allocated heap blocks are written. See tools/coredump_decode.py.
+ *
+ * @return RET_OK or RET_FAIL.
+ */
+int32_t iot_task_dump_to_gtp(const exception_info_t *info);
+
+#if CONFIG_COREDUMP_FLASH
+/**
+ * @brief core dump kept in flash
+ * seq: dump number, counts up over reboots
+ * len: bytes of binary frames
+ * sector: first sector in the core dump ring
+ * uploaded: acked by the host with iot_core_dump_flash_ack()
+ * truncated: the ring was full, the tail of the dump is lost
+ */
+typedef struct _iot_core_dump_flash_info_t {
+    uint32_t seq;
+    uint32_t len;
+    uint32_t crc;
+    uint8_t sector;
+    uint8_t uploaded;
+    uint8_t truncated;
+    uint8_t reserved;
+} __attribute__((packed)) iot_core_dump_flash_info_t;
+
+/**
+ * @brief This function is used to write core dump information as binary frames
+ * into the flash core dump ring. The sectors were erased after the last boot,
+ * so only program is done in the crash path.
+ *
+ * @return RET_OK or RET_FAIL.
+ */
+int32_t iot_task_dump_to_flash(const exception_info_t *info);
+
+/**
+ * @brief scan the flash core dump ring and erase the free sectors in the
+ * background. Each dump is uploaded to uart0 once on the boot after it,
+ * unless CONFIG_COREDUMP_FLASH_AUTO_UPLOAD is 0, the others only with
+ * iot_core_dump_flash_upload(). Call it once after boot, with the share task
+ * running.
+ */
+void iot_core_dump_flash_init(void);
+
+/**
+ * @brief get the dumps kept in flash, oldest first
+ * @param info output array
+ * @param num entries of info
+ * @return entries filled
+ */
+uint32_t iot_core_dump_flash_get_info(iot_core_dump_flash_info_t *info, uint32_t num);
+
+/**
+ * @brief upload a dump in the background, as the DUMP_TID panic log packets
+ * of iot_task_dump_to_gtp(). The dumps not acked with a greater seq follow.
+ * @param seq seq of the dump
+ * @param io generic_transmission_io_t to send through
+ * @return RET_OK, RET_INVAL if no such dump, RET_BUSY if an upload is running
+ */
+uint8_t iot_core_dump_flash_upload(uint32_t seq, uint8_t io);
+
+/**
+ * @brief mark a dump received by the host, its sectors may be reused then
+ * @param seq seq of the dump
+ * @return RET_OK or RET_INVAL if no such dump
+ */
+uint8_t iot_core_dump_flash_ack(uint32_t seq);
+#endif
+
 /**
  * @brief   iot_core_dump_init - init coredump module.
  */
@@ -29,10 +29,23 @@ Information is free from patent or copyright infringement.
 #include "dbglog.h"
 #endif
 #include "iot_debounce.h"
+#ifdef LIB_GENERIC_TRANSMISSION_ENABLE
+#include "crc.h"
+#include "generic_transmission_api.h"
+#include "generic_transmission_config.h"
+#endif
+#if CONFIG_COREDUMP_FLASH
+#include "iot_flash.h"
+#include "iot_share_task.h"
+#include "os_lock.h"
+#endif
+
 #define COREDUMP_OK 0
 
 #define COREDUMP_MAX_TASK_STACK_SIZE        (64*1024)
 #define COREDUMP_VERSION                    1
+/* heap written as one segment per run of allocated blocks */
+#define COREDUMP_VERSION_SPARSE             2
 #define CONFIG_WQ_CORE_DUMP_MAX_TASKS_NUM  20
 
 #define IOT_COREDUMP_MAX_LOG_SIZE       256
@@ -92,6 +105,8 @@ typedef struct _core_dump_write_config_t {
     iot_core_dump_flash_write_data_t    write;
     // number of tasks with corrupted TCBs
     uint32_t                            bad_tasks_num;
+    // write the allocated heap blocks only
+    bool_t                              heap_sparse;
     // pointer to data which are specific for particular core dump emitter
     void                               *priv;
 } core_dump_write_config_t;
@@ -196,6 +211,68 @@ static inline bool iot_stack_ptr_is_sane(uint32_t sp)
 #endif
 }
 
+/** allocated heap blocks walk context, adjacent blocks are merged in a run */
+typedef struct _core_dump_heap_walk_t {
+    const core_dump_write_config_t *write_cfg;
+    uint32_t run_start;
+    uint32_t run_end;
+    uint32_t segment_id;
+    int err;
+} core_dump_heap_walk_t;
+
+static void iot_core_dump_heap_run_flush(core_dump_heap_walk_t *walk)
+{
+    core_dump_data_header_t data_hrd;
+
+    if (walk->run_end == walk->run_start) {
+        return;
+    }
+
+    data_hrd.segment_flag = HEAP_MEMORY_FLAG;
+    data_hrd.segment_id = walk->segment_id++;
+    data_hrd.segment_start = walk->run_start;
+    data_hrd.segment_end = walk->run_end;
+    walk->err |= walk->write_cfg->write(walk->write_cfg->priv, &data_hrd, sizeof(data_hrd));
+    walk->err |= walk->write_cfg->write(walk->write_cfg->priv, (void *)walk->run_start,
+                                        walk->run_end - walk->run_start);
+    walk->run_start = walk->run_end;
+}
+
+static bool_t iot_core_dump_heap_walk_cb(void *arg, void *block, uint32_t size, bool_t allocated)
+{
+    core_dump_heap_walk_t *walk = arg;
+    uint32_t addr = (uint32_t)block;
+
+    if (!allocated || addr != walk->run_end) {
+        iot_core_dump_heap_run_flush(walk);
+    }
+    if (allocated) {
+        if (walk->run_end != addr) {
+            walk->run_start = addr;
+        }
+        walk->run_end = addr + size;
+    }
+
+    return walk->err == COREDUMP_OK;
+}
+
+/**
+ * write the allocated heap blocks, allocator header included, one segment
+ * with an increasing segment_id per run of adjacent blocks. Free blocks
+ * are left out.
+ */
+static int iot_core_dump_heap_sparse(const core_dump_write_config_t *write_cfg)
+{
+    core_dump_heap_walk_t walk;
+
+    memset(&walk, 0, sizeof(walk));
+    walk.write_cfg = write_cfg;
+    os_mem_heap_walk_in_crash(iot_core_dump_heap_walk_cb, &walk);
+    iot_core_dump_heap_run_flush(&walk);
+
+    return walk.err;
+}
+
 static int iot_core_dump_segment(int segment_flag, const core_dump_write_config_t *write_cfg)
 {
     int err = 0;
@@ -241,6 +318,8 @@ static int iot_core_dump_segment(int segment_flag, const core_dump_write_config_
         dump_data.data_hrd.segment_end    = SHARE_MEMORY_START + SHARE_MEMORY_LENGTH;
         err |= write_cfg->write(write_cfg->priv, &dump_data, sizeof(core_dump_data_header_t));
         err |= write_cfg->write(write_cfg->priv, (void *)SHARE_MEMORY_START, SHARE_MEMORY_LENGTH);
+    } else if (segment_flag == HEAP_MEMORY_FLAG && write_cfg->heap_sparse) {
+        err |= iot_core_dump_heap_sparse(write_cfg);
     } else if (segment_flag == HEAP_MEMORY_FLAG) {
         dump_data.data_hrd.segment_start = (uint32_t)&_heap_start;
         dump_data.data_hrd.segment_end   = (uint32_t)&_heap_end;
@@ -377,7 +456,7 @@ static void iot_core_dump_write(const exception_info_t *info, core_dump_write_co
     }
     // write header
     dump_data.hdr.data_len  = data_len;
-    dump_data.hdr.version   = COREDUMP_VERSION;
+    dump_data.hdr.version   = write_cfg->heap_sparse ? COREDUMP_VERSION_SPARSE : COREDUMP_VERSION;
     dump_data.hdr.tasks_num = task_num - write_cfg->bad_tasks_num;
     dump_data.hdr.tcb_sz    = tcb_sz;
     err = write_cfg->write(write_cfg->priv, &dump_data, sizeof(core_dump_header_t));
@@ -517,13 +596,891 @@ int32_t iot_task_dump_to_uart(const exception_info_t *info)
     return 0;
 }
 
+#if CONFIG_COREDUMP_BIN
+/*
+ * Binary core dump. The stream of iot_core_dump_write() is cut in blocks,
+ * every block is sent as a frame, LZ coded when it gets smaller. Long runs
+ * of one byte, zeroed bss or 0xA5 filled stacks, are sent as fill frames
+ * straight from memory without staging. tools/coredump_decode.py rebuilds
+ * the stream and an ELF core from the frames.
+ */
+#define COREDUMP_BIN_MAGIC                  0x4443  /* "CD" */
+#define COREDUMP_BIN_VERSION                1
+#define COREDUMP_BIN_BLOCK_SIZE             1024
+#define COREDUMP_BIN_HASH_BITS              8
+#define COREDUMP_BIN_MIN_MATCH              4
+#define COREDUMP_BIN_MIN_FILL               8
+/* generic transmission fifo full, wait for the uart to drain it */
+#define COREDUMP_BIN_TX_RETRY_DELAY_US      100
+/* no room for this long, a 1KB frame drains in 5ms at 2Mbps, the uart is stuck */
+#define COREDUMP_BIN_TX_STALL_US            100000
+/* whole dump, 2MB of frames at 2Mbps, several times the ram of dtop sent raw */
+#ifndef CONFIG_COREDUMP_BIN_TX_MAX_MS
+#define CONFIG_COREDUMP_BIN_TX_MAX_MS       10000
+#endif
+
+/* core_dump_bin_frame_t.type */
+#define COREDUMP_BIN_FRAME_START            0   /* payload: COREDUMP_BIN_VERSION */
+#define COREDUMP_BIN_FRAME_LZ               1   /* payload: lz tokens of raw_len bytes */
+#define COREDUMP_BIN_FRAME_RAW              2   /* payload: raw_len bytes as is */
+#define COREDUMP_BIN_FRAME_FILL             3   /* payload: one byte, raw_len times */
+#define COREDUMP_BIN_FRAME_END              4   /* payload: crc32 of the stream, raw_len is its length */
+
+/* lz token, a varint (n << 2) | op */
+#define COREDUMP_BIN_OP_LITERAL             0   /* n bytes follow */
+#define COREDUMP_BIN_OP_FILL                1   /* one byte follows, n times */
+#define COREDUMP_BIN_OP_MATCH               2   /* varint distance follows, copy n bytes */
+#define COREDUMP_BIN_OP_SHIFT               2
+
+/** binary core dump frame header, little endian */
+typedef struct _core_dump_bin_frame_t {
+    uint16_t magic;
+    uint8_t type;
+    uint8_t core;           // cpu id
+    uint16_t seq;           // frame sequence, to find lost frames
+    uint16_t payload_len;
+    uint32_t raw_len;       // core dump stream bytes of the frame
+} __attribute__((packed)) core_dump_bin_frame_t;
+
+/* frame output, generic transmission or the flash ring */
+typedef int (*iot_core_dump_bin_tx_t)(const uint8_t *data, uint32_t len);
+
+typedef struct _core_dump_bin_ctxt_t {
+    iot_core_dump_bin_tx_t tx;
+    uint32_t start_us;      // dump start, for CONFIG_COREDUMP_BIN_TX_MAX_MS
+    bool_t tx_aborted;      // uart stuck or out of time, the rest of the dump is dropped
+    uint32_t raw_total;
+    uint32_t crc;
+    uint32_t stage_len;
+    uint32_t out_len;
+    uint16_t seq;
+    uint16_t hash[1 << COREDUMP_BIN_HASH_BITS];
+    uint8_t stage[COREDUMP_BIN_BLOCK_SIZE];
+    uint8_t out[sizeof(core_dump_bin_frame_t) + COREDUMP_BIN_BLOCK_SIZE];
+} core_dump_bin_ctxt_t;
+
+static core_dump_bin_ctxt_t coredump_bin;
+
+static int iot_core_dump_bin_tx(const uint8_t *data, uint32_t len)
+{
+    int32_t ret;
+    uint32_t stall_us = 0;
+
+    if (coredump_bin.tx_aborted) {
+        return -RET_TIMEOVER;
+    }
+
+    while (len > 0) {
+        ret = generic_transmission_data_tx_panic(GENERIC_TRANSMISSION_TX_MODE_LAZY,
+                                                 GENERIC_TRANSMISSION_DATA_TYPE_PANIC_LOG,
+                                                 DUMP_TID, GENERIC_TRANSMISSION_IO_UART0,
+                                                 data, len);
+        if (ret == -RET_NOMEM) {
+            // give up the dump rather than spin in the crash path forever
+            if (stall_us >= COREDUMP_BIN_TX_STALL_US
+                || iot_timer_get_time() - coredump_bin.start_us
+                   >= CONFIG_COREDUMP_BIN_TX_MAX_MS * 1000) {
+                coredump_bin.tx_aborted = true;
+                return -RET_TIMEOVER;
+            }
+            iot_timer_delay_us(COREDUMP_BIN_TX_RETRY_DELAY_US);
+            stall_us += COREDUMP_BIN_TX_RETRY_DELAY_US;
+            continue;
+        }
+        stall_us = 0;
+        if (ret < 0) {
+            return (int)ret;
+        }
+        data += ret;
+        len -= (uint32_t)ret;
+    }
+
+    return COREDUMP_OK;
+}
+
+static int iot_core_dump_bin_frame_send(core_dump_bin_ctxt_t *ctxt, uint8_t type,
+                                        uint32_t raw_len, uint32_t payload_len)
+{
+    core_dump_bin_frame_t *frame = (core_dump_bin_frame_t *)ctxt->out;
+
+    frame->magic = COREDUMP_BIN_MAGIC;
+    frame->type = type;
+    frame->core = (uint8_t)cpu_get_mhartid();
+    frame->seq = ctxt->seq++;
+    frame->payload_len = (uint16_t)payload_len;
+    frame->raw_len = raw_len;
+
+    return ctxt->tx(ctxt->out, sizeof(core_dump_bin_frame_t) + payload_len);
+}
+
+static bool_t iot_core_dump_bin_put_varint(core_dump_bin_ctxt_t *ctxt, uint32_t v)
+{
+    uint8_t *p = ctxt->out + sizeof(core_dump_bin_frame_t);
+
+    do {
+        if (ctxt->out_len >= COREDUMP_BIN_BLOCK_SIZE) {
+            return false;
+        }
+        p[ctxt->out_len++] = (uint8_t)((v >= 0x80) ? (v | 0x80) : v);
+        v >>= 7;
+    } while (v);
+
+    return true;
+}
+
+static bool_t iot_core_dump_bin_put_literal(core_dump_bin_ctxt_t *ctxt, const uint8_t *src,
+                                            uint32_t len)
+{
+    if (len == 0) {
+        return true;
+    }
+    if (!iot_core_dump_bin_put_varint(ctxt, (len << COREDUMP_BIN_OP_SHIFT) | COREDUMP_BIN_OP_LITERAL)
+        || ctxt->out_len + len > COREDUMP_BIN_BLOCK_SIZE) {
+        return false;
+    }
+    memcpy(ctxt->out + sizeof(core_dump_bin_frame_t) + ctxt->out_len, src, len);
+    ctxt->out_len += len;
+
+    return true;
+}
+
+static inline uint32_t iot_core_dump_bin_hash(const uint8_t *p)
+{
+    uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16)
+                 | ((uint32_t)p[3] << 24);
+
+    return (uint32_t)(v * 2654435761U) >> (32 - COREDUMP_BIN_HASH_BITS);
+}
+
+static uint32_t iot_core_dump_bin_run(const uint8_t *p, uint32_t len)
+{
+    uint32_t n = 1;
+
+    while (n < len && p[n] == p[0]) {
+        n++;
+    }
+
+    return n;
+}
+
+/**
+ * greedy lz of the staged block into the out payload, matches are only
+ * searched inside the block so every frame decodes on its own.
+ * @return false if the coded block is not smaller than the block
+ */
+static bool_t iot_core_dump_bin_lz(core_dump_bin_ctxt_t *ctxt)
+{
+    const uint8_t *p = ctxt->stage;
+    uint32_t len = ctxt->stage_len;
+    uint32_t i = 0, lit = 0, n, h, cand;
+
+    memset(ctxt->hash, 0, sizeof(ctxt->hash));
+    ctxt->out_len = 0;
+
+    while (i + COREDUMP_BIN_MIN_MATCH <= len) {
+        n = iot_core_dump_bin_run(p + i, len - i);
+        if (n >= COREDUMP_BIN_MIN_FILL) {
+            if (!iot_core_dump_bin_put_literal(ctxt, p + lit, i - lit)
+                || !iot_core_dump_bin_put_varint(ctxt, (n << COREDUMP_BIN_OP_SHIFT) | COREDUMP_BIN_OP_FILL)
+                || ctxt->out_len >= COREDUMP_BIN_BLOCK_SIZE) {
+                return false;
+            }
+            ctxt->out[sizeof(core_dump_bin_frame_t) + ctxt->out_len++] = p[i];
+            i += n;
+            lit = i;
+            continue;
+        }
+
+        h = iot_core_dump_bin_hash(p + i);
+        cand = ctxt->hash[h];
+        ctxt->hash[h] = (uint16_t)(i + 1);
+        if (cand && memcmp(p + cand - 1, p + i, COREDUMP_BIN_MIN_MATCH) == 0) {
+            cand--;
+            n = COREDUMP_BIN_MIN_MATCH;
+            while (i + n < len && p[cand + n] == p[i + n]) {
+                n++;
+            }
+            if (!iot_core_dump_bin_put_literal(ctxt, p + lit, i - lit)
+                || !iot_core_dump_bin_put_varint(ctxt, (n << COREDUMP_BIN_OP_SHIFT) | COREDUMP_BIN_OP_MATCH)
+                || !iot_core_dump_bin_put_varint(ctxt, i - cand)) {
+                return false;
+            }
+            i += n;
+            lit = i;
+            continue;
+        }
+        i++;
+    }
+
+    return iot_core_dump_bin_put_literal(ctxt, p + lit, len - lit)
+           && ctxt->out_len < len;
+}
+
+static int iot_core_dump_bin_flush(core_dump_bin_ctxt_t *ctxt)
+{
+    int err;
+
+    if (ctxt->stage_len == 0) {
+        return COREDUMP_OK;
+    }
+
+    if (iot_core_dump_bin_lz(ctxt)) {
+        err = iot_core_dump_bin_frame_send(ctxt, COREDUMP_BIN_FRAME_LZ, ctxt->stage_len,
+                                           ctxt->out_len);
+    } else {
+        memcpy(ctxt->out + sizeof(core_dump_bin_frame_t), ctxt->stage, ctxt->stage_len);
+        err = iot_core_dump_bin_frame_send(ctxt, COREDUMP_BIN_FRAME_RAW, ctxt->stage_len,
+                                           ctxt->stage_len);
+    }
+    ctxt->stage_len = 0;
+
+    return err;
+}
+
+static int iot_core_dump_bin_write_start(void *priv)
+{
+    core_dump_bin_ctxt_t *ctxt = priv;
+
+    if (generic_transmission_get_status(cpu_get_mhartid()) < GTB_ST_IN_PANIC) {
+        generic_transmission_panic_start();
+    }
+    iot_coredump_log_print("================= BINARY CORE DUMP START =================\r\n");
+
+    ctxt->start_us = iot_timer_get_time();
+    ctxt->tx_aborted = false;
+    ctxt->raw_total = 0;
+    ctxt->crc = 0xFFFFFFFF;
+    ctxt->stage_len = 0;
+    ctxt->seq = 0;
+    ctxt->out[sizeof(core_dump_bin_frame_t)] = COREDUMP_BIN_VERSION;
+
+    return iot_core_dump_bin_frame_send(ctxt, COREDUMP_BIN_FRAME_START, 0, 1);
+}
+
+static int iot_core_dump_bin_write_end(void *priv)
+{
+    core_dump_bin_ctxt_t *ctxt = priv;
+    uint32_t crc;
+    int err;
+
+    err = iot_core_dump_bin_flush(ctxt);
+    if (err != COREDUMP_OK) {
+        return err;
+    }
+
+    crc = ctxt->crc ^ 0xFFFFFFFF;
+    memcpy(ctxt->out + sizeof(core_dump_bin_frame_t), &crc, sizeof(crc));
+    err = iot_core_dump_bin_frame_send(ctxt, COREDUMP_BIN_FRAME_END, ctxt->raw_total, sizeof(crc));
+    iot_coredump_log_print("================= BINARY CORE DUMP END (%lu bytes, %d frames) =================\r\n",
+                           ctxt->raw_total, ctxt->seq);
+
+    return err;
+}
+
+static int iot_core_dump_bin_write_data(void *priv, void *data, uint32_t data_len)
+{
+    core_dump_bin_ctxt_t *ctxt = priv;
+    const uint8_t *p = data;
+    uint32_t n;
+    int err;
+
+    ctxt->crc = getcrc32_update(ctxt->crc, p, data_len);
+    ctxt->raw_total += data_len;
+
+    while (data_len > 0) {
+        if (ctxt->stage_len == 0) {
+            n = iot_core_dump_bin_run(p, data_len);
+            if (n >= COREDUMP_BIN_BLOCK_SIZE) {
+                ctxt->out[sizeof(core_dump_bin_frame_t)] = p[0];
+                err = iot_core_dump_bin_frame_send(ctxt, COREDUMP_BIN_FRAME_FILL, n, 1);
+                if (err != COREDUMP_OK) {
+                    return err;
+                }
+                p += n;
+                data_len -= n;
+                continue;
+            }
+        }
+
+        n = MIN(data_len, COREDUMP_BIN_BLOCK_SIZE - ctxt->stage_len);
+        memcpy(ctxt->stage + ctxt->stage_len, p, n);
+        ctxt->stage_len += n;
+        p += n;
+        data_len -= n;
+        if (ctxt->stage_len == COREDUMP_BIN_BLOCK_SIZE) {
+            err = iot_core_dump_bin_flush(ctxt);
+            if (err != COREDUMP_OK) {
+                return err;
+            }
+        }
+    }
+
+    return COREDUMP_OK;
+}
+
+//lint -sem(iot_task_dump_to_gtp, thread_protected) dump only call in crash path
+int32_t iot_task_dump_to_gtp(const exception_info_t *info)
+{
+    core_dump_write_config_t wr_cfg;
+    memset(&wr_cfg, 0, sizeof(wr_cfg));
+    wr_cfg.prepare = NULL;
+    wr_cfg.start = iot_core_dump_bin_write_start;
+    wr_cfg.end = iot_core_dump_bin_write_end;
+    wr_cfg.write = iot_core_dump_bin_write_data;
+    wr_cfg.heap_sparse = true;
+    wr_cfg.priv = &coredump_bin;
+    coredump_bin.tx = iot_core_dump_bin_tx;
+    iot_core_dump_write(info, &wr_cfg);
+    if (coredump_bin.tx_aborted) {
+        iot_coredump_log_print("[auto]Core dump to generic transmission aborted at %lu bytes, %lums.\r\n",
+                               coredump_bin.raw_total,
+                               (iot_timer_get_time() - coredump_bin.start_us) / 1000);
+        return -1;
+    }
+    iot_coredump_log_print("[auto]Core dump has written to generic transmission.\r\n");
+    return 0;
+}
+#endif /* CONFIG_COREDUMP_BIN */
+
+#if CONFIG_COREDUMP_FLASH
+/*
+ * Flash core dump ring, the FLASH_COREDUMP_SECTORS at the end of FOTA. A dump
+ * takes whole sectors from a sector boundary on, wrapping at the ring end, and
+ * keeps the binary frames as iot_task_dump_to_gtp() sends them. The header at
+ * the start of its first sector is written last and commits the dump. After
+ * boot the free sectors are erased in the background, so the crash path only
+ * programs. A new dump is uploaded to uart0 once on the next boot, the flag in
+ * its header is cleared before it starts, so a reboot loop or a host that is
+ * not listening does not get it on every boot. After that the dumps not acked
+ * are only uploaded on request.
+ */
+#define COREDUMP_FLASH_MAGIC                0x4C464443  /* "CDFL" */
+#define COREDUMP_FLASH_VERSION              1
+#define COREDUMP_FLASH_SECTOR_NUM           FLASH_COREDUMP_SECTORS
+#define COREDUMP_FLASH_BASE                 (uint32_t)(FLASH_COREDUMP_OFFSET - FLASH_START)
+#define COREDUMP_FLASH_SIZE                 FLASH_COREDUMP_LENGTH
+#define COREDUMP_FLASH_FLAG_TRUNCATED       0x00000001
+#define COREDUMP_FLASH_NOT_UPLOADED         0xFFFFFFFF
+#define COREDUMP_FLASH_AUTO_PENDING         0xFFFFFFFF
+
+/* upload a new dump once after boot, 0 to upload only on request */
+#ifndef CONFIG_COREDUMP_FLASH_AUTO_UPLOAD
+#define CONFIG_COREDUMP_FLASH_AUTO_UPLOAD       1
+#endif
+
+/* background work after boot */
+#ifndef CONFIG_COREDUMP_FLASH_BOOT_DELAY_MS
+#define CONFIG_COREDUMP_FLASH_BOOT_DELAY_MS     5000
+#endif
+#define COREDUMP_FLASH_ERASE_INTERVAL_MS        50
+#define COREDUMP_FLASH_UPLOAD_INTERVAL_MS       10
+#define COREDUMP_FLASH_UPLOAD_CHUNK             256
+
+#if COREDUMP_FLASH_SECTOR_NUM > 32
+#error "core dump ring sectors are kept in a 32 bit map"
+#endif
+
+typedef struct _core_dump_flash_hdr_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sectors;       // sectors taken, header included
+    uint32_t seq;
+    uint32_t len;           // bytes of frames after the header
+    uint32_t crc;           // crc32 of the frames
+    uint32_t flags;
+    uint32_t uploaded;      // COREDUMP_FLASH_NOT_UPLOADED until acked, then programmed to 0
+    uint32_t auto_upload;   // COREDUMP_FLASH_AUTO_PENDING until the boot upload starts, then 0
+} __attribute__((packed)) core_dump_flash_hdr_t;
+
+typedef struct _core_dump_flash_t {
+    uint32_t dump_map;      // bit n: a committed dump starts at sector n
+    uint32_t next_seq;
+    uint8_t next_sector;
+    bool_t scanned;
+    /* crash path */
+    uint8_t wr_sector;
+    bool_t wr_truncated;
+    uint32_t wr_len;
+    uint32_t wr_crc;
+    /* background */
+    os_mutex_h mutex;
+    iot_share_work_t work;
+    uint8_t erase_sector;
+    uint8_t erase_cnt;      // sectors left to erase ahead
+    uint8_t upload_sector;
+    uint8_t upload_io;
+    bool_t upload_auto;     // the boot upload, only the dumps not sent once follow
+    uint32_t upload_seq;
+    uint32_t upload_pos;
+    uint32_t upload_len;    // 0 if no upload running
+} core_dump_flash_t;
+
+static core_dump_flash_t coredump_flash;
+
+static inline const core_dump_flash_hdr_t *iot_core_dump_flash_hdr(uint8_t sector)
+{
+    return (const core_dump_flash_hdr_t *)(FLASH_START + COREDUMP_FLASH_BASE +
+                                           (uint32_t)sector * FLASH_SECTOR_SIZE);
+}
+
+/* ring offset of byte off of the dump starting at sector */
+static inline uint32_t iot_core_dump_flash_offset(uint8_t sector, uint32_t off)
+{
+    return ((uint32_t)sector * FLASH_SECTOR_SIZE + off) % COREDUMP_FLASH_SIZE;
+}
+
+static bool_t iot_core_dump_flash_hdr_valid(const core_dump_flash_hdr_t *hdr)
+{
+    return hdr->magic == COREDUMP_FLASH_MAGIC && hdr->version == COREDUMP_FLASH_VERSION &&
+        hdr->sectors > 0 && hdr->sectors <= COREDUMP_FLASH_SECTOR_NUM &&
+        hdr->len <= (uint32_t)hdr->sectors * FLASH_SECTOR_SIZE - sizeof(core_dump_flash_hdr_t);
+}
+
+static void iot_core_dump_flash_scan(core_dump_flash_t *fl)
+{
+    const core_dump_flash_hdr_t *hdr;
+    bool_t found = false;
+    uint32_t newest = 0;
+
+    fl->dump_map = 0;
+    fl->next_seq = 0;
+    fl->next_sector = 0;
+    for (uint8_t s = 0; s < COREDUMP_FLASH_SECTOR_NUM; s++) {
+        hdr = iot_core_dump_flash_hdr(s);
+        if (!iot_core_dump_flash_hdr_valid(hdr)) {
+            continue;
+        }
+        fl->dump_map |= BIT(s);
+        if (!found || (int32_t)(hdr->seq - newest) > 0) {
+            found = true;
+            newest = hdr->seq;
+            fl->next_seq = hdr->seq + 1;
+            fl->next_sector = (uint8_t)((s + hdr->sectors) % COREDUMP_FLASH_SECTOR_NUM);
+        }
+    }
+    fl->scanned = true;
+}
+
+/* start sector of the committed dump taking sector, -1 if it's free */
+static int32_t iot_core_dump_flash_owner(const core_dump_flash_t *fl, uint8_t sector)
+{
+    for (uint8_t s = 0; s < COREDUMP_FLASH_SECTOR_NUM; s++) {
+        if ((fl->dump_map & BIT(s)) &&
+            (sector + COREDUMP_FLASH_SECTOR_NUM - s) % COREDUMP_FLASH_SECTOR_NUM <
+                iot_core_dump_flash_hdr(s)->sectors) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+/* drop the dumps taking sector and make sure it's erased */
+static int iot_core_dump_flash_sector_reclaim(core_dump_flash_t *fl, uint8_t sector)
+{
+    const uint32_t *p = (const uint32_t *)(FLASH_START + COREDUMP_FLASH_BASE +
+                                           (uint32_t)sector * FLASH_SECTOR_SIZE);
+    const uint32_t zero = 0;
+    int32_t owner;
+
+    while ((owner = iot_core_dump_flash_owner(fl, sector)) >= 0) {
+        /* clear the magic first, a dump is never left with sectors missing */
+        iot_flash_write_without_erase(COREDUMP_FLASH_BASE + (uint32_t)owner * FLASH_SECTOR_SIZE,
+                                      &zero, sizeof(zero));
+        fl->dump_map &= ~BIT(owner);
+    }
+
+    for (uint32_t i = 0; i < FLASH_SECTOR_SIZE / sizeof(uint32_t); i++) {
+        if (p[i] != 0xFFFFFFFF) {
+            return iot_flash_erase_sector(
+                (uint16_t)(COREDUMP_FLASH_BASE / FLASH_SECTOR_SIZE + sector));
+        }
+    }
+    return COREDUMP_OK;
+}
+
+//lint -sem(iot_core_dump_flash_tx, thread_protected) dump only call in crash path
+static int iot_core_dump_flash_tx(const uint8_t *data, uint32_t len)
+{
+    core_dump_flash_t *fl = &coredump_flash;
+    uint32_t off, n;
+    int err;
+
+    while (len > 0) {
+        off = sizeof(core_dump_flash_hdr_t) + fl->wr_len;
+        if (off >= COREDUMP_FLASH_SIZE) {
+            /* ring full, keep the head of the dump */
+            fl->wr_truncated = true;
+            return COREDUMP_OK;
+        }
+        if (off % FLASH_SECTOR_SIZE == 0) {
+            err = iot_core_dump_flash_sector_reclaim(
+                fl, (uint8_t)((fl->wr_sector + off / FLASH_SECTOR_SIZE) % COREDUMP_FLASH_SECTOR_NUM));
+            if (err != COREDUMP_OK) {
+                return err;
+            }
+        }
+
+        n = MIN(len, FLASH_SECTOR_SIZE - off % FLASH_SECTOR_SIZE);
+        err = iot_flash_write_without_erase(
+            COREDUMP_FLASH_BASE + iot_core_dump_flash_offset(fl->wr_sector, off), data, n);
+        if (err != COREDUMP_OK) {
+            return err;
+        }
+        fl->wr_crc = getcrc32_update(fl->wr_crc, data, n);
+        fl->wr_len += n;
+        data += n;
+        len -= n;
+    }
+
+    return COREDUMP_OK;
+}
+
+static int iot_core_dump_flash_write_prepare(void *priv, uint32_t *data_len)
+{
+    core_dump_flash_t *fl = &coredump_flash;
+
+    UNUSED(priv);
+    UNUSED(data_len);
+
+    if (IOT_FLASH_PE_SW_MODE == iot_flash_get_pe_mode()) {
+        iot_flash_set_pe_mode(IOT_FLASH_PE_HW_MODE);
+    }
+    if (!fl->scanned) {
+        iot_core_dump_flash_scan(fl);
+    }
+
+    fl->wr_sector = fl->next_sector;
+    fl->wr_truncated = false;
+    fl->wr_len = 0;
+    fl->wr_crc = 0xFFFFFFFF;
+
+    return iot_core_dump_flash_sector_reclaim(fl, fl->wr_sector);
+}
+
+static int iot_core_dump_flash_write_start(void *priv)
+{
+    core_dump_bin_ctxt_t *ctxt = priv;
+
+    ctxt->tx = iot_core_dump_flash_tx;
+    return iot_core_dump_bin_write_start(priv);
+}
+
+static int iot_core_dump_flash_write_end(void *priv)
+{
+    core_dump_flash_t *fl = &coredump_flash;
+    core_dump_flash_hdr_t hdr;
+    int err;
+
+    err = iot_core_dump_bin_write_end(priv);
+
+    hdr.magic = COREDUMP_FLASH_MAGIC;
+    hdr.version = COREDUMP_FLASH_VERSION;
+    hdr.sectors = (uint16_t)((sizeof(hdr) + fl->wr_len + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE);
+    hdr.seq = fl->next_seq;
+    hdr.len = fl->wr_len;
+    hdr.crc = fl->wr_crc ^ 0xFFFFFFFF;
+    hdr.flags = fl->wr_truncated ? COREDUMP_FLASH_FLAG_TRUNCATED : 0;
+    hdr.uploaded = COREDUMP_FLASH_NOT_UPLOADED;
+    hdr.auto_upload = COREDUMP_FLASH_AUTO_PENDING;
+    if (iot_flash_write_without_erase(COREDUMP_FLASH_BASE + (uint32_t)fl->wr_sector * FLASH_SECTOR_SIZE,
+                                      &hdr, sizeof(hdr)) != RET_OK) {
+        err = RET_FAIL;
+    }
+
+    iot_coredump_log_print("Core dump %lu saved to flash sector %d, %lu bytes%s\r\n", hdr.seq,
+                           fl->wr_sector, hdr.len, fl->wr_truncated ? " (truncated)" : "");
+
+    return err;
+}
+
+//lint -sem(iot_task_dump_to_flash, thread_protected) dump only call in crash path
+int32_t iot_task_dump_to_flash(const exception_info_t *info)
+{
+    core_dump_write_config_t wr_cfg;
+    memset(&wr_cfg, 0, sizeof(wr_cfg));
+    wr_cfg.prepare = iot_core_dump_flash_write_prepare;
+    wr_cfg.start = iot_core_dump_flash_write_start;
+    wr_cfg.end = iot_core_dump_flash_write_end;
+    wr_cfg.write = iot_core_dump_bin_write_data;
+    wr_cfg.heap_sparse = true;
+    wr_cfg.priv = &coredump_bin;
+    iot_core_dump_write(info, &wr_cfg);
+    iot_coredump_log_print("[auto]Core dump has written to flash.\r\n");
+    return 0;
+}
+
+/* oldest dump not acked with seq from on, not uploaded at boot yet if auto_only, -1 if none */
+static int32_t iot_core_dump_flash_find_pending(const core_dump_flash_t *fl, uint32_t seq,
+                                                bool_t auto_only)
+{
+    const core_dump_flash_hdr_t *hdr;
+    int32_t found = -1;
+
+    for (uint8_t s = 0; s < COREDUMP_FLASH_SECTOR_NUM; s++) {
+        if (!(fl->dump_map & BIT(s))) {
+            continue;
+        }
+        hdr = iot_core_dump_flash_hdr(s);
+        if (auto_only && hdr->auto_upload != COREDUMP_FLASH_AUTO_PENDING) {
+            continue;
+        }
+        if (hdr->uploaded == COREDUMP_FLASH_NOT_UPLOADED && (int32_t)(hdr->seq - seq) >= 0 &&
+            (found < 0 || (int32_t)(hdr->seq - iot_core_dump_flash_hdr((uint8_t)found)->seq) < 0)) {
+            found = s;
+        }
+    }
+    return found;
+}
+
+/* committed dump of seq, -1 if none */
+static int32_t iot_core_dump_flash_find(const core_dump_flash_t *fl, uint32_t seq)
+{
+    for (uint8_t s = 0; s < COREDUMP_FLASH_SECTOR_NUM; s++) {
+        if ((fl->dump_map & BIT(s)) && iot_core_dump_flash_hdr(s)->seq == seq) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+static void iot_core_dump_flash_upload_begin(core_dump_flash_t *fl, uint8_t sector, uint8_t io,
+                                             bool_t is_auto)
+{
+    const uint32_t auto_upload = 0;
+
+    if (is_auto) {
+        /* one boot upload per dump, even if this one never completes */
+        iot_flash_write_without_erase(COREDUMP_FLASH_BASE + (uint32_t)sector * FLASH_SECTOR_SIZE +
+                                          offsetof(core_dump_flash_hdr_t, auto_upload),
+                                      &auto_upload, sizeof(auto_upload));
+    }
+    fl->upload_sector = sector;
+    fl->upload_io = io;
+    fl->upload_auto = is_auto;
+    fl->upload_seq = iot_core_dump_flash_hdr(sector)->seq;
+    fl->upload_pos = 0;
+    fl->upload_len = iot_core_dump_flash_hdr(sector)->len;
+}
+
+/* erase one sector ahead of the next dump, false when done */
+static bool_t iot_core_dump_flash_erase_step(core_dump_flash_t *fl)
+{
+    int32_t owner = iot_core_dump_flash_owner(fl, fl->erase_sector);
+
+    /* the next dumps may take the uploaded ones but not those still pending */
+    if (owner >= 0 &&
+        iot_core_dump_flash_hdr((uint8_t)owner)->uploaded == COREDUMP_FLASH_NOT_UPLOADED) {
+        fl->erase_cnt = 0;
+        return false;
+    }
+
+    iot_core_dump_flash_sector_reclaim(fl, fl->erase_sector);
+    fl->erase_sector = (uint8_t)((fl->erase_sector + 1) % COREDUMP_FLASH_SECTOR_NUM);
+    fl->erase_cnt--;
+    return fl->erase_cnt > 0;
+}
+
+/* send one chunk of the dump being uploaded, false when done */
+static bool_t iot_core_dump_flash_upload_step(core_dump_flash_t *fl)
+{
+    uint32_t off, n;
+    int32_t ret, next;
+
+    if (!(fl->dump_map & BIT(fl->upload_sector)) ||
+        iot_core_dump_flash_hdr(fl->upload_sector)->seq != fl->upload_seq) {
+        /* erased meanwhile */
+        fl->upload_len = 0;
+        return false;
+    }
+
+    off = iot_core_dump_flash_offset(fl->upload_sector, sizeof(core_dump_flash_hdr_t) + fl->upload_pos);
+    n = MIN(fl->upload_len - fl->upload_pos, COREDUMP_FLASH_UPLOAD_CHUNK);
+    n = MIN(n, COREDUMP_FLASH_SIZE - off);
+    ret = generic_transmission_data_tx(GENERIC_TRANSMISSION_TX_MODE_LAZY,
+                                       GENERIC_TRANSMISSION_DATA_TYPE_PANIC_LOG, DUMP_TID,
+                                       (generic_transmission_io_t)fl->upload_io,
+                                       (const uint8_t *)(FLASH_START + COREDUMP_FLASH_BASE + off), n,
+                                       /* need ack */ false);
+    if (ret == -RET_NOMEM || ret == 0) {
+        /* fifo full, try again later */
+        return true;
+    } else if (ret < 0) {
+        fl->upload_len = 0;
+        return false;
+    }
+
+    fl->upload_pos += (uint32_t)ret;
+    if (fl->upload_pos < fl->upload_len) {
+        return true;
+    }
+
+    /* the next one not acked, the dump just sent stays until the host acks it */
+    next = iot_core_dump_flash_find_pending(fl, fl->upload_seq + 1, fl->upload_auto);
+    if (next < 0) {
+        fl->upload_len = 0;
+        return false;
+    }
+    iot_core_dump_flash_upload_begin(fl, (uint8_t)next, fl->upload_io, fl->upload_auto);
+    return true;
+}
+
+static void iot_core_dump_flash_work_func(iot_share_work_t *work)
+{
+    core_dump_flash_t *fl = list_entry(work, core_dump_flash_t, work);
+    uint32_t delay_ms = 0;
+
+    os_acquire_mutex(fl->mutex);
+    if (fl->erase_cnt > 0) {
+        iot_core_dump_flash_erase_step(fl);
+        delay_ms = COREDUMP_FLASH_ERASE_INTERVAL_MS;
+    } else if (fl->upload_len > 0 && iot_core_dump_flash_upload_step(fl)) {
+        delay_ms = COREDUMP_FLASH_UPLOAD_INTERVAL_MS;
+    }
+    os_release_mutex(fl->mutex);
+
+    if (delay_ms) {
+        iot_share_task_queue_delayed_work(IOT_SHARE_TASK_QUEUE_LP, work, delay_ms);
+    }
+}
+
+void iot_core_dump_flash_init(void)
+{
+    core_dump_flash_t *fl = &coredump_flash;
+#if CONFIG_COREDUMP_FLASH_AUTO_UPLOAD
+    int32_t pending;
+#endif
+
+    fl->mutex = os_create_mutex(UNKNOWN_MID);
+    assert(fl->mutex);
+    iot_share_task_init_work(&fl->work, iot_core_dump_flash_work_func);
+
+    iot_core_dump_flash_scan(fl);
+    fl->erase_sector = fl->next_sector;
+    fl->erase_cnt = COREDUMP_FLASH_SECTOR_NUM;
+
+#if CONFIG_COREDUMP_FLASH_AUTO_UPLOAD
+    pending = iot_core_dump_flash_find_pending(fl, 0, true);
+    if (pending >= 0) {
+        iot_core_dump_flash_upload_begin(fl, (uint8_t)pending, GENERIC_TRANSMISSION_IO_UART0, true);
+        iot_coredump_log_print("[auto]Core dump %lu in flash, uploading once\r\n", fl->upload_seq);
+    }
+#endif
+
+    iot_share_task_queue_delayed_work(IOT_SHARE_TASK_QUEUE_LP, &fl->work,
+                                      CONFIG_COREDUMP_FLASH_BOOT_DELAY_MS);
+}
+
+uint32_t iot_core_dump_flash_get_info(iot_core_dump_flash_info_t *info, uint32_t num)
+{
+    core_dump_flash_t *fl = &coredump_flash;
+    const core_dump_flash_hdr_t *hdr;
+    uint32_t cnt = 0, i;
+
+    if (fl->mutex == NULL) {
+        return 0;
+    }
+
+    os_acquire_mutex(fl->mutex);
+    for (uint8_t s = 0; s < COREDUMP_FLASH_SECTOR_NUM && cnt < num; s++) {
+        if (!(fl->dump_map & BIT(s))) {
+            continue;
+        }
+        hdr = iot_core_dump_flash_hdr(s);
+        /* insert by seq, oldest first */
+        for (i = cnt; i > 0 && (int32_t)(info[i - 1].seq - hdr->seq) > 0; i--) {
+            info[i] = info[i - 1];
+        }
+        info[i].seq = hdr->seq;
+        info[i].len = hdr->len;
+        info[i].crc = hdr->crc;
+        info[i].sector = s;
+        info[i].uploaded = hdr->uploaded != COREDUMP_FLASH_NOT_UPLOADED;
+        info[i].truncated = !!(hdr->flags & COREDUMP_FLASH_FLAG_TRUNCATED);
+        info[i].reserved = 0;
+        cnt++;
+    }
+    os_release_mutex(fl->mutex);
+
+    return cnt;
+}
+
+uint8_t iot_core_dump_flash_upload(uint32_t seq, uint8_t io)
+{
+    core_dump_flash_t *fl = &coredump_flash;
+    int32_t sector;
+    uint8_t ret = RET_OK;
+
+    if (fl->mutex == NULL || io >= GENERIC_TRANSMISSION_IO_NUM) {
+        return RET_INVAL;
+    }
+
+    os_acquire_mutex(fl->mutex);
+    sector = iot_core_dump_flash_find(fl, seq);
+    if (sector < 0) {
+        ret = RET_INVAL;
+    } else if (fl->upload_len > 0) {
+        ret = RET_BUSY;
+    } else {
+        iot_core_dump_flash_upload_begin(fl, (uint8_t)sector, io, false);
+    }
+    os_release_mutex(fl->mutex);
+
+    if (ret == RET_OK) {
+        iot_share_task_queue_work(IOT_SHARE_TASK_QUEUE_LP, &fl->work);
+    }
+    return ret;
+}
+
+uint8_t iot_core_dump_flash_ack(uint32_t seq)
+{
+    core_dump_flash_t *fl = &coredump_flash;
+    const uint32_t uploaded = 0;
+    int32_t sector;
+    uint8_t ret = RET_OK;
+
+    if (fl->mutex == NULL) {
+        return RET_INVAL;
+    }
+
+    os_acquire_mutex(fl->mutex);
+    sector = iot_core_dump_flash_find(fl, seq);
+    if (sector < 0) {
+        ret = RET_INVAL;
+    } else if (iot_core_dump_flash_hdr((uint8_t)sector)->uploaded == COREDUMP_FLASH_NOT_UPLOADED) {
+        ret = iot_flash_write_without_erase(COREDUMP_FLASH_BASE + (uint32_t)sector * FLASH_SECTOR_SIZE +
+                                                offsetof(core_dump_flash_hdr_t, uploaded),
+                                            &uploaded, sizeof(uploaded));
+    }
+    os_release_mutex(fl->mutex);
+
+    return ret;
+}
+#endif /* CONFIG_COREDUMP_FLASH */
+
 static void iot_debug_core_dump_register_callback(iot_core_dump_callback cb)
 {
     extern iot_core_dump_callback coredump_callback;
     coredump_callback = cb;
 }
 
+#if CONFIG_COREDUMP_FLASH && defined(LIB_DBGLOG_ENABLE)
+//lint -sem(iot_task_dump_by_dbglog_io, thread_protected) dump only call in crash path
+static int32_t iot_task_dump_by_dbglog_io(const exception_info_t *info)
+{
+    if (dbglog_get_dump_io() == DBGLOG_DUMP_FLASH) {
+        return iot_task_dump_to_flash(info);
+    }
+    return iot_task_dump_to_gtp(info);
+}
+#endif
+
 void iot_core_dump_init(void)
 {
+#if CONFIG_COREDUMP_FLASH && defined(LIB_DBGLOG_ENABLE)
+    iot_debug_core_dump_register_callback(iot_task_dump_by_dbglog_io);
+#elif CONFIG_COREDUMP_BIN
+    iot_debug_core_dump_register_callback(iot_task_dump_to_gtp);
+#else
     iot_debug_core_dump_register_callback(iot_task_dump_to_uart);
+#endif
 }
@@ -32,6 +32,8 @@ extern "C" {
 
 #define OTA_SIZE_UNKNOWN 0xffffffff /*!< Used for ota_begin() if new image size is unknown */
 
+#define OTA_PROGRESS_BLOCK_LEN 512 /*!< Block size tracked by the ota progress bitmap */
+
 #define IMAGE_DESC_MAGIC_WORD 0xABCD6543 /*!< The magic word for the image_desc_t structure. */
 
 #define IMAGE_CORE0_FLAG     BIT(0)
@@ -73,6 +75,65 @@ typedef struct {
 
 /** pack_desc_t should be 16 bytes */
 static_assert(sizeof(pack_desc_t) == 16, ota_h);
+
+#define OTA_IMAGE_DESC_MAX 16   /*!< Max images in a package */
+
+/**
+ * @brief Time spent by each stage of ota_end() and ota_commit(), unit is us.
+ */
+typedef struct {
+    uint32_t delta_time;                        /*!< Finishing a delta package */
+    uint32_t header_time;                       /*!< Package header and image descriptor check */
+    uint32_t verify_time;                       /*!< Whole verify, header and compressed data */
+    uint32_t image_time[OTA_IMAGE_DESC_MAX];    /*!< Crc of each image read back, 0 if streamed */
+    uint32_t commit_time;                       /*!< Boot map update in ota_commit() */
+    uint8_t image_num;                          /*!< Images in the package */
+    uint8_t streamed;                           /*!< Data crc was streamed during the writes */
+} ota_commit_timing_t;
+
+#define OTA_VERIFY_FLAG_INVALID BIT(0) /*!< Header is broken, ota_end() reads the image back */
+
+/**
+ * @brief Streaming verify state, updated while the package is written in order.
+ *
+ * It lives in ram with the handle only. A download resumed after a reboot
+ * starts a new handle, so ota_end() reads that package back.
+ */
+typedef struct {
+    uint32_t offset;        /*!< Bytes of the package written in order from offset 0 */
+    uint32_t crc;           /*!< Running crc32 of the compressed data written so far */
+    uint32_t data_start;    /*!< Offset of the compressed data, 0 until the header is written */
+    uint32_t data_end;      /*!< End of the compressed data, 0 until the descriptors are written */
+    uint32_t flags;         /*!< OTA_VERIFY_FLAG_* */
+} ota_verify_state_t;
+
+#define OTA_DELTA_MAGIC      0x41544C44 /*!< "DLTA", magic word of ota_delta_hdr_t */
+#define OTA_DELTA_WINDOW_MAX 2          /*!< Max sectors of old package kept in ram while patching */
+
+/**
+ * @brief Header of a delta package.
+ *
+ * A delta package rebuilds a full ota package from the package currently in the
+ * ota zone, it is applied in place. The header is followed by ops, each starts
+ * with a LEB128 varint (len << 1 | type) and ends with a varint 0:
+ *  - type 0, insert: len literal bytes follow.
+ *  - type 1, copy: a varint offset in the base package follows, len bytes are copied from it.
+ *
+ * The output sector is erased before it is written, a copy may only read the
+ * sectors after it or the last window sectors erased before it.
+ */
+typedef struct {
+    uint32_t magic;         /*!< OTA_DELTA_MAGIC */
+    uint32_t base_size;     /*!< Size of the package the delta was made against */
+    uint32_t base_crc;      /*!< crc32 of the base package */
+    uint32_t target_size;   /*!< Size of the rebuilt package */
+    uint32_t target_crc;    /*!< crc32 of the rebuilt package */
+    uint16_t window;        /*!< Sectors the copies may read behind the output, <= OTA_DELTA_WINDOW_MAX */
+    uint16_t reserved;
+} ota_delta_hdr_t;
+
+/** ota_delta_hdr_t should be 24 bytes */
+static_assert(sizeof(ota_delta_hdr_t) == 24, ota_delta_h);
 /**
  * @}
  */
@@ -140,6 +201,66 @@ RET_TYPE ota_write(ota_handle_t handle, const void* data, size_t size);
  */
 RET_TYPE ota_write_data(ota_handle_t handle, const void* data, size_t size, uint32_t offset);
 
+/**
+ * @brief   Commence a delta OTA update against the package in the OTA zone.
+ *
+ * Nothing is erased here, the base package is checked against the delta header
+ * on the first ota_delta_write() and erased sector by sector while rebuilding.
+ *
+ * @param out_handle On success, returns a handle(>0) which should be used for subsequent ota_delta_write() and ota_end() calls.
+ *
+ * @return
+ *    - RET_OK: OTA operation commenced successfully.
+ *    - RET_*: out_handle argument was NULL, or other internal error happened.
+ */
+RET_TYPE ota_delta_begin(ota_handle_t *out_handle);
+
+/**
+ * @brief   Write delta package, the rebuilt package is written to the OTA zone.
+ *
+ * The delta package is decoded as a stream, it must be written in order.
+ *
+ * @param handle  Handle obtained from ota_delta_begin
+ * @param data    Delta data buffer
+ * @param size    Size of data buffer in bytes.
+ * @param offset  Offset of the data in the delta package.
+ *
+ * @return
+ *    - RET_OK: Data was applied successfully.
+ *    - RET_CRC_FAIL: The package in the OTA zone is not the base of the delta.
+ *    - RET_*: Out of order data, broken delta or flash error, the update must be restarted with a full package.
+ */
+RET_TYPE ota_delta_write(ota_handle_t handle, const void *data, size_t size, uint32_t offset);
+
+/**
+ * @brief   Get the streaming verify state of an OTA update.
+ *
+ * The state covers the data written in order from offset 0.
+ *
+ * @param handle  Handle obtained from ota_begin
+ * @param state   Buffer to save the state.
+ *
+ * @return
+ *    - RET_OK: State was saved to the buffer.
+ *    - RET_*: handle or state arguments were invalid, or handle was not found.
+ */
+RET_TYPE ota_get_verify_state(ota_handle_t handle, ota_verify_state_t *state);
+
+/**
+ * @brief   Get where an OTA update of this image should resume.
+ *
+ * ota_begin() starts a progress bitmap in the OTA zone, a block of
+ * OTA_PROGRESS_BLOCK_LEN is marked once ota_write() or ota_write_data() wrote it
+ * completely. A partially written block is never reported as written.
+ *
+ * @param image_size  Size the update was started with.
+ * @param offset      Offset to search from, block aligned.
+ *
+ * @return The offset of the first block not written at or after offset, image_size
+ *         if all were written, or offset itself if there is no progress of this image.
+ */
+uint32_t ota_progress_get_resume_offset(uint32_t image_size, uint32_t offset);
+
 /**
  * @brief   Read OTA compressed package from OTA zone
  *
@@ -156,6 +277,10 @@ RET_TYPE ota_read_data(void *data, size_t size, uint32_t offset);
 /**
  * @brief Finish OTA update and validate newly written app image.
  *
+ * If the whole package was written in order the crc streamed during the writes
+ * is used, only the package header is read back. A delta update is also checked
+ * against the size and crc of the rebuilt package in its header.
+ *
  * @param handle  Handle obtained from ota_begin().
  *
  * @note After calling ota_end(), the handle is no longer valid and any memory associated with it is freed.
@@ -166,6 +291,13 @@ RET_TYPE ota_read_data(void *data, size_t size, uint32_t offset);
  */
 RET_TYPE ota_end(ota_handle_t handle);
 
+/**
+ * @brief   Get the time spent by each stage of the last ota_end() and ota_commit().
+ *
+ * @param timing  Stage times copied out.
+ */
+void ota_get_commit_timing(ota_commit_timing_t *timing);
+
 /**
  * @brief Commit flag which enable OTA image to flash.
  *
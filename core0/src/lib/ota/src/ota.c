@@ -26,37 +26,149 @@ Information is free from patent or copyright infringement.
 
 #include "iot_memory_config.h"
 #include "iot_flash.h"
+#include "iot_timer.h"
 #include "iot_boot_map.h"
 #include "oem.h"
 #include "ota.h"
 
-#define OTA_LIMIT_SIZE     (FLASH_FOTA_LENGTH)
+#define SPI_FLASH_SEC_SIZE 4096
+// the last sector of the ota zone keeps the progress bitmap
+#define OTA_LIMIT_SIZE     (FLASH_FOTA_LENGTH - FLASH_COREDUMP_LENGTH - SPI_FLASH_SEC_SIZE)
 #define OTA_OFFSET         FLASH_FOTA_OFFSET
 #define OTA_WRITE_OFFSET   (FLASH_FOTA_OFFSET - FLASH_START)
-#define SPI_FLASH_SEC_SIZE 4096
 #define OTA_ANC_BIN_TYPE   (0x00000080UL)
 
+#define OTA_PROGRESS_MAGIC      0x50415451   // QTAP
+#define OTA_PROGRESS_OFFSET     (OTA_WRITE_OFFSET + OTA_LIMIT_SIZE)
+#define OTA_PROGRESS_BITMAP_MAX ((SPI_FLASH_SEC_SIZE - sizeof(ota_progress_hdr_t)) / sizeof(uint32_t))
+
+// erase one more step once the erased range is less than this ahead of a write
+#define OTA_ERASE_AHEAD    BLOCK_ERASE_64K_SIZE
+
+#define OTA_DELTA_SCRATCH_SIZE 256
+
+#define OTA_DELTA_OP_INSERT 0
+#define OTA_DELTA_OP_COPY   1
+
+typedef enum {
+    OTA_DELTA_STATE_HDR,
+    OTA_DELTA_STATE_OP,
+    OTA_DELTA_STATE_SRC,
+    OTA_DELTA_STATE_INSERT,
+    OTA_DELTA_STATE_DONE,
+    OTA_DELTA_STATE_ERROR,
+} ota_delta_state_t;
+
+typedef struct ota_delta {
+    ota_delta_hdr_t hdr;
+    ota_delta_state_t state;
+    uint32_t in_offset;        // offset of the next patch byte expected
+    uint32_t varint;           // varint being decoded
+    uint8_t varint_shift;
+    uint8_t op;
+    uint32_t op_len;           // bytes left of the current op
+    uint32_t out_crc;          // running crc32 of the rebuilt package
+    uint32_t erased_sectors;   // sectors [0, erased_sectors) were erased
+    uint8_t *window;           // old contents of the last hdr.window erased sectors
+    uint8_t scratch[OTA_DELTA_SCRATCH_SIZE];
+} ota_delta_t;
+
 typedef struct ota_operation {
     struct list_head node;
     uint32_t handle;
-    uint32_t erased_size;
+    uint32_t erased_size;      // [0, erased_size) of the ota zone was erased
+    uint32_t erase_limit;      // the ota zone is erased up to here at most
     uint32_t wrote_size;
+    ota_verify_state_t verify;
+    ota_delta_t *delta;
 } ota_operation_t;
 
+/**
+ * @brief Progress record in the last sector of the ota zone, bitmap words follow it.
+ *
+ * Every bit starts erased (1) and is cleared once its block was written completely, so
+ * the record is only appended to until the next ota_begin().
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t image_size;
+    uint32_t block_len;
+} ota_progress_hdr_t;
+
 static struct list_head ota_opt_list;
 static uint32_t s_ota_ops_last_handle = 0;
-static image_desc image_desc_data[16];
+static image_desc image_desc_data[OTA_IMAGE_DESC_MAX];
 static ota_anc_data_process_cb anc_process_cb = NULL;
+static ota_commit_timing_t ota_timing;
+/**
+ * @brief Erase the biggest unit that starts at start and fits in [start, end),
+ * 64KB or 32KB blocks where aligned and sectors at the edges.
+ *
+ * @return the size erased, 0 on failure.
+ */
+static uint32_t partition_erase_step(uint32_t start, uint32_t end)
+{
+    uint32_t left = end - start;
+    uint32_t size;
+    int ret;
+
+    if ((start & (BLOCK_ERASE_64K_SIZE - 1)) == 0 && left >= BLOCK_ERASE_64K_SIZE) {
+        size = BLOCK_ERASE_64K_SIZE;
+        ret = iot_flash_erase_block(start, size);
+    } else if ((start & (BLOCK_ERASE_32K_SIZE - 1)) == 0 && left >= BLOCK_ERASE_32K_SIZE) {
+        size = BLOCK_ERASE_32K_SIZE;
+        ret = iot_flash_erase_block(start, size);
+    } else {
+        size = SPI_FLASH_SEC_SIZE;
+        ret = iot_flash_erase_sector((uint16_t)(start / SPI_FLASH_SEC_SIZE));
+    }
+    return ret == RET_OK ? size : 0;
+}
+
 static int partition_erase_range(uint32_t start, uint32_t length)
 {
-    int ret = RET_OK;
     assert(length <= OTA_LIMIT_SIZE);
-    uint16_t sec_num = (uint16_t)((length +  SPI_FLASH_SEC_SIZE -1) / SPI_FLASH_SEC_SIZE);
-    uint16_t start_sec = (uint16_t)(start / SPI_FLASH_SEC_SIZE);
-    for (uint16_t num = 0; num < sec_num; num++) {
-        ret |= iot_flash_erase_sector(start_sec + num);
+    uint32_t end = start + (length + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    while (start < end) {
+        uint32_t size = partition_erase_step(start, end);
+        if (size == 0) {
+            return RET_FAIL;
+        }
+        start += size;
+    }
+    return RET_OK;
+}
+
+/**
+ * @brief Erase the ota zone lazily up to end before it's written.
+ */
+static int partition_erase_until(ota_operation_t *it, uint32_t end)
+{
+    if (end > it->erase_limit) {
+        return RET_INVAL;
+    }
+    while (it->erased_size < end) {
+        uint32_t size = partition_erase_step(OTA_WRITE_OFFSET + it->erased_size,
+                                             OTA_WRITE_OFFSET + it->erase_limit);
+        if (size == 0) {
+            return RET_FAIL;
+        }
+        it->erased_size += size;
+    }
+    return RET_OK;
+}
+
+/**
+ * @brief Erase one more step after a write ending at end once less than OTA_ERASE_AHEAD is
+ * left erased, so the erases are spread over the writes while the next blocks arrive and the
+ * first write only waits for one erase command. A failed step is retried by the next write.
+ */
+static void partition_erase_ahead(ota_operation_t *it, uint32_t end)
+{
+    if (it->erased_size < it->erase_limit && it->erased_size - end < OTA_ERASE_AHEAD) {
+        it->erased_size += partition_erase_step(OTA_WRITE_OFFSET + it->erased_size,
+                                                OTA_WRITE_OFFSET + it->erase_limit);
     }
-    return ret;
 }
 
 static int partition_write(uint32_t offset, const uint8_t *buf, size_t length)
@@ -65,9 +177,178 @@ static int partition_write(uint32_t offset, const uint8_t *buf, size_t length)
     return iot_flash_write_without_erase(offset + OTA_WRITE_OFFSET, buf, length);
 }
 
-static int ota_image_verify(void)
+/**
+ * @brief Feed bytes written in order at verify->offset into the streaming verifier.
+ *
+ * The package layout is pack_desc_t, image_desc[num], header crc, compressed data and data crc.
+ * The data range is only known once the header is in flash, the chunk is fed after it has been
+ * written so the header is always readable from the mapped ota zone here.
+ */
+static void ota_verify_update(ota_verify_state_t *verify, const uint8_t *data, uint32_t size)
+{
+    uint32_t start = verify->offset;
+    uint32_t end = start + size;
+
+    verify->offset = end;
+    if (verify->flags & OTA_VERIFY_FLAG_INVALID) {
+        return;
+    }
+
+    if (verify->data_start == 0 && end >= sizeof(pack_desc_t)) {
+        pack_desc_t package_header;
+        uint32_t num = 0;
+
+        memcpy((uint8_t *)&package_header, (uint8_t *)OTA_OFFSET, sizeof(pack_desc_t));
+        for (uint32_t p_type = package_header.image_pack_types; p_type != 0;
+             p_type &= (p_type - 1)) {
+            num++;
+        }
+        if (package_header.magic_word != IMAGE_DESC_MAGIC_WORD || num == 0
+            || num > OTA_IMAGE_DESC_MAX) {
+            verify->flags |= OTA_VERIFY_FLAG_INVALID;
+            return;
+        }
+        verify->data_start = sizeof(pack_desc_t) + num * sizeof(image_desc) + sizeof(uint32_t);
+    }
+
+    if (verify->data_start == 0 || end <= verify->data_start) {
+        return;
+    }
+
+    if (verify->data_end == 0) {
+        const image_desc *desc = (const image_desc *)(OTA_OFFSET + sizeof(pack_desc_t));
+        uint32_t num = (verify->data_start - sizeof(pack_desc_t) - sizeof(uint32_t))
+            / sizeof(image_desc);
+        uint32_t compress_total_len = 0;
+
+        for (uint32_t i = 0; i < num; i++) {
+            compress_total_len += desc[i].image_compress_size;
+        }
+        if (compress_total_len >= OTA_LIMIT_SIZE) {
+            verify->flags |= OTA_VERIFY_FLAG_INVALID;
+            return;
+        }
+        verify->data_end = verify->data_start + compress_total_len;
+        verify->crc = 0xFFFFFFFF;
+    }
+
+    uint32_t crc_start = start > verify->data_start ? start : verify->data_start;
+    uint32_t crc_end = end < verify->data_end ? end : verify->data_end;
+    if (crc_start < crc_end) {
+        verify->crc = getcrc32_update(verify->crc, data + (crc_start - start), crc_end - crc_start);
+    }
+}
+
+static void ota_progress_reset(uint32_t image_size)
+{
+    ota_progress_hdr_t hdr;
+
+    partition_erase_range(OTA_PROGRESS_OFFSET, SPI_FLASH_SEC_SIZE);
+    // a record that can't cover the image is left empty, nothing will be resumed from it
+    if (image_size == 0 || image_size == OTA_SIZE_UNKNOWN
+        || image_size > OTA_PROGRESS_BITMAP_MAX * 32 * OTA_PROGRESS_BLOCK_LEN) {
+        return;
+    }
+    hdr.magic = OTA_PROGRESS_MAGIC;
+    hdr.image_size = image_size;
+    hdr.block_len = OTA_PROGRESS_BLOCK_LEN;
+    iot_flash_write_without_erase(OTA_PROGRESS_OFFSET, &hdr, sizeof(hdr));
+}
+
+static const ota_progress_hdr_t *ota_progress_get(uint32_t image_size)
+{
+    const ota_progress_hdr_t *hdr = (const ota_progress_hdr_t *)(FLASH_START + OTA_PROGRESS_OFFSET);
+
+    if (hdr->magic != OTA_PROGRESS_MAGIC || hdr->image_size != image_size
+        || hdr->block_len != OTA_PROGRESS_BLOCK_LEN) {
+        return NULL;
+    }
+    return hdr;
+}
+
+static void ota_progress_mark(uint32_t offset, uint32_t size)
+{
+    const ota_progress_hdr_t *hdr = (const ota_progress_hdr_t *)(FLASH_START + OTA_PROGRESS_OFFSET);
+    uint32_t end = offset + size;
+    uint32_t first, last;
+
+    if (hdr->magic != OTA_PROGRESS_MAGIC) {
+        return;
+    }
+
+    // only whole blocks are committed, the last block of the image may be short
+    first = (offset + OTA_PROGRESS_BLOCK_LEN - 1) / OTA_PROGRESS_BLOCK_LEN;
+    last = end >= hdr->image_size ? (hdr->image_size + OTA_PROGRESS_BLOCK_LEN - 1)
+            / OTA_PROGRESS_BLOCK_LEN : end / OTA_PROGRESS_BLOCK_LEN;
+
+    while (first < last) {
+        uint32_t word = first / 32;
+        uint32_t n = MIN(last - first, 32 - first % 32);
+        uint32_t bits = (n == 32 ? 0xFFFFFFFF : (BIT(n) - 1)) << (first % 32);
+        // writing 1 leaves a bit as it is, only the new blocks are cleared
+        uint32_t value = ~bits;
+        iot_flash_write_without_erase(OTA_PROGRESS_OFFSET + sizeof(ota_progress_hdr_t)
+                                          + word * sizeof(uint32_t),
+                                      &value, sizeof(value));
+        first += n;
+    }
+}
+
+static int ota_image_verify_streamed(const ota_verify_state_t *verify)
+{
+    image_desc desc[OTA_IMAGE_DESC_MAX];
+    uint32_t num = (verify->data_start - sizeof(pack_desc_t) - sizeof(uint32_t))
+        / sizeof(image_desc);
+    uint32_t compress_total_len = 0;
+    uint32_t saved_crc = 0;
+    uint32_t cal_crc;
+    uint32_t start = iot_timer_get_time();
+
+    ota_timing.streamed = true;
+    ota_timing.image_num = (uint8_t)num;
+    // the header may have been rewritten after it was parsed, check it again, it is small
+    memcpy(desc, (uint8_t *)(OTA_OFFSET + sizeof(pack_desc_t)), num * sizeof(image_desc));
+    cal_crc = getcrc32((const uint8_t *)desc, num * sizeof(image_desc));
+    memcpy(&saved_crc, (uint8_t *)(OTA_OFFSET + verify->data_start - sizeof(uint32_t)),
+           sizeof(uint32_t));
+    if (cal_crc != saved_crc) {
+        DBGLOG_LIB_OTA_ERROR("OTA image header crc check failed 0x%08x != 0x%08x\n", cal_crc, saved_crc);
+        return RET_CRC_FAIL;
+    }
+
+    for (uint32_t i = 0; i < num; i++) {
+        compress_total_len += desc[i].image_compress_size;
+    }
+    if (verify->data_start + compress_total_len != verify->data_end) {
+        DBGLOG_LIB_OTA_ERROR("OTA image header changed during streaming verify\n");
+        return RET_CRC_FAIL;
+    }
+    ota_timing.header_time = iot_timer_get_time() - start;
+
+    // the data crc was computed per chunk while it was written, nothing is read back
+    cal_crc = verify->crc ^ 0xFFFFFFFF;
+    memcpy(&saved_crc, (uint8_t *)(OTA_OFFSET + verify->data_end), sizeof(uint32_t));
+    if (cal_crc != saved_crc) {
+        DBGLOG_LIB_OTA_ERROR("OTA compressed data check failed 0x%08x != 0x%08x\n", cal_crc, saved_crc);
+        return RET_CRC_FAIL;
+    }
+    return RET_OK;
+}
+
+static int ota_image_verify(const ota_verify_state_t *verify)
 {
+    if (!(verify->flags & OTA_VERIFY_FLAG_INVALID) && verify->data_end != 0
+        && verify->offset >= verify->data_end + sizeof(uint32_t)) {
+        return ota_image_verify_streamed(verify);
+    }
+
+    DBGLOG_LIB_OTA_INFO("OTA streaming verify incomplete offset:%d, read back image\n",
+                        verify->offset);
+
     pack_desc_t package_header;
+    uint32_t start = iot_timer_get_time();
+
+    ota_timing.streamed = false;
     memcpy((uint8_t *)&package_header, (uint8_t *)OTA_OFFSET, sizeof(pack_desc_t));
     if (package_header.magic_word != IMAGE_DESC_MAGIC_WORD) {
         DBGLOG_LIB_OTA_ERROR("OTA image has invalid magic byte saw 0x%08x\n", package_header.magic_word);
@@ -81,7 +362,8 @@ static int ota_image_verify(void)
     for (; p_type != 0; p_type &= (p_type - 1)) {
         num++;
     }
-    assert(num > 0);
+    assert(num > 0 && num <= OTA_IMAGE_DESC_MAX);
+    ota_timing.image_num = (uint8_t)num;
 
     memcpy(image_desc_data, (uint8_t *)(OTA_OFFSET + sizeof(pack_desc_t)),
            num * sizeof(image_desc));
@@ -105,9 +387,19 @@ static int ota_image_verify(void)
         compress_total_len += image_desc_data[i].image_compress_size;
     }
     assert(compress_total_len < OTA_LIMIT_SIZE);
+    ota_timing.header_time = iot_timer_get_time() - start;
 
-    // check crc of compressed data
-    cal_crc = getcrc32((const uint8_t *)(OTA_OFFSET + compress_data_offset), compress_total_len);
+    // check crc of compressed data, image by image straight from the mapped ota zone
+    uint32_t image_offset = compress_data_offset;
+    cal_crc = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < num; i++) {
+        start = iot_timer_get_time();
+        cal_crc = getcrc32_update(cal_crc, (const uint8_t *)(OTA_OFFSET + image_offset),
+                                  image_desc_data[i].image_compress_size);
+        image_offset += image_desc_data[i].image_compress_size;
+        ota_timing.image_time[i] = iot_timer_get_time() - start;
+    }
+    cal_crc ^= 0xFFFFFFFF;
     memcpy(&saved_crc, (uint8_t *)(OTA_OFFSET + compress_data_offset + compress_total_len),
            sizeof(uint32_t));
 
@@ -138,22 +430,20 @@ RET_TYPE ota_begin(size_t image_size, ota_handle_t *out_handle)
         return ret;
     }
 
-    // If input image size is 0 or OTA_SIZE_UNKNOWN, erase entire partition
+    // If input image size is 0 or OTA_SIZE_UNKNOWN, the entire partition may be written.
+    // It's erased lazily ahead of the writes, not all at once here.
     if ((image_size == 0) || (image_size == OTA_SIZE_UNKNOWN)) {
-        ret = (RET_TYPE)partition_erase_range(OTA_WRITE_OFFSET, OTA_LIMIT_SIZE);
-        it->erased_size = OTA_LIMIT_SIZE;
+        it->erase_limit = OTA_LIMIT_SIZE;
     } else {
-        ret = (RET_TYPE)partition_erase_range(
-            OTA_WRITE_OFFSET, (image_size / SPI_FLASH_SEC_SIZE + 1) * SPI_FLASH_SEC_SIZE);
-        it->erased_size = (image_size / SPI_FLASH_SEC_SIZE + 1) * SPI_FLASH_SEC_SIZE;
-    }
-
-    if (ret != RET_OK) {
-        os_mem_free(it);
-        return ret;
+        it->erase_limit = MIN((uint32_t)((image_size / SPI_FLASH_SEC_SIZE + 1) * SPI_FLASH_SEC_SIZE),
+                              (uint32_t)OTA_LIMIT_SIZE);
     }
+    it->erased_size = 0;
+    ota_progress_reset(image_size);
 
     it->wrote_size = 0;
+    memset(&it->verify, 0, sizeof(it->verify));
+    it->delta = NULL;
     it->handle = ++s_ota_ops_last_handle;
     list_init(&ota_opt_list);
     list_add_tail(&it->node, &ota_opt_list);
@@ -177,16 +467,25 @@ RET_TYPE ota_write(ota_handle_t handle, const void *data, size_t size)
     // find ota handle in linked list
     list_for_each_entry_safe (it, &ota_opt_list, node, saved) {
         if (it->handle == handle) {
-            // must erase the partition before writing to it
-            assert(it->erased_size > 0);
+            if (it->delta) {
+                DBGLOG_LIB_OTA_ERROR("delta handle must be written by ota_delta_write\n");
+                return RET_INVAL;
+            }
             if (it->wrote_size == 0 && size > 0
                 && data_bytes[0] != (IMAGE_DESC_MAGIC_WORD & 0x000000FF)) {
                 DBGLOG_LIB_OTA_ERROR("OTA image has invalid magic byte (expected 0x43, saw 0x%02x)\n",
                                  data_bytes[0]);
                 return RET_INVAL;
             }
-            ret = (RET_TYPE)partition_write(it->wrote_size, data_bytes, size);
+            // must erase the partition before writing to it
+            ret = (RET_TYPE)partition_erase_until(it, it->wrote_size + size);
+            if (ret == RET_OK) {
+                ret = (RET_TYPE)partition_write(it->wrote_size, data_bytes, size);
+            }
             if (ret == RET_OK) {
+                partition_erase_ahead(it, it->wrote_size + size);
+                ota_progress_mark(it->wrote_size, size);
+                ota_verify_update(&it->verify, data_bytes, size);
                 it->wrote_size += size;
             }
             return ret;
@@ -213,8 +512,10 @@ RET_TYPE ota_write_data(ota_handle_t handle, const void *data, size_t size, uint
     // find ota handle in linked list
     list_for_each_entry_safe (it, &ota_opt_list, node, saved) {
         if (it->handle == handle) {
-            // must erase the partition before writing to it
-            assert(it->erased_size > 0);
+            if (it->delta) {
+                DBGLOG_LIB_OTA_ERROR("delta handle must be written by ota_delta_write\n");
+                return RET_INVAL;
+            }
             if (offset == 0 && size > 0
                 && data_bytes[0] != (IMAGE_DESC_MAGIC_WORD & 0x000000FF)) {
                 DBGLOG_LIB_OTA_ERROR("OTA image has invalid magic byte (expected 0x43, saw 0x%02x)\n",
@@ -224,8 +525,18 @@ RET_TYPE ota_write_data(ota_handle_t handle, const void *data, size_t size, uint
             if(offset != it->wrote_size) {
                 DBGLOG_LIB_OTA_INFO("ota packet missing!\n");
             }
-            ret = (RET_TYPE)partition_write(offset, data_bytes, size);
+            // must erase the partition before writing to it
+            ret = (RET_TYPE)partition_erase_until(it, offset + size);
+            if (ret == RET_OK) {
+                ret = (RET_TYPE)partition_write(offset, data_bytes, size);
+            }
             if (ret == RET_OK) {
+                partition_erase_ahead(it, offset + size);
+                ota_progress_mark(offset, size);
+                // only the in order run is streamed, a gap falls back to the read back verify
+                if (offset == it->verify.offset) {
+                    ota_verify_update(&it->verify, data_bytes, size);
+                }
                 it->wrote_size += size;
             }
             return ret;
@@ -237,6 +548,377 @@ RET_TYPE ota_write_data(ota_handle_t handle, const void *data, size_t size, uint
     return RET_NOT_EXIST;
 }
 
+static ota_operation_t *ota_find_operation(ota_handle_t handle)
+{
+    ota_operation_t *it;
+    struct list_head *saved;
+
+    list_for_each_entry_safe (it, &ota_opt_list, node, saved) {
+        if (it->handle == handle) {
+            return it;
+        }
+    }
+    return NULL;
+}
+
+RET_TYPE ota_get_verify_state(ota_handle_t handle, ota_verify_state_t *state)
+{
+    ota_operation_t *it;
+
+    if (handle == 0 || state == NULL) {
+        return RET_INVAL;
+    }
+
+    it = ota_find_operation(handle);
+    if (it == NULL) {
+        return RET_NOT_EXIST;
+    }
+    *state = it->verify;
+    return RET_OK;
+}
+
+static void ota_operation_free(ota_operation_t *it)
+{
+    list_del(&it->node);
+    if (it->delta) {
+        if (it->delta->window) {
+            os_mem_free(it->delta->window);
+        }
+        os_mem_free(it->delta);
+    }
+    os_mem_free(it);
+}
+
+RET_TYPE ota_delta_begin(ota_handle_t *out_handle)
+{
+    ota_operation_t *it;
+
+    if (out_handle == NULL) {
+        return RET_INVAL;
+    }
+
+    it = (ota_operation_t *)os_mem_malloc(IOT_OTA_MID, sizeof(ota_operation_t));
+    if (it == NULL) {
+        return RET_NOMEM;
+    }
+    it->delta = (ota_delta_t *)os_mem_malloc(IOT_OTA_MID, sizeof(ota_delta_t));
+    if (it->delta == NULL) {
+        os_mem_free(it);
+        return RET_NOMEM;
+    }
+    memset(it->delta, 0, sizeof(ota_delta_t));
+
+    // reset boot mode to normal alway when ota begin, save main boot map firstly
+    iot_boot_map_update();
+    RET_TYPE ret = (RET_TYPE)iot_boot_map_set_boot_type(IOT_BOOT_MODE_NORMAL);
+    if (ret != RET_OK) {
+        os_mem_free(it->delta);
+        os_mem_free(it);
+        return ret;
+    }
+
+    // the rebuilt package is not tracked by the progress bitmap, drop the old record
+    ota_progress_reset(0);
+
+    // the base package lives in the ota zone, it is erased sector by sector while rebuilding
+    it->erased_size = 0;
+    it->erase_limit = OTA_LIMIT_SIZE;
+    it->wrote_size = 0;
+    memset(&it->verify, 0, sizeof(it->verify));
+    it->delta->out_crc = 0xFFFFFFFF;
+    it->handle = ++s_ota_ops_last_handle;
+    list_init(&ota_opt_list);
+    list_add_tail(&it->node, &ota_opt_list);
+
+    *out_handle = it->handle;
+    return RET_OK;
+}
+
+static RET_TYPE ota_delta_check_hdr(ota_delta_t *delta)
+{
+    const ota_delta_hdr_t *hdr = &delta->hdr;
+    uint32_t crc;
+
+    if (hdr->magic != OTA_DELTA_MAGIC) {
+        DBGLOG_LIB_OTA_ERROR("OTA delta has invalid magic 0x%08x\n", hdr->magic);
+        return RET_INVAL;
+    }
+    if (hdr->base_size > OTA_LIMIT_SIZE || hdr->target_size >= OTA_LIMIT_SIZE
+        || hdr->target_size == 0 || hdr->window == 0 || hdr->window > OTA_DELTA_WINDOW_MAX) {
+        DBGLOG_LIB_OTA_ERROR("OTA delta invalid base:%d target:%d window:%d\n", hdr->base_size,
+                             hdr->target_size, hdr->window);
+        return RET_INVAL;
+    }
+
+    // the patch only applies to the package it was made against
+    crc = getcrc32((const uint8_t *)OTA_OFFSET, hdr->base_size);
+    if (crc != hdr->base_crc) {
+        DBGLOG_LIB_OTA_ERROR("OTA delta base mismatch 0x%08x != 0x%08x\n", crc, hdr->base_crc);
+        return RET_CRC_FAIL;
+    }
+
+    delta->window = os_mem_malloc(IOT_OTA_MID, hdr->window * SPI_FLASH_SEC_SIZE);
+    if (delta->window == NULL) {
+        return RET_NOMEM;
+    }
+    return RET_OK;
+}
+
+/**
+ * @brief Make sure the sector holding output offset out is erased. The old sector is kept in the
+ * ram window first, copies may still read it until hdr.window more sectors were erased.
+ */
+static RET_TYPE ota_delta_prepare(ota_operation_t *it, uint32_t out)
+{
+    ota_delta_t *delta = it->delta;
+    uint32_t sector = out / SPI_FLASH_SEC_SIZE;
+
+    while (delta->erased_sectors <= sector) {
+        uint32_t start = delta->erased_sectors * SPI_FLASH_SEC_SIZE;
+        if (start < delta->hdr.base_size) {
+            memcpy(delta->window + (delta->erased_sectors % delta->hdr.window) * SPI_FLASH_SEC_SIZE,
+                   (uint8_t *)(OTA_OFFSET + start), SPI_FLASH_SEC_SIZE);
+        }
+        if (partition_erase_range(OTA_WRITE_OFFSET + start, SPI_FLASH_SEC_SIZE) != RET_OK) {
+            return RET_FAIL;
+        }
+        delta->erased_sectors++;
+        it->erased_size = delta->erased_sectors * SPI_FLASH_SEC_SIZE;
+    }
+    return RET_OK;
+}
+
+static RET_TYPE ota_delta_output(ota_operation_t *it, const uint8_t *data, uint32_t size)
+{
+    ota_delta_t *delta = it->delta;
+
+    if (it->wrote_size + size > delta->hdr.target_size) {
+        return RET_INVAL;
+    }
+
+    while (size) {
+        uint32_t out = it->wrote_size;
+        uint32_t len = MIN(size, SPI_FLASH_SEC_SIZE - out % SPI_FLASH_SEC_SIZE);
+
+        if (ota_delta_prepare(it, out) != RET_OK
+            || partition_write(out, data, len) != RET_OK) {
+            return RET_FAIL;
+        }
+        ota_verify_update(&it->verify, data, len);
+        delta->out_crc = getcrc32_update(delta->out_crc, data, len);
+        it->wrote_size += len;
+        data += len;
+        size -= len;
+    }
+    return RET_OK;
+}
+
+static RET_TYPE ota_delta_copy(ota_operation_t *it, uint32_t src, uint32_t size)
+{
+    ota_delta_t *delta = it->delta;
+
+    if (src + size > delta->hdr.base_size || src + size < src) {
+        return RET_INVAL;
+    }
+
+    while (size) {
+        uint32_t out = it->wrote_size;
+        uint32_t len = MIN(size, (uint32_t)OTA_DELTA_SCRATCH_SIZE);
+        len = MIN(len, SPI_FLASH_SEC_SIZE - out % SPI_FLASH_SEC_SIZE);
+        len = MIN(len, SPI_FLASH_SEC_SIZE - src % SPI_FLASH_SEC_SIZE);
+
+        // the source is read after the output sector was erased, it may sit in the window now
+        if (ota_delta_prepare(it, out) != RET_OK) {
+            return RET_FAIL;
+        }
+        uint32_t src_sector = src / SPI_FLASH_SEC_SIZE;
+        if (src_sector >= delta->erased_sectors) {
+            memcpy(delta->scratch, (uint8_t *)(OTA_OFFSET + src), len);
+        } else if (src_sector + delta->hdr.window >= delta->erased_sectors) {
+            memcpy(delta->scratch,
+                   delta->window + (src_sector % delta->hdr.window) * SPI_FLASH_SEC_SIZE
+                       + src % SPI_FLASH_SEC_SIZE,
+                   len);
+        } else {
+            DBGLOG_LIB_OTA_ERROR("OTA delta copy from erased sector %d src:%d out:%d\n",
+                                 src_sector, src, out);
+            return RET_INVAL;
+        }
+
+        RET_TYPE ret = ota_delta_output(it, delta->scratch, len);
+        if (ret != RET_OK) {
+            return ret;
+        }
+        src += len;
+        size -= len;
+    }
+    return RET_OK;
+}
+
+/**
+ * @brief Feed one varint byte, done is set once the value is complete in delta->varint.
+ * A varint is 5 bytes at most and its 5th byte carries the top 4 bits only.
+ */
+static RET_TYPE ota_delta_varint(ota_delta_t *delta, uint8_t byte, bool_t *done)
+{
+    *done = false;
+    if (delta->varint_shift > 28 || (delta->varint_shift == 28 && (byte & 0xF0))) {
+        DBGLOG_LIB_OTA_ERROR("OTA delta varint overflow\n");
+        return RET_FAIL;
+    }
+    delta->varint |= (uint32_t)(byte & 0x7F) << delta->varint_shift;
+    delta->varint_shift += 7;
+    if (byte & 0x80) {
+        return RET_OK;
+    }
+    delta->varint_shift = 0;
+    *done = true;
+    return RET_OK;
+}
+
+RET_TYPE ota_delta_write(ota_handle_t handle, const void *data, size_t size, uint32_t offset)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    ota_operation_t *it;
+    ota_delta_t *delta;
+    RET_TYPE ret = RET_OK;
+    bool_t done;
+
+    if (data == NULL || handle == 0 || size == 0) {
+        DBGLOG_LIB_OTA_ERROR("write parameter is invalid\n");
+        return RET_INVAL;
+    }
+
+    it = ota_find_operation(handle);
+    if (it == NULL || it->delta == NULL) {
+        DBGLOG_LIB_OTA_ERROR("not found the delta handle\n");
+        return RET_NOT_EXIST;
+    }
+    delta = it->delta;
+
+    // ops are decoded as a stream, the patch can only be applied in order
+    if (offset != delta->in_offset) {
+        DBGLOG_LIB_OTA_ERROR("OTA delta offset %d, expected %d\n", offset, delta->in_offset);
+        return RET_INVAL;
+    }
+    delta->in_offset += size;
+
+    while (size && ret == RET_OK) {
+        switch (delta->state) {
+            case OTA_DELTA_STATE_HDR: {
+                uint32_t got = delta->op_len;
+                uint32_t len = MIN((uint32_t)size, (uint32_t)sizeof(ota_delta_hdr_t) - got);
+                memcpy((uint8_t *)&delta->hdr + got, p, len);
+                delta->op_len += len;
+                p += len;
+                size -= len;
+                if (delta->op_len == sizeof(ota_delta_hdr_t)) {
+                    delta->op_len = 0;
+                    ret = ota_delta_check_hdr(delta);
+                    delta->state = OTA_DELTA_STATE_OP;
+                }
+                break;
+            }
+            case OTA_DELTA_STATE_OP:
+                ret = ota_delta_varint(delta, *p, &done);
+                if (ret == RET_OK && done) {
+                    delta->op = delta->varint & 0x1;
+                    delta->op_len = delta->varint >> 1;
+                    delta->varint = 0;
+                    if (delta->op_len == 0) {
+                        delta->state = OTA_DELTA_STATE_DONE;
+                    } else if (delta->op == OTA_DELTA_OP_COPY) {
+                        delta->state = OTA_DELTA_STATE_SRC;
+                    } else {
+                        delta->state = OTA_DELTA_STATE_INSERT;
+                    }
+                }
+                p++;
+                size--;
+                break;
+            case OTA_DELTA_STATE_SRC:
+                ret = ota_delta_varint(delta, *p, &done);
+                if (ret == RET_OK && done) {
+                    ret = ota_delta_copy(it, delta->varint, delta->op_len);
+                    delta->varint = 0;
+                    delta->state = OTA_DELTA_STATE_OP;
+                }
+                p++;
+                size--;
+                break;
+            case OTA_DELTA_STATE_INSERT: {
+                uint32_t len = MIN((uint32_t)size, delta->op_len);
+                ret = ota_delta_output(it, p, len);
+                delta->op_len -= len;
+                p += len;
+                size -= len;
+                if (delta->op_len == 0) {
+                    delta->state = OTA_DELTA_STATE_OP;
+                }
+                break;
+            }
+            case OTA_DELTA_STATE_DONE:
+                DBGLOG_LIB_OTA_ERROR("OTA delta has %d bytes after the end\n", size);
+                ret = RET_INVAL;
+                break;
+            case OTA_DELTA_STATE_ERROR:
+            default:
+                ret = RET_FAIL;
+                break;
+        }
+    }
+
+    // a broken patch can not be continued, ota_end() will fail
+    if (ret != RET_OK) {
+        delta->state = OTA_DELTA_STATE_ERROR;
+    }
+    return ret;
+}
+
+static RET_TYPE ota_delta_end(const ota_delta_t *delta, uint32_t wrote_size)
+{
+    uint32_t crc = delta->out_crc ^ 0xFFFFFFFF;
+
+    if (delta->state != OTA_DELTA_STATE_DONE || wrote_size != delta->hdr.target_size) {
+        DBGLOG_LIB_OTA_ERROR("OTA delta incomplete state:%d size:%d/%d\n", delta->state,
+                             wrote_size, delta->hdr.target_size);
+        return RET_INVAL;
+    }
+    if (crc != delta->hdr.target_crc) {
+        DBGLOG_LIB_OTA_ERROR("OTA delta target crc failed 0x%08x != 0x%08x\n", crc,
+                             delta->hdr.target_crc);
+        return RET_CRC_FAIL;
+    }
+    return RET_OK;
+}
+
+uint32_t ota_progress_get_resume_offset(uint32_t image_size, uint32_t offset)
+{
+    const ota_progress_hdr_t *hdr = ota_progress_get(image_size);
+    const uint32_t *bitmap;
+    uint32_t block, words;
+
+    if (hdr == NULL || offset >= image_size) {
+        return offset;
+    }
+
+    bitmap = (const uint32_t *)(hdr + 1);
+    block = offset / OTA_PROGRESS_BLOCK_LEN;
+    words = (image_size + OTA_PROGRESS_BLOCK_LEN * 32 - 1) / (OTA_PROGRESS_BLOCK_LEN * 32);
+
+    // the first set bit at or after block is the first block not written yet
+    for (uint32_t word = block / 32; word < words; word++) {
+        uint32_t pending = bitmap[word];
+        if (word == block / 32) {
+            pending &= ~(BIT(block % 32) - 1);
+        }
+        if (pending) {
+            return MIN((word * 32 + __builtin_ctz(pending)) * OTA_PROGRESS_BLOCK_LEN, image_size);
+        }
+    }
+    return image_size;
+}
+
 RET_TYPE ota_read_data(void *data, size_t size, uint32_t offset)
 {
     if (data == NULL || size == 0) {
@@ -270,30 +952,47 @@ RET_TYPE ota_end(ota_handle_t handle)
 
     // ota_end() is only valid if some data was written to this handle
     if ((it->erased_size == 0) || (it->wrote_size == 0)) {
-        list_del(&it->node);
-        os_mem_free(it);
+        ota_operation_free(it);
         return RET_INVAL;
     }
 
-    if (ota_image_verify() != RET_OK) {
-        list_del(&it->node);
-        os_mem_free(it);
+    memset(&ota_timing, 0, sizeof(ota_timing));
+    uint32_t start = iot_timer_get_time();
+    if (it->delta) {
+        RET_TYPE ret = ota_delta_end(it->delta, it->wrote_size);
+        if (ret != RET_OK) {
+            ota_operation_free(it);
+            return ret;
+        }
+    }
+
+    ota_timing.delta_time = iot_timer_get_time() - start;
+
+    start = iot_timer_get_time();
+    if (ota_image_verify(&it->verify) != RET_OK) {
+        ota_operation_free(it);
         return RET_CRC_FAIL;
     }
+    ota_timing.verify_time = iot_timer_get_time() - start;
+    DBGLOG_LIB_OTA_INFO("OTA end images:%d streamed:%d delta:%dus header:%dus verify:%dus\n",
+                        ota_timing.image_num, ota_timing.streamed, ota_timing.delta_time,
+                        ota_timing.header_time, ota_timing.verify_time);
 
-    list_del(&it->node);
-    os_mem_free(it);
+    ota_operation_free(it);
     return RET_OK;
 }
 
 RET_TYPE ota_commit(bool_t reboot)
 {
+    uint32_t start = iot_timer_get_time();
     // save main boot map firstly
     iot_boot_map_update();
     RET_TYPE ret = (RET_TYPE)iot_boot_map_set_boot_type(IOT_BOOT_MODE_OTA);
     if (ret != RET_OK) {
         return ret;
     }
+    ota_timing.commit_time = iot_timer_get_time() - start;
+    DBGLOG_LIB_OTA_INFO("OTA commit boot map:%dus\n", ota_timing.commit_time);
 
     if (reboot) {
         DBGLOG_LIB_OTA_INFO("OTA finished, will reset system\n");
@@ -305,6 +1004,11 @@ RET_TYPE ota_commit(bool_t reboot)
     return ret;
 }
 
+void ota_get_commit_timing(ota_commit_timing_t *timing)
+{
+    *timing = ota_timing;
+}
+
 RET_TYPE ota_register_anc_data_process_cb(ota_anc_data_process_cb cb)
 {
     anc_process_cb = cb;
@@ -18,6 +18,7 @@ Information is free from patent or copyright infringement.
 
 /* os shim includes */
 #include "types.h"
+#include "generic_list.h"
 
 
 /**
@@ -51,11 +52,80 @@ typedef enum {
     IOT_SHARE_EVENT_SPK_SINE_TONE_EVENT,
     IOT_SHARE_EVENT_CHARGER_CMC_EVENT,
     IOT_SHARE_EVENT_CFG_ANC_EVENT,
+    IOT_SHARE_EVENT_WORK_EVENT,
     IOT_SHARE_EVENT_END = 32,
 } iot_share_event_type;
 
 typedef void (*iot_share_event_func)(void *);
 
+/** @brief Post to run latency histogram buckets, bucket n holds latencies
+ *         below 4^(n+3) us, the last bucket takes the rest. */
+#define IOT_SHARE_TASK_HIST_NUM         8
+#define IOT_SHARE_TASK_STATS_MAGIC      0x5453  /* "ST" */
+#define IOT_SHARE_TASK_STATS_VERSION    1
+
+/**
+ * @brief Share task statistics record of iot_share_task_get_stats(). The
+ *        header is followed by task_num task records (fast task first),
+ *        msg_num msg records and event_num event records, all little endian.
+ *        Times in us.
+ */
+typedef struct _iot_share_task_stats_hdr_t {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t task_num;
+    uint8_t msg_num;
+    uint8_t event_num;
+    uint8_t hist_num;
+    uint8_t reserved;
+} __attribute__((packed)) iot_share_task_stats_hdr_t;
+
+typedef struct _iot_share_task_stats_task_t {
+    uint16_t queue_len;         /* SHARE_TASK_*_QUEUE_LENGTH */
+    uint16_t queue_high;        /* most messages waiting at once */
+    uint32_t max_latency;       /* longest post to run of msgs, events and works */
+    uint32_t max_run;           /* longest handler */
+    uint32_t max_run_func;      /* address of the longest handler */
+    uint16_t hist[IOT_SHARE_TASK_HIST_NUM];
+} __attribute__((packed)) iot_share_task_stats_task_t;
+
+typedef struct _iot_share_task_stats_msg_t {
+    uint8_t msg_id;
+    uint8_t reserved[3];
+    uint32_t func;
+    uint32_t post_cnt;
+    uint32_t max_run;
+} __attribute__((packed)) iot_share_task_stats_msg_t;
+
+typedef struct _iot_share_task_stats_event_t {
+    uint8_t task;               /* IOT_SHARE_TASK_QUEUE_HP or _LP */
+    uint8_t type;               /* iot_share_event_type */
+    uint16_t reserved;
+    uint32_t post_cnt;
+    uint32_t max_run;
+} __attribute__((packed)) iot_share_task_stats_event_t;
+
+struct iot_share_work;
+typedef void (*iot_share_work_func)(struct iot_share_work *work);
+
+/**
+ * @brief Deferred work item, embedded in the structure of its owner and
+ *        got back with list_entry() in the work function. The item may queue
+ *        itself again in its function but must not be freed there, the run
+ *        statistics are written after the function returns.
+ */
+typedef struct iot_share_work {
+    struct list_head node;
+    iot_share_work_func func;
+    uint32_t due_ms;        /* os_boot_time32() to run at, delayed work only */
+    uint32_t queue_ts;      /* iot_timer_get_time() when put on a run queue */
+    uint32_t run_cnt;
+    uint32_t max_latency;   /* longest us from queued to run */
+    uint32_t max_run;       /* longest us in the work function */
+    uint8_t prio;
+    volatile uint8_t state;
+} iot_share_work_t;
+
 /**
  * @brief This function is to init share task and to create the background.
  *
@@ -148,6 +218,68 @@ int32_t iot_share_task_msg_register(iot_share_event_func exec_func);
  */
 void iot_share_task_msg_unregister(int32_t msg_id);
 
+/**
+ * @brief This function is to init a work item, it must be done before the
+ *        item is queued and never while it is queued.
+ *
+ * @param work is the work item.
+ * @param func is the function to run in share task.
+ */
+void iot_share_task_init_work(iot_share_work_t *work, iot_share_work_func func);
+
+/**
+ * @brief This function is to queue a work item to share task. A work item
+ *        already queued is not queued again and runs once, a delayed one
+ *        keeps its time.
+ *
+ * @param prio is priority to handle this work.
+ * @param work is the work item.
+ * @return bool_t true if queued, false if it was queued or delayed already.
+ */
+bool_t iot_share_task_queue_work(uint32_t prio, iot_share_work_t *work);
+
+/**
+ * @brief This function is to queue a work item to share task from isr.
+ *
+ * @param prio is priority to handle this work.
+ * @param work is the work item.
+ * @return bool_t true if queued, false if it was queued or delayed already.
+ */
+bool_t iot_share_task_queue_work_from_isr(uint32_t prio, iot_share_work_t *work);
+
+/**
+ * @brief This function is to queue a work item to share task after a delay,
+ *        caller is a task. A work item already queued or delayed keeps its
+ *        place and time.
+ *
+ * @param prio is priority to handle this work.
+ * @param work is the work item.
+ * @param delay_ms is the delay in ms, 0 to queue it right now.
+ * @return bool_t true if queued, false if it was queued or delayed already.
+ */
+bool_t iot_share_task_queue_delayed_work(uint32_t prio, iot_share_work_t *work,
+                                         uint32_t delay_ms);
+
+/**
+ * @brief This function is to cancel a queued or delayed work item, caller is
+ *        a task. It does not wait for the work function running right now.
+ *
+ * @param work is the work item.
+ * @return bool_t true if the item was queued or delayed, else false.
+ */
+bool_t iot_share_task_cancel_work(iot_share_work_t *work);
+
+/**
+ * @brief This function is to get the share task statistics record, the msg
+ *        and event records that do not fit in the buffer are left out.
+ *
+ * @param buf is the output buffer.
+ * @param len is the buffer length.
+ * @param clear is to clear the statistics after they are read.
+ * @return uint32_t bytes filled, 0 if the buffer is too short for the tasks.
+ */
+uint32_t iot_share_task_get_stats(uint8_t *buf, uint32_t len, bool_t clear);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,7 +22,13 @@ Information is free from patent or copyright infringement.
 #include "os_task.h"
 #include "os_event.h"
 #include "os_queue.h"
+#include "os_lock.h"
+#include "os_timer.h"
+#include "os_utils.h"
 #include "riscv_cpu.h"
+#include "critical_sec.h"
+#include "utils.h"
+#include "iot_timer.h"
 
 #ifdef BUILD_CORE_CORE0
 #define SHARE_TASK_FAST_QUEUE_MSG_ID_TYPE   7
@@ -39,6 +45,22 @@ Information is free from patent or copyright infringement.
 #define EVENT_TYPE_VALID(tp) \
         ((tp) >= IOT_SHARE_EVENT_START && (tp) < IOT_SHARE_EVENT_END)
 
+/* work items run per wakeup, the rest waits for the other events */
+#define SHARE_TASK_WORK_BATCH       8
+
+#define SHARE_WORK_ST_IDLE          0
+#define SHARE_WORK_ST_QUEUED        1
+#define SHARE_WORK_ST_DELAYED       2
+
+/* events with statistics, the others are not used */
+#define SHARE_TASK_EVENT_STAT_NUM   (IOT_SHARE_EVENT_WORK_EVENT + 1)
+
+struct event_stat {
+    uint32_t post_cnt;
+    uint32_t post_ts;       /* first post not run yet, 0 if none */
+    uint32_t max_run;
+};
+
 struct func_args {
     iot_share_event_func func;
     void *arg;
@@ -50,6 +72,14 @@ struct share_task {
     os_task_h task;                 /* The higher priority task */
     os_event_h event;
     struct func_args handlers[IOT_SHARE_EVENT_END];
+    struct list_head work_list;     /* queued work items, protected by cpu critical */
+    /* statistics, see iot_share_task_stats_task_t */
+    uint16_t queue_high;
+    uint32_t max_latency;
+    uint32_t max_run;
+    uint32_t max_run_func;
+    uint16_t hist[IOT_SHARE_TASK_HIST_NUM];
+    struct event_stat events[SHARE_TASK_EVENT_STAT_NUM];
 };
 
 typedef struct _iot_share_twins_task {
@@ -75,14 +105,26 @@ static iot_share_twins_task twins_task = {
 static os_queue_h msg_faster;
 static os_queue_h msg_slower;
 
+/* delayed work items sorted by due time, protected by cpu critical. The timer
+ * is armed outside of it, work_delayed_gen counts the list changes so a
+ * restart that raced with another one arms the timer again. */
+static struct list_head work_delayed;
+static uint32_t work_delayed_gen;
+static timer_id_t work_timer;
+/* the timer task couldn't re-arm work_timer, the next restart from a task does */
+static bool_t work_timer_lost;
+
 struct msg_id_info {
     iot_share_event_func func;
+    uint32_t post_cnt;
+    uint32_t max_run;
 };
 static struct msg_id_info msg_id_queue[SHARE_TASK_MSG_ID_TYPE] = {0};
 
 struct queue_item {
     int32_t msg_id;
     void *data;
+    uint32_t post_ts;
 };
 
 static inline struct share_task *iot_share_task_route_task(uint32_t prio)
@@ -91,12 +133,38 @@ static inline struct share_task *iot_share_task_route_task(uint32_t prio)
             &twins_task.faster : &twins_task.slower;
 }
 
+/* in the share task itself, one handler of latency and run time in us */
+static void share_task_stat_run(struct share_task *task, uint32_t latency, uint32_t run,
+                                const void *func)
+{
+    int32_t bucket;
+
+    //bucket n: latency < 4^(n + 3) us
+    bucket = latency ? (int32_t)(32 - __builtin_clz(latency)) : 0;
+    bucket = bucket > 6 ? (bucket - 5) >> 1 : 0;
+    if (bucket >= IOT_SHARE_TASK_HIST_NUM) {
+        bucket = IOT_SHARE_TASK_HIST_NUM - 1;
+    }
+    if (task->hist[bucket] != 0xFFFF) {
+        task->hist[bucket]++;
+    }
+
+    task->max_latency = MAX(task->max_latency, latency);
+    if (run > task->max_run) {
+        task->max_run = run;
+        task->max_run_func = (uint32_t)func;
+    }
+}
+
 //lint -sem(iot_share_task_msg_handler, thread_protected)
 static void iot_share_task_msg_handler(void *arg)
 {
     os_queue_h queue = arg;
+    struct share_task *task = (queue == msg_faster ? &twins_task.faster : &twins_task.slower);
     struct queue_item item;
     iot_share_event_func exec_func;
+    uint32_t start;
+    uint32_t run;
 
     while (os_queue_peek(queue, &item)) {
         assert(item.msg_id < SHARE_TASK_MSG_ID_TYPE);
@@ -104,14 +172,31 @@ static void iot_share_task_msg_handler(void *arg)
         exec_func = msg_id_queue[item.msg_id].func;
         assert(exec_func);
 
+        start = iot_timer_get_time();
         exec_func(item.data);
+        run = iot_timer_get_time() - start;
+
+        msg_id_queue[item.msg_id].max_run = MAX(msg_id_queue[item.msg_id].max_run, run);
+        share_task_stat_run(task, start - item.post_ts, run, exec_func);
     }
 }
 
+/* after a msg is queued, in task or isr */
+static void share_task_stat_post_msg(uint32_t prio, int32_t msg_id, os_queue_h msg)
+{
+    struct share_task *task = iot_share_task_route_task(prio);
+    uint32_t items = os_queue_items_get(msg);
+
+    cpu_critical_enter();
+    msg_id_queue[msg_id].post_cnt++;
+    task->queue_high = (uint16_t)MAX(task->queue_high, items);
+    cpu_critical_exit();
+}
+
 bool_t iot_share_task_post_msg(uint32_t prio, int32_t msg_id, void *data)
 {
     bool_t ret;
-    struct queue_item item = { msg_id, data };
+    struct queue_item item = { msg_id, data, iot_timer_get_time() };
     static os_queue_h msg;
     uint32_t dump_param[5];
 
@@ -132,6 +217,7 @@ bool_t iot_share_task_post_msg(uint32_t prio, int32_t msg_id, void *data)
         dump_param[4] = os_queue_items_get(msg);                /* current queue size */
         ASSERT_FAILED_DUMP(dump_param, 5);
     }
+    share_task_stat_post_msg(prio, msg_id, msg);
     iot_share_task_post_event(prio, IOT_SHARE_EVENT_MSG_EVENT);
 
     return true;
@@ -141,7 +227,7 @@ bool_t iot_share_task_post_msg_from_isr(uint32_t prio, int32_t msg_id, void *dat
 bool_t iot_share_task_post_msg_from_isr(uint32_t prio, int32_t msg_id, void *data)
 {
     bool_t ret;
-    struct queue_item item = { msg_id, data };
+    struct queue_item item = { msg_id, data, iot_timer_get_time() };
     static os_queue_h msg;
     uint32_t dump_param[5];
 
@@ -162,6 +248,7 @@ bool_t iot_share_task_post_msg_from_isr(uint32_t prio, int32_t msg_id, void *dat
         dump_param[4] = os_queue_items_get(msg);                /* current queue size */
         ASSERT_FAILED_DUMP(dump_param, 5);
     }
+    share_task_stat_post_msg(prio, msg_id, msg);
     iot_share_task_post_event_from_isr(prio, IOT_SHARE_EVENT_MSG_EVENT);
 
     return true;
@@ -203,6 +290,268 @@ void iot_share_task_msg_unregister(int32_t msg_id)
     msg_id_unbind(msg_id);
 }
 
+static inline bool_t share_work_before(uint32_t ts, uint32_t ref)
+{
+    return (int32_t)(ts - ref) < 0;
+}
+
+/* with cpu critical, return true if the item was put on the run queue */
+static bool_t share_work_enqueue(uint32_t prio, iot_share_work_t *work)
+{
+    if (work->state == SHARE_WORK_ST_QUEUED) {
+        return false;
+    }
+
+    work->prio = (uint8_t)prio;
+    work->state = SHARE_WORK_ST_QUEUED;
+    work->queue_ts = iot_timer_get_time();
+    list_add_tail(&work->node, &iot_share_task_route_task(prio)->work_list);
+
+    return true;
+}
+
+//lint -sem(iot_share_task_work_handler, thread_protected)
+static void iot_share_task_work_handler(void *arg)
+{
+    struct share_task *task = arg;
+    iot_share_work_t *work;
+    uint32_t start;
+    uint32_t latency;
+    uint32_t run;
+    bool_t more;
+
+    for (uint32_t n = 0; n < SHARE_TASK_WORK_BATCH; n++) {
+        cpu_critical_enter();
+        if (list_empty(&task->work_list)) {
+            cpu_critical_exit();
+            return;
+        }
+        work = list_entry(task->work_list.next, iot_share_work_t, node);
+        list_del(&work->node);
+        work->state = SHARE_WORK_ST_IDLE;
+        cpu_critical_exit();
+
+        start = iot_timer_get_time();
+        latency = start - work->queue_ts;
+        work->func(work);
+        run = iot_timer_get_time() - start;
+
+        work->run_cnt++;
+        work->max_latency = MAX(work->max_latency, latency);
+        work->max_run = MAX(work->max_run, run);
+        share_task_stat_run(task, latency, run, work->func);
+    }
+
+    cpu_critical_enter();
+    more = !list_empty(&task->work_list);
+    cpu_critical_exit();
+
+    /* come back for the rest after the other events */
+    if (more) {
+        os_set_event(task->event, BIT(IOT_SHARE_EVENT_WORK_EVENT));
+    }
+}
+
+/* arm the timer for the first delayed item, no lock is held across the timer
+ * commands. It is done again if the list changed meanwhile, so the last
+ * command sent always matches the list. In the timer callback the one shot
+ * timer has expired already and the timer task must not wait on its own
+ * command queue. */
+static void share_work_timer_restart(bool_t in_timer)
+{
+    iot_share_work_t *work;
+    uint32_t gen;
+    uint32_t now;
+    uint32_t period;
+    bool_t armed;
+
+    do {
+        cpu_critical_enter();
+        gen = work_delayed_gen;
+        period = 0;
+        if (!list_empty(&work_delayed)) {
+            work = list_entry(work_delayed.next, iot_share_work_t, node);
+            now = os_boot_time32();
+            period = share_work_before(now, work->due_ms) ? work->due_ms - now : 1;
+        }
+        cpu_critical_exit();
+
+        if (period == 0) {
+            if (!in_timer) {
+                os_stop_timer(work_timer);
+            }
+            armed = true;
+        } else if (in_timer) {
+            armed = os_start_timer_nowait(work_timer, period);
+        } else {
+            os_start_timer(work_timer, period);
+            armed = true;
+        }
+
+        cpu_critical_enter();
+        work_timer_lost = !armed;
+        gen -= work_delayed_gen;
+        cpu_critical_exit();
+    } while (gen != 0 && armed);
+}
+
+static void iot_share_task_work_timer_handler(timer_id_t timer_id, void *arg)
+{
+    iot_share_work_t *work;
+    uint32_t now = os_boot_time32();
+    uint32_t post = 0;
+
+    UNUSED(timer_id);
+    UNUSED(arg);
+
+    for (;;) {
+        cpu_critical_enter();
+        if (list_empty(&work_delayed)) {
+            cpu_critical_exit();
+            break;
+        }
+        work = list_entry(work_delayed.next, iot_share_work_t, node);
+        if (share_work_before(now, work->due_ms)) {
+            cpu_critical_exit();
+            break;
+        }
+        list_del(&work->node);
+        work_delayed_gen++;
+        work->state = SHARE_WORK_ST_IDLE;
+        share_work_enqueue(work->prio, work);
+        cpu_critical_exit();
+        post |= BIT(work->prio);
+    }
+
+    share_work_timer_restart(true);
+
+    if (post & BIT(IOT_SHARE_TASK_QUEUE_HP)) {
+        iot_share_task_post_event(IOT_SHARE_TASK_QUEUE_HP, IOT_SHARE_EVENT_WORK_EVENT);
+    }
+    if (post & BIT(IOT_SHARE_TASK_QUEUE_LP)) {
+        iot_share_task_post_event(IOT_SHARE_TASK_QUEUE_LP, IOT_SHARE_EVENT_WORK_EVENT);
+    }
+}
+
+void iot_share_task_init_work(iot_share_work_t *work, iot_share_work_func func)
+{
+    assert(work && func);
+
+    memset(work, 0, sizeof(*work));
+    list_init(&work->node);
+    work->func = func;
+    work->state = SHARE_WORK_ST_IDLE;
+}
+
+bool_t iot_share_task_queue_work(uint32_t prio, iot_share_work_t *work)
+{
+    bool_t queued;
+
+    cpu_critical_enter();
+    queued = (work->state == SHARE_WORK_ST_DELAYED ? false : share_work_enqueue(prio, work));
+    cpu_critical_exit();
+
+    if (queued) {
+        iot_share_task_post_event(prio, IOT_SHARE_EVENT_WORK_EVENT);
+    }
+
+    return queued;
+}
+
+bool_t iot_share_task_queue_work_from_isr(uint32_t prio, iot_share_work_t *work) IRAM_TEXT(iot_share_task_queue_work_from_isr);
+bool_t iot_share_task_queue_work_from_isr(uint32_t prio, iot_share_work_t *work)
+{
+    bool_t queued;
+
+    cpu_critical_enter();
+    queued = (work->state == SHARE_WORK_ST_DELAYED ? false : share_work_enqueue(prio, work));
+    cpu_critical_exit();
+
+    if (queued) {
+        iot_share_task_post_event_from_isr(prio, IOT_SHARE_EVENT_WORK_EVENT);
+    }
+
+    return queued;
+}
+
+bool_t iot_share_task_queue_delayed_work(uint32_t prio, iot_share_work_t *work,
+                                         uint32_t delay_ms)
+{
+    struct list_head *pos;
+    iot_share_work_t *item;
+    uint32_t due_ms;
+    bool_t queued;
+    bool_t restart = false;
+
+    if (delay_ms == 0) {
+        return iot_share_task_queue_work(prio, work);
+    }
+
+    due_ms = os_boot_time32() + delay_ms;
+
+    /* state checked and changed with the insert, queue_work_from_isr may race.
+     * The list holds a few items, the walk is short. */
+    cpu_critical_enter();
+    queued = (work->state == SHARE_WORK_ST_IDLE);
+    if (queued) {
+        /* after the items due at the same time or earlier */
+        list_for_each(pos, &work_delayed) {
+            item = list_entry(pos, iot_share_work_t, node);
+            if (share_work_before(due_ms, item->due_ms)) {
+                break;
+            }
+        }
+        work->prio = (uint8_t)prio;
+        work->due_ms = due_ms;
+        list_add_tail(&work->node, pos);
+        work->state = SHARE_WORK_ST_DELAYED;
+        work_delayed_gen++;
+        restart = (work_delayed.next == &work->node || work_timer_lost);
+    }
+    cpu_critical_exit();
+
+    if (restart) {
+        share_work_timer_restart(false);
+    }
+
+    return queued;
+}
+
+bool_t iot_share_task_cancel_work(iot_share_work_t *work)
+{
+    bool_t pending;
+
+    cpu_critical_enter();
+    pending = (work->state != SHARE_WORK_ST_IDLE);
+    if (pending) {
+        list_del(&work->node);
+        work->state = SHARE_WORK_ST_IDLE;
+        work_delayed_gen++;
+    }
+    cpu_critical_exit();
+
+    /* a timer left for a cancelled first item just re-arms for the next */
+    return pending;
+}
+
+static void share_task_stat_post_event(struct share_task *task, uint32_t type) IRAM_TEXT(share_task_stat_post_event);
+static void share_task_stat_post_event(struct share_task *task, uint32_t type)
+{
+    struct event_stat *stat;
+
+    if (type >= SHARE_TASK_EVENT_STAT_NUM) {
+        return;
+    }
+
+    stat = &task->events[type];
+    cpu_critical_enter();
+    stat->post_cnt++;
+    if (!stat->post_ts) {
+        stat->post_ts = iot_timer_get_time() | 1;
+    }
+    cpu_critical_exit();
+}
+
 uint32_t iot_share_task_post_event(uint32_t prio,
                                     iot_share_event_type type)
 {
@@ -212,6 +561,7 @@ uint32_t iot_share_task_post_event(uint32_t prio,
         return RET_FAIL;
     }
 
+    share_task_stat_post_event(task, type);
     ret = os_set_event(task->event, BIT(type));
     if (!ret) {
         return RET_FAIL;
@@ -231,6 +581,7 @@ uint32_t iot_share_task_post_event_from_isr(uint32_t prio,
         return RET_FAIL;
     }
 
+    share_task_stat_post_event(task, type);
     ret = os_set_event_isr(task->event, BIT(type));
     if (!ret) {
         return RET_FAIL;
@@ -284,18 +635,144 @@ uint32_t iot_share_task_event_unregister(uint32_t prio,
     return RET_OK;
 }
 
-static void iot_share_task_handle_event(struct share_task *task, uint32_t event)
+static void share_task_stats_task_fill(struct share_task *task, uint16_t queue_len,
+                                       iot_share_task_stats_task_t *rec, bool_t clear)
 {
-    struct func_args *entry;
-    uint32_t type, mask;
+    rec->queue_len = queue_len;
+    rec->queue_high = task->queue_high;
+    rec->max_latency = task->max_latency;
+    rec->max_run = task->max_run;
+    rec->max_run_func = task->max_run_func;
+    memcpy(rec->hist, task->hist, sizeof(rec->hist));
+
+    if (clear) {
+        task->queue_high = 0;
+        task->max_latency = 0;
+        task->max_run = 0;
+        task->max_run_func = 0;
+        memset(task->hist, 0, sizeof(task->hist));
+    }
+}
+
+uint32_t iot_share_task_get_stats(uint8_t *buf, uint32_t len, bool_t clear)
+{
+    iot_share_task_stats_hdr_t *hdr = (iot_share_task_stats_hdr_t *)buf;
+    iot_share_task_stats_task_t *task_rec = (iot_share_task_stats_task_t *)(hdr + 1);
+    iot_share_task_stats_msg_t *msg_rec = (iot_share_task_stats_msg_t *)(task_rec + 2);
+    iot_share_task_stats_event_t *event_rec;
+    uint8_t *end = buf + len;
+    struct share_task *task;
+
+    if (len < sizeof(*hdr) + sizeof(*task_rec) * 2) {
+        return 0;
+    }
+
+    hdr->magic = IOT_SHARE_TASK_STATS_MAGIC;
+    hdr->version = IOT_SHARE_TASK_STATS_VERSION;
+    hdr->task_num = 2;
+    hdr->msg_num = 0;
+    hdr->event_num = 0;
+    hdr->hist_num = IOT_SHARE_TASK_HIST_NUM;
+    hdr->reserved = 0;
+
+    cpu_critical_enter();
+
+    share_task_stats_task_fill(&twins_task.faster, SHARE_TASK_FAST_QUEUE_LENGTH,
+                               &task_rec[0], clear);
+    share_task_stats_task_fill(&twins_task.slower, SHARE_TASK_SLOW_QUEUE_LENGTH,
+                               &task_rec[1], clear);
 
-    for (type = IOT_SHARE_EVENT_START; type < IOT_SHARE_EVENT_END; type++) {
-        mask = BIT(type);
-        if (mask & event) {
-            entry = &task->handlers[type];
+    for (uint32_t i = 1; i < SHARE_TASK_MSG_ID_TYPE; i++) {
+        struct msg_id_info *info = &msg_id_queue[i];
 
+        if (!info->func && !info->post_cnt) {
+            continue;
+        }
+        if ((uint8_t *)(msg_rec + 1) > end) {
+            break;
+        }
+        msg_rec->msg_id = (uint8_t)i;
+        memset(msg_rec->reserved, 0, sizeof(msg_rec->reserved));
+        msg_rec->func = (uint32_t)info->func;
+        msg_rec->post_cnt = info->post_cnt;
+        msg_rec->max_run = info->max_run;
+        msg_rec++;
+        hdr->msg_num++;
+        if (clear) {
+            info->post_cnt = 0;
+            info->max_run = 0;
+        }
+    }
+
+    event_rec = (iot_share_task_stats_event_t *)msg_rec;
+    for (uint32_t prio = IOT_SHARE_TASK_QUEUE_HP; prio <= IOT_SHARE_TASK_QUEUE_LP; prio++) {
+        task = iot_share_task_route_task(prio);
+        for (uint32_t type = 0; type < SHARE_TASK_EVENT_STAT_NUM; type++) {
+            struct event_stat *stat = &task->events[type];
+
+            if (!task->handlers[type].func && !stat->post_cnt) {
+                continue;
+            }
+            if ((uint8_t *)(event_rec + 1) > end) {
+                break;
+            }
+            event_rec->task = (uint8_t)prio;
+            event_rec->type = (uint8_t)type;
+            event_rec->reserved = 0;
+            event_rec->post_cnt = stat->post_cnt;
+            event_rec->max_run = stat->max_run;
+            event_rec++;
+            hdr->event_num++;
+            if (clear) {
+                stat->post_cnt = 0;
+                stat->max_run = 0;
+            }
+        }
+    }
+
+    cpu_critical_exit();
+
+    return (uint32_t)((uint8_t *)event_rec - buf);
+}
+
+static void iot_share_task_handle_event(struct share_task *task, uint32_t event)
+{
+    struct func_args *entry;
+    struct event_stat *stat;
+    uint32_t type;
+    uint32_t post_ts;
+    uint32_t start;
+    uint32_t run;
+
+    /* lowest event first, only the bits set are visited */
+    while (event) {
+        type = (uint32_t)__builtin_ctz(event);
+        event &= event - 1;
+        entry = &task->handlers[type];
+
+        if (type >= SHARE_TASK_EVENT_STAT_NUM) {
             if (entry->func)
                 entry->func(entry->arg);
+            continue;
+        }
+
+        stat = &task->events[type];
+        cpu_critical_enter();
+        post_ts = stat->post_ts;
+        stat->post_ts = 0;
+        cpu_critical_exit();
+
+        if (!entry->func)
+            continue;
+
+        start = iot_timer_get_time();
+        entry->func(entry->arg);
+        run = iot_timer_get_time() - start;
+        stat->max_run = MAX(stat->max_run, run);
+
+        /* messages and works count their own latency per item */
+        if (type != IOT_SHARE_EVENT_MSG_EVENT && type != IOT_SHARE_EVENT_WORK_EVENT) {
+            share_task_stat_run(task, post_ts ? start - post_ts : 0, run, entry->func);
         }
     }
 
@@ -339,6 +816,7 @@ static uint32_t create_share_task(struct share_task *task)
     task->task = p_task;
 
     memset(task->handlers, 0, sizeof(struct func_args) * IOT_SHARE_EVENT_END);
+    list_init(&task->work_list);
     return RET_OK;
 }
 
@@ -366,6 +844,25 @@ uint32_t iot_share_task_init(void)
         return RET_FAIL;
     }
 
+    list_init(&work_delayed);
+    work_timer = os_create_timer(IOT_SHARETASK_MID, false,
+                                 iot_share_task_work_timer_handler, NULL);
+    if (!work_timer) {
+        return RET_FAIL;
+    }
+
+    ret = iot_share_task_event_register(IOT_SHARE_TASK_QUEUE_HP,
+                                        IOT_SHARE_EVENT_WORK_EVENT,
+                                        iot_share_task_work_handler,
+                                        &twins_task.faster);
+    ret |= iot_share_task_event_register(IOT_SHARE_TASK_QUEUE_LP,
+                                         IOT_SHARE_EVENT_WORK_EVENT,
+                                         iot_share_task_work_handler,
+                                         &twins_task.slower);
+    if (ret != RET_OK) {
+        return RET_FAIL;
+    }
+
 #if (SHARE_TASK_FAST_QUEUE_LENGTH > 0)
     msg_faster = os_queue_create(IOT_SHARETASK_MID,
                                     SHARE_TASK_FAST_QUEUE_LENGTH,
@@ -405,6 +902,10 @@ uint32_t iot_share_task_init(void)
 
 void iot_share_task_deinit(void)
 {
+    if (work_timer) {
+        os_delete_timer(work_timer);
+        work_timer = 0;
+    }
     delete_share_task(&twins_task.slower);
     delete_share_task(&twins_task.faster);
 }
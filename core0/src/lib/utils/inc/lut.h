@@ -0,0 +1,51 @@
+/****************************************************************************
+
+Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+
+This Information is proprietary to WuQi Technologies and MAY NOT
+be copied by any method or incorporated into another program without
+the express written consent of WuQi. This Information or any portion
+thereof remains the property of WuQi. The Information contained herein
+is believed to be accurate and WuQi assumes no responsibility or
+liability for its use in any way and conveys no license or title under
+any patent or copyright and makes no representation or warranty that this
+Information is free from patent or copyright infringement.
+
+****************************************************************************/
+
+#ifndef LIB_UTILS_LUT_H
+#define LIB_UTILS_LUT_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Piecewise linear lookup table point
+ */
+typedef struct lut_point {
+    int32_t x;
+    int32_t y;
+} lut_point_t;
+
+/**
+ * @brief This function is to look up a piecewise linear table.
+ *
+ * Points must be sorted by x in ascending order. Value below the first point
+ * or above the last point is clamped to the y of that point, value between two
+ * points is linearly interpolated and rounded toward the lower point.
+ *
+ * @param table is the sorted point table
+ * @param num is the number of points in the table
+ * @param x is the value to look up
+ * @return int32_t the interpolated y value, 0 if table is empty
+ */
+int32_t lut_interp(const lut_point_t *table, uint32_t num, int32_t x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIB_UTILS_LUT_H */
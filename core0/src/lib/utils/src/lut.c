@@ -0,0 +1,53 @@
+/****************************************************************************
+
+Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+
+This Information is proprietary to WuQi Technologies and MAY NOT
+be copied by any method or incorporated into another program without
+the express written consent of WuQi. This Information or any portion
+thereof remains the property of WuQi. The Information contained herein
+is believed to be accurate and WuQi assumes no responsibility or
+liability for its use in any way and conveys no license or title under
+any patent or copyright and makes no representation or warranty that this
+Information is free from patent or copyright infringement.
+
+****************************************************************************/
+#include "types.h"
+#include "lut.h"
+
+int32_t lut_interp(const lut_point_t *table, uint32_t num, int32_t x)
+{
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t mid;
+
+    if (table == NULL || num == 0) {
+        return 0;
+    }
+
+    if (x <= table[0].x) {
+        return table[0].y;
+    } else if (x >= table[num - 1].x) {
+        return table[num - 1].y;
+    }
+
+    // Binary search for the segment with table[lo].x <= x < table[hi].x
+    lo = 0;
+    hi = num - 1;
+    while (hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if (x >= table[mid].x) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (table[hi].x == table[lo].x) {
+        return table[hi].y;
+    }
+
+    return table[lo].y
+        + (int32_t)(((int64_t)(x - table[lo].x) * (table[hi].y - table[lo].y))
+                    / (table[hi].x - table[lo].x));
+}
@@ -151,6 +151,40 @@ void vPortInitialiseBlocks( void ) PRIVILEGED_FUNCTION;
 size_t xPortGetFreeHeapSize( void ) PRIVILEGED_FUNCTION;
 size_t xPortGetMinimumEverFreeHeapSize( void ) PRIVILEGED_FUNCTION;
 
+/*
+ * Fragmentation helpers of heap_5.c.  Free blocks are counted per power of two
+ * size class, class n holds blocks of [ 2^n, 2^(n+1) ) bytes.
+ */
+#define portHEAP_HIST_NUM		32
+
+/*
+ * Called for each block of the heap in address order, region by region.
+ * Return pdFALSE to stop the walk.  The scheduler is suspended during the
+ * walk so the callback must not block or allocate.
+ */
+typedef BaseType_t ( *HeapWalkCallback_t )( void *pvArg, BaseType_t xRegion, void *pvBlock, size_t xBlockSize, BaseType_t xAllocated );
+
+/*
+ * Exact size of the largest free block.  It is cached and O(1) while no
+ * allocation took the largest block since the last call, otherwise the whole
+ * free list is walked once with the scheduler suspended, O(free blocks).
+ * Use xPortGetLargestFreeBlockClass() where that walk is not acceptable.
+ */
+size_t xPortGetLargestFreeBlockSize( void ) PRIVILEGED_FUNCTION;
+
+/*
+ * Largest free block rounded down to a power of two, always O(1).
+ */
+size_t xPortGetLargestFreeBlockClass( void ) PRIVILEGED_FUNCTION;
+void vPortGetFreeBlockHistogram( uint16_t *pusHist, size_t xNum ) PRIVILEGED_FUNCTION;
+void vPortHeapWalk( HeapWalkCallback_t pxCallback, void *pvArg ) PRIVILEGED_FUNCTION;
+
+/*
+ * Same walk without suspending the scheduler, only for the crash path where
+ * interrupts are disabled and no other task can run.
+ */
+void vPortHeapWalkUnlocked( HeapWalkCallback_t pxCallback, void *pvArg ) PRIVILEGED_FUNCTION;
+
 /*
  * Setup the hardware ready for the scheduler to take control.  This generally
  * sets up a tick interrupt and sets timers for the correct tick frequency.
@@ -493,6 +493,131 @@ uint32_t os_mem_get_heap_lowest_free(void)
     return (xPortGetMinimumEverFreeHeapSize());
 }
 
+uint32_t os_mem_get_heap_largest_free(void)
+{
+    return (xPortGetLargestFreeBlockSize());
+}
+
+uint32_t os_mem_get_heap_largest_free_class(void)
+{
+    return (xPortGetLargestFreeBlockClass());
+}
+
+void os_mem_get_heap_free_hist(uint16_t *hist, uint32_t num)
+{
+    vPortGetFreeBlockHistogram(hist, num);
+}
+
+typedef struct _os_mem_heap_map_ctxt_t {
+    os_mem_heap_map_hdr_t *hdr;
+    uint8_t *buf;
+    uint32_t len;
+    uint32_t pos;
+    BaseType_t region;
+} os_mem_heap_map_ctxt_t;
+
+static uint32_t os_mem_heap_map_put_varint(uint8_t *p, uint32_t v)
+{
+    uint32_t n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+
+    return n;
+}
+
+static BaseType_t os_mem_heap_map_walk_cb(void *arg, BaseType_t region, void *block,
+                                          size_t size, BaseType_t allocated)
+{
+    os_mem_heap_map_ctxt_t *ctxt = arg;
+    uint8_t tmp[16];
+    uint32_t n = 0;
+
+    if (region != ctxt->region) {
+        uint32_t addr = (uint32_t)block;
+
+        tmp[n++] = 0;
+        tmp[n++] = (uint8_t)addr;
+        tmp[n++] = (uint8_t)(addr >> 8);
+        tmp[n++] = (uint8_t)(addr >> 16);
+        tmp[n++] = (uint8_t)(addr >> 24);
+    }
+    n += os_mem_heap_map_put_varint(tmp + n, (uint32_t)((size >> OS_MEM_HEAP_MAP_UNIT_SHIFT) << 1)
+                                                 | (allocated ? 1U : 0U));
+
+    if (ctxt->pos + n > ctxt->len) {
+        ctxt->hdr->flags |= OS_MEM_HEAP_MAP_FLAG_TRUNCATED;
+        return pdFALSE;
+    }
+
+    if (region != ctxt->region) {
+        ctxt->region = region;
+        ctxt->hdr->region_num++;
+    }
+    memcpy(ctxt->buf + ctxt->pos, tmp, n);
+    ctxt->pos += n;
+    ctxt->hdr->block_num++;
+
+    return pdTRUE;
+}
+
+uint32_t os_mem_get_heap_map(uint8_t *buf, uint32_t len)
+{
+    os_mem_heap_map_ctxt_t ctxt;
+    os_mem_heap_map_hdr_t *hdr = (os_mem_heap_map_hdr_t *)buf;
+
+    if (!buf || len < sizeof(os_mem_heap_map_hdr_t)) {
+        return 0;
+    }
+
+    memset(hdr, 0, sizeof(os_mem_heap_map_hdr_t));
+    hdr->magic = OS_MEM_HEAP_MAP_MAGIC;
+    hdr->version = OS_MEM_HEAP_MAP_VERSION;
+    hdr->unit_shift = OS_MEM_HEAP_MAP_UNIT_SHIFT;
+    hdr->free_size = xPortGetFreeHeapSize();
+    hdr->largest_free = xPortGetLargestFreeBlockSize();
+
+    ctxt.hdr = hdr;
+    ctxt.buf = buf;
+    ctxt.len = len;
+    ctxt.pos = sizeof(os_mem_heap_map_hdr_t);
+    ctxt.region = -1;
+
+    vPortHeapWalk(os_mem_heap_map_walk_cb, &ctxt);
+
+    return ctxt.pos;
+}
+
+typedef struct _os_mem_heap_walk_ctxt_t {
+    os_mem_heap_walk_cb_t cb;
+    void *arg;
+} os_mem_heap_walk_ctxt_t;
+
+static BaseType_t os_mem_heap_walk_cb(void *arg, BaseType_t region, void *block,
+                                      size_t size, BaseType_t allocated)
+{
+    os_mem_heap_walk_ctxt_t *ctxt = arg;
+
+    UNUSED(region);
+    return ctxt->cb(ctxt->arg, block, (uint32_t)size, allocated != pdFALSE) ? pdTRUE : pdFALSE;
+}
+
+void os_mem_heap_walk_in_crash(os_mem_heap_walk_cb_t cb, void *arg)
+{
+    os_mem_heap_walk_ctxt_t ctxt;
+
+    if (!cb) {
+        return;
+    }
+
+    ctxt.cb = cb;
+    ctxt.arg = arg;
+    vPortHeapWalkUnlocked(os_mem_heap_walk_cb, &ctxt);
+}
+
 void os_mem_display_heap_malloc_info(void)
 {
 #if defined(OS_MALLOC_DEBUG_LEVEL) && OS_MALLOC_DEBUG_LEVEL >= 1
@@ -363,6 +363,13 @@ task_info_t* ICACHE_ATTR os_get_task_info(uint32_t *tasks_to_get, uint32_t *task
     return p_task_buf;
 }
 
+uint32_t os_get_idle_run_time(uint32_t *total_time)
+{
+    *total_time = portGET_RUN_TIME_COUNTER_VALUE();
+
+    return (uint32_t)xTaskGetIdleRunTimeCounter();
+}
+
 uint32_t os_get_cpu_utilization(void)
 {
     uint32_t cpu_u;
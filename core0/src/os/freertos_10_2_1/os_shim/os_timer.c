@@ -126,6 +126,15 @@ void os_start_timer(timer_id_t id, uint32_t period)
     xTimerChangePeriod((TimerHandle_t)id, period / portTICK_PERIOD_MS, portMAX_DELAY);
 }
 
+bool_t os_start_timer_nowait(timer_id_t id, uint32_t period)
+{
+    if (period == 0) {
+        /* avoid crash */
+        period = 1;
+    }
+    return xTimerChangePeriod((TimerHandle_t)id, period / portTICK_PERIOD_MS, 0) == pdPASS;
+}
+
 void os_stop_timer_from_isr(timer_id_t id)
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
@@ -94,6 +94,21 @@ your application. */
 #define INCLUDE_xTaskResumeFromISR              1
 #define INCLUDE_pxTaskGetStackStart             1
 /* A header file that defines trace macro can be included here. */
+#if defined(CPU_USAGE_TRACE_ENABLE) && !defined(OS_PROFILING_ENABLE) && !defined(__ASSEMBLER__)
+/* task cycle accounting in lib/cpu_usage */
+void cpu_usage_trace_task_ready(const void *task, const char *name);
+void cpu_usage_trace_task_switched_in(const void *task, const char *name);
+void cpu_usage_trace_task_switched_out(const void *task);
+void cpu_usage_trace_task_deleted(const void *task);
+#define traceMOVED_TASK_TO_READY_STATE(pxTCB) \
+    cpu_usage_trace_task_ready((pxTCB), (pxTCB)->pcTaskName)
+#define traceTASK_SWITCHED_IN() \
+    cpu_usage_trace_task_switched_in(pxCurrentTCB, pxCurrentTCB->pcTaskName)
+#define traceTASK_SWITCHED_OUT() \
+    cpu_usage_trace_task_switched_out(pxCurrentTCB)
+#define traceTASK_DELETE(pxTCB) \
+    cpu_usage_trace_task_deleted(pxTCB)
+#endif
 
 /* low power management */
 #define configUSE_TICKLESS_IDLE                 1
@@ -89,6 +89,9 @@ task.h is included from an application file. */
 /* Assumes 8bit bytes! */
 #define heapBITS_PER_BYTE		( ( size_t ) 8 )
 
+/* Most regions that can be tracked for the heap walk. */
+#define heapMAX_REGIONS			( ( size_t ) 4 )
+
 /* Define the linked list structure.  This is used to link free blocks in order
 of their memory address. */
 typedef struct A_BLOCK_LINK
@@ -107,6 +110,18 @@ typedef struct A_BLOCK_LINK
  */
 static void prvInsertBlockIntoFreeList( BlockLink_t *pxBlockToInsert );
 
+/*
+ * Keep the free block size histogram and the largest free block in step with
+ * every block that enters or leaves the free list.
+ */
+static void prvFreeBlockAdd( size_t xBlockSize );
+static void prvFreeBlockRemove( size_t xBlockSize );
+
+/*
+ * Visit every block of every region, the caller takes care of locking.
+ */
+static void prvHeapWalk( HeapWalkCallback_t pxCallback, void *pvArg );
+
 /*-----------------------------------------------------------*/
 
 /* The size of the structure placed at the beginning of each allocated memory
@@ -127,6 +142,73 @@ application.  When the bit is free the block is still part of the free heap
 space. */
 static size_t xBlockAllocatedBit = 0;
 
+/* Number of free blocks per power of two size class, bit n of
+uxFreeBlockClassMap is set while usFreeBlockHist[ n ] is not zero so the
+largest class is found with a single count-leading-zeros. */
+static uint16_t usFreeBlockHist[ portHEAP_HIST_NUM ];
+static uint32_t uxFreeBlockClassMap = 0U;
+
+/* Exact size of the largest free block.  Growing is tracked on every insert,
+only taking the largest block itself marks it stale, and the free list is
+walked again the next time it is read. */
+static size_t xLargestFreeBlock = 0U;
+static BaseType_t xLargestFreeBlockStale = pdFALSE;
+
+/* Start and end marker of each region, used to walk every block. */
+static BlockLink_t *pxRegionStart[ heapMAX_REGIONS ];
+static BlockLink_t *pxRegionEnd[ heapMAX_REGIONS ];
+static size_t xRegionNum = 0U;
+
+/*-----------------------------------------------------------*/
+
+static void prvFreeBlockAdd( size_t xBlockSize )
+{
+uint32_t ulClass;
+
+	/* Region end markers have no size and are never counted. */
+	if( xBlockSize == 0U )
+	{
+		return;
+	}
+	ulClass = 31U - ( uint32_t ) __builtin_clz( ( uint32_t ) xBlockSize );
+
+	if( usFreeBlockHist[ ulClass ] != 0xFFFFU )
+	{
+		usFreeBlockHist[ ulClass ]++;
+	}
+	uxFreeBlockClassMap |= ( 1UL << ulClass );
+
+	if( xBlockSize > xLargestFreeBlock )
+	{
+		xLargestFreeBlock = xBlockSize;
+	}
+}
+
+static void prvFreeBlockRemove( size_t xBlockSize )
+{
+uint32_t ulClass;
+
+	/* Region end markers have no size and are never counted. */
+	if( xBlockSize == 0U )
+	{
+		return;
+	}
+	ulClass = 31U - ( uint32_t ) __builtin_clz( ( uint32_t ) xBlockSize );
+
+	if( usFreeBlockHist[ ulClass ] != 0U )
+	{
+		usFreeBlockHist[ ulClass ]--;
+	}
+	if( usFreeBlockHist[ ulClass ] == 0U )
+	{
+		uxFreeBlockClassMap &= ~( 1UL << ulClass );
+	}
+
+	if( xBlockSize == xLargestFreeBlock )
+	{
+		xLargestFreeBlockStale = pdTRUE;
+	}
+}
 /*-----------------------------------------------------------*/
 
 void *pvPortMalloc( size_t xWantedSize )
@@ -192,6 +274,7 @@ void *pvReturn = NULL;
 					/* This block is being returned for use so must be taken out
 					of the list of free blocks. */
 					pxPreviousBlock->pxNextFreeBlock = pxBlock->pxNextFreeBlock;
+					prvFreeBlockRemove( pxBlock->xBlockSize );
 
 					/* If the block is larger than required it can be split into
 					two. */
@@ -331,6 +414,7 @@ void *pvReturn = NULL;
 					/* This block is being returned for use so must be taken out
 					of the list of free blocks. */
 					pxPreviousBlock->pxNextFreeBlock = pxBlock->pxNextFreeBlock;
+					prvFreeBlockRemove( pxBlock->xBlockSize );
 
 					/* If the block is larger than required it can be split into
 					two. */
@@ -503,6 +587,115 @@ size_t xPortGetMinimumEverFreeHeapSize( void )
 }
 /*-----------------------------------------------------------*/
 
+size_t xPortGetLargestFreeBlockSize( void )
+{
+BlockLink_t *pxBlock;
+size_t xLargest;
+
+	vTaskSuspendAll();
+	{
+		if( xLargestFreeBlockStale != pdFALSE )
+		{
+			xLargest = 0U;
+			for( pxBlock = xStart.pxNextFreeBlock; pxBlock != NULL; pxBlock = pxBlock->pxNextFreeBlock )
+			{
+				if( pxBlock->xBlockSize > xLargest )
+				{
+					xLargest = pxBlock->xBlockSize;
+				}
+			}
+			xLargestFreeBlock = xLargest;
+			xLargestFreeBlockStale = pdFALSE;
+		}
+		xLargest = xLargestFreeBlock;
+	}
+	( void ) xTaskResumeAll();
+
+	return xLargest;
+}
+/*-----------------------------------------------------------*/
+
+size_t xPortGetLargestFreeBlockClass( void )
+{
+	if( uxFreeBlockClassMap == 0U )
+	{
+		return 0U;
+	}
+
+	return ( ( size_t ) 1 ) << ( 31U - ( uint32_t ) __builtin_clz( uxFreeBlockClassMap ) );
+}
+/*-----------------------------------------------------------*/
+
+void vPortGetFreeBlockHistogram( uint16_t *pusHist, size_t xNum )
+{
+size_t x;
+
+	if( xNum > portHEAP_HIST_NUM )
+	{
+		xNum = portHEAP_HIST_NUM;
+	}
+
+	vTaskSuspendAll();
+	{
+		for( x = 0; x < xNum; x++ )
+		{
+			pusHist[ x ] = usFreeBlockHist[ x ];
+		}
+	}
+	( void ) xTaskResumeAll();
+}
+/*-----------------------------------------------------------*/
+
+static void prvHeapWalk( HeapWalkCallback_t pxCallback, void *pvArg )
+{
+BlockLink_t *pxBlock;
+size_t xRegion, xSize;
+BaseType_t xContinue = pdTRUE;
+
+	for( xRegion = 0; ( xRegion < xRegionNum ) && ( xContinue != pdFALSE ); xRegion++ )
+	{
+		pxBlock = pxRegionStart[ xRegion ];
+
+		/* Every block, free or allocated, starts with a BlockLink_t so the
+		region is walked by size up to its end marker. */
+		while( ( pxBlock < pxRegionEnd[ xRegion ] ) && ( xContinue != pdFALSE ) )
+		{
+			xSize = pxBlock->xBlockSize & ~xBlockAllocatedBit;
+			if( ( xSize < xHeapStructSize ) ||
+				( xSize > ( size_t ) ( ( uint8_t * ) pxRegionEnd[ xRegion ] - ( uint8_t * ) pxBlock ) ) )
+			{
+				/* Corrupted header, a block smaller than its header or
+				running past the end marker. Stop walking this region. */
+				break;
+			}
+
+			xContinue = pxCallback( pvArg, ( BaseType_t ) xRegion,
+									( void * ) pxBlock, xSize,
+									( pxBlock->xBlockSize & xBlockAllocatedBit ) != 0U );
+			pxBlock = ( BlockLink_t * ) ( ( ( uint8_t * ) pxBlock ) + xSize );
+		}
+	}
+}
+/*-----------------------------------------------------------*/
+
+void vPortHeapWalk( HeapWalkCallback_t pxCallback, void *pvArg )
+{
+	vTaskSuspendAll();
+	{
+		prvHeapWalk( pxCallback, pvArg );
+	}
+	( void ) xTaskResumeAll();
+}
+/*-----------------------------------------------------------*/
+
+void vPortHeapWalkUnlocked( HeapWalkCallback_t pxCallback, void *pvArg )
+{
+	/* Resuming the scheduler may yield, which must not happen in the crash
+	path, so the walk is done without suspending it. */
+	prvHeapWalk( pxCallback, pvArg );
+}
+/*-----------------------------------------------------------*/
+
 static void prvInsertBlockIntoFreeList( BlockLink_t *pxBlockToInsert )
 {
 BlockLink_t *pxIterator;
@@ -520,6 +713,7 @@ uint8_t *puc;
 	puc = ( uint8_t * ) pxIterator;
 	if( ( puc + pxIterator->xBlockSize ) == ( uint8_t * ) pxBlockToInsert )
 	{
+		prvFreeBlockRemove( pxIterator->xBlockSize );
 		pxIterator->xBlockSize += pxBlockToInsert->xBlockSize;
 		pxBlockToInsert = pxIterator;
 	}
@@ -536,6 +730,7 @@ uint8_t *puc;
 		if( pxIterator->pxNextFreeBlock != pxEnd )
 		{
 			/* Form one big block from the two blocks. */
+			prvFreeBlockRemove( pxIterator->pxNextFreeBlock->xBlockSize );
 			pxBlockToInsert->xBlockSize += pxIterator->pxNextFreeBlock->xBlockSize;
 			pxBlockToInsert->pxNextFreeBlock = pxIterator->pxNextFreeBlock->pxNextFreeBlock;
 		}
@@ -549,6 +744,8 @@ uint8_t *puc;
 		pxBlockToInsert->pxNextFreeBlock = pxIterator->pxNextFreeBlock;
 	}
 
+	prvFreeBlockAdd( pxBlockToInsert->xBlockSize );
+
 	/* If the block being inserted plugged a gab, so was merged with the block
 	before and the block after, then it's pxNextFreeBlock pointer will have
 	already been set, and should not be set here as that would make it point
@@ -641,6 +838,12 @@ const HeapRegion_t *pxHeapRegion;
 		}
 
 		xTotalHeapSize += pxFirstFreeBlockInRegion->xBlockSize;
+		prvFreeBlockAdd( pxFirstFreeBlockInRegion->xBlockSize );
+
+		configASSERT( xRegionNum < heapMAX_REGIONS );
+		pxRegionStart[ xRegionNum ] = pxFirstFreeBlockInRegion;
+		pxRegionEnd[ xRegionNum ] = pxEnd;
+		xRegionNum++;
 
 		/* Move onto the next HeapRegion_t structure. */
 		xDefinedRegions++;
@@ -46,6 +46,33 @@ typedef struct heap_region
     size_t length;
 } os_heap_region_t;
 
+/** @brief Free block histogram size, class n counts blocks of [2^n, 2^(n+1)) bytes. */
+#define OS_MEM_HEAP_HIST_NUM            32
+
+#define OS_MEM_HEAP_MAP_MAGIC           0x4D48  /* "HM" */
+#define OS_MEM_HEAP_MAP_VERSION         1
+/** @brief Block sizes in the map are in units of 1 << OS_MEM_HEAP_MAP_UNIT_SHIFT bytes. */
+#define OS_MEM_HEAP_MAP_UNIT_SHIFT      3
+/** @brief The buffer was too small, the map stops at the last whole block. */
+#define OS_MEM_HEAP_MAP_FLAG_TRUNCATED  0x01
+
+/**
+ * @brief Heap fragmentation map header. It is followed by LEB128 varints,
+ *        one per block in address order: (size_in_units << 1) | allocated.
+ *        A varint 0 starts a new region and is followed by the 4 bytes
+ *        little endian address of the first block of the region.
+ */
+typedef struct _os_mem_heap_map_hdr_t {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t unit_shift;
+    uint8_t flags;
+    uint8_t region_num;
+    uint16_t block_num;
+    uint32_t free_size;
+    uint32_t largest_free;
+} __attribute__((packed)) os_mem_heap_map_hdr_t;
+
 /**
  * @brief
  *
@@ -165,6 +192,65 @@ uint32_t os_mem_get_heap_free(void);
  */
 uint32_t os_mem_get_heap_lowest_free(void);
 
+/**
+ * @brief This function is used to get the largest free block of heap, which
+ *        is the biggest buffer os_mem_malloc can return. The size is cached,
+ *        but once the largest block was allocated the next call walks the
+ *        whole free list with the scheduler suspended, so keep it off hot
+ *        paths.
+ *
+ * @return uint32_t largest free block size in bytes.
+ */
+uint32_t os_mem_get_heap_largest_free(void);
+
+/**
+ * @brief This function is used to get the largest free block of heap rounded
+ *        down to a power of two, always O(1), for periodic reports.
+ *
+ * @return uint32_t largest free block size class in bytes.
+ */
+uint32_t os_mem_get_heap_largest_free_class(void);
+
+/**
+ * @brief This function is used to get heap's free block size histogram.
+ *
+ * @param hist is the buffer for free block count of each size class.
+ * @param num is the count of hist, at most OS_MEM_HEAP_HIST_NUM are filled.
+ */
+void os_mem_get_heap_free_hist(uint16_t *hist, uint32_t num);
+
+/**
+ * @brief This function is used to walk the heap and serialize a fragmentation
+ *        map of all regions registered by os_heap_init.
+ *
+ * @param buf is the buffer for the map, see os_mem_heap_map_hdr_t.
+ * @param len is the buffer length.
+ * @return uint32_t map length in bytes, 0 if buffer is too small for the header.
+ */
+uint32_t os_mem_get_heap_map(uint8_t *buf, uint32_t len);
+
+/**
+ * @brief Callback of os_mem_heap_walk_in_crash, called for each heap block
+ *        in address order.
+ *
+ * @param arg is the argument given to os_mem_heap_walk_in_crash.
+ * @param block is the block start, the allocator block header included.
+ * @param size is the block size in bytes, header included.
+ * @param allocated is true when the block is in use.
+ * @return bool_t true to go on, false to stop the walk.
+ */
+typedef bool_t (*os_mem_heap_walk_cb_t)(void *arg, void *block, uint32_t size,
+                                        bool_t allocated);
+
+/**
+ * @brief This function is used to walk every block of heap in the crash
+ *        path. No lock is taken, interrupts must be disabled already.
+ *
+ * @param cb is called for each block.
+ * @param arg is given to cb.
+ */
+void os_mem_heap_walk_in_crash(os_mem_heap_walk_cb_t cb, void *arg);
+
 /**
  * @brief This function is used to dump heap's malloc size with module id.
  */
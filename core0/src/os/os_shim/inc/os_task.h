@@ -252,6 +252,16 @@ uint32_t os_get_total_task_cnt(void);
  */
 task_info_t *os_get_task_info(uint32_t *tasks_to_get, uint32_t *task_time);
 
+/**
+ * @brief This function is used to get the run time of the idle task, the
+ *        busy time of a window is its total time minus the idle time. It's
+ *        up to date when called from any task other than the idle task.
+ *
+ * @param[out] total_time is the run time counter now.
+ * @return uint32_t the run time counter of the idle task.
+ */
+uint32_t os_get_idle_run_time(uint32_t *total_time);
+
 /**
  * @brief This function is used to get latest 5s' CPU utilization percentage.
  *
@@ -72,6 +72,17 @@ timer_id_t os_create_timer(module_id_t module_id,
  */
 void os_start_timer(timer_id_t id, uint32_t period);
 
+/**
+ * @brief os_start_timer_nowait() - start a timer without waiting for room in
+ *        the timer command queue. For the timer callbacks, which run in the
+ *        timer task and would wait on their own queue. Not for ISR.
+ *
+ * @param id is the id of the timer to be started.
+ * @param period is time period of the timer in milliseconds.
+ * @return true if started, false if the timer command queue is full.
+ */
+bool_t os_start_timer_nowait(timer_id_t id, uint32_t period);
+
 /**
  * @brief This function is used to stop a timer.
  *        This method should not be called in ISR.
@@ -11,6 +11,7 @@
 
 #include "iot_irq.h"
 #include "iot_debug.h"
+#include "iot_coredump.h"
 #include "iot_soc.h"
 #include "iot_dsp.h"
 #include "iot_rtc.h"
@@ -287,6 +288,11 @@ static void main_lib_init(void)
     key_value_init();
     storage_init();
 
+#if CONFIG_COREDUMP_FLASH
+    // erases the dump ring ahead and uploads the last crash dumps in share task
+    iot_core_dump_flash_init();
+#endif
+
 #ifdef LIB_DFS_ENABLE
     dfs_init_cfg_t dfs_init_cfg;
 
@@ -294,6 +300,9 @@ static void main_lib_init(void)
     dfs_init_cfg.init_timeout_ms = 10000;
 
     dfs_init(&dfs_init_cfg);
+#if CONFIG_DFS_GOV_ENABLE
+    dfs_governor_start(NULL);
+#endif
 #endif
 
 #ifdef LIB_BATTERY_ENABLE
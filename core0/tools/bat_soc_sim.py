@@ -0,0 +1,229 @@
+#! /usr/bin/env python3
+# Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+#
+# This Information is proprietary to WuQi Technologies and MAY NOT
+# be copied by any method or incorporated into another program without
+# the express written consent of WuQi. This Information or any portion
+# thereof remains the property of WuQi. The Information contained herein
+# is believed to be accurate and WuQi assumes no responsibility or
+# liability for its use in any way and conveys no license or title under
+# any patent or copyright and makes no representation or warranty that this
+# Information is free from patent or copyright infringement.
+#
+# Discharge trace replay of the battery level in app/tws/user_app/app_bat.c.
+# A trace gives the battery voltage in mV over time and optionally the true
+# level, lines of "time_s volt_mv [level]". Without a file a discharge with
+# adc noise and load dips is made up. The raw policy is the level from voltage
+# with the shake revise of the old code at a fixed check period, the filter
+# policies run battery_soc_update() with the check period stretching of
+# battery_check_period_get(), with and without the learned discharge rate.
+
+import bisect
+import random
+import sys
+
+from optparse import OptionParser
+
+CHECK_PERIOD_MS = 10 * 1000
+MAX_CHECK_PERIOD_MS = 60 * 1000
+
+SHIFT = 8
+VAR_INIT = 100 << SHIFT
+VAR_PROCESS = (1 << SHIFT) // 4
+VAR_VOLT = 16 << SHIFT
+OUTLIER_DIFF = 10 << SHIFT
+OUTLIER_VAR_SCALE = 16
+VAR_STABLE = 4 << SHIFT
+RATE_PERIOD_MS = 60 * 1000
+RATE_TAU_MS = 16 * 60 * 1000
+RATE_MAX = 10 << SHIFT
+
+# ro_cfg_default_battery()
+LOW_POWER_OFF_VOLT = 3100
+LOW_EVENT_VOLT = 3400
+LEVEL_VOLTS = (3000, 3100, 3200, 3300, 3400, 3500, 3600, 3700, 3800, 3900)
+
+
+def cdiv(a, b):
+    """c integer division, rounds toward zero"""
+    q = abs(a) // abs(b)
+    return q if (a < 0) == (b < 0) else -q
+
+
+def level_lut(level_volts, off_volt):
+    """mirrors volt_2_level_lut_init()"""
+    level_0 = off_volt
+    if level_0 > level_volts[0]:
+        level_0 = level_volts[0] - 500
+    return [(level_0, 0)] + [(v, i * 10 + 10) for i, v in enumerate(level_volts)]
+
+
+def lut_interp(table, x):
+    """mirrors lut_interp() in lib/utils/src/lut.c"""
+    if x <= table[0][0]:
+        return table[0][1]
+    if x >= table[-1][0]:
+        return table[-1][1]
+    hi = bisect.bisect_right([p[0] for p in table], x)
+    lo = hi - 1
+    if table[hi][0] == table[lo][0]:
+        return table[hi][1]
+    return table[lo][1] + cdiv((x - table[lo][0]) * (table[hi][1] - table[lo][1]),
+                               table[hi][0] - table[lo][0])
+
+
+class SocFilter(object):
+    """mirrors battery_soc_update() and battery_check_period_get() when discharging"""
+
+    def __init__(self, learn_rate):
+        self.learn_rate = learn_rate
+        self.soc = None
+        self.var = 0
+        self.rate = 0
+        self.period_ms = CHECK_PERIOD_MS
+
+    def update(self, volt_level):
+        meas = volt_level << SHIFT
+        if self.soc is None:
+            self.soc = meas
+            self.var = VAR_INIT
+            return volt_level
+
+        soc_prev = self.soc
+        if self.learn_rate:
+            self.soc -= cdiv(self.rate * self.period_ms, RATE_PERIOD_MS)
+        self.var += cdiv(VAR_PROCESS * self.period_ms, CHECK_PERIOD_MS)
+        self.var = min(self.var, VAR_INIT)
+
+        meas_var = VAR_VOLT
+        diff = meas - self.soc
+        if diff > OUTLIER_DIFF or diff < -OUTLIER_DIFF:
+            meas_var *= OUTLIER_VAR_SCALE
+        gain = cdiv(self.var << SHIFT, self.var + meas_var)
+        self.soc += (diff * gain) >> SHIFT
+        self.var = (self.var * ((1 << SHIFT) - gain)) >> SHIFT
+        self.soc = max(0, min(self.soc, 100 << SHIFT))
+
+        if self.learn_rate:
+            self.rate += cdiv((soc_prev - self.soc) * RATE_PERIOD_MS - self.rate * self.period_ms,
+                              RATE_TAU_MS)
+            self.rate = max(0, min(self.rate, RATE_MAX))
+
+        return (self.soc + (1 << (SHIFT - 1))) >> SHIFT
+
+    def next_period(self, is_low):
+        if is_low:
+            self.period_ms = CHECK_PERIOD_MS
+        elif self.var < VAR_STABLE:
+            self.period_ms = min(self.period_ms * 2, MAX_CHECK_PERIOD_MS)
+        else:
+            self.period_ms = max(self.period_ms // 2, CHECK_PERIOD_MS)
+        return self.period_ms
+
+
+def synth_trace(hours, noise_mv, dip_mv, dip_rate, lut, seed):
+    """(time s, volt mV, true level) every second of a linear discharge, the true
+    level is what the table gives for the voltage without noise"""
+    random.seed(seed)
+    total = int(hours * 3600)
+    trace = []
+    for t in range(total + 1):
+        level = 100.0 * (total - t) / total
+        # invert the level table for the open circuit voltage
+        for (x0, y0), (x1, y1) in zip(lut, lut[1:]):
+            if y0 <= level <= y1:
+                volt = x0 + (level - y0) * (x1 - x0) / float(max(y1 - y0, 1))
+                break
+        else:
+            volt = lut[-1][0] + (level - lut[-1][1]) * 10
+        level = lut_interp(lut, int(volt))
+        volt += random.gauss(0, noise_mv)
+        if random.random() < dip_rate:
+            volt -= dip_mv
+        trace.append((t, int(volt), level))
+    return trace
+
+
+def read_trace(name):
+    trace = []
+    with open(name) as f:
+        for line in f:
+            line = line.split('#')[0].split()
+            if line:
+                trace.append((float(line[0]), int(float(line[1])),
+                              float(line[2]) if len(line) > 2 else None))
+    return trace
+
+
+def replay(trace, lut, policy):
+    times = [p[0] for p in trace]
+    flt = SocFilter(policy == 'rate')
+    level = None
+    t_ms = 100
+    samples = 0
+    err_sum = 0.0
+    err_max = 0.0
+    err_num = 0
+    step_max = 0
+    end_ms = trace[-1][0] * 1000
+    while t_ms <= end_ms:
+        _, volt, truth = trace[max(bisect.bisect_right(times, t_ms / 1000.0) - 1, 0)]
+        samples += 1
+        volt_level = lut_interp(lut, volt)
+        new = volt_level if policy == 'raw' else flt.update(volt_level)
+        if level is not None:
+            # shake revise when discharging
+            new = min(new, level)
+            step_max = max(step_max, level - new)
+        level = new
+        if truth is not None:
+            err = abs(level - truth)
+            err_sum += err
+            err_max = max(err_max, err)
+            err_num += 1
+        if policy == 'raw':
+            t_ms += CHECK_PERIOD_MS
+        else:
+            t_ms += flt.next_period(volt < LOW_EVENT_VOLT)
+    return {'samples': samples, 'err': err_sum / max(err_num, 1) if err_num else None,
+            'err_max': err_max if err_num else None, 'step': step_max, 'rate': flt.rate}
+
+
+def main():
+    parser = OptionParser(usage='%prog [options] [trace.txt]')
+    parser.add_option('-H', '--hours', type='float', default=5.0, help='synthetic discharge time')
+    parser.add_option('-n', '--noise', type='float', default=15.0, help='adc noise std in mV')
+    parser.add_option('-d', '--dip', type='float', default=120.0,
+                      help='voltage dip under load in mV')
+    parser.add_option('-r', '--dip-rate', type='float', default=0.05,
+                      help='share of the samples taken in a dip')
+    parser.add_option('-o', '--off-volt', type='int', default=LOW_POWER_OFF_VOLT,
+                      help='battery_low_power_off_voltage')
+    parser.add_option('--seed', type='int', default=1)
+    (options, args) = parser.parse_args()
+
+    lut = level_lut(LEVEL_VOLTS, options.off_volt)
+    if args:
+        trace = read_trace(args[0])
+        name = args[0]
+    else:
+        trace = synth_trace(options.hours, options.noise, options.dip, options.dip_rate, lut,
+                            options.seed)
+        name = '%.1fh discharge, noise %.0f mV, %.0f%% dips of %.0f mV' % \
+            (options.hours, options.noise, options.dip_rate * 100, options.dip)
+    if not trace:
+        parser.error('empty trace')
+
+    print('trace %s, %d points over %.0f s' % (name, len(trace), trace[-1][0]))
+    print('policy\tsamples\tavg err\tmax err\tmax step\trate/min')
+    for policy in ('raw', 'filter', 'rate'):
+        r = replay(trace, lut, policy)
+        err = '%.2f\t%.0f' % (r['err'], r['err_max']) if r['err'] is not None else '-\t-'
+        print('%s\t%d\t%s\t%d\t%.2f' % (policy, r['samples'], err, r['step'],
+                                         r['rate'] / float(1 << SHIFT)))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
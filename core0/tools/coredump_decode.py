@@ -0,0 +1,330 @@
+#! /usr/bin/env python3
+# Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+#
+# This Information is proprietary to WuQi Technologies and MAY NOT
+# be copied by any method or incorporated into another program without
+# the express written consent of WuQi. This Information or any portion
+# thereof remains the property of WuQi. The Information contained herein
+# is believed to be accurate and WuQi assumes no responsibility or
+# liability for its use in any way and conveys no license or title under
+# any patent or copyright and makes no representation or warranty that this
+# Information is free from patent or copyright infringement.
+#
+# Binary core dump decoder for iot_task_dump_to_gtp() of
+# lib/iot_debug/src/iot_coredump.c, sent in the crash or uploaded from the
+# flash core dump ring after reboot. The input is either the payloads of the
+# panic log packets of DUMP_TID put back to back, or with --gtp a raw capture
+# of the uart. The frames are decoded to the core dump stream, which is
+# written as is with --raw and as an ELF core with one thread per task with
+# --core, to be opened by gdb together with the elf of the image.
+
+import struct
+import sys
+import zlib
+
+from optparse import OptionParser
+
+BIN_MAGIC = 0x4443
+BIN_FRAME_FMT = '<HBBHHI'
+FRAME_START, FRAME_LZ, FRAME_RAW, FRAME_FILL, FRAME_END = range(5)
+FRAME_NAMES = ('start', 'lz', 'raw', 'fill', 'end')
+OP_LITERAL, OP_FILL, OP_MATCH = range(3)
+
+GTP_SYNC = b'\xd0\xd2\xc5\xc2'
+GTP_HDR_FMT = '<BHBBHB'
+GTP_CRC_LEN = 4
+GTP_TYPE_PANIC_LOG = 0x05
+DUMP_TID = 3
+# uart of the generic transmission, 10 bits per byte on the line
+GTP_BAUD = 2000000
+# per frame limits of iot_core_dump_bin_tx, COREDUMP_BIN_TX_STALL_US and
+# CONFIG_COREDUMP_BIN_TX_MAX_MS
+TX_STALL_MS = 100
+TX_MAX_MS = 10000
+
+HDR_FMT = '<IIII'
+TASK_HDR_FMT = '<IIII'
+DATA_HDR_FMT = '<IIII'
+COREDUMP_VERSION_SPARSE = 2
+
+SEGMENTS = {0x01: 'data', 0x02: 'bss', 0x04: 'rom_data', 0x08: 'rom_bss', 0x10: 'share_memory',
+            0x20: 'heap', 0x40: 'heap2', 0x80: 'exchange', 0x100: 'rom_tbl'}
+
+# task context of the dumped stack after the SP/GP/TP words are put in:
+# mepc, 32 float registers, then x1 to x31 in order
+CTX_WORDS = 65
+CTX_PC = 0
+CTX_X1 = 33
+# bytes pushed by the trap, the stack pointer of the task is above them
+CTX_TRAP_SIZE = 248
+STACK_EXTRA = 12
+
+EM_RISCV = 243
+PT_LOAD = 1
+PT_NOTE = 4
+NT_PRSTATUS = 1
+PRSTATUS_SIZE = 204
+PRSTATUS_PID = 24
+PRSTATUS_REG = 72
+
+
+def read_varint(buf, pos):
+    v = 0
+    shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        v |= (b & 0x7f) << shift
+        shift += 7
+        if not b & 0x80:
+            return v, pos
+
+
+def lz_decode(payload, raw_len):
+    out = bytearray()
+    pos = 0
+    while pos < len(payload):
+        v, pos = read_varint(payload, pos)
+        n, op = v >> 2, v & 3
+        if op == OP_LITERAL:
+            out += payload[pos:pos + n]
+            pos += n
+        elif op == OP_FILL:
+            out += bytes([payload[pos]]) * n
+            pos += 1
+        elif op == OP_MATCH:
+            dist, pos = read_varint(payload, pos)
+            for _ in range(n):
+                out.append(out[-dist])
+        else:
+            raise ValueError('bad lz op %d' % op)
+    if len(out) != raw_len:
+        raise ValueError('lz block decoded to %d bytes, expected %d' % (len(out), raw_len))
+    return bytes(out)
+
+
+def gtp_payloads(data):
+    """payloads of the panic log packets of DUMP_TID in a raw uart capture"""
+    out = bytearray()
+    hdr_len = struct.calcsize(GTP_HDR_FMT)
+    pos = data.find(GTP_SYNC)
+    while pos >= 0 and pos + len(GTP_SYNC) + hdr_len <= len(data):
+        hdr = pos + len(GTP_SYNC)
+        _, pkt_len, pkt_type, fc, _, _ = struct.unpack_from(GTP_HDR_FMT, data, hdr)
+        pld_len = pkt_len - hdr_len - GTP_CRC_LEN
+        if pld_len >= 0 and hdr + pkt_len <= len(data):
+            if pkt_type == GTP_TYPE_PANIC_LOG and (fc & 0x7) == DUMP_TID:
+                out += data[hdr + hdr_len:hdr + hdr_len + pld_len]
+            pos = data.find(GTP_SYNC, hdr + pkt_len)
+        else:
+            pos = data.find(GTP_SYNC, pos + 1)
+    return bytes(out)
+
+
+def decode_frames(data):
+    """core dump stream and frame statistics"""
+    frame_len = struct.calcsize(BIN_FRAME_FMT)
+    stream = bytearray()
+    stats = {'frames': 0, 'lost': 0, 'bytes': 0, 'crc': None, 'total': None, 'core': None,
+             'types': {}}
+    seq = None
+    pos = 0
+    while pos + frame_len <= len(data):
+        magic, ftype, core, fseq, pld_len, raw_len = struct.unpack_from(BIN_FRAME_FMT, data, pos)
+        if magic != BIN_MAGIC or pos + frame_len + pld_len > len(data):
+            pos += 1
+            continue
+        payload = data[pos + frame_len:pos + frame_len + pld_len]
+        pos += frame_len + pld_len
+        if ftype == FRAME_START:
+            stream = bytearray()
+            stats.update({'frames': 0, 'lost': 0, 'bytes': 0, 'core': core, 'types': {}})
+        elif seq is not None and fseq != (seq + 1) & 0xffff:
+            stats['lost'] += (fseq - seq - 1) & 0xffff
+        seq = fseq
+        stats['frames'] += 1
+        stats['bytes'] += frame_len + pld_len
+        num, wire, raw = stats['types'].get(ftype, (0, 0, 0))
+        if ftype in (FRAME_LZ, FRAME_RAW, FRAME_FILL):
+            raw += raw_len
+        stats['types'][ftype] = (num + 1, wire + frame_len + pld_len, raw)
+        if ftype == FRAME_LZ:
+            stream += lz_decode(payload, raw_len)
+        elif ftype == FRAME_RAW:
+            stream += payload
+        elif ftype == FRAME_FILL:
+            stream += payload[:1] * raw_len
+        elif ftype == FRAME_END:
+            stats['crc'] = struct.unpack('<I', payload)[0]
+            stats['total'] = raw_len
+            break
+    return bytes(stream), stats
+
+
+def parse_stream(stream):
+    """tasks and memory chunks of the core dump stream, in writing order"""
+    data_len, version, tasks_num, tcb_sz = struct.unpack_from(HDR_FMT, stream)
+    pos = struct.calcsize(HDR_FMT)
+    tasks = []
+    chunks = []
+    for _ in range(tasks_num):
+        tcb, handle, stack_start, stack_end = struct.unpack_from(TASK_HDR_FMT, stream, pos)
+        pos += struct.calcsize(TASK_HDR_FMT)
+        chunks.append((tcb, stream[pos:pos + tcb_sz], 'tcb'))
+        pos += tcb_sz
+        stack = b''
+        if stack_start and stack_end > stack_start:
+            stack = stream[pos:pos + stack_end - stack_start]
+            chunks.append((stack_start, stack, 'stack'))
+            pos += stack_end - stack_start
+        tasks.append({'tcb': tcb, 'handle': handle, 'stack_start': stack_start,
+                      'stack_end': stack_end, 'stack': stack})
+    segments = []
+    while pos + struct.calcsize(DATA_HDR_FMT) <= len(stream):
+        flag, seg_id, start, end = struct.unpack_from(DATA_HDR_FMT, stream, pos)
+        pos += struct.calcsize(DATA_HDR_FMT)
+        if end < start or pos + end - start > len(stream):
+            raise ValueError('bad segment 0x%x at stream offset %d' % (flag, pos))
+        chunks.append((start, stream[pos:pos + end - start], SEGMENTS.get(flag, hex(flag))))
+        segments.append((flag, seg_id, start, end))
+        pos += end - start
+    return {'version': version, 'data_len': data_len, 'tcb_sz': tcb_sz, 'tasks': tasks,
+            'segments': segments, 'chunks': chunks}
+
+
+def task_regs(task):
+    """pc, x1 to x31 of the context on the task stack"""
+    stack = task['stack']
+    if len(stack) < CTX_WORDS * 4:
+        return None
+    words = struct.unpack_from('<%dI' % CTX_WORDS, stack)
+    regs = [words[CTX_PC]] + list(words[CTX_X1:CTX_X1 + 31])
+    regs[2] = task['stack_start'] + STACK_EXTRA + CTX_TRAP_SIZE
+    return regs
+
+
+def merge_chunks(chunks):
+    """non overlapping memory regions, later chunks win where they overlap"""
+    spans = []
+    for addr, data, _ in sorted(chunks, key=lambda c: c[0]):
+        end = addr + len(data)
+        if spans and addr <= spans[-1][1]:
+            spans[-1][1] = max(spans[-1][1], end)
+        elif data:
+            spans.append([addr, end])
+    regions = [(start, bytearray(end - start)) for start, end in spans]
+    for addr, data, _ in chunks:
+        for start, buf in regions:
+            if start <= addr < start + len(buf):
+                buf[addr - start:addr - start + len(data)] = data
+                break
+    return regions
+
+
+def note(name, ntype, desc):
+    name = name + b'\0'
+    out = struct.pack('<III', len(name), len(desc), ntype) + name
+    out += b'\0' * (-len(out) % 4) + desc
+    return out + b'\0' * (-len(out) % 4)
+
+
+def write_core(path, dump):
+    notes = b''
+    for i, task in enumerate(dump['tasks']):
+        regs = task_regs(task)
+        if regs is None:
+            continue
+        prstatus = bytearray(PRSTATUS_SIZE)
+        struct.pack_into('<I', prstatus, PRSTATUS_PID, i + 1)
+        struct.pack_into('<32I', prstatus, PRSTATUS_REG, *regs)
+        notes += note(b'CORE', NT_PRSTATUS, bytes(prstatus))
+    regions = merge_chunks(dump['chunks'])
+
+    ehdr_len, phdr_len = 52, 32
+    phnum = 1 + len(regions)
+    offset = ehdr_len + phnum * phdr_len
+    phdrs = struct.pack('<IIIIIIII', PT_NOTE, offset, 0, 0, len(notes), 0, 0, 4)
+    offset += len(notes)
+    for addr, buf in regions:
+        phdrs += struct.pack('<IIIIIIII', PT_LOAD, offset, addr, addr, len(buf), len(buf), 7, 4)
+        offset += len(buf)
+    ident = b'\x7fELF' + bytes([1, 1, 1, 0]) + b'\0' * 8
+    ehdr = ident + struct.pack('<HHIIIIIHHHHHH', 4, EM_RISCV, 1, 0, ehdr_len, 0, 0,
+                               ehdr_len, phdr_len, phnum, 40, 0, 0)
+    with open(path, 'wb') as f:
+        f.write(ehdr + phdrs + notes)
+        for _, buf in regions:
+            f.write(buf)
+    return len(regions)
+
+
+def main():
+    parser = OptionParser(usage='%prog [options] dump.bin')
+    parser.add_option('-g', '--gtp', action='store_true', help='input is a raw uart capture')
+    parser.add_option('-r', '--raw', help='write the decoded core dump stream')
+    parser.add_option('-c', '--core', help='write an ELF core')
+    parser.add_option('-b', '--baud', type='int', default=GTP_BAUD,
+                      help='uart baud rate for the time estimate [default: %default]')
+    (options, args) = parser.parse_args()
+
+    if len(args) != 1:
+        parser.print_help()
+        return 1
+
+    with open(args[0], 'rb') as f:
+        data = f.read()
+    if options.gtp:
+        data = gtp_payloads(data)
+    stream, stats = decode_frames(data)
+
+    print('core %s: %d frames, %d bytes for %d bytes of core dump (%.1fx)' %
+          (stats['core'], stats['frames'], stats['bytes'], len(stream),
+           len(stream) / float(max(stats['bytes'], 1))))
+    for ftype, (num, wire, raw) in sorted(stats['types'].items()):
+        name = FRAME_NAMES[ftype] if ftype < len(FRAME_NAMES) else str(ftype)
+        print('  %-6s %6d frames %8d bytes for %8d bytes' % (name, num, wire, raw))
+    # one generic transmission packet per frame at least
+    wire = stats['bytes'] + stats['frames'] * (len(GTP_SYNC) + struct.calcsize(GTP_HDR_FMT)
+                                               + GTP_CRC_LEN)
+    tx_ms = wire * 10 * 1000.0 / options.baud
+    print('about %d bytes on the uart, %.1f ms at %d baud (dump gives up after %d ms, '
+          'or %d ms without progress)' % (wire, tx_ms, options.baud, TX_MAX_MS, TX_STALL_MS))
+    if tx_ms >= TX_MAX_MS:
+        print('the dump does not fit in the time limit, raise CONFIG_COREDUMP_BIN_TX_MAX_MS')
+    if stats['lost']:
+        print('%d frames lost, the dump is not usable' % stats['lost'])
+        return 1
+    if stats['total'] is None:
+        print('no end frame, the dump was cut')
+    elif stats['total'] != len(stream) or stats['crc'] != zlib.crc32(stream) & 0xffffffff:
+        print('length or crc mismatch, the dump is corrupted')
+        return 1
+
+    if options.raw:
+        with open(options.raw, 'wb') as f:
+            f.write(stream)
+
+    dump = parse_stream(stream)
+    print('version %d, %d tasks, tcb size %d' %
+          (dump['version'], len(dump['tasks']), dump['tcb_sz']))
+    for task in dump['tasks']:
+        regs = task_regs(task)
+        print('  tcb 0x%08x stack 0x%08x-0x%08x pc 0x%08x ra 0x%08x' %
+              (task['tcb'], task['stack_start'], task['stack_end'],
+               regs[0] if regs else 0, regs[1] if regs else 0))
+    sizes = {}
+    for flag, _, start, end in dump['segments']:
+        name = SEGMENTS.get(flag, hex(flag))
+        sizes[name] = (sizes.get(name, (0, 0))[0] + 1, sizes.get(name, (0, 0))[1] + end - start)
+    for name, (num, size) in sorted(sizes.items()):
+        print('  %-12s %6d bytes in %d segments' % (name, size, num))
+
+    if options.core:
+        num = write_core(options.core, dump)
+        print('%s: %d load segments' % (options.core, num))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
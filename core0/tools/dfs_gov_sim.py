@@ -0,0 +1,176 @@
+#! /usr/bin/env python3
+# Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+#
+# This Information is proprietary to WuQi Technologies and MAY NOT
+# be copied by any method or incorporated into another program without
+# the express written consent of WuQi. This Information or any portion
+# thereof remains the property of WuQi. The Information contained herein
+# is believed to be accurate and WuQi assumes no responsibility or
+# liability for its use in any way and conveys no license or title under
+# any patent or copyright and makes no representation or warranty that this
+# Information is free from patent or copyright infringement.
+#
+# Trace replay of the dfs load governor in lib/dfs/src/callee/dtop/dfs.c.
+# A trace gives the dtop work of each governor window in MHz (Mcycles/s) and
+# optionally the clock floor of the started dfs objects. Work not done in its
+# window is carried over and counts as a deadline miss. The energy proxy is
+# cycles x V^2 plus a leakage term per ms at the voltage of the clock.
+
+import random
+import sys
+
+from optparse import OptionParser
+
+CLOCKS = (16, 32, 48, 64, 80, 96, 128, 160)
+# relative core voltage per clock, assumed, tune with --volt
+VOLT = {16: 0.80, 32: 0.80, 48: 0.85, 64: 0.90, 80: 0.95, 96: 1.00, 128: 1.05, 160: 1.10}
+LEAK_PER_MS = 2.0
+
+
+class Governor(object):
+    """mirrors dfs_gov_timer_handler() and dfs_gov_level_get()"""
+
+    def __init__(self, target, down_windows, burst_load, floor_mhz):
+        self.target = target
+        self.down_windows = down_windows
+        self.burst_load = burst_load
+        self.floor_mhz = floor_mhz
+        self.avg_demand = 0
+        self.down_cnt = 0
+        self.down_level = 0
+        self.level = self.level_get(0)
+
+    def level_get(self, demand):
+        for clk in CLOCKS:
+            if clk >= self.floor_mhz and clk * self.target >= demand:
+                return clk
+        return CLOCKS[-1]
+
+    def sample(self, load, cur_mhz):
+        demand = load * cur_mhz
+        if self.burst_load and load >= self.burst_load:
+            # saturated, step up to twice the clock at once
+            self.avg_demand = max(self.avg_demand, demand)
+            self.down_cnt = 0
+            self.level = max(self.level, self.level_get(demand * 2))
+            return self.level
+        self.avg_demand = (self.avg_demand + demand) // 2
+        level = self.level_get(max(demand, self.avg_demand))
+        if level >= self.level:
+            self.down_cnt = 0
+        else:
+            self.down_level = level if self.down_cnt == 0 else max(self.down_level, level)
+            self.down_cnt += 1
+            if self.down_cnt < self.down_windows:
+                return self.level
+            self.down_cnt = 0
+            level = self.down_level
+        self.level = level
+        return level
+
+
+def synth_trace(name, windows, seed):
+    """(work MHz, floor MHz) per window"""
+    random.seed(seed)
+    trace = []
+    for w in range(windows):
+        if name == 'music':
+            # a2dp decode with a burst every 4 windows
+            work = 14 + random.uniform(-3, 3) + (20 if w % 4 == 0 else 0)
+            floor = 32
+        elif name == 'voice':
+            work = 38 + random.uniform(-6, 6)
+            floor = 32
+        elif name == 'idle':
+            work = 2 + (30 if random.random() < 0.05 else 0)
+            floor = 16
+        else:
+            # mixed phases of idle, music and ota
+            phase = (w // 200) % 3
+            work = (3, 18, 55)[phase] + random.uniform(-4, 4) + \
+                (40 if random.random() < 0.03 else 0)
+            floor = (16, 32, 64)[phase]
+        trace.append((max(work, 0.0), floor))
+    return trace
+
+
+def read_trace(name):
+    trace = []
+    with open(name) as f:
+        for line in f:
+            line = line.split('#')[0].split()
+            if line:
+                trace.append((float(line[0]), int(line[1]) if len(line) > 1 else CLOCKS[0]))
+    return trace
+
+
+def replay(trace, window_ms, policy, options):
+    gov = Governor(options.target, options.down_windows, options.burst_load, options.floor_mhz)
+    backlog = 0.0
+    energy = 0.0
+    misses = 0
+    max_backlog_ms = 0.0
+    mhz_sum = 0.0
+    for work, floor in trace:
+        if policy == 'static':
+            mhz = max(options.static_mhz, floor)
+        else:
+            mhz = max(gov.level, floor)
+        todo = backlog + work * window_ms
+        cap = mhz * window_ms
+        done = min(todo, cap)
+        backlog = todo - done
+        busy_ms = done / mhz
+        energy += done * VOLT[mhz] ** 2 + LEAK_PER_MS * window_ms * VOLT[mhz] ** 2
+        mhz_sum += mhz
+        if backlog > 1e-9:
+            misses += 1
+            max_backlog_ms = max(max_backlog_ms, backlog / mhz)
+        if policy == 'gov':
+            gov.sample(int(busy_ms * 100 / window_ms), mhz)
+    return {'energy': energy, 'misses': misses, 'backlog': max_backlog_ms,
+            'mhz': mhz_sum / max(len(trace), 1)}
+
+
+def main():
+    parser = OptionParser(usage='%prog [options] [trace.txt]')
+    parser.add_option('-p', '--profile', default='mixed',
+                      help='synthetic trace without a file: music, voice, idle or mixed')
+    parser.add_option('-n', '--windows', type='int', default=3000, help='synthetic windows')
+    parser.add_option('-w', '--window-ms', type='int', default=50, help='CONFIG_DFS_GOV_WINDOW_MS')
+    parser.add_option('-t', '--target', type='int', default=90, help='CONFIG_DFS_GOV_TARGET_LOAD')
+    parser.add_option('-d', '--down-windows', type='int', default=4,
+                      help='CONFIG_DFS_GOV_DOWN_WINDOWS')
+    parser.add_option('-b', '--burst-load', type='int', default=95,
+                      help='CONFIG_DFS_GOV_BURST_LOAD, 0 to turn the step up off')
+    parser.add_option('-f', '--floor-mhz', type='int', default=32, help='CONFIG_DFS_GOV_FLOOR_MHZ')
+    parser.add_option('-s', '--static-mhz', type='int', default=64,
+                      help='clock held by the explicit objects without the governor')
+    parser.add_option('--seed', type='int', default=1)
+    (options, args) = parser.parse_args()
+
+    if args:
+        trace = read_trace(args[0])
+        name = args[0]
+    else:
+        trace = synth_trace(options.profile, options.windows, options.seed)
+        name = options.profile
+    if options.static_mhz not in CLOCKS:
+        parser.error('static clock must be one of %s' % (CLOCKS,))
+
+    print('trace %s, %d windows of %d ms, target %d%%, down after %d windows, burst %d%%, '
+          'floor %d MHz' % (name, len(trace), options.window_ms, options.target,
+                            options.down_windows, options.burst_load, options.floor_mhz))
+    print('policy\tavg MHz\tenergy\tmisses\tmax backlog/ms')
+    base = None
+    for policy in ('static', 'gov'):
+        r = replay(trace, options.window_ms, policy, options)
+        base = base or r['energy']
+        print('%s\t%.1f\t%.3f\t%d\t%.2f' %
+              (policy, r['mhz'], r['energy'] / base, r['misses'], r['backlog']))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
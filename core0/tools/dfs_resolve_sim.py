@@ -0,0 +1,236 @@
+#! /usr/bin/env python3
+# Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+#
+# This Information is proprietary to WuQi Technologies and MAY NOT
+# be copied by any method or incorporated into another program without
+# the express written consent of WuQi. This Information or any portion
+# thereof remains the property of WuQi. The Information contained herein
+# is believed to be accurate and WuQi assumes no responsibility or
+# liability for its use in any way and conveys no license or title under
+# any patent or copyright and makes no representation or warranty that this
+# Information is free from patent or copyright infringement.
+#
+# Cross check of the dfs clock mode resolver in lib/dfs/src/callee/dtop/dfs.c.
+# The dfs tables are read from the source, random start/stop sequences are
+# resolved by the old walk over every active object and by the per domain
+# demand counters of dfs_demand_update()/dfs_demand_resolve(), and the modes
+# must match after every request.
+
+import os
+import random
+import re
+import sys
+
+from optparse import OptionParser
+
+SRC = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src', 'lib', 'dfs')
+
+CLOCK_LEVEL = {16: 1, 32: 2, 48: 3, 64: 4, 80: 5, 96: 6, 128: 8, 160: 10}
+LEVEL_16M = CLOCK_LEVEL[16]
+
+GROUPS = ('SHARED_FIXED', 'SHARED_ATLEAST', 'DSP', 'BT', 'DTOP')
+FIXED, SHARED = 0, 1
+
+RET_OK, RET_EXIST, RET_PENDING, RET_FAIL = 'ok', 'exist', 'pending', 'fail'
+
+
+def parse_objs(text):
+    """DFS_OBJ enum of dfs.h, name -> value"""
+    body = re.search(r'typedef enum \{(.*?)\} DFS_OBJ;', text, re.S).group(1)
+    objs = {}
+    value = 0
+    for line in body.split('\n'):
+        line = line.split('//')[0].strip().rstrip(',')
+        if not line:
+            continue
+        name, _, expr = line.partition('=')
+        name, expr = name.strip(), expr.strip()
+        if expr:
+            value = objs[expr] if expr in objs else int(expr, 0)
+        objs[name] = value
+        value += 1
+    return objs
+
+
+def parse_tables(text):
+    """dfs tables of dfs.c, table name -> {obj name: mode}"""
+    tables = {}
+    for m in re.finditer(r'static const IOT_CLOCK_MODE (\w+)\[\w+\] = \{(.*?)\};', text, re.S):
+        tables[m.group(1)] = dict((o, int(n)) for o, n in re.findall(
+            r'\[DFS_OBJ_GRP_\w+_OFFSET\((DFS_OBJ_\w+)\)\]\s*=\s*IOT_CLOCK_MODE_(\d+)', m.group(2)))
+    return tables
+
+
+def mode_clocks(fixed_table):
+    """the fixed objects are named after the clocks of their mode"""
+    clocks = {}
+    for name, mode in fixed_table.items():
+        mhz = re.search(r'_(\d+)_(\d+)_(\d+)M$', name).groups()
+        clocks[mode] = tuple(CLOCK_LEVEL[int(v)] for v in mhz)
+    return clocks
+
+
+class Model(object):
+    def __init__(self, objs, tables, music_32m_disable):
+        self.clocks = mode_clocks(tables['s_dfs_shared_fixed_table'])
+        self.modes = dict((v, k) for k, v in self.clocks.items())
+        suffix = '_music_32m_disable' if music_32m_disable else ''
+        self.groups = []
+        for grp in GROUPS:
+            name = 's_dfs_%s_table' % grp.lower()
+            if grp in ('DSP', 'BT', 'DTOP'):
+                name += suffix
+            start = objs['DFS_OBJ_%s_START' % grp]
+            tab = dict((objs[o] - start, mode) for o, mode in tables[name].items())
+            self.groups.append((start, objs['DFS_OBJ_%s_END' % grp], tab))
+
+    def locate(self, obj):
+        for idx, (start, end, tab) in enumerate(self.groups):
+            if start <= obj < end:
+                return idx, obj - start
+        raise ValueError('bad obj %d' % obj)
+
+    def objs(self):
+        return [start + i for start, end, _ in self.groups for i in range(end - start)]
+
+
+class OldResolver(object):
+    """the walk over every active object"""
+
+    def __init__(self, model):
+        self.model = model
+        self.masks = [0] * len(GROUPS)
+        self.lookups = []
+
+    def active(self, obj):
+        grp, idx = self.model.locate(obj)
+        return bool(self.masks[grp] & (1 << idx))
+
+    def request(self, obj, start):
+        grp, idx = self.model.locate(obj)
+        if bool(self.masks[grp] & (1 << idx)) == start:
+            return RET_EXIST, None
+        self.masks[grp] ^= 1 << idx
+        if grp == 0 and self.masks[0]:
+            grps = range(0, 1)
+        elif self.masks[0]:
+            return RET_PENDING, None
+        else:
+            grps = range(1, len(GROUPS))
+        clk = [LEVEL_16M] * 3
+        self.lookups.append(0)
+        for g in grps:
+            tab = self.model.groups[g][2]
+            for i in range(32):
+                if self.masks[g] & (1 << i):
+                    self.lookups[-1] += 3
+                    clk = [max(a, b) for a, b in zip(clk, self.model.clocks[tab[i]])]
+        assert clk[0] == clk[1]
+        mode = self.model.modes.get(tuple(clk))
+        return (RET_OK, mode) if mode is not None else (RET_FAIL, None)
+
+
+class DemandResolver(object):
+    """mirrors dfs_demand_update() and dfs_demand_resolve()"""
+
+    def __init__(self, model):
+        self.model = model
+        self.masks = [0] * len(GROUPS)
+        self.cnt = [[[0] * 16 for _ in range(3)] for _ in range(2)]
+        self.level_mask = [[0] * 3 for _ in range(2)]
+
+    def update(self, grp, idx, add):
+        demand = FIXED if grp == 0 else SHARED
+        clk = self.model.clocks[self.model.groups[grp][2][idx]]
+        for domain in range(3):
+            level = clk[domain]
+            self.cnt[demand][domain][level] += 1 if add else -1
+            assert self.cnt[demand][domain][level] >= 0
+            if self.cnt[demand][domain][level]:
+                self.level_mask[demand][domain] |= 1 << level
+            else:
+                self.level_mask[demand][domain] &= ~(1 << level)
+
+    def top(self, demand, domain):
+        return (self.level_mask[demand][domain] | 1 << LEVEL_16M).bit_length() - 1
+
+    def request(self, obj, start):
+        grp, idx = self.model.locate(obj)
+        if bool(self.masks[grp] & (1 << idx)) == start:
+            return RET_EXIST, None
+        self.masks[grp] ^= 1 << idx
+        self.update(grp, idx, start)
+        if grp == 0 and self.masks[0]:
+            demand = FIXED
+        elif self.masks[0]:
+            return RET_PENDING, None
+        else:
+            demand = SHARED
+        dtop, bt, dsp = [self.top(demand, d) for d in range(3)]
+        assert dtop == bt
+        mode = self.model.modes.get((dtop, dtop, dsp))
+        return (RET_OK, mode) if mode is not None else (RET_FAIL, None)
+
+
+def read_file(name):
+    with open(name) as f:
+        return f.read()
+
+
+def main():
+    parser = OptionParser(usage='%prog [options]')
+    parser.add_option('-n', '--requests', type='int', default=10000,
+                      help='start/stop requests per run')
+    parser.add_option('-r', '--runs', type='int', default=10, help='random runs')
+    parser.add_option('-f', '--fixed-ratio', type='float', default=0.05,
+                      help='ratio of requests on the shared fixed objects')
+    parser.add_option('-d', '--dup-ratio', type='float', default=0.1,
+                      help='ratio of start on started or stop on stopped objects')
+    parser.add_option('--music-32m-disable', action='store_true', default=False,
+                      help='use the tables of music 32M disabled')
+    parser.add_option('--seed', type='int', default=1)
+    (options, args) = parser.parse_args()
+
+    objs = parse_objs(read_file(os.path.join(SRC, 'inc', 'dfs.h')))
+    tables = parse_tables(read_file(os.path.join(SRC, 'src', 'callee', 'dtop', 'dfs.c')))
+    model = Model(objs, tables, options.music_32m_disable)
+    all_objs = model.objs()
+    fixed_objs = [o for o in all_objs if model.locate(o)[0] == 0]
+    other_objs = [o for o in all_objs if model.locate(o)[0] != 0]
+
+    random.seed(options.seed)
+    results = {}
+    lookups = []
+    for run in range(options.runs):
+        old, new = OldResolver(model), DemandResolver(model)
+        for n in range(options.requests):
+            # a fixed object is held shortly, everything else pends meanwhile
+            started_fixed = [o for o in fixed_objs if old.active(o)]
+            if started_fixed and random.random() < 0.5:
+                obj = random.choice(started_fixed)
+            elif random.random() < options.fixed_ratio:
+                obj = random.choice(fixed_objs)
+            else:
+                obj = random.choice(other_objs)
+            start = not old.active(obj)
+            if random.random() < options.dup_ratio:
+                start = not start
+            a, b = old.request(obj, start), new.request(obj, start)
+            if a != b:
+                print('FAIL: run %d request %d obj %d %s, old %s new %s' %
+                      (run, n, obj, 'start' if start else 'stop', a, b))
+                return 1
+            results[a[0]] = results.get(a[0], 0) + 1
+        lookups += old.lookups
+
+    print('%d objects, %d runs x %d requests: %s' %
+          (len(all_objs), options.runs, options.requests,
+           ', '.join('%s %d' % (k, results[k]) for k in sorted(results))))
+    print('clock lookups per resolve: walk avg %.1f max %d, demand 3' %
+          (sum(lookups) / float(max(len(lookups), 1)), max(lookups or [0])))
+    print('OK: modes match')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,291 @@
+#! /usr/bin/env python3
+# Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+#
+# This Information is proprietary to WuQi Technologies and MAY NOT
+# be copied by any method or incorporated into another program without
+# the express written consent of WuQi. This Information or any portion
+# thereof remains the property of WuQi. The Information contained herein
+# is believed to be accurate and WuQi assumes no responsibility or
+# liability for its use in any way and conveys no license or title under
+# any patent or copyright and makes no representation or warranty that this
+# Information is free from patent or copyright infringement.
+#
+# Check of the dfs timeout min-heap in lib/dfs/src/callee/dtop/dfs.c.
+# Random dfs_timeout_add()/dfs_timeout_modify()/dfs_timeout_del() calls and
+# timer expiries run on a 32 bit ms clock that wraps, against a plain dict of
+# the pending end times. After every call the heap order, the positions kept
+# in the items, the pending set and the armed timer are checked, and every
+# expiry must stop exactly the objects due.
+
+import os
+import random
+import re
+import sys
+
+from optparse import OptionParser
+
+SRC = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src', 'lib', 'dfs')
+
+GROUPS = ('SHARED_FIXED', 'SHARED_ATLEAST', 'DSP', 'BT', 'DTOP')
+
+TIMEOUT_MS_MIN = 5
+TIMEOUT_MS_MARGIN = 30
+TIMEOUT_MS_MAX = 0x7FFFFFFF
+TIMEOUT_BATCH = 8
+POS_NONE = 0xFF
+MASK = 0xFFFFFFFF
+
+
+def obj_tab_num():
+    """DFS_OBJ_TAB_NUM from the DFS_OBJ enum of dfs.h"""
+    with open(os.path.join(SRC, 'inc', 'dfs.h')) as f:
+        body = re.search(r'typedef enum \{(.*?)\} DFS_OBJ;', f.read(), re.S).group(1)
+    objs = {}
+    value = 0
+    for line in body.split('\n'):
+        line = line.split('//')[0].strip().rstrip(',')
+        if not line:
+            continue
+        name, _, expr = line.partition('=')
+        name, expr = name.strip(), expr.strip()
+        if expr:
+            value = objs[expr] if expr in objs else int(expr, 0)
+        objs[name] = value
+        value += 1
+    return sum(objs['DFS_OBJ_%s_END' % g] - objs['DFS_OBJ_%s_START' % g] for g in GROUPS)
+
+
+def before(ts, ref):
+    """dfs_timeout_before()"""
+    return ((ts - ref) & MASK) >= 0x80000000
+
+
+def s32(v):
+    v &= MASK
+    return v - 0x100000000 if v >= 0x80000000 else v
+
+
+class Timeouts(object):
+    """mirrors dfs_timeout_*() of dfs.c, the timer is a due time on the clock"""
+
+    def __init__(self, num, now):
+        self.end_ts = [0] * num
+        self.pos = [POS_NONE] * num
+        self.heap = [0] * num
+        self.num = 0
+        self.armed = False
+        self.armed_ts = 0
+        self.rearm_cnt = 0
+        self.now = now
+        self.fire_at = None
+
+    def heap_set(self, pos, idx):
+        self.heap[pos] = idx
+        self.pos[idx] = pos
+
+    def heap_up(self, pos):
+        idx = self.heap[pos]
+        end_ts = self.end_ts[idx]
+        while pos > 0:
+            parent = (pos - 1) // 2
+            if not before(end_ts, self.end_ts[self.heap[parent]]):
+                break
+            self.heap_set(pos, self.heap[parent])
+            pos = parent
+        self.heap_set(pos, idx)
+
+    def heap_down(self, pos):
+        idx = self.heap[pos]
+        end_ts = self.end_ts[idx]
+        while True:
+            child = pos * 2 + 1
+            if child >= self.num:
+                break
+            if child + 1 < self.num and \
+                    before(self.end_ts[self.heap[child + 1]], self.end_ts[self.heap[child]]):
+                child += 1
+            if not before(self.end_ts[self.heap[child]], end_ts):
+                break
+            self.heap_set(pos, self.heap[child])
+            pos = child
+        self.heap_set(pos, idx)
+
+    def heap_remove(self, idx):
+        pos = self.pos[idx]
+        self.pos[idx] = POS_NONE
+        self.num -= 1
+        last = self.heap[self.num]
+        if last == idx:
+            return
+        self.heap_set(pos, last)
+        self.heap_up(pos)
+        self.heap_down(self.pos[last])
+
+    def restart_timer(self):
+        if self.num == 0:
+            self.armed = False
+            self.fire_at = None
+            return
+        end_ts = self.end_ts[self.heap[0]]
+        if not self.armed or before(end_ts, self.armed_ts):
+            self.armed = True
+            self.armed_ts = end_ts
+            period = (end_ts - self.now) & MASK
+            if period < TIMEOUT_MS_MIN or period > TIMEOUT_MS_MAX:
+                period = TIMEOUT_MS_MIN
+            self.rearm_cnt += 1
+            self.fire_at = (self.now + period) & MASK
+
+    def handler(self):
+        expired = []
+        self.armed = False
+        while len(expired) < TIMEOUT_BATCH and self.num != 0:
+            idx = self.heap[0]
+            if s32(self.end_ts[idx] - self.now) > TIMEOUT_MS_MARGIN:
+                break
+            expired.append(idx)
+            self.heap_remove(idx)
+        self.fire_at = None
+        self.restart_timer()
+        return expired
+
+    def add(self, idx, timeout):
+        if timeout == 0:
+            return
+        self.end_ts[idx] = (self.now + timeout) & MASK
+        if self.pos[idx] == POS_NONE:
+            self.heap_set(self.num, idx)
+            self.num += 1
+            self.heap_up(self.pos[idx])
+        else:
+            self.heap_up(self.pos[idx])
+            self.heap_down(self.pos[idx])
+        self.restart_timer()
+
+    def delete(self, idx):
+        if self.pos[idx] != POS_NONE:
+            self.heap_remove(idx)
+        self.restart_timer()
+
+    def modify(self, idx, timeout):
+        new_ts = (self.now + timeout) & MASK
+        if self.pos[idx] != POS_NONE:
+            if timeout == 0:
+                self.heap_remove(idx)
+            elif before(self.end_ts[idx], new_ts):
+                self.end_ts[idx] = new_ts
+                self.heap_down(self.pos[idx])
+        self.restart_timer()
+
+
+def check(t, ref):
+    """heap order, positions, pending set and armed timer, error string or None"""
+    if t.num != len(ref):
+        return 'num %d, expected %d' % (t.num, len(ref))
+    for pos in range(t.num):
+        idx = t.heap[pos]
+        if t.pos[idx] != pos:
+            return 'item %d at %d says %d' % (idx, pos, t.pos[idx])
+        if idx not in ref or ref[idx] != t.end_ts[idx]:
+            return 'item %d end_ts 0x%08x not pending' % (idx, t.end_ts[idx])
+        if pos and before(t.end_ts[idx], t.end_ts[t.heap[(pos - 1) // 2]]):
+            return 'item %d at %d before its parent' % (idx, pos)
+    for idx in range(len(t.pos)):
+        if idx not in ref and t.pos[idx] != POS_NONE:
+            return 'item %d not pending at %d' % (idx, t.pos[idx])
+    if t.num:
+        # the timer must fire no later than the head is due
+        head = t.end_ts[t.heap[0]]
+        if not t.armed or before(head, t.armed_ts) or t.fire_at is None:
+            return 'head 0x%08x due before the timer 0x%08x' % (head, t.armed_ts)
+    return None
+
+
+def run(num, ops, start, max_timeout, seed):
+    random.seed(seed)
+    t = Timeouts(num, start)
+    ref = {}
+    fired = 0
+    empty = 0
+    late = 0
+    for n in range(ops):
+        r = random.random()
+        idx = random.randrange(num)
+        if r < 0.4:
+            timeout = random.randint(0, max_timeout)
+            t.add(idx, timeout)
+            if timeout:
+                ref[idx] = (t.now + timeout) & MASK
+        elif r < 0.6:
+            timeout = random.choice((0, random.randint(1, max_timeout)))
+            t.modify(idx, timeout)
+            if idx in ref:
+                new_ts = (t.now + timeout) & MASK
+                if timeout == 0:
+                    del ref[idx]
+                elif before(ref[idx], new_ts):
+                    ref[idx] = new_ts
+        elif r < 0.75:
+            t.delete(idx)
+            ref.pop(idx, None)
+        else:
+            # time goes on, the timer fires when due
+            step = random.randint(1, max_timeout // 4 + 1)
+            while step > 0:
+                if t.fire_at is not None and s32(t.fire_at - t.now) <= step:
+                    wait = max(s32(t.fire_at - t.now), 0)
+                    t.now = (t.now + wait) & MASK
+                    step -= wait
+                    due = sorted(i for i, ts in ref.items()
+                                 if s32(ts - t.now) <= TIMEOUT_MS_MARGIN)
+                    expired = t.handler()
+                    fired += 1
+                    empty += not expired
+                    if len(expired) < TIMEOUT_BATCH and sorted(expired) != due:
+                        return 'op %d: expired %s, due %s' % (n, sorted(expired), due), None
+                    if not set(expired) <= set(due):
+                        return 'op %d: expired %s not due' % (n, expired), None
+                    for idx in expired:
+                        late = max(late, -s32(ref.pop(idx) - t.now))
+                else:
+                    t.now = (t.now + step) & MASK
+                    step = 0
+        err = check(t, ref)
+        if err:
+            return 'op %d: %s' % (n, err), None
+    return None, {'rearm': t.rearm_cnt, 'fired': fired, 'empty': empty, 'late': late}
+
+
+def main():
+    parser = OptionParser(usage='%prog [options]')
+    parser.add_option('-n', '--ops', type='int', default=50000, help='operations per run')
+    parser.add_option('-r', '--runs', type='int', default=10, help='random runs')
+    parser.add_option('-t', '--max-timeout', type='int', default=5000,
+                      help='max timeout of a request in ms')
+    parser.add_option('--seed', type='int', default=1)
+    (options, args) = parser.parse_args()
+
+    num = obj_tab_num()
+    total = {'rearm': 0, 'fired': 0, 'empty': 0, 'late': 0}
+    for r in range(options.runs):
+        # half of the runs start right before the ms clock wraps
+        start = (MASK - random.Random(options.seed + r).randint(0, 10 * options.max_timeout)) \
+            if r % 2 == 0 else 0
+        err, stats = run(num, options.ops, start, options.max_timeout, options.seed + r)
+        if err:
+            print('FAIL: run %d, start 0x%08x, %s' % (r, start, err))
+            return 1
+        for k in ('rearm', 'fired', 'empty'):
+            total[k] += stats[k]
+        total['late'] = max(total['late'], stats['late'])
+
+    print('%d items, %d runs x %d ops, timeouts up to %d ms' %
+          (num, options.runs, options.ops, options.max_timeout))
+    print('timer re-arms %d, expiries %d, %d of them with nothing due, max late %d ms' %
+          (total['rearm'], total['fired'], total['empty'], total['late']))
+    print('OK: heap matches')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,151 @@
+#! /usr/bin/env python3
+# Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+#
+# This Information is proprietary to WuQi Technologies and MAY NOT
+# be copied by any method or incorporated into another program without
+# the express written consent of WuQi. This Information or any portion
+# thereof remains the property of WuQi. The Information contained herein
+# is believed to be accurate and WuQi assumes no responsibility or
+# liability for its use in any way and conveys no license or title under
+# any patent or copyright and makes no representation or warranty that this
+# Information is free from patent or copyright infringement.
+#
+# Dfs transition trace viewer, decodes dfs_trace_hdr_t/dfs_trace_rec_t of
+# lib/dfs/inc/dfs_callee.h as returned by dfs_trace_get() or dfs_trace_export().
+# Besides the records it sums the stall per requester and finds the ping-pong,
+# a switch undone by the next one within a short time.
+
+import os
+import re
+import struct
+import sys
+
+from optparse import OptionParser
+
+DFS_INC = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src', 'lib', 'dfs', 'inc')
+
+DFS_TRACE_MAGIC = 0x5444
+DFS_TRACE_HDR_FMT = '<HBBIBBHHH'
+DFS_TRACE_REC_FMT = '<IHBBHHHBB'
+DFS_TRACE_OBJ_GOV = 0xFFFE
+DFS_TRACE_OBJ_PM = 0xFFFF
+DFS_TRACE_FLAG_STOP = 0x01
+DFS_TRACE_FLAG_PENDING = 0x02
+
+
+def parse_objs():
+    """DFS_OBJ enum of dfs.h, value -> name"""
+    try:
+        with open(os.path.join(DFS_INC, 'dfs.h')) as f:
+            text = f.read()
+    except IOError:
+        return {}
+    body = re.search(r'typedef enum \{(.*?)\} DFS_OBJ;', text, re.S).group(1)
+    objs = {}
+    names = {}
+    value = 0
+    for line in body.split('\n'):
+        line = line.split('//')[0].strip().rstrip(',')
+        if not line:
+            continue
+        name, _, expr = line.partition('=')
+        name, expr = name.strip(), expr.strip()
+        if expr:
+            value = objs[expr] if expr in objs else int(expr, 0)
+        objs[name] = value
+        if not name.endswith(('_START', '_END', '_MAX')):
+            names.setdefault(value, name[len('DFS_OBJ_'):])
+        value += 1
+    return names
+
+
+def decode_trace(data):
+    hdr_len = struct.calcsize(DFS_TRACE_HDR_FMT)
+    magic, version, rec_num, seq, curr_mode, hist_num, sfc_busy, mode_miss, _ = \
+        struct.unpack_from(DFS_TRACE_HDR_FMT, data)
+    if magic != DFS_TRACE_MAGIC:
+        raise ValueError('bad dfs trace magic 0x%04x' % magic)
+
+    hist = struct.unpack_from('<%dH' % hist_num, data, hdr_len)
+    hdr = {'version': version, 'seq': seq, 'curr_mode': curr_mode,
+           'sfc_busy': sfc_busy, 'mode_miss': mode_miss, 'hist': hist}
+    recs = []
+    pos = hdr_len + hist_num * 2
+    for _ in range(rec_num):
+        ts, obj, src, dst, bt_wait, ack_wait, switch_time, flags, pending = \
+            struct.unpack_from(DFS_TRACE_REC_FMT, data, pos)
+        recs.append({'ts': ts, 'obj': obj, 'src': src, 'dst': dst, 'bt_wait': bt_wait,
+                     'ack_wait': ack_wait, 'switch': switch_time, 'flags': flags,
+                     'pending': pending})
+        pos += struct.calcsize(DFS_TRACE_REC_FMT)
+    return hdr, recs
+
+
+def obj_name(names, obj):
+    if obj == DFS_TRACE_OBJ_GOV:
+        return 'GOV'
+    if obj == DFS_TRACE_OBJ_PM:
+        return 'PM_RESTORE'
+    return names.get(obj, str(obj))
+
+
+def main():
+    parser = OptionParser(usage='%prog [options] dfs_trace.bin')
+    parser.add_option('-p', '--ping-pong-ms', type='int', default=100,
+                      help='a switch back to the source mode within it is a ping-pong')
+    (options, args) = parser.parse_args()
+
+    if len(args) != 1:
+        parser.print_help()
+        return 1
+
+    with open(args[0], 'rb') as f:
+        hdr, recs = decode_trace(f.read())
+    names = parse_objs()
+
+    print('mode %d, %d transitions, %d records, flash busy deferred %d, overwritten %d' %
+          (hdr['curr_mode'], hdr['seq'], len(recs), hdr['sfc_busy'], hdr['mode_miss']))
+
+    print('\nts/us\t\tsrc->dst\tbt/us\tack/us\tswitch/us\tpend\trequester')
+    for r in recs:
+        act = ''
+        if r['obj'] not in (DFS_TRACE_OBJ_GOV, DFS_TRACE_OBJ_PM):
+            act = ' stop' if r['flags'] & DFS_TRACE_FLAG_STOP else ' start'
+        print('%10u\t%2d -> %2d\t%d\t%d\t%d\t\t%d\t%s%s%s' %
+              (r['ts'], r['src'], r['dst'], r['bt_wait'], r['ack_wait'], r['switch'],
+               r['pending'], obj_name(names, r['obj']), act,
+               ' (deferred)' if r['flags'] & DFS_TRACE_FLAG_PENDING else ''))
+
+    per_obj = {}
+    for r in recs:
+        s = per_obj.setdefault(obj_name(names, r['obj']), [0, 0, 0, 0])
+        s[0] += 1
+        s[1] += r['switch']
+        s[2] = max(s[2], r['switch'])
+        s[3] = max(s[3], r['ack_wait'])
+    print('\nrequester\t\t\tswitches\tstall/us\tmax/us\tmax ack/us')
+    for name, s in sorted(per_obj.items(), key=lambda kv: -kv[1][1]):
+        print('%-24s\t%d\t\t%d\t\t%d\t%d' % (name, s[0], s[1], s[2], s[3]))
+
+    pairs = {}
+    for a, b in zip(recs, recs[1:]):
+        if b['dst'] == a['src'] and (b['ts'] - a['ts']) & 0xFFFFFFFF < options.ping_pong_ms * 1000:
+            key = (obj_name(names, a['obj']), obj_name(names, b['obj']))
+            pairs[key] = pairs.get(key, 0) + 1
+    if pairs:
+        print('\nping-pong within %d ms:' % options.ping_pong_ms)
+        for (a, b), n in sorted(pairs.items(), key=lambda kv: -kv[1]):
+            print('  %s / %s: %d' % (a, b, n))
+
+    print('\nswitch time histogram:')
+    for i, n in enumerate(hdr['hist']):
+        if i == len(hdr['hist']) - 1:
+            print('  >= %5d us: %d' % (1 << (i + 4), n))
+        else:
+            print('  <  %5d us: %d' % (1 << (i + 5), n))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
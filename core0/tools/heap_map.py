@@ -0,0 +1,114 @@
+#! /usr/bin/env python3
+# Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+#
+# This Information is proprietary to WuQi Technologies and MAY NOT
+# be copied by any method or incorporated into another program without
+# the express written consent of WuQi. This Information or any portion
+# thereof remains the property of WuQi. The Information contained herein
+# is believed to be accurate and WuQi assumes no responsibility or
+# liability for its use in any way and conveys no license or title under
+# any patent or copyright and makes no representation or warranty that this
+# Information is free from patent or copyright infringement.
+#
+# Heap fragmentation map viewer, decodes the map of os_mem_get_heap_map()
+
+import sys
+import struct
+
+from optparse import OptionParser
+
+HEAP_MAP_MAGIC = 0x4D48
+HEAP_MAP_HDR_FMT = '<HBBBBHII'
+HEAP_MAP_FLAG_TRUNCATED = 0x01
+
+
+def read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def decode_heap_map(data):
+    hdr_len = struct.calcsize(HEAP_MAP_HDR_FMT)
+    magic, version, unit_shift, flags, region_num, block_num, free_size, largest = \
+        struct.unpack_from(HEAP_MAP_HDR_FMT, data)
+    if magic != HEAP_MAP_MAGIC:
+        raise ValueError('bad heap map magic 0x%04x' % magic)
+
+    hdr = {'version': version, 'flags': flags, 'region_num': region_num,
+           'block_num': block_num, 'free': free_size, 'largest': largest}
+    regions = []
+    pos = hdr_len
+    addr = 0
+    while pos < len(data):
+        value, pos = read_varint(data, pos)
+        if value == 0:
+            addr = struct.unpack_from('<I', data, pos)[0]
+            pos += 4
+            regions.append({'start': addr, 'blocks': []})
+            continue
+        size = (value >> 1) << unit_shift
+        regions[-1]['blocks'].append((addr, size, bool(value & 1)))
+        addr += size
+
+    return hdr, regions
+
+
+def draw_region(region, width, unit):
+    line = ''
+    for addr, size, used in region['blocks']:
+        cells = max(1, (size + unit - 1) // unit)
+        line += ('#' if used else '.') * cells
+    return [line[i:i + width] for i in range(0, len(line), width)]
+
+
+def main():
+    parser = OptionParser(usage='%prog [options] heap_map.bin')
+    parser.add_option('-w', '--width', type='int', default=64,
+                      help='cells per line of the map')
+    parser.add_option('-u', '--unit', type='int', default=256,
+                      help='bytes per cell of the map')
+    (options, args) = parser.parse_args()
+
+    if len(args) != 1:
+        parser.print_help()
+        return 1
+
+    with open(args[0], 'rb') as f:
+        hdr, regions = decode_heap_map(f.read())
+
+    print('free %d B, largest free block %d B, %d blocks in %d regions%s' %
+          (hdr['free'], hdr['largest'], hdr['block_num'], hdr['region_num'],
+           ' (truncated)' if hdr['flags'] & HEAP_MAP_FLAG_TRUNCATED else ''))
+    if hdr['free']:
+        print('fragmentation %d%%' % (100 - hdr['largest'] * 100 // hdr['free']))
+
+    hist = {}
+    for region in regions:
+        blocks = region['blocks']
+        used = sum(size for _, size, busy in blocks if busy)
+        free = sum(size for _, size, busy in blocks if not busy)
+        print('\nregion 0x%08x: used %d B, free %d B, %d blocks' %
+              (region['start'], used, free, len(blocks)))
+        for line in draw_region(region, options.width, options.unit):
+            print('  ' + line)
+        for _, size, busy in blocks:
+            if not busy:
+                cls = size.bit_length() - 1
+                hist[cls] = hist.get(cls, 0) + 1
+
+    print('\nfree block histogram:')
+    for cls in sorted(hist):
+        print('  %7d - %7d B: %d' % (1 << cls, (2 << cls) - 1, hist[cls]))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,282 @@
+#! /usr/bin/env python3
+# Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+#
+# This Information is proprietary to WuQi Technologies and MAY NOT
+# be copied by any method or incorporated into another program without
+# the express written consent of WuQi. This Information or any portion
+# thereof remains the property of WuQi. The Information contained herein
+# is believed to be accurate and WuQi assumes no responsibility or
+# liability for its use in any way and conveys no license or title under
+# any patent or copyright and makes no representation or warranty that this
+# Information is free from patent or copyright infringement.
+#
+# Delta ota package tool, see ota_delta_hdr_t in lib/ota/inc/ota.h.
+# diff makes a delta from the package in the ota zone (base) to a new package,
+# apply rebuilds the new package in place the same way ota_delta_write() does,
+# check runs both and compares the result bit exact with the new package.
+
+import struct
+import sys
+import zlib
+
+from optparse import OptionParser
+
+DELTA_MAGIC = 0x41544C44
+DELTA_HDR_FMT = '<IIIIIHH'
+DELTA_WINDOW_MAX = 2
+SECTOR_SIZE = 4096
+
+OP_INSERT = 0
+OP_COPY = 1
+
+KEY_LEN = 8
+MIN_COPY = 16
+MAX_CANDIDATES = 16
+
+
+def crc32(data):
+    return zlib.crc32(data) & 0xFFFFFFFF
+
+
+def write_varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return out
+
+
+def read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def inplace_len(src, dst, length, window):
+    # the output sector is erased before it is written, a copy may only read
+    # sectors after it or the last window sectors erased before it
+    ok = 0
+    while ok < length:
+        seg = min(length - ok, SECTOR_SIZE - (dst + ok) % SECTOR_SIZE)
+        if (src + ok) // SECTOR_SIZE < (dst + ok) // SECTOR_SIZE - window + 1:
+            break
+        ok += seg
+    return min(ok, length)
+
+
+def match_len(base, s, target, p, limit):
+    n = 0
+    step = 256
+    while n < limit:
+        m = min(step, limit - n)
+        if base[s + n:s + n + m] == target[p + n:p + n + m]:
+            n += m
+            continue
+        while n < limit and base[s + n] == target[p + n]:
+            n += 1
+        break
+    return n
+
+
+def build_index(base):
+    index = {}
+    for i in range(0, len(base) - KEY_LEN + 1):
+        key = base[i:i + KEY_LEN]
+        slot = index.get(key)
+        if slot is None:
+            index[key] = [i]
+        elif len(slot) < MAX_CANDIDATES:
+            slot.append(i)
+    return index
+
+
+def diff(base, target, window):
+    index = build_index(base)
+    ops = []
+    literal = bytearray()
+    p = 0
+    # prefer the source at the same offset, unchanged parts stay in place
+    while p < len(target):
+        best_len = 0
+        best_src = 0
+        candidates = []
+        if p < len(base):
+            candidates.append(p)
+        candidates += index.get(bytes(target[p:p + KEY_LEN]), [])
+        for s in candidates:
+            limit = min(len(base) - s, len(target) - p)
+            n = match_len(base, s, target, p, limit)
+            if n < MIN_COPY:
+                continue
+            n = inplace_len(s, p, n, window)
+            if n > best_len:
+                best_len = n
+                best_src = s
+        if best_len >= MIN_COPY:
+            if literal:
+                ops.append((OP_INSERT, bytes(literal)))
+                literal = bytearray()
+            ops.append((OP_COPY, best_src, best_len))
+            p += best_len
+        else:
+            literal.append(target[p])
+            p += 1
+    if literal:
+        ops.append((OP_INSERT, bytes(literal)))
+
+    body = bytearray()
+    for op in ops:
+        if op[0] == OP_COPY:
+            body += write_varint(op[2] << 1 | OP_COPY)
+            body += write_varint(op[1])
+        else:
+            body += write_varint(len(op[1]) << 1 | OP_INSERT)
+            body += op[1]
+    body += write_varint(0)
+
+    hdr = struct.pack(DELTA_HDR_FMT, DELTA_MAGIC, len(base), crc32(base), len(target),
+                      crc32(target), window, 0)
+    return hdr + body, ops
+
+
+class Zone(object):
+    """ota zone rebuilt in place, mirrors ota_delta_prepare() and ota_delta_copy()"""
+
+    def __init__(self, base, size, window):
+        self.flash = bytearray(base) + b'\xff' * max(0, size - len(base))
+        self.base_size = len(base)
+        self.window = window
+        self.ram = {}
+        self.erased = 0
+        self.out = 0
+
+    def prepare(self, out):
+        sector = out // SECTOR_SIZE
+        while self.erased <= sector:
+            start = self.erased * SECTOR_SIZE
+            if start < self.base_size:
+                self.ram[self.erased % self.window] = bytes(self.flash[start:start + SECTOR_SIZE])
+            self.flash[start:start + SECTOR_SIZE] = b'\xff' * len(self.flash[start:start + SECTOR_SIZE])
+            self.erased += 1
+
+    def output(self, data):
+        pos = 0
+        while pos < len(data):
+            n = min(len(data) - pos, SECTOR_SIZE - self.out % SECTOR_SIZE)
+            self.prepare(self.out)
+            self.flash[self.out:self.out + n] = data[pos:pos + n]
+            self.out += n
+            pos += n
+
+    def copy(self, src, length):
+        if src + length > self.base_size:
+            raise ValueError('copy beyond the base src:%d len:%d' % (src, length))
+        while length:
+            n = min(length, SECTOR_SIZE - self.out % SECTOR_SIZE, SECTOR_SIZE - src % SECTOR_SIZE)
+            self.prepare(self.out)
+            sector = src // SECTOR_SIZE
+            if sector >= self.erased:
+                data = self.flash[src:src + n]
+            elif sector + self.window >= self.erased:
+                off = src % SECTOR_SIZE
+                data = self.ram[sector % self.window][off:off + n]
+            else:
+                raise ValueError('copy from erased sector %d src:%d out:%d' % (sector, src, self.out))
+            self.output(bytes(data))
+            src += n
+            length -= n
+
+
+def apply(base, patch):
+    hdr_len = struct.calcsize(DELTA_HDR_FMT)
+    magic, base_size, base_crc, target_size, target_crc, window, _ = \
+        struct.unpack_from(DELTA_HDR_FMT, patch)
+    if magic != DELTA_MAGIC:
+        raise ValueError('bad delta magic 0x%08x' % magic)
+    if window < 1 or window > DELTA_WINDOW_MAX:
+        raise ValueError('bad delta window %d' % window)
+    if base_size != len(base) or base_crc != crc32(base):
+        raise ValueError('base package mismatch')
+
+    zone = Zone(base, target_size, window)
+    pos = hdr_len
+    while True:
+        value, pos = read_varint(patch, pos)
+        if value == 0:
+            break
+        length = value >> 1
+        if value & 1 == OP_COPY:
+            src, pos = read_varint(patch, pos)
+            zone.copy(src, length)
+        else:
+            zone.output(patch[pos:pos + length])
+            pos += length
+    if pos != len(patch):
+        raise ValueError('%d bytes after the end of delta' % (len(patch) - pos))
+
+    out = bytes(zone.flash[:zone.out])
+    if len(out) != target_size or crc32(out) != target_crc:
+        raise ValueError('rebuilt package mismatch size:%d/%d' % (len(out), target_size))
+    return out
+
+
+def read_file(name):
+    with open(name, 'rb') as f:
+        return f.read()
+
+
+def write_file(name, data):
+    with open(name, 'wb') as f:
+        f.write(data)
+
+
+def main():
+    parser = OptionParser(usage='%prog diff|apply|check [options] base.bin new.bin|delta.bin')
+    parser.add_option('-o', '--output', help='output file of diff or apply')
+    parser.add_option('-w', '--window', type='int', default=DELTA_WINDOW_MAX,
+                      help='sectors of the old package kept in ram, <= %d' % DELTA_WINDOW_MAX)
+    (options, args) = parser.parse_args()
+
+    if len(args) != 3 or args[0] not in ('diff', 'apply', 'check'):
+        parser.print_help()
+        return 1
+    if options.window < 1 or options.window > DELTA_WINDOW_MAX:
+        parser.error('window must be 1 to %d' % DELTA_WINDOW_MAX)
+
+    cmd, base = args[0], read_file(args[1])
+    if cmd == 'apply':
+        out = apply(base, read_file(args[2]))
+        if options.output:
+            write_file(options.output, out)
+        print('rebuilt %d B, crc 0x%08X' % (len(out), crc32(out)))
+        return 0
+
+    target = read_file(args[2])
+    patch, ops = diff(base, target, options.window)
+    copied = sum(op[2] for op in ops if op[0] == OP_COPY)
+    print('base %d B, new %d B, delta %d B (%.1f%%), %d copies %d B, %d inserts %d B' %
+          (len(base), len(target), len(patch), len(patch) * 100.0 / max(len(target), 1),
+           sum(1 for op in ops if op[0] == OP_COPY), copied,
+           sum(1 for op in ops if op[0] == OP_INSERT), len(target) - copied))
+    if options.output:
+        write_file(options.output, patch)
+    if cmd == 'check':
+        if apply(base, patch) != target:
+            print('FAIL: rebuilt package differs')
+            return 1
+        print('OK: rebuilt package is bit exact')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
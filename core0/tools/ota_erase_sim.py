@@ -0,0 +1,168 @@
+#! /usr/bin/env python3
+# Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+#
+# This Information is proprietary to WuQi Technologies and MAY NOT
+# be copied by any method or incorporated into another program without
+# the express written consent of WuQi. This Information or any portion
+# thereof remains the property of WuQi. The Information contained herein
+# is believed to be accurate and WuQi assumes no responsibility or
+# liability for its use in any way and conveys no license or title under
+# any patent or copyright and makes no representation or warranty that this
+# Information is free from patent or copyright infringement.
+#
+# Simulated flash for the ota zone erase, compares erasing every sector in
+# ota_begin() with the lazy block erase of partition_erase_until() and
+# partition_erase_ahead() in lib/ota/src/ota.c. Blocks arrive at the link rate
+# and are written in order by ota task, erases run between the writes.
+
+import sys
+
+from optparse import OptionParser
+
+SECTOR_SIZE = 0x1000
+BLOCK_32K_SIZE = 0x8000
+BLOCK_64K_SIZE = 0x10000
+ERASE_AHEAD = BLOCK_64K_SIZE
+PAGE_SIZE = 0x100
+
+
+class Flash(object):
+    """erased state per sector and the time spent in erase commands"""
+
+    def __init__(self, options):
+        self.erase_time = {SECTOR_SIZE: options.sector_ms, BLOCK_32K_SIZE: options.block32_ms,
+                           BLOCK_64K_SIZE: options.block64_ms}
+        self.page_ms = options.page_ms
+        self.erased = set()
+        self.cmds = {SECTOR_SIZE: 0, BLOCK_32K_SIZE: 0, BLOCK_64K_SIZE: 0}
+
+    def erase(self, addr, size):
+        if addr % size:
+            raise ValueError('unaligned erase 0x%x size 0x%x' % (addr, size))
+        for sec in range(addr // SECTOR_SIZE, (addr + size) // SECTOR_SIZE):
+            self.erased.add(sec)
+        self.cmds[size] += 1
+        return self.erase_time[size]
+
+    def program(self, addr, size):
+        for sec in range(addr // SECTOR_SIZE, (addr + size - 1) // SECTOR_SIZE + 1):
+            if sec not in self.erased:
+                raise ValueError('write 0x%x to a sector not erased' % addr)
+        return (size + PAGE_SIZE - 1) // PAGE_SIZE * self.page_ms
+
+
+def erase_step(flash, start, end):
+    """mirrors partition_erase_step(), returns (size, ms)"""
+    left = end - start
+    if start % BLOCK_64K_SIZE == 0 and left >= BLOCK_64K_SIZE:
+        size = BLOCK_64K_SIZE
+    elif start % BLOCK_32K_SIZE == 0 and left >= BLOCK_32K_SIZE:
+        size = BLOCK_32K_SIZE
+    else:
+        size = SECTOR_SIZE
+    return size, flash.erase(start, size)
+
+
+class Upfront(object):
+    """erase every sector of the image in ota_begin(), the old way"""
+
+    def __init__(self, flash, base, limit):
+        self.flash = flash
+        self.base = base
+        self.limit = limit
+
+    def begin(self):
+        ms = 0.0
+        for off in range(0, self.limit, SECTOR_SIZE):
+            ms += self.flash.erase(self.base + off, SECTOR_SIZE)
+        return ms
+
+    def until(self, end):
+        return 0.0
+
+    def ahead(self, end):
+        return 0.0
+
+
+class Lazy(object):
+    """mirrors partition_erase_until() and partition_erase_ahead()"""
+
+    def __init__(self, flash, base, limit):
+        self.flash = flash
+        self.base = base
+        self.limit = limit
+        self.erased = 0
+
+    def begin(self):
+        return 0.0
+
+    def step(self):
+        size, ms = erase_step(self.flash, self.base + self.erased, self.base + self.limit)
+        self.erased += size
+        return ms
+
+    def until(self, end):
+        ms = 0.0
+        while self.erased < end:
+            ms += self.step()
+        return ms
+
+    def ahead(self, end):
+        if self.erased < self.limit and self.erased - end < ERASE_AHEAD:
+            return self.step()
+        return 0.0
+
+
+def simulate(options, planner_cls):
+    flash = Flash(options)
+    limit = (options.size // SECTOR_SIZE + 1) * SECTOR_SIZE
+    planner = planner_cls(flash, options.offset, limit)
+    block_ms = options.block_len * 8.0 / options.rate
+
+    now = planner.begin()
+    first_write = None
+    max_stall = 0.0
+    off = 0
+    arrive = 0.0
+    while off < options.size:
+        n = min(options.block_len, options.size - off)
+        arrive += block_ms
+        start = max(now, arrive)
+        now = start + planner.until(off + n) + flash.program(options.offset + off, n)
+        if first_write is None:
+            first_write = now
+        now += planner.ahead(off + n)
+        max_stall = max(max_stall, now - arrive)
+        off += n
+
+    return {'cmds': flash.cmds, 'first': first_write, 'total': now, 'stall': max_stall,
+            'erase_ms': sum(flash.erase_time[k] * v for k, v in flash.cmds.items())}
+
+
+def main():
+    parser = OptionParser(usage='%prog [options]')
+    parser.add_option('-s', '--size', type='int', default=400 * 1024, help='image size in bytes')
+    parser.add_option('-o', '--offset', type='int', default=0x138000,
+                      help='flash offset of the ota zone')
+    parser.add_option('-b', '--block-len', type='int', default=512, help='bytes per write')
+    parser.add_option('-r', '--rate', type='float', default=200.0, help='link rate in kbps')
+    parser.add_option('--sector-ms', type='float', default=45.0, help='4KB sector erase in ms')
+    parser.add_option('--block32-ms', type='float', default=120.0, help='32KB block erase in ms')
+    parser.add_option('--block64-ms', type='float', default=150.0, help='64KB block erase in ms')
+    parser.add_option('--page-ms', type='float', default=0.4, help='256B page program in ms')
+    (options, args) = parser.parse_args()
+
+    print('image %d B at 0x%x, %d B per write, link %.0f kbps' %
+          (options.size, options.offset, options.block_len, options.rate))
+    print('planner\tsector\t32K\t64K\terase/ms\tfirst write/ms\tmax stall/ms\ttotal/s')
+    for name, cls in (('upfront', Upfront), ('lazy', Lazy)):
+        r = simulate(options, cls)
+        print('%s\t%d\t%d\t%d\t%.0f\t\t%.1f\t\t%.1f\t\t%.2f' %
+              (name, r['cmds'][SECTOR_SIZE], r['cmds'][BLOCK_32K_SIZE], r['cmds'][BLOCK_64K_SIZE],
+               r['erase_ms'], r['first'], r['stall'], r['total'] / 1000.0))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
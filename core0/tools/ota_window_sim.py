@@ -0,0 +1,160 @@
+#! /usr/bin/env python3
+# Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+#
+# This Information is proprietary to WuQi Technologies and MAY NOT
+# be copied by any method or incorporated into another program without
+# the express written consent of WuQi. This Information or any portion
+# thereof remains the property of WuQi. The Information contained herein
+# is believed to be accurate and WuQi assumes no responsibility or
+# liability for its use in any way and conveys no license or title under
+# any patent or copyright and makes no representation or warranty that this
+# Information is free from patent or copyright infringement.
+#
+# Simulated phone <-> earbud link for the windowed wq ota block transfer.
+# It models app_wqota.c: blocks ahead of a gap are held, the window base is
+# queued to ota task in order, every block is answered with the lowest missing
+# offset and the phone resends a block when that offset is repeated.
+
+import heapq
+import random
+import sys
+
+from optparse import OptionParser
+
+
+class Link(object):
+    def __init__(self, options):
+        self.latency = options.latency / 1000.0
+        self.block_air = options.block_len * 8.0 / (options.rate * 1000.0)
+        self.loss = options.loss
+        self.up_free = 0.0
+
+    def send_block(self, now):
+        # phone to device blocks share the air, responses are small
+        start = max(now, self.up_free)
+        self.up_free = start + self.block_air
+        return self.up_free + self.latency
+
+    def send_rsp(self, now):
+        return now + self.latency
+
+    def lost(self):
+        return random.random() < self.loss
+
+
+class Device(object):
+    def __init__(self, options, window, blocks):
+        self.window = window
+        self.blocks = blocks
+        self.pool = window + 2 if window > 1 else 2
+        self.flash_time = options.flash_ms / 1000.0
+        self.base = 0
+        self.held = set()
+        self.busy = 0
+        self.flash_free = 0.0
+
+    def receive(self, now, blk, events):
+        # a missing pool buffer drops the block, like ota_pkt_pool_malloc
+        if self.busy >= self.pool:
+            return
+        idx = blk - self.base
+        if 0 <= idx < self.window and blk not in self.held:
+            self.held.add(blk)
+            self.busy += 1
+            while self.base in self.held:
+                self.held.remove(self.base)
+                start = max(now, self.flash_free)
+                self.flash_free = start + self.flash_time
+                heapq.heappush(events, (self.flash_free, 'flash', self.base))
+                self.base += 1
+
+    def flashed(self):
+        self.busy -= 1
+
+
+def simulate(options, window):
+    random.seed(options.seed)
+    blocks = (options.size + options.block_len - 1) // options.block_len
+    link = Link(options)
+    dev = Device(options, window, blocks)
+    events = []
+    next_send = 0
+    last_ack = -1
+    dup_ack = 0
+    now = 0.0
+
+    def phone_send(now, blk):
+        arrive = link.send_block(now)
+        if not link.lost():
+            heapq.heappush(events, (arrive, 'block', blk))
+
+    while next_send < min(window, blocks):
+        phone_send(now, next_send)
+        next_send += 1
+
+    done = False
+    while not done:
+        if not events:
+            # everything in flight got lost, resend the base on timeout
+            now += options.timeout / 1000.0
+            phone_send(now, max(last_ack, 0))
+            continue
+        now, kind, arg = heapq.heappop(events)
+        if kind == 'block':
+            dev.receive(now, arg, events)
+            if not link.lost():
+                heapq.heappush(events, (link.send_rsp(now), 'rsp', dev.base))
+        elif kind == 'flash':
+            dev.flashed()
+            done = dev.base >= blocks and dev.busy == 0 and last_ack >= blocks
+        elif kind == 'rsp':
+            if arg == last_ack:
+                # resend once per window of repeated offsets
+                dup_ack += 1
+                if dup_ack % window == 1 or window == 1:
+                    phone_send(now, arg)
+            else:
+                last_ack = max(last_ack, arg)
+                dup_ack = 0
+            if arg >= blocks:
+                done = dev.busy == 0
+                continue
+            while next_send < min(arg + window, blocks):
+                phone_send(now, next_send)
+                next_send += 1
+
+    return now
+
+
+def main():
+    parser = OptionParser(usage='%prog [options]')
+    parser.add_option('-s', '--size', type='int', default=400 * 1024, help='image size in bytes')
+    parser.add_option('-b', '--block-len', type='int', default=512, help='OTA_BLOCK_LEN')
+    parser.add_option('-l', '--latency', type='float', default=30.0,
+                      help='one way latency in ms')
+    parser.add_option('-r', '--rate', type='float', default=200.0,
+                      help='phone to device rate in kbps')
+    parser.add_option('-f', '--flash-ms', type='float', default=3.0,
+                      help='flash program time per block in ms')
+    parser.add_option('-p', '--loss', type='float', default=0.0, help='packet loss ratio')
+    parser.add_option('-t', '--timeout', type='float', default=1000.0,
+                      help='phone resend timeout in ms')
+    parser.add_option('-w', '--windows', default='1,2,4,8,16',
+                      help='comma separated window sizes')
+    parser.add_option('--seed', type='int', default=1)
+    (options, args) = parser.parse_args()
+
+    print('image %d B, block %d B, latency %.1f ms, rate %.0f kbps, loss %.3f' %
+          (options.size, options.block_len, options.latency, options.rate, options.loss))
+    print('window\ttime/s\tspeedup')
+    base = None
+    for window in [int(w) for w in options.windows.split(',')]:
+        t = simulate(options, window)
+        base = base or t
+        print('%d\t%.2f\t%.2fx' % (window, t, base / t))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,144 @@
+#! /usr/bin/env python3
+# Copyright(c) 2020 by WuQi Technologies. ALL RIGHTS RESERVED.
+#
+# This Information is proprietary to WuQi Technologies and MAY NOT
+# be copied by any method or incorporated into another program without
+# the express written consent of WuQi. This Information or any portion
+# thereof remains the property of WuQi. The Information contained herein
+# is believed to be accurate and WuQi assumes no responsibility or
+# liability for its use in any way and conveys no license or title under
+# any patent or copyright and makes no representation or warranty that this
+# Information is free from patent or copyright infringement.
+#
+# Share task statistics viewer, decodes the record of iot_share_task_get_stats()
+# in lib/share_task/inc/iot_share_task.h. Handler addresses are resolved with
+# the elf of the image when one is given.
+
+import os
+import re
+import struct
+import subprocess
+import sys
+
+from optparse import OptionParser
+
+SHARE_TASK_INC = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src', 'lib',
+                              'share_task', 'inc')
+
+STATS_MAGIC = 0x5453
+STATS_HDR_FMT = '<HBBBBBB'
+STATS_TASK_FMT = '<HHIII'
+STATS_MSG_FMT = '<B3xIII'
+STATS_EVENT_FMT = '<BBxxII'
+
+TASK_NAMES = ('share_task_fast', 'share_task_slow')
+
+
+def parse_events():
+    """iot_share_event_type of iot_share_task.h, value -> name"""
+    try:
+        with open(os.path.join(SHARE_TASK_INC, 'iot_share_task.h')) as f:
+            text = f.read()
+    except IOError:
+        return {}
+    body = re.search(r'typedef enum \{(.*?)\} iot_share_event_type;', text, re.S).group(1)
+    names = {}
+    value = 0
+    for line in body.split('\n'):
+        line = line.split('//')[0].strip().rstrip(',')
+        if not line:
+            continue
+        name, _, expr = line.partition('=')
+        name, expr = name.strip(), expr.strip()
+        if expr:
+            value = int(expr, 0)
+        if name not in ('IOT_SHARE_EVENT_START', 'IOT_SHARE_EVENT_END'):
+            names[value] = name[len('IOT_SHARE_EVENT_'):]
+        value += 1
+    return names
+
+
+def read_symbols(elf, nm):
+    syms = {}
+    try:
+        out = subprocess.check_output([nm, elf]).decode()
+    except (OSError, subprocess.CalledProcessError):
+        return syms
+    for line in out.split('\n'):
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in 'tT':
+            syms[int(parts[0], 16)] = parts[2]
+    return syms
+
+
+def decode_stats(data):
+    pos = struct.calcsize(STATS_HDR_FMT)
+    magic, version, task_num, msg_num, event_num, hist_num, _ = \
+        struct.unpack_from(STATS_HDR_FMT, data)
+    if magic != STATS_MAGIC:
+        raise ValueError('bad share task stats magic 0x%04x' % magic)
+
+    tasks, msgs, events = [], [], []
+    for _ in range(task_num):
+        queue_len, queue_high, max_latency, max_run, max_run_func = \
+            struct.unpack_from(STATS_TASK_FMT, data, pos)
+        pos += struct.calcsize(STATS_TASK_FMT)
+        hist = struct.unpack_from('<%dH' % hist_num, data, pos)
+        pos += hist_num * 2
+        tasks.append({'queue_len': queue_len, 'queue_high': queue_high,
+                      'max_latency': max_latency, 'max_run': max_run,
+                      'max_run_func': max_run_func, 'hist': hist})
+    for _ in range(msg_num):
+        msgs.append(struct.unpack_from(STATS_MSG_FMT, data, pos))
+        pos += struct.calcsize(STATS_MSG_FMT)
+    for _ in range(event_num):
+        events.append(struct.unpack_from(STATS_EVENT_FMT, data, pos))
+        pos += struct.calcsize(STATS_EVENT_FMT)
+    return tasks, msgs, events
+
+
+def main():
+    parser = OptionParser(usage='%prog [options] share_task_stats.bin')
+    parser.add_option('-e', '--elf', help='elf of the image to name the handlers')
+    parser.add_option('--nm', default='riscv64-unknown-elf-nm', help='nm of the toolchain')
+    (options, args) = parser.parse_args()
+
+    if len(args) != 1:
+        parser.print_help()
+        return 1
+
+    with open(args[0], 'rb') as f:
+        tasks, msgs, events = decode_stats(f.read())
+    syms = read_symbols(options.elf, options.nm) if options.elf else {}
+    event_names = parse_events()
+
+    def func_name(addr):
+        return syms.get(addr, '0x%08x' % addr)
+
+    for i, t in enumerate(tasks):
+        print('%s: queue %d/%d, max latency %d us, longest handler %d us %s' %
+              (TASK_NAMES[i] if i < len(TASK_NAMES) else i, t['queue_high'], t['queue_len'],
+               t['max_latency'], t['max_run'], func_name(t['max_run_func'])))
+        if t['queue_high'] * 4 >= t['queue_len'] * 3:
+            print('  queue above 75%, increase it or move handlers to the other task')
+        for n, cnt in enumerate(t['hist']):
+            if n == len(t['hist']) - 1:
+                print('  >= %7d us: %d' % (4 ** (n + 2), cnt))
+            else:
+                print('  <  %7d us: %d' % (4 ** (n + 3), cnt))
+
+    print('\nmsg id\tposts\tmax run/us\thandler')
+    for msg_id, func, post_cnt, max_run in msgs:
+        print('%d\t%d\t%d\t\t%s' % (msg_id, post_cnt, max_run, func_name(func)))
+
+    print('\ntask\t\t\tevent\t\t\tposts\tmax run/us')
+    for task, etype, post_cnt, max_run in events:
+        print('%-16s\t%-20s\t%d\t%d' %
+              (TASK_NAMES[task] if task < len(TASK_NAMES) else task,
+               event_names.get(etype, str(etype)), post_cnt, max_run))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())